@@ -1,4 +1,4 @@
-QT += core gui widgets printsupport
+QT += core gui widgets printsupport concurrent network
 
 CONFIG += c++17
 
@@ -9,18 +9,71 @@ TEMPLATE = app
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Uncomment to compile the TRACE_SCOPE/TRACE_COUNTER instrumentation out entirely
+#DEFINES += CPPWORD_NO_TRACING
+
 SOURCES += \
     src/main.cpp \
     src/mainwindow.cpp \
     src/texteditor.cpp \
     src/formatbar.cpp \
-    src/documentmanager.cpp
+    src/documentmanager.cpp \
+    src/outlinepanel.cpp \
+    src/progressiveloader.cpp \
+    src/pastejob.cpp \
+    src/selectionmimedata.cpp \
+    src/sharedsession.cpp \
+    src/versionhistory.cpp \
+    src/textimport.cpp \
+    src/filemonitor.cpp \
+    src/tracer.cpp \
+    src/latencymonitor.cpp \
+    src/sessionstate.cpp \
+    src/macrorecorder.cpp \
+    src/tableimport.cpp \
+    src/stylemanager.cpp \
+    src/formatcompactor.cpp \
+    src/htmlimport.cpp \
+    src/documentexporter.cpp \
+    src/htmlwriter.cpp \
+    src/paginator.cpp \
+    src/recentfiles.cpp \
+    src/singleinstance.cpp \
+    src/taskexecutor.cpp \
+    src/documentcompare.cpp \
+    src/compareview.cpp \
+    src/wordcounter.cpp
 
 HEADERS += \
     src/mainwindow.h \
     src/texteditor.h \
     src/formatbar.h \
-    src/documentmanager.h
+    src/documentmanager.h \
+    src/outlinepanel.h \
+    src/progressiveloader.h \
+    src/pastejob.h \
+    src/selectionmimedata.h \
+    src/sharedsession.h \
+    src/versionhistory.h \
+    src/textimport.h \
+    src/filemonitor.h \
+    src/tracer.h \
+    src/latencymonitor.h \
+    src/sessionstate.h \
+    src/macrorecorder.h \
+    src/tableimport.h \
+    src/stylemanager.h \
+    src/formatcompactor.h \
+    src/htmlimport.h \
+    src/documentexporter.h \
+    src/htmlwriter.h \
+    src/paginator.h \
+    src/recentfiles.h \
+    src/singleinstance.h \
+    src/taskexecutor.h \
+    src/documentcompare.h \
+    src/compareview.h \
+    src/wordcounter.h
 
 RESOURCES += \
     icons.qrc
@@ -0,0 +1,299 @@
+#include "compareview.h"
+#include "texteditor.h"
+#include "tracer.h"
+
+#include <QSplitter>
+#include <QVBoxLayout>
+#include <QScrollBar>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QAbstractTextDocumentLayout>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+QTextCharFormat runFormat(DocumentCompare::Run::Kind kind)
+{
+    QTextCharFormat format;
+    if (kind == DocumentCompare::Run::Deleted) {
+        format.setForeground(QColor(160, 0, 0));
+        format.setBackground(QColor(255, 200, 200));
+        format.setFontStrikeOut(true);
+    } else {
+        format.setForeground(QColor(0, 110, 0));
+        format.setBackground(QColor(200, 240, 200));
+        format.setFontUnderline(true);
+    }
+    return format;
+}
+
+QTextBlockFormat blockBackground(const QColor &color)
+{
+    QTextBlockFormat format;
+    format.setBackground(color);
+    return format;
+}
+
+}
+
+CompareView::CompareView(QWidget *parent)
+    : QWidget(parent)
+    , m_mode(Inline)
+    , m_splitter(new QSplitter(Qt::Horizontal, this))
+    , m_left(new TextEditor(this))
+    , m_right(new TextEditor(this))
+    , m_updating(false)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_splitter);
+
+    for (TextEditor *editor : {m_left, m_right}) {
+        editor->setReadOnly(true);
+        editor->setUndoRedoEnabled(false);
+        m_splitter->addWidget(editor);
+        connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, [this, editor]() {
+            syncScroll(editor, editor == m_left ? m_right : m_left);
+            renderVisible();
+        });
+    }
+    m_right->hide();
+}
+
+CompareView::~CompareView()
+{
+}
+
+void CompareView::setResult(const DocumentCompare::Result &result)
+{
+    m_result = result;
+    rebuild();
+}
+
+void CompareView::setMode(Mode mode)
+{
+    if (mode == m_mode) {
+        return;
+    }
+
+    // Stay on the same part of the comparison
+    const int hunk = hunkAt(m_left->cursorForPosition(QPoint(0, 0)).position());
+    m_mode = mode;
+    rebuild();
+    showHunk(hunk);
+}
+
+CompareView::Mode CompareView::mode() const
+{
+    return m_mode;
+}
+
+// Navigation goes from the hunk at the top of the view, which is where
+// showHunk() puts a hunk, not from the text cursor
+void CompareView::nextChange()
+{
+    for (int i = hunkAt(m_left->cursorForPosition(QPoint(0, 0)).position()) + 1; i < m_result.hunks.size(); ++i) {
+        if (m_result.hunks.at(i).changed) {
+            showHunk(i);
+            return;
+        }
+    }
+}
+
+void CompareView::previousChange()
+{
+    for (int i = hunkAt(m_left->cursorForPosition(QPoint(0, 0)).position()) - 1; i >= 0; --i) {
+        if (m_result.hunks.at(i).changed) {
+            showHunk(i);
+            return;
+        }
+    }
+}
+
+void CompareView::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    // Once the editors have their new size
+    QTimer::singleShot(0, this, [this]() { renderVisible(); });
+}
+
+void CompareView::renderVisible()
+{
+    if (m_updating) {
+        return;
+    }
+    TRACE_SCOPE("CompareView::renderVisible");
+    if (m_mode == Inline) {
+        renderVisibleHunks(m_left, BothSides, &m_leftPlacements);
+    } else {
+        renderVisibleHunks(m_left, OldSide, &m_leftPlacements);
+        renderVisibleHunks(m_right, NewSide, &m_rightPlacements);
+    }
+}
+
+void CompareView::rebuild()
+{
+    TRACE_SCOPE("CompareView::rebuild");
+    m_updating = true;
+    fill(m_left, m_mode == Inline ? BothSides : OldSide, &m_leftPlacements);
+    if (m_mode == SideBySide) {
+        fill(m_right, NewSide, &m_rightPlacements);
+    } else {
+        m_right->clear();
+        m_rightPlacements.clear();
+    }
+    m_right->setVisible(m_mode == SideBySide);
+    m_updating = false;
+
+    // After the view has laid out its first screen
+    QTimer::singleShot(0, this, [this]() { renderVisible(); });
+}
+
+void CompareView::fill(TextEditor *editor, Side side, QVector<Placement> *placements)
+{
+    placements->clear();
+    placements->reserve(m_result.hunks.size());
+
+    QString text;
+    for (const DocumentCompare::Hunk &hunk : std::as_const(m_result.hunks)) {
+        if (!placements->isEmpty()) {
+            text += QLatin1Char('\n');
+        }
+        Placement placement;
+        placement.start = text.size();
+
+        if (!hunk.changed) {
+            text += m_result.oldBlocks.mid(hunk.oldStart, hunk.oldCount).join(QLatin1Char('\n'));
+        } else if (side == BothSides) {
+            for (const DocumentCompare::Run &run : hunk.runs) {
+                text += run.text;
+            }
+        } else {
+            const bool old = side == OldSide;
+            const int count = old ? hunk.oldCount : hunk.newCount;
+            const QStringList &blocks = old ? m_result.oldBlocks : m_result.newBlocks;
+            text += blocks.mid(old ? hunk.oldStart : hunk.newStart, count).join(QLatin1Char('\n'));
+            // Both sides of a hunk get the same number of paragraphs, so they
+            // line up
+            text += QString(qMax(hunk.oldCount, hunk.newCount) - qMax(count, 1), QLatin1Char('\n'));
+        }
+
+        placement.length = text.size() - placement.start;
+        placements->append(placement);
+    }
+
+    editor->document()->setPlainText(text);
+}
+
+void CompareView::renderVisibleHunks(TextEditor *editor, Side side, QVector<Placement> *placements)
+{
+    if (placements->isEmpty()) {
+        return;
+    }
+
+    const QRect viewport = editor->viewport()->rect();
+    const int first = editor->cursorForPosition(viewport.topLeft()).position();
+    const int last = editor->cursorForPosition(viewport.bottomRight()).position();
+
+    auto it = std::lower_bound(placements->begin(), placements->end(), first,
+                               [](const Placement &placement, int position) {
+        return placement.start + placement.length < position;
+    });
+    for (int i = int(it - placements->begin()); i < placements->size() && placements->at(i).start <= last; ++i) {
+        Placement &placement = (*placements)[i];
+        if (!placement.rendered && m_result.hunks.at(i).changed) {
+            renderHunk(editor, side, m_result.hunks.at(i), placement);
+        }
+        placement.rendered = true;
+    }
+}
+
+void CompareView::renderHunk(TextEditor *editor, Side side, const DocumentCompare::Hunk &hunk, const Placement &placement)
+{
+    QTextDocument *document = editor->document();
+    const int end = placement.start + placement.length;
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+
+    // Paragraph backgrounds show the extent of the change; padding that
+    // keeps the sides aligned is grey
+    QColor background(255, 248, 220);
+    if (side == OldSide) {
+        background = QColor(255, 236, 236);
+    } else if (side == NewSide) {
+        background = QColor(234, 250, 234);
+    }
+    const int count = side == OldSide ? hunk.oldCount : side == NewSide ? hunk.newCount : -1;
+    int index = 0;
+    for (QTextBlock block = document->findBlock(placement.start);
+         block.isValid() && block.position() <= end; block = block.next(), ++index) {
+        const bool padding = count >= 0 && index >= count;
+        QTextCursor(block).mergeBlockFormat(blockBackground(padding ? QColor(240, 240, 240) : background));
+    }
+
+    // Word level changes; each side only holds its own runs
+    int position = placement.start;
+    for (const DocumentCompare::Run &run : hunk.runs) {
+        if ((side == OldSide && run.kind == DocumentCompare::Run::Inserted)
+            || (side == NewSide && run.kind == DocumentCompare::Run::Deleted)) {
+            continue;
+        }
+        if (run.kind != DocumentCompare::Run::Equal) {
+            cursor.setPosition(position);
+            cursor.setPosition(position + run.text.size(), QTextCursor::KeepAnchor);
+            cursor.mergeCharFormat(runFormat(run.kind));
+        }
+        position += run.text.size();
+    }
+
+    cursor.endEditBlock();
+}
+
+void CompareView::syncScroll(TextEditor *from, TextEditor *to)
+{
+    if (m_updating || m_mode != SideBySide) {
+        return;
+    }
+
+    // Paragraph numbers agree between the sides; line wrapping may not
+    m_updating = true;
+    const QTextBlock block = from->cursorForPosition(QPoint(0, 0)).block();
+    const qreal within = from->verticalScrollBar()->value()
+                         - from->document()->documentLayout()->blockBoundingRect(block).top();
+    const QTextBlock other = to->document()->findBlockByNumber(block.blockNumber());
+    if (other.isValid()) {
+        const QRectF rect = to->document()->documentLayout()->blockBoundingRect(other);
+        to->verticalScrollBar()->setValue(int(rect.top() + qBound(qreal(0), within, rect.height())));
+    }
+    m_updating = false;
+}
+
+void CompareView::showHunk(int index)
+{
+    if (index < 0 || index >= m_leftPlacements.size()) {
+        return;
+    }
+
+    QTextCursor cursor(m_left->document());
+    cursor.setPosition(m_leftPlacements.at(index).start);
+    m_left->setTextCursor(cursor);
+
+    // Put the hunk at the top of the view; the other side follows
+    const QRectF rect = m_left->document()->documentLayout()->blockBoundingRect(cursor.block());
+    m_left->verticalScrollBar()->setValue(int(rect.top()));
+    renderVisible();
+}
+
+int CompareView::hunkAt(int position) const
+{
+    const auto it = std::lower_bound(m_leftPlacements.begin(), m_leftPlacements.end(), position,
+                                     [](const Placement &placement, int value) {
+        return placement.start + placement.length < value;
+    });
+    if (it == m_leftPlacements.end()) {
+        return m_leftPlacements.size() - 1;
+    }
+    return int(it - m_leftPlacements.begin());
+}
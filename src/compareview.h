@@ -0,0 +1,76 @@
+#ifndef COMPAREVIEW_H
+#define COMPAREVIEW_H
+
+#include <QWidget>
+#include <QVector>
+
+#include "documentcompare.h"
+
+class TextEditor;
+class QSplitter;
+
+// Shows a DocumentCompare result inline (deleted words struck out, inserted
+// words underlined) or side by side with the two revisions scrolled
+// together. The text goes in plain; a changed hunk is only highlighted
+// when it first scrolls into view, so a long comparison with thousands of
+// changes opens without formatting all of them.
+class CompareView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Inline,
+        SideBySide
+    };
+
+    explicit CompareView(QWidget *parent = nullptr);
+    ~CompareView();
+
+    void setResult(const DocumentCompare::Result &result);
+    void setMode(Mode mode);
+    Mode mode() const;
+
+public slots:
+    void nextChange();
+    void previousChange();
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+
+private slots:
+    void renderVisible();
+
+private:
+    enum Side {
+        OldSide,
+        NewSide,
+        BothSides
+    };
+
+    // Where a hunk ended up in one of the editors
+    struct Placement {
+        int start = 0;
+        int length = 0;
+        bool rendered = false;
+    };
+
+    void rebuild();
+    void fill(TextEditor *editor, Side side, QVector<Placement> *placements);
+    void renderVisibleHunks(TextEditor *editor, Side side, QVector<Placement> *placements);
+    void renderHunk(TextEditor *editor, Side side, const DocumentCompare::Hunk &hunk, const Placement &placement);
+    void syncScroll(TextEditor *from, TextEditor *to);
+    void showHunk(int index);
+    int hunkAt(int position) const;
+
+    DocumentCompare::Result m_result;
+    Mode m_mode;
+    QSplitter *m_splitter;
+    TextEditor *m_left;  // old revision, or the inline view
+    TextEditor *m_right; // new revision
+    QVector<Placement> m_leftPlacements;
+    QVector<Placement> m_rightPlacements;
+    bool m_updating; // scroll positions or text are being set from here
+};
+
+#endif // COMPAREVIEW_H
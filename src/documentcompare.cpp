@@ -0,0 +1,417 @@
+#include "documentcompare.h"
+#include "textimport.h"
+#include "htmlimport.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <algorithm>
+
+namespace {
+
+typedef QList<QPair<int, int>> Matches;
+
+struct ReadResult {
+    bool ok = false;
+    QStringList blocks;
+    QString errorString;
+};
+
+// Myers' O(ND) diff of a[aBegin, aEnd) against b[bBegin, bEnd). Past the
+// distance limit nothing is matched and the stretch is replaced as a whole.
+void myersMatch(const QVector<size_t> &a, int aBegin, int aEnd,
+                const QVector<size_t> &b, int bBegin, int bEnd, Matches *matches)
+{
+    const int n = aEnd - aBegin;
+    const int m = bEnd - bBegin;
+    const int maxDistance = qMin(n + m, int(DocumentCompare::MAX_EDIT_DISTANCE));
+    const int offset = maxDistance + 1;
+    QVector<int> v(2 * offset + 1, 0);
+    // Only diagonals -d-1..d+1 matter at step d, so that is all that is kept
+    QVector<QVector<int>> trace;
+    int distance = -1;
+
+    for (int d = 0; d <= maxDistance && distance < 0; ++d) {
+        trace.append(v.mid(offset - d - 1, 2 * d + 3));
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v.at(offset + k - 1) < v.at(offset + k + 1))) {
+                x = v.at(offset + k + 1);
+            } else {
+                x = v.at(offset + k - 1) + 1;
+            }
+            int y = x - k;
+            while (x < n && y < m && a.at(aBegin + x) == b.at(bBegin + y)) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                distance = d;
+                break;
+            }
+        }
+    }
+    if (distance < 0) {
+        return;
+    }
+
+    Matches middle;
+    int x = n;
+    int y = m;
+    for (int d = distance; d > 0; --d) {
+        const QVector<int> &previous = trace.at(d);
+        const int k = x - y;
+        const int previousK = (k == -d || (k != d && previous.at(k - 1 + d + 1) < previous.at(k + 1 + d + 1)))
+                              ? k + 1 : k - 1;
+        const int previousX = previous.at(previousK + d + 1);
+        const int previousY = previousX - previousK;
+        while (x > previousX && y > previousY) {
+            --x;
+            --y;
+            middle.append(qMakePair(aBegin + x, bBegin + y));
+        }
+        x = previousX;
+        y = previousY;
+    }
+    while (x > 0 && y > 0) {
+        --x;
+        --y;
+        middle.append(qMakePair(aBegin + x, bBegin + y));
+    }
+    std::reverse(middle.begin(), middle.end());
+    matches->append(middle);
+}
+
+// Keys that occur exactly once on each side, reduced to the longest run
+// that appears in the same order on both
+Matches uniqueAnchors(const QVector<size_t> &a, int aBegin, int aEnd,
+                      const QVector<size_t> &b, int bBegin, int bEnd)
+{
+    // -1 once a key has been seen twice
+    QHash<size_t, int> oldIndex;
+    for (int i = aBegin; i < aEnd; ++i) {
+        const auto it = oldIndex.find(a.at(i));
+        if (it == oldIndex.end()) {
+            oldIndex.insert(a.at(i), i);
+        } else {
+            it.value() = -1;
+        }
+    }
+    QHash<size_t, int> newIndex;
+    for (int j = bBegin; j < bEnd; ++j) {
+        const auto it = newIndex.find(b.at(j));
+        if (it == newIndex.end()) {
+            newIndex.insert(b.at(j), j);
+        } else {
+            it.value() = -1;
+        }
+    }
+
+    Matches candidates;
+    for (int i = aBegin; i < aEnd; ++i) {
+        if (oldIndex.value(a.at(i)) != i) {
+            continue;
+        }
+        const int j = newIndex.value(a.at(i), -1);
+        if (j >= 0) {
+            candidates.append(qMakePair(i, j));
+        }
+    }
+
+    // Patience sorting: tails[l] ends the best increasing run of length l + 1
+    QVector<int> tails;
+    QVector<int> previous(candidates.size(), -1);
+    for (int c = 0; c < candidates.size(); ++c) {
+        const int value = candidates.at(c).second;
+        const auto pos = std::lower_bound(tails.begin(), tails.end(), value, [&candidates](int tail, int v) {
+            return candidates.at(tail).second < v;
+        });
+        const int length = int(pos - tails.begin());
+        if (length > 0) {
+            previous[c] = tails.at(length - 1);
+        }
+        if (pos == tails.end()) {
+            tails.append(c);
+        } else {
+            *pos = c;
+        }
+    }
+
+    Matches anchors;
+    for (int c = tails.isEmpty() ? -1 : tails.last(); c >= 0; c = previous.at(c)) {
+        anchors.append(candidates.at(c));
+    }
+    std::reverse(anchors.begin(), anchors.end());
+    return anchors;
+}
+
+void matchRange(const QVector<size_t> &a, int aBegin, int aEnd,
+                const QVector<size_t> &b, int bBegin, int bEnd, Matches *matches)
+{
+    while (aBegin < aEnd && bBegin < bEnd && a.at(aBegin) == b.at(bBegin)) {
+        matches->append(qMakePair(aBegin++, bBegin++));
+    }
+    int suffix = 0;
+    while (suffix < aEnd - aBegin && suffix < bEnd - bBegin
+           && a.at(aEnd - 1 - suffix) == b.at(bEnd - 1 - suffix)) {
+        ++suffix;
+    }
+    aEnd -= suffix;
+    bEnd -= suffix;
+
+    if (aBegin < aEnd && bBegin < bEnd) {
+        const Matches anchors = uniqueAnchors(a, aBegin, aEnd, b, bBegin, bEnd);
+        if (anchors.isEmpty()) {
+            myersMatch(a, aBegin, aEnd, b, bBegin, bEnd, matches);
+        } else {
+            for (const QPair<int, int> &anchor : anchors) {
+                matchRange(a, aBegin, anchor.first, b, bBegin, anchor.second, matches);
+                matches->append(anchor);
+                aBegin = anchor.first + 1;
+                bBegin = anchor.second + 1;
+            }
+            matchRange(a, aBegin, aEnd, b, bBegin, bEnd, matches);
+        }
+    }
+
+    for (int i = 0; i < suffix; ++i) {
+        matches->append(qMakePair(aEnd + i, bEnd + i));
+    }
+}
+
+// Words, runs of spaces, paragraph breaks and single other characters
+QStringList tokenize(const QString &text)
+{
+    QStringList tokens;
+    const qsizetype size = text.size();
+    qsizetype i = 0;
+    while (i < size) {
+        const QChar c = text.at(i);
+        qsizetype end = i + 1;
+        if (c.isLetterOrNumber()) {
+            while (end < size && text.at(end).isLetterOrNumber()) {
+                ++end;
+            }
+        } else if (c.isSpace() && c != QLatin1Char('\n')) {
+            while (end < size && text.at(end).isSpace() && text.at(end) != QLatin1Char('\n')) {
+                ++end;
+            }
+        }
+        tokens.append(text.mid(i, end - i));
+        i = end;
+    }
+    return tokens;
+}
+
+QVector<size_t> hashes(const QStringList &texts)
+{
+    QVector<size_t> keys;
+    keys.reserve(texts.size());
+    for (const QString &text : texts) {
+        keys.append(qHash(text));
+    }
+    return keys;
+}
+
+void appendRun(QList<DocumentCompare::Run> *runs, DocumentCompare::Run::Kind kind, const QString &text)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    if (!runs->isEmpty() && runs->last().kind == kind) {
+        runs->last().text += text;
+    } else {
+        runs->append(DocumentCompare::Run{kind, text});
+    }
+}
+
+}
+
+DocumentCompare::Result DocumentCompare::compareFiles(const QString &oldFile, const QString &newFile,
+                                                      const TaskExecutor::CancellationToken &token)
+{
+    TRACE_SCOPE("DocumentCompare::compareFiles");
+    QElapsedTimer timer;
+    timer.start();
+
+    // The revised file is read on another worker meanwhile
+    QFuture<ReadResult> newRead = TaskExecutor::instance()->submit(TaskExecutor::Interactive, token,
+        [newFile](const TaskExecutor::CancellationToken &) {
+            ReadResult read;
+            read.ok = readBlocks(newFile, &read.blocks, &read.errorString);
+            return read;
+        });
+
+    Result result;
+    QStringList oldBlocks;
+    QString oldError;
+    const bool oldOk = readBlocks(oldFile, &oldBlocks, &oldError);
+    const ReadResult newBlocks = newRead.result();
+    if (token.isCancelled()) {
+        return result;
+    }
+    if (!oldOk || !newBlocks.ok) {
+        result.errorString = !oldOk
+            ? QCoreApplication::translate("DocumentCompare", "Could not open %1: %2").arg(oldFile, oldError)
+            : QCoreApplication::translate("DocumentCompare", "Could not open %1: %2").arg(newFile, newBlocks.errorString);
+        return result;
+    }
+
+    result = compare(oldBlocks, newBlocks.blocks, token);
+    result.msecs = timer.elapsed();
+    return result;
+}
+
+DocumentCompare::Result DocumentCompare::compare(const QStringList &oldBlocks, const QStringList &newBlocks,
+                                                 const TaskExecutor::CancellationToken &token)
+{
+    TRACE_SCOPE("DocumentCompare::compare");
+    QElapsedTimer timer;
+    timer.start();
+
+    Result result;
+    const Matches matches = matchKeys(hashes(oldBlocks), hashes(newBlocks));
+    if (token.isCancelled()) {
+        return result;
+    }
+
+    int oldIndex = 0;
+    int newIndex = 0;
+    auto addChanged = [&](int oldEnd, int newEnd) {
+        if (oldIndex == oldEnd && newIndex == newEnd) {
+            return;
+        }
+        Hunk hunk;
+        hunk.oldStart = oldIndex;
+        hunk.oldCount = oldEnd - oldIndex;
+        hunk.newStart = newIndex;
+        hunk.newCount = newEnd - newIndex;
+        hunk.changed = true;
+        result.hunks.append(hunk);
+        ++result.changes;
+    };
+    for (const QPair<int, int> &match : matches) {
+        addChanged(match.first, match.second);
+        if (result.hunks.isEmpty() || result.hunks.last().changed) {
+            Hunk hunk;
+            hunk.oldStart = match.first;
+            hunk.newStart = match.second;
+            result.hunks.append(hunk);
+        }
+        ++result.hunks.last().oldCount;
+        ++result.hunks.last().newCount;
+        oldIndex = match.first + 1;
+        newIndex = match.second + 1;
+    }
+    addChanged(oldBlocks.size(), newBlocks.size());
+
+    // Word level, one task per changed hunk; waiting here runs tasks not
+    // started yet on this worker
+    QList<QPair<int, QFuture<QList<Run>>>> wordDiffs;
+    for (int i = 0; i < result.hunks.size(); ++i) {
+        const Hunk &hunk = result.hunks.at(i);
+        if (!hunk.changed) {
+            continue;
+        }
+        const QString oldText = oldBlocks.mid(hunk.oldStart, hunk.oldCount).join(QLatin1Char('\n'));
+        const QString newText = newBlocks.mid(hunk.newStart, hunk.newCount).join(QLatin1Char('\n'));
+        const bool inserted = hunk.oldCount == 0;
+        const bool deleted = hunk.newCount == 0;
+        wordDiffs.append(qMakePair(i, TaskExecutor::instance()->submit(TaskExecutor::Interactive, token,
+            [oldText, newText, inserted, deleted](const TaskExecutor::CancellationToken &) {
+                QList<Run> runs;
+                if (inserted) {
+                    appendRun(&runs, Run::Inserted, newText);
+                } else if (deleted) {
+                    appendRun(&runs, Run::Deleted, oldText);
+                } else {
+                    runs = diffWords(oldText, newText);
+                }
+                return runs;
+            })));
+    }
+    for (const QPair<int, QFuture<QList<Run>>> &wordDiff : std::as_const(wordDiffs)) {
+        result.hunks[wordDiff.first].runs = wordDiff.second.result();
+    }
+    if (token.isCancelled()) {
+        return Result();
+    }
+
+    result.oldBlocks = oldBlocks;
+    result.newBlocks = newBlocks;
+    result.msecs = timer.elapsed();
+    result.ok = true;
+    return result;
+}
+
+bool DocumentCompare::readBlocks(const QString &filePath, QStringList *blocks, QString *errorString)
+{
+    QString content;
+    if (!TextImport::readFile(filePath, &content, nullptr, errorString)) {
+        return false;
+    }
+
+    const bool markdown = filePath.endsWith(".md", Qt::CaseInsensitive)
+                          || filePath.endsWith(".markdown", Qt::CaseInsensitive);
+    const bool richText = filePath.endsWith(".html", Qt::CaseInsensitive)
+                          || filePath.endsWith(".htm", Qt::CaseInsensitive)
+                          || filePath.endsWith(".rtf", Qt::CaseInsensitive);
+    if (!markdown && !richText) {
+        *blocks = content.split(QLatin1Char('\n'));
+        return true;
+    }
+
+    QTextDocument document;
+    document.setUndoRedoEnabled(false);
+    if (markdown) {
+        document.setMarkdown(content);
+    } else {
+        HtmlImport::importInto(&document, content);
+    }
+    content.clear();
+
+    blocks->clear();
+    blocks->reserve(document.blockCount());
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        blocks->append(block.text());
+    }
+    return true;
+}
+
+QList<QPair<int, int>> DocumentCompare::matchKeys(const QVector<size_t> &oldKeys, const QVector<size_t> &newKeys)
+{
+    Matches matches;
+    matchRange(oldKeys, 0, oldKeys.size(), newKeys, 0, newKeys.size(), &matches);
+    return matches;
+}
+
+QList<DocumentCompare::Run> DocumentCompare::diffWords(const QString &oldText, const QString &newText)
+{
+    const QStringList oldTokens = tokenize(oldText);
+    const QStringList newTokens = tokenize(newText);
+    const Matches matches = matchKeys(hashes(oldTokens), hashes(newTokens));
+
+    QList<Run> runs;
+    int oldIndex = 0;
+    int newIndex = 0;
+    auto addGap = [&](int oldEnd, int newEnd) {
+        for (; oldIndex < oldEnd; ++oldIndex) {
+            appendRun(&runs, Run::Deleted, oldTokens.at(oldIndex));
+        }
+        for (; newIndex < newEnd; ++newIndex) {
+            appendRun(&runs, Run::Inserted, newTokens.at(newIndex));
+        }
+    };
+    for (const QPair<int, int> &match : matches) {
+        addGap(match.first, match.second);
+        appendRun(&runs, Run::Equal, oldTokens.at(match.first));
+        oldIndex = match.first + 1;
+        newIndex = match.second + 1;
+    }
+    addGap(oldTokens.size(), newTokens.size());
+    return runs;
+}
@@ -0,0 +1,70 @@
+#ifndef DOCUMENTCOMPARE_H
+#define DOCUMENTCOMPARE_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "taskexecutor.h"
+
+// Compares two revisions of a document paragraph by paragraph, then word by
+// word inside the paragraphs that changed. Paragraphs are matched by hash
+// with a patience diff (paragraphs that occur once on each side anchor the
+// match, which keeps moved boilerplate from pairing up wrongly) and Myers'
+// diff for the stretches between anchors. Word diffs of the changed hunks
+// run in parallel. Everything here is safe to run off the GUI thread.
+class DocumentCompare
+{
+public:
+    struct Run {
+        enum Kind : quint8 {
+            Equal,
+            Deleted,
+            Inserted
+        };
+
+        Kind kind;
+        QString text; // '\n' separates paragraphs
+    };
+
+    // Hunks alternate between unchanged and changed stretches and cover
+    // both documents in order
+    struct Hunk {
+        int oldStart = 0;
+        int oldCount = 0;
+        int newStart = 0;
+        int newCount = 0;
+        bool changed = false;
+        QList<Run> runs; // changed hunks only
+    };
+
+    struct Result {
+        bool ok = false;
+        QString errorString;
+        QStringList oldBlocks;
+        QStringList newBlocks;
+        QList<Hunk> hunks;
+        int changes = 0;
+        qint64 msecs = 0;
+    };
+
+    // Reads both files (in parallel) and compares them; an empty result
+    // once cancelled
+    static Result compareFiles(const QString &oldFile, const QString &newFile,
+                               const TaskExecutor::CancellationToken &token = TaskExecutor::CancellationToken());
+    static Result compare(const QStringList &oldBlocks, const QStringList &newBlocks,
+                          const TaskExecutor::CancellationToken &token = TaskExecutor::CancellationToken());
+
+    // Paragraph texts of a file; rich formats are parsed, formatting is ignored
+    static bool readBlocks(const QString &filePath, QStringList *blocks, QString *errorString = nullptr);
+
+    // Matched index pairs in increasing order
+    static QList<QPair<int, int>> matchKeys(const QVector<size_t> &oldKeys, const QVector<size_t> &newKeys);
+    static QList<Run> diffWords(const QString &oldText, const QString &newText);
+
+    static const int MAX_EDIT_DISTANCE = 1000; // beyond this a stretch is replaced whole
+};
+
+#endif // DOCUMENTCOMPARE_H
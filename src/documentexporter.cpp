@@ -0,0 +1,1292 @@
+#include "documentexporter.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextFrame>
+#include <QTextTable>
+#include <QTextBlock>
+#include <QTextList>
+#include <QTextFragment>
+#include <QTextStream>
+#include <QXmlStreamWriter>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QImage>
+#include <QPixmap>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QCoreApplication>
+#include <QDebug>
+
+namespace {
+
+const QString ODT_MIME_TYPE = QStringLiteral("application/vnd.oasis.opendocument.text");
+
+// Writes Markdown for one document. Emphasis markers are opened and closed
+// only where the formatting changes, so runs split by properties Markdown
+// cannot express (a color change, say) do not turn into "**a****b**"
+class MarkdownWriter
+{
+public:
+    explicit MarkdownWriter(QTextStream &out)
+        : m_out(out)
+    {
+    }
+
+    void writeFrame(QTextFrame::iterator it);
+    void finish() { closeCodeBlock(); }
+
+private:
+    enum Marker {
+        Bold,
+        Italic,
+        StrikeOut,
+        Code
+    };
+
+    void writeBlock(const QTextBlock &block);
+    void writeTable(const QTextTable *table);
+    void writeInline(const QTextBlock &block, const QString &continuation, bool heading, bool inTable);
+    void writeRun(QStringView text, const QList<Marker> &markers, const QString &href, bool inTable);
+    void closeMarkers(const QList<Marker> &markers, const QString &href);
+    void closeCodeBlock();
+    void separate(bool tight);
+    QString escaped(QStringView text, bool inTable) const;
+
+    static const char *markerText(Marker marker);
+    static QString destination(const QString &url);
+
+    QTextStream &m_out;
+    QList<Marker> m_open;
+    QString m_href;
+    QString m_pending; // whitespace held back until the next markers are known
+    bool m_lineStart = true;
+    bool m_started = false;
+    bool m_inCodeBlock = false;
+    bool m_previousWasList = false;
+};
+
+const char *MarkdownWriter::markerText(Marker marker)
+{
+    switch (marker) {
+    case Bold:
+        return "**";
+    case Italic:
+        return "*";
+    case StrikeOut:
+        return "~~";
+    case Code:
+        return "`";
+    }
+    return "";
+}
+
+// Link and image URLs end at the first space or unbalanced parenthesis, and
+// a bar would end a table cell; those are percent-encoded
+QString MarkdownWriter::destination(const QString &url)
+{
+    QString result;
+    result.reserve(url.size());
+    for (const QChar ch : url) {
+        switch (ch.unicode()) {
+        case ' ':
+            result += QLatin1String("%20");
+            break;
+        case '(':
+            result += QLatin1String("%28");
+            break;
+        case ')':
+            result += QLatin1String("%29");
+            break;
+        case '|':
+            result += QLatin1String("%7C");
+            break;
+        default:
+            result += ch;
+            break;
+        }
+    }
+    return result;
+}
+
+void MarkdownWriter::writeFrame(QTextFrame::iterator it)
+{
+    for (; !it.atEnd(); ++it) {
+        if (QTextFrame *frame = it.currentFrame()) {
+            if (QTextTable *table = qobject_cast<QTextTable *>(frame)) {
+                writeTable(table);
+            } else {
+                writeFrame(frame->begin());
+            }
+        } else if (it.currentBlock().isValid()) {
+            writeBlock(it.currentBlock());
+        }
+    }
+}
+
+void MarkdownWriter::separate(bool tight)
+{
+    if (m_started && !tight) {
+        m_out << '\n';
+    }
+    m_started = true;
+}
+
+void MarkdownWriter::closeCodeBlock()
+{
+    if (m_inCodeBlock) {
+        m_out << "```\n";
+        m_inCodeBlock = false;
+    }
+}
+
+void MarkdownWriter::writeBlock(const QTextBlock &block)
+{
+    const QTextBlockFormat format = block.blockFormat();
+    if (format.hasProperty(QTextFormat::BlockCodeFence) || format.nonBreakableLines()) {
+        if (!m_inCodeBlock) {
+            separate(false);
+            m_out << "```" << format.stringProperty(QTextFormat::BlockCodeLanguage) << '\n';
+            m_inCodeBlock = true;
+        }
+        QString text = block.text();
+        text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+        m_out << text << '\n';
+        m_previousWasList = false;
+        return;
+    }
+    closeCodeBlock();
+
+    if (format.hasProperty(QTextFormat::BlockTrailingHorizontalRulerWidth)) {
+        separate(false);
+        m_out << "---\n";
+        m_previousWasList = false;
+        return;
+    }
+
+    QTextList *list = block.textList();
+    if (!list && block.length() <= 1) {
+        return; // empty paragraphs only space blocks apart
+    }
+    separate(list && m_previousWasList);
+    m_previousWasList = list != nullptr;
+
+    QString prefix = QStringLiteral("> ").repeated(format.intProperty(QTextFormat::BlockQuoteLevel));
+    QString continuation = prefix;
+    if (list) {
+        const QTextListFormat listFormat = list->format();
+        const QString indent((qMax(1, listFormat.indent()) - 1) * 4, QLatin1Char(' '));
+        QString marker;
+        switch (listFormat.style()) {
+        case QTextListFormat::ListDisc:
+        case QTextListFormat::ListCircle:
+        case QTextListFormat::ListSquare:
+            marker = QStringLiteral("- ");
+            break;
+        default:
+            // Markdown only numbers in decimal
+            marker = QString::number(list->itemNumber(block) + 1) + QStringLiteral(". ");
+            break;
+        }
+        prefix += indent + marker;
+        continuation += indent + QString(marker.size(), QLatin1Char(' '));
+        if (format.marker() == QTextBlockFormat::MarkerType::Checked) {
+            prefix += QStringLiteral("[x] ");
+        } else if (format.marker() == QTextBlockFormat::MarkerType::Unchecked) {
+            prefix += QStringLiteral("[ ] ");
+        }
+    }
+    const int level = format.headingLevel();
+    if (level > 0) {
+        prefix += QString(level, QLatin1Char('#')) + QLatin1Char(' ');
+    }
+
+    m_out << prefix;
+    writeInline(block, continuation, level > 0, false);
+    m_out << '\n';
+}
+
+void MarkdownWriter::writeTable(const QTextTable *table)
+{
+    closeCodeBlock();
+    separate(false);
+    m_previousWasList = false;
+
+    for (int row = 0; row < table->rows(); ++row) {
+        m_out << '|';
+        for (int column = 0; column < table->columns(); ++column) {
+            const QTextTableCell cell = table->cellAt(row, column);
+            m_out << ' ';
+            // Pipe tables cannot span; covered cells are left empty
+            if (cell.row() == row && cell.column() == column) {
+                bool first = true;
+                for (QTextFrame::iterator it = cell.begin(); !it.atEnd(); ++it) {
+                    if (it.currentFrame() || !it.currentBlock().isValid()) {
+                        continue;
+                    }
+                    if (!first) {
+                        m_out << "<br>";
+                    }
+                    writeInline(it.currentBlock(), QString(), false, true);
+                    first = false;
+                }
+            }
+            m_out << " |";
+        }
+        m_out << '\n';
+
+        if (row == 0) {
+            m_out << '|';
+            for (int column = 0; column < table->columns(); ++column) {
+                m_out << " --- |";
+            }
+            m_out << '\n';
+        }
+    }
+}
+
+void MarkdownWriter::writeInline(const QTextBlock &block, const QString &continuation, bool heading, bool inTable)
+{
+    m_lineStart = true;
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        if (!fragment.isValid()) {
+            continue;
+        }
+        const QTextCharFormat format = fragment.charFormat();
+        const QString href = format.isAnchor() ? format.anchorHref() : QString();
+
+        if (format.isImageFormat()) {
+            closeMarkers({}, QString());
+            if (!m_lineStart) {
+                m_out << m_pending;
+            }
+            m_pending.clear();
+            for (int i = 0; i < fragment.length(); ++i) {
+                m_out << "![](" << destination(format.toImageFormat().name()) << ')';
+            }
+            m_lineStart = false;
+            continue;
+        }
+
+        const QString text = fragment.text();
+        QList<Marker> markers;
+        if (!heading && format.fontWeight() >= QFont::Bold) {
+            markers << Bold;
+        }
+        if (format.fontItalic()) {
+            markers << Italic;
+        }
+        if (format.fontStrikeOut()) {
+            markers << StrikeOut;
+        }
+        if (format.fontFixedPitch() && !text.contains(QLatin1Char('`'))) {
+            markers << Code;
+        }
+
+        const QList<QStringView> lines = QStringView(text).split(QChar::LineSeparator);
+        for (int i = 0; i < lines.size(); ++i) {
+            if (i > 0) {
+                closeMarkers({}, QString());
+                m_pending.clear();
+                if (heading) {
+                    m_out << ' ';
+                } else if (inTable) {
+                    m_out << "<br>";
+                } else {
+                    m_out << "\\\n" << continuation;
+                    m_lineStart = true;
+                }
+            }
+            writeRun(lines.at(i), markers, href, inTable);
+        }
+    }
+    closeMarkers({}, QString());
+    m_pending.clear();
+}
+
+void MarkdownWriter::writeRun(QStringView text, const QList<Marker> &markers, const QString &href, bool inTable)
+{
+    // Emphasis may not begin or end with whitespace, so whitespace at the
+    // edges of a run stays outside the markers
+    qsizetype start = 0;
+    while (start < text.size() && text.at(start).isSpace()) {
+        ++start;
+    }
+    if (start == text.size()) {
+        m_pending += text;
+        return;
+    }
+    qsizetype end = text.size();
+    while (text.at(end - 1).isSpace()) {
+        --end;
+    }
+
+    closeMarkers(markers, href);
+    if (!m_lineStart) {
+        m_out << m_pending << text.left(start);
+    }
+    m_pending = text.mid(end).toString();
+    if (m_href != href) {
+        m_out << '[';
+        m_href = href;
+    }
+    for (Marker marker : markers) {
+        if (!m_open.contains(marker)) {
+            m_out << markerText(marker);
+            m_open.append(marker);
+        }
+    }
+
+    const QStringView core = text.mid(start, end - start);
+    if (m_open.contains(Code)) {
+        m_out << (inTable ? core.toString().replace(QLatin1Char('|'), QStringLiteral("\\|")) : core.toString());
+    } else {
+        m_out << escaped(core, inTable);
+    }
+    m_lineStart = false;
+}
+
+void MarkdownWriter::closeMarkers(const QList<Marker> &markers, const QString &href)
+{
+    int keep = 0;
+    if (href == m_href) {
+        while (keep < m_open.size() && markers.contains(m_open.at(keep))) {
+            ++keep;
+        }
+    }
+    // Nothing can be opened inside a code span
+    const int codeAt = m_open.indexOf(Code);
+    if (codeAt >= 0 && codeAt < keep && markers.size() > keep) {
+        keep = codeAt;
+    }
+    while (m_open.size() > keep) {
+        m_out << markerText(m_open.takeLast());
+    }
+
+    if (href != m_href && !m_href.isEmpty()) {
+        m_out << "](" << destination(m_href) << ')';
+        m_href.clear();
+    }
+}
+
+QString MarkdownWriter::escaped(QStringView text, bool inTable) const
+{
+    QString result;
+    result.reserve(text.size() + 8);
+    qsizetype i = 0;
+
+    // Text that would otherwise start a heading, quote, list or rule
+    if (m_lineStart && !text.isEmpty()) {
+        qsizetype digits = 0;
+        while (digits < text.size() && text.at(digits).isDigit()) {
+            ++digits;
+        }
+        if (digits > 0 && digits < text.size()
+            && (text.at(digits) == QLatin1Char('.') || text.at(digits) == QLatin1Char(')'))) {
+            result += text.left(digits);
+            result += QLatin1Char('\\');
+            i = digits;
+        } else if (QStringView(u"#>-+=").contains(text.at(0))) {
+            result += QLatin1Char('\\');
+        }
+    }
+
+    for (; i < text.size(); ++i) {
+        const QChar c = text.at(i);
+        if (QStringView(u"\\`*_[]<>~").contains(c) || (inTable && c == QLatin1Char('|'))) {
+            result += QLatin1Char('\\');
+        }
+        result += c;
+    }
+    return result;
+}
+
+// Little-endian fields of zip headers
+void appendUInt16(QByteArray *data, quint16 value)
+{
+    data->append(char(value & 0xff));
+    data->append(char(value >> 8));
+}
+
+void appendUInt32(QByteArray *data, quint32 value)
+{
+    appendUInt16(data, quint16(value & 0xffff));
+    appendUInt16(data, quint16(value >> 16));
+}
+
+struct CrcTable
+{
+    quint32 entries[256];
+
+    CrcTable()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320u : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+// Writes stored (uncompressed) zip entries. Sizes and checksums are only
+// known once an entry has been streamed, so they are patched into its
+// local header afterwards.
+class ZipWriter
+{
+public:
+    explicit ZipWriter(QIODevice *device)
+        : m_device(device)
+    {
+        const QDateTime now = QDateTime::currentDateTime();
+        m_time = quint16((now.time().hour() << 11) | (now.time().minute() << 5) | (now.time().second() / 2));
+        m_date = quint16(((now.date().year() - 1980) << 9) | (now.date().month() << 5) | now.date().day());
+    }
+
+    bool beginEntry(const QString &name);
+    bool write(const char *data, qint64 size);
+    bool endEntry();
+    bool addEntry(const QString &name, const QByteArray &data);
+    bool finish();
+
+private:
+    struct Entry {
+        QByteArray name;
+        quint32 crc;
+        quint32 size;
+        quint32 offset;
+    };
+
+    bool writeRaw(const QByteArray &data);
+
+    QIODevice *m_device;
+    QList<Entry> m_entries;
+    Entry m_current = {};
+    quint32 m_crc = 0;
+    qint64 m_size = 0;
+    quint16 m_time = 0;
+    quint16 m_date = 0;
+    bool m_failed = false;
+};
+
+bool ZipWriter::writeRaw(const QByteArray &data)
+{
+    if (!m_failed && m_device->write(data) != data.size()) {
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool ZipWriter::beginEntry(const QString &name)
+{
+    m_current.name = name.toUtf8();
+    m_current.offset = quint32(m_device->pos());
+    m_crc = 0xffffffffu;
+    m_size = 0;
+
+    QByteArray header;
+    appendUInt32(&header, 0x04034b50);
+    appendUInt16(&header, 20); // version needed to extract
+    appendUInt16(&header, 0);  // flags
+    appendUInt16(&header, 0);  // stored
+    appendUInt16(&header, m_time);
+    appendUInt16(&header, m_date);
+    appendUInt32(&header, 0);  // crc and sizes, patched in endEntry()
+    appendUInt32(&header, 0);
+    appendUInt32(&header, 0);
+    appendUInt16(&header, quint16(m_current.name.size()));
+    appendUInt16(&header, 0);
+    header += m_current.name;
+    return writeRaw(header);
+}
+
+bool ZipWriter::write(const char *data, qint64 size)
+{
+    static const CrcTable table;
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    for (qint64 i = 0; i < size; ++i) {
+        m_crc = table.entries[(m_crc ^ bytes[i]) & 0xff] ^ (m_crc >> 8);
+    }
+    m_size += size;
+    if (!m_failed && m_device->write(data, size) != size) {
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool ZipWriter::endEntry()
+{
+    // No zip64: entries and offsets must fit in 32 bits
+    if (m_size > 0xffffffffLL || m_device->pos() > 0xffffffffLL) {
+        m_failed = true;
+    }
+    if (m_failed) {
+        return false;
+    }
+    m_current.crc = m_crc ^ 0xffffffffu;
+    m_current.size = quint32(m_size);
+
+    QByteArray fields;
+    appendUInt32(&fields, m_current.crc);
+    appendUInt32(&fields, m_current.size);
+    appendUInt32(&fields, m_current.size);
+    const qint64 end = m_device->pos();
+    if (!m_device->seek(m_current.offset + 14) || !writeRaw(fields) || !m_device->seek(end)) {
+        m_failed = true;
+        return false;
+    }
+    m_entries.append(m_current);
+    return true;
+}
+
+bool ZipWriter::addEntry(const QString &name, const QByteArray &data)
+{
+    return beginEntry(name) && write(data.constData(), data.size()) && endEntry();
+}
+
+bool ZipWriter::finish()
+{
+    if (m_failed) {
+        return false;
+    }
+    const quint32 directoryOffset = quint32(m_device->pos());
+    QByteArray directory;
+    for (const Entry &entry : m_entries) {
+        appendUInt32(&directory, 0x02014b50);
+        appendUInt16(&directory, 20); // version made by
+        appendUInt16(&directory, 20); // version needed to extract
+        appendUInt16(&directory, 0);
+        appendUInt16(&directory, 0);
+        appendUInt16(&directory, m_time);
+        appendUInt16(&directory, m_date);
+        appendUInt32(&directory, entry.crc);
+        appendUInt32(&directory, entry.size);
+        appendUInt32(&directory, entry.size);
+        appendUInt16(&directory, quint16(entry.name.size()));
+        appendUInt16(&directory, 0);  // extra field
+        appendUInt16(&directory, 0);  // comment
+        appendUInt16(&directory, 0);  // disk
+        appendUInt16(&directory, 0);  // internal attributes
+        appendUInt32(&directory, 0);  // external attributes
+        appendUInt32(&directory, entry.offset);
+        directory += entry.name;
+    }
+
+    QByteArray end;
+    appendUInt32(&end, 0x06054b50);
+    appendUInt16(&end, 0);
+    appendUInt16(&end, 0);
+    appendUInt16(&end, quint16(m_entries.size()));
+    appendUInt16(&end, quint16(m_entries.size()));
+    appendUInt32(&end, quint32(directory.size()));
+    appendUInt32(&end, directoryOffset);
+    appendUInt16(&end, 0);
+    return writeRaw(directory) && writeRaw(end);
+}
+
+// Feeds a QXmlStreamWriter straight into the current zip entry
+class ZipEntryDevice : public QIODevice
+{
+public:
+    explicit ZipEntryDevice(ZipWriter *zip)
+        : m_zip(zip)
+    {
+        open(QIODevice::WriteOnly);
+    }
+
+    bool isSequential() const override { return true; }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        return m_zip->write(data, size) ? size : -1;
+    }
+
+private:
+    ZipWriter *m_zip;
+};
+
+void writeNamespaces(QXmlStreamWriter &xml)
+{
+    xml.writeAttribute("xmlns:office", "urn:oasis:names:tc:opendocument:xmlns:office:1.0");
+    xml.writeAttribute("xmlns:style", "urn:oasis:names:tc:opendocument:xmlns:style:1.0");
+    xml.writeAttribute("xmlns:text", "urn:oasis:names:tc:opendocument:xmlns:text:1.0");
+    xml.writeAttribute("xmlns:table", "urn:oasis:names:tc:opendocument:xmlns:table:1.0");
+    xml.writeAttribute("xmlns:draw", "urn:oasis:names:tc:opendocument:xmlns:drawing:1.0");
+    xml.writeAttribute("xmlns:fo", "urn:oasis:names:tc:opendocument:xmlns:xsl-fo-compatible:1.0");
+    xml.writeAttribute("xmlns:svg", "urn:oasis:names:tc:opendocument:xmlns:svg-compatible:1.0");
+    xml.writeAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+    xml.writeAttribute("office:version", "1.2");
+}
+
+// Document coordinates are pixels at 96 dpi
+QString points(qreal pixels)
+{
+    return QString::number(pixels * 72.0 / 96.0) + QStringLiteral("pt");
+}
+
+QImage imageResource(const QTextDocument *document, const QString &name)
+{
+    const QVariant resource = document->resource(QTextDocument::ImageResource, QUrl(name));
+    QImage image;
+    if (resource.typeId() == QMetaType::QImage) {
+        image = qvariant_cast<QImage>(resource);
+    } else if (resource.typeId() == QMetaType::QPixmap) {
+        image = qvariant_cast<QPixmap>(resource).toImage();
+    } else if (resource.typeId() == QMetaType::QByteArray) {
+        image.loadFromData(resource.toByteArray());
+    }
+    if (image.isNull()) {
+        const QUrl url(name);
+        image.load(url.isLocalFile() ? url.toLocalFile() : name);
+    }
+    return image;
+}
+
+// Writes the body of content.xml. Automatic styles are named after the
+// index of their format in the document's format table, so fragments and
+// blocks refer to them without any lookup of their own.
+class OdtWriter
+{
+public:
+    OdtWriter(const QTextDocument *document, QXmlStreamWriter &xml)
+        : m_document(document)
+        , m_xml(xml)
+    {
+    }
+
+    void writeAutomaticStyles();
+    void writeFrame(QTextFrame::iterator it);
+    void closeLists();
+
+    QStringList imageNames() const { return m_imageNames; }
+
+private:
+    void writeParagraphStyle(int index, const QTextBlockFormat &format);
+    void writeTextStyle(int index, const QTextCharFormat &format);
+    void writeListStyle(int index, const QTextListFormat &format);
+    void writeBlock(const QTextBlock &block);
+    void writeTable(const QTextTable *table);
+    void writeFragment(const QTextFragment &fragment);
+    void writeImage(const QTextImageFormat &format);
+    void writeText(QStringView text);
+    void enterList(const QTextList *list);
+    void closeList();
+
+    const QTextDocument *m_document;
+    QXmlStreamWriter &m_xml;
+    QList<const QTextList *> m_lists; // open lists, outermost first
+    QSet<const QTextList *> m_startedLists;
+    QStringList m_imageNames;
+    QHash<QString, int> m_imageIndexes;
+    int m_tables = 0;
+    int m_frames = 0;
+};
+
+void OdtWriter::writeAutomaticStyles()
+{
+    const QList<QTextFormat> formats = m_document->allFormats();
+    for (int i = 0; i < formats.size(); ++i) {
+        const QTextFormat &format = formats.at(i);
+        if (format.isBlockFormat()) {
+            writeParagraphStyle(i, format.toBlockFormat());
+        } else if (format.isListFormat()) {
+            writeListStyle(i, format.toListFormat());
+        } else if (format.isCharFormat() && !format.isImageFormat()) {
+            writeTextStyle(i, format.toCharFormat());
+        }
+    }
+
+    m_xml.writeStartElement("style:style");
+    m_xml.writeAttribute("style:name", "Cell");
+    m_xml.writeAttribute("style:family", "table-cell");
+    m_xml.writeEmptyElement("style:table-cell-properties");
+    m_xml.writeAttribute("fo:border", "0.5pt solid #000000");
+    m_xml.writeAttribute("fo:padding", "0.1cm");
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeParagraphStyle(int index, const QTextBlockFormat &format)
+{
+    m_xml.writeStartElement("style:style");
+    m_xml.writeAttribute("style:name", QStringLiteral("P%1").arg(index));
+    m_xml.writeAttribute("style:family", "paragraph");
+    m_xml.writeEmptyElement("style:paragraph-properties");
+
+    if (format.hasProperty(QTextFormat::BlockAlignment)) {
+        const Qt::Alignment alignment = format.alignment() & Qt::AlignHorizontal_Mask;
+        QString value = QStringLiteral("start");
+        if (alignment & Qt::AlignRight) {
+            value = QStringLiteral("end");
+        } else if (alignment & Qt::AlignHCenter) {
+            value = QStringLiteral("center");
+        } else if (alignment & Qt::AlignJustify) {
+            value = QStringLiteral("justify");
+        }
+        m_xml.writeAttribute("fo:text-align", value);
+    }
+    if (format.hasProperty(QTextFormat::BlockTopMargin)) {
+        m_xml.writeAttribute("fo:margin-top", points(format.topMargin()));
+    }
+    if (format.hasProperty(QTextFormat::BlockBottomMargin)) {
+        m_xml.writeAttribute("fo:margin-bottom", points(format.bottomMargin()));
+    }
+    if (format.hasProperty(QTextFormat::BlockLeftMargin) || format.hasProperty(QTextFormat::BlockIndent)) {
+        m_xml.writeAttribute("fo:margin-left",
+                             points(format.leftMargin() + format.indent() * m_document->indentWidth()));
+    }
+    if (format.hasProperty(QTextFormat::BlockRightMargin)) {
+        m_xml.writeAttribute("fo:margin-right", points(format.rightMargin()));
+    }
+    if (format.hasProperty(QTextFormat::TextIndent)) {
+        m_xml.writeAttribute("fo:text-indent", points(format.textIndent()));
+    }
+    if (format.lineHeightType() == QTextBlockFormat::ProportionalHeight) {
+        m_xml.writeAttribute("fo:line-height", QString::number(format.lineHeight()) + QLatin1Char('%'));
+    }
+    if (format.hasProperty(QTextFormat::BackgroundBrush) && format.background().style() != Qt::NoBrush) {
+        m_xml.writeAttribute("fo:background-color", format.background().color().name());
+    }
+    if (format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysBefore) {
+        m_xml.writeAttribute("fo:break-before", "page");
+    }
+    if (format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysAfter) {
+        m_xml.writeAttribute("fo:break-after", "page");
+    }
+
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeTextStyle(int index, const QTextCharFormat &format)
+{
+    m_xml.writeStartElement("style:style");
+    m_xml.writeAttribute("style:name", QStringLiteral("T%1").arg(index));
+    m_xml.writeAttribute("style:family", "text");
+    m_xml.writeEmptyElement("style:text-properties");
+
+    const QStringList families = format.property(QTextFormat::FontFamilies).toStringList();
+    if (!families.isEmpty()) {
+        m_xml.writeAttribute("fo:font-family", families.first());
+    }
+    if (format.hasProperty(QTextFormat::FontPointSize)) {
+        m_xml.writeAttribute("fo:font-size", QString::number(format.fontPointSize()) + QStringLiteral("pt"));
+    }
+    if (format.hasProperty(QTextFormat::FontWeight)) {
+        const int weight = format.fontWeight();
+        m_xml.writeAttribute("fo:font-weight", weight == QFont::Normal ? QStringLiteral("normal")
+                             : weight == QFont::Bold ? QStringLiteral("bold") : QString::number(weight));
+    }
+    if (format.hasProperty(QTextFormat::FontItalic)) {
+        m_xml.writeAttribute("fo:font-style", format.fontItalic() ? "italic" : "normal");
+    }
+    if (format.hasProperty(QTextFormat::TextUnderlineStyle) || format.hasProperty(QTextFormat::FontUnderline)) {
+        QString style;
+        switch (format.underlineStyle()) {
+        case QTextCharFormat::NoUnderline:
+            style = QStringLiteral("none");
+            break;
+        case QTextCharFormat::DashUnderline:
+            style = QStringLiteral("dash");
+            break;
+        case QTextCharFormat::DotLine:
+            style = QStringLiteral("dotted");
+            break;
+        case QTextCharFormat::DashDotLine:
+            style = QStringLiteral("dot-dash");
+            break;
+        case QTextCharFormat::DashDotDotLine:
+            style = QStringLiteral("dot-dot-dash");
+            break;
+        case QTextCharFormat::WaveUnderline:
+        case QTextCharFormat::SpellCheckUnderline:
+            style = QStringLiteral("wave");
+            break;
+        default:
+            style = QStringLiteral("solid");
+            break;
+        }
+        m_xml.writeAttribute("style:text-underline-style", style);
+        if (style != QLatin1String("none")) {
+            m_xml.writeAttribute("style:text-underline-width", "auto");
+            m_xml.writeAttribute("style:text-underline-color", "font-color");
+        }
+    }
+    if (format.hasProperty(QTextFormat::FontStrikeOut)) {
+        m_xml.writeAttribute("style:text-line-through-style", format.fontStrikeOut() ? "solid" : "none");
+    }
+    if (format.hasProperty(QTextFormat::FontOverline)) {
+        m_xml.writeAttribute("style:text-overline-style", format.fontOverline() ? "solid" : "none");
+    }
+    if (format.hasProperty(QTextFormat::ForegroundBrush) && format.foreground().style() != Qt::NoBrush) {
+        m_xml.writeAttribute("fo:color", format.foreground().color().name());
+    }
+    if (format.hasProperty(QTextFormat::BackgroundBrush) && format.background().style() != Qt::NoBrush) {
+        m_xml.writeAttribute("fo:background-color", format.background().color().name());
+    }
+    if (format.verticalAlignment() == QTextCharFormat::AlignSuperScript) {
+        m_xml.writeAttribute("style:text-position", "super 58%");
+    } else if (format.verticalAlignment() == QTextCharFormat::AlignSubScript) {
+        m_xml.writeAttribute("style:text-position", "sub 58%");
+    }
+    switch (format.fontCapitalization()) {
+    case QFont::AllUppercase:
+        m_xml.writeAttribute("fo:text-transform", "uppercase");
+        break;
+    case QFont::AllLowercase:
+        m_xml.writeAttribute("fo:text-transform", "lowercase");
+        break;
+    case QFont::Capitalize:
+        m_xml.writeAttribute("fo:text-transform", "capitalize");
+        break;
+    case QFont::SmallCaps:
+        m_xml.writeAttribute("fo:font-variant", "small-caps");
+        break;
+    default:
+        break;
+    }
+
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeListStyle(int index, const QTextListFormat &format)
+{
+    m_xml.writeStartElement("text:list-style");
+    m_xml.writeAttribute("style:name", QStringLiteral("L%1").arg(index));
+
+    // The level used depends on how deeply the list ends up nested, so
+    // every level looks the same
+    for (int level = 1; level <= 10; ++level) {
+        switch (format.style()) {
+        case QTextListFormat::ListDisc:
+        case QTextListFormat::ListCircle:
+        case QTextListFormat::ListSquare:
+            m_xml.writeStartElement("text:list-level-style-bullet");
+            m_xml.writeAttribute("text:level", QString::number(level));
+            m_xml.writeAttribute("text:bullet-char", format.style() == QTextListFormat::ListDisc ? QStringLiteral("•")
+                                 : format.style() == QTextListFormat::ListCircle ? QStringLiteral("◦")
+                                 : QStringLiteral("▪"));
+            break;
+        default: {
+            QString numbering = QStringLiteral("1");
+            if (format.style() == QTextListFormat::ListLowerAlpha) {
+                numbering = QStringLiteral("a");
+            } else if (format.style() == QTextListFormat::ListUpperAlpha) {
+                numbering = QStringLiteral("A");
+            } else if (format.style() == QTextListFormat::ListLowerRoman) {
+                numbering = QStringLiteral("i");
+            } else if (format.style() == QTextListFormat::ListUpperRoman) {
+                numbering = QStringLiteral("I");
+            }
+            m_xml.writeStartElement("text:list-level-style-number");
+            m_xml.writeAttribute("text:level", QString::number(level));
+            m_xml.writeAttribute("style:num-format", numbering);
+            m_xml.writeAttribute("style:num-prefix", format.numberPrefix());
+            m_xml.writeAttribute("style:num-suffix", format.numberSuffix());
+            break;
+        }
+        }
+        m_xml.writeStartElement("style:list-level-properties");
+        m_xml.writeAttribute("text:list-level-position-and-space-mode", "label-alignment");
+        m_xml.writeEmptyElement("style:list-level-label-alignment");
+        m_xml.writeAttribute("text:label-followed-by", "listtab");
+        m_xml.writeAttribute("fo:margin-left", QString::number(0.635 * level) + QStringLiteral("cm"));
+        m_xml.writeAttribute("fo:text-indent", "-0.635cm");
+        m_xml.writeEndElement();
+        m_xml.writeEndElement();
+    }
+
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeFrame(QTextFrame::iterator it)
+{
+    for (; !it.atEnd(); ++it) {
+        if (QTextFrame *frame = it.currentFrame()) {
+            closeLists();
+            if (QTextTable *table = qobject_cast<QTextTable *>(frame)) {
+                writeTable(table);
+            } else {
+                writeFrame(frame->begin());
+            }
+        } else if (it.currentBlock().isValid()) {
+            writeBlock(it.currentBlock());
+        }
+    }
+}
+
+void OdtWriter::enterList(const QTextList *list)
+{
+    const int indent = list->format().indent();
+    while (!m_lists.isEmpty() && m_lists.last() != list && m_lists.last()->format().indent() >= indent) {
+        closeList();
+    }
+
+    if (!m_lists.isEmpty() && m_lists.last() == list) {
+        m_xml.writeEndElement(); // text:list-item
+    } else {
+        // Nested lists go inside the open item of their parent
+        m_xml.writeStartElement("text:list");
+        m_xml.writeAttribute("text:style-name", QStringLiteral("L%1").arg(list->formatIndex()));
+        if (m_startedLists.contains(list)) {
+            m_xml.writeAttribute("text:continue-numbering", "true");
+        }
+        m_startedLists.insert(list);
+        m_lists.append(list);
+    }
+    m_xml.writeStartElement("text:list-item");
+}
+
+void OdtWriter::closeList()
+{
+    m_xml.writeEndElement(); // text:list-item
+    m_xml.writeEndElement(); // text:list
+    m_lists.removeLast();
+}
+
+void OdtWriter::closeLists()
+{
+    while (!m_lists.isEmpty()) {
+        closeList();
+    }
+}
+
+void OdtWriter::writeBlock(const QTextBlock &block)
+{
+    if (const QTextList *list = block.textList()) {
+        enterList(list);
+    } else {
+        closeLists();
+    }
+
+    const int level = block.blockFormat().headingLevel();
+    if (level > 0) {
+        m_xml.writeStartElement("text:h");
+        m_xml.writeAttribute("text:outline-level", QString::number(level));
+    } else {
+        m_xml.writeStartElement("text:p");
+    }
+    m_xml.writeAttribute("text:style-name", QStringLiteral("P%1").arg(block.blockFormatIndex()));
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        if (it.fragment().isValid()) {
+            writeFragment(it.fragment());
+        }
+    }
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeTable(const QTextTable *table)
+{
+    const bool bordered = table->format().border() > 0;
+    m_xml.writeStartElement("table:table");
+    m_xml.writeAttribute("table:name", QStringLiteral("Table%1").arg(++m_tables));
+    m_xml.writeEmptyElement("table:table-column");
+    m_xml.writeAttribute("table:number-columns-repeated", QString::number(table->columns()));
+
+    for (int row = 0; row < table->rows(); ++row) {
+        m_xml.writeStartElement("table:table-row");
+        for (int column = 0; column < table->columns(); ++column) {
+            const QTextTableCell cell = table->cellAt(row, column);
+            if (cell.row() != row || cell.column() != column) {
+                m_xml.writeEmptyElement("table:covered-table-cell");
+                continue;
+            }
+            m_xml.writeStartElement("table:table-cell");
+            m_xml.writeAttribute("office:value-type", "string");
+            if (bordered) {
+                m_xml.writeAttribute("table:style-name", "Cell");
+            }
+            if (cell.rowSpan() > 1) {
+                m_xml.writeAttribute("table:number-rows-spanned", QString::number(cell.rowSpan()));
+            }
+            if (cell.columnSpan() > 1) {
+                m_xml.writeAttribute("table:number-columns-spanned", QString::number(cell.columnSpan()));
+            }
+            writeFrame(cell.begin());
+            closeLists();
+            m_xml.writeEndElement();
+        }
+        m_xml.writeEndElement();
+    }
+
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeFragment(const QTextFragment &fragment)
+{
+    const QTextCharFormat format = fragment.charFormat();
+    if (format.isImageFormat()) {
+        for (int i = 0; i < fragment.length(); ++i) {
+            writeImage(format.toImageFormat());
+        }
+        return;
+    }
+
+    const bool link = format.isAnchor() && !format.anchorHref().isEmpty();
+    if (link) {
+        m_xml.writeStartElement("text:a");
+        m_xml.writeAttribute("xlink:type", "simple");
+        m_xml.writeAttribute("xlink:href", format.anchorHref());
+    }
+    m_xml.writeStartElement("text:span");
+    m_xml.writeAttribute("text:style-name", QStringLiteral("T%1").arg(fragment.charFormatIndex()));
+    writeText(fragment.text());
+    m_xml.writeEndElement();
+    if (link) {
+        m_xml.writeEndElement();
+    }
+}
+
+void OdtWriter::writeImage(const QTextImageFormat &format)
+{
+    const QString name = format.name();
+    int index = m_imageIndexes.value(name, -1);
+
+    // Only the size is needed here; the image itself is encoded after
+    // content.xml, one at a time
+    const QImage image = imageResource(m_document, name);
+    if (image.isNull()) {
+        return;
+    }
+    if (index < 0) {
+        index = m_imageNames.size();
+        m_imageNames.append(name);
+        m_imageIndexes.insert(name, index);
+    }
+
+    qreal width = format.width();
+    qreal height = format.height();
+    if (width <= 0 && height <= 0) {
+        width = image.width();
+        height = image.height();
+    } else if (width <= 0) {
+        width = height * image.width() / qMax(1, image.height());
+    } else if (height <= 0) {
+        height = width * image.height() / qMax(1, image.width());
+    }
+
+    m_xml.writeStartElement("draw:frame");
+    m_xml.writeAttribute("draw:name", QStringLiteral("Image%1").arg(++m_frames));
+    m_xml.writeAttribute("text:anchor-type", "as-char");
+    m_xml.writeAttribute("svg:width", points(width));
+    m_xml.writeAttribute("svg:height", points(height));
+    m_xml.writeEmptyElement("draw:image");
+    m_xml.writeAttribute("xlink:href", QStringLiteral("Pictures/image%1.png").arg(index));
+    m_xml.writeAttribute("xlink:type", "simple");
+    m_xml.writeAttribute("xlink:show", "embed");
+    m_xml.writeAttribute("xlink:actuate", "onLoad");
+    m_xml.writeEndElement();
+}
+
+void OdtWriter::writeText(QStringView text)
+{
+    qsizetype runStart = 0;
+    auto flush = [&](qsizetype end) {
+        if (end > runStart) {
+            m_xml.writeCharacters(text.mid(runStart, end - runStart).toString());
+        }
+    };
+
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const QChar c = text.at(i);
+        if (c == QLatin1Char(' ') && i + 1 < text.size() && text.at(i + 1) == QLatin1Char(' ')) {
+            // ODF collapses runs of spaces; the extra ones are counted
+            flush(i + 1);
+            int count = 0;
+            while (i + 1 < text.size() && text.at(i + 1) == QLatin1Char(' ')) {
+                ++count;
+                ++i;
+            }
+            m_xml.writeEmptyElement("text:s");
+            m_xml.writeAttribute("text:c", QString::number(count));
+            runStart = i + 1;
+        } else if (c == QLatin1Char('\t')) {
+            flush(i);
+            m_xml.writeEmptyElement("text:tab");
+            runStart = i + 1;
+        } else if (c == QChar::LineSeparator) {
+            flush(i);
+            m_xml.writeEmptyElement("text:line-break");
+            runStart = i + 1;
+        } else if (c.unicode() < 0x20) {
+            // Not allowed in XML
+            flush(i);
+            runStart = i + 1;
+        }
+    }
+    flush(text.size());
+}
+
+QByteArray stylesXml(const QTextDocument *document)
+{
+    QByteArray data;
+    QXmlStreamWriter xml(&data);
+    xml.writeStartDocument();
+    xml.writeStartElement("office:document-styles");
+    writeNamespaces(xml);
+    xml.writeStartElement("office:styles");
+    xml.writeStartElement("style:default-style");
+    xml.writeAttribute("style:family", "paragraph");
+    xml.writeEmptyElement("style:text-properties");
+    const QFont font = document->defaultFont();
+    xml.writeAttribute("fo:font-family", font.family());
+    if (font.pointSizeF() > 0) {
+        xml.writeAttribute("fo:font-size", QString::number(font.pointSizeF()) + QStringLiteral("pt"));
+    }
+    xml.writeEndDocument();
+    return data;
+}
+
+QByteArray manifestXml(int images)
+{
+    QByteArray data;
+    QXmlStreamWriter xml(&data);
+    xml.writeStartDocument();
+    xml.writeStartElement("manifest:manifest");
+    xml.writeAttribute("xmlns:manifest", "urn:oasis:names:tc:opendocument:xmlns:manifest:1.0");
+    xml.writeAttribute("manifest:version", "1.2");
+
+    auto entry = [&xml](const QString &path, const QString &mediaType) {
+        xml.writeEmptyElement("manifest:file-entry");
+        xml.writeAttribute("manifest:full-path", path);
+        xml.writeAttribute("manifest:media-type", mediaType);
+    };
+    entry(QStringLiteral("/"), ODT_MIME_TYPE);
+    xml.writeAttribute("manifest:version", "1.2");
+    entry(QStringLiteral("content.xml"), QStringLiteral("text/xml"));
+    entry(QStringLiteral("styles.xml"), QStringLiteral("text/xml"));
+    for (int i = 0; i < images; ++i) {
+        entry(QStringLiteral("Pictures/image%1.png").arg(i), QStringLiteral("image/png"));
+    }
+    xml.writeEndDocument();
+    return data;
+}
+
+}
+
+bool DocumentExporter::formatForFile(const QString &fileName, Format *format)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == QLatin1String("md") || suffix == QLatin1String("markdown")) {
+        *format = Markdown;
+        return true;
+    }
+    if (suffix == QLatin1String("odt")) {
+        *format = Odt;
+        return true;
+    }
+    return false;
+}
+
+QString DocumentExporter::fileFilter(Format format)
+{
+    if (format == Markdown) {
+        return QCoreApplication::translate("DocumentExporter", "Markdown Documents (*.md *.markdown)");
+    }
+    return QCoreApplication::translate("DocumentExporter", "OpenDocument Text (*.odt)");
+}
+
+bool DocumentExporter::exportToFile(const QTextDocument *document, const QString &fileName, Format format,
+                                    QString *errorString)
+{
+    TRACE_SCOPE("DocumentExporter::exportToFile");
+
+    // QSaveFile keeps the previous file intact until the export is complete
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+
+    const bool written = format == Markdown ? writeMarkdown(document, &file) : writeOdt(document, &file);
+    if (!written) {
+        file.cancelWriting();
+        if (errorString) {
+            *errorString = QCoreApplication::translate("DocumentExporter", "The document could not be written");
+        }
+        return false;
+    }
+    if (!file.commit()) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool DocumentExporter::writeMarkdown(const QTextDocument *document, QIODevice *device)
+{
+    QTextStream out(device);
+    out.setEncoding(QStringConverter::Utf8);
+    MarkdownWriter writer(out);
+    writer.writeFrame(document->rootFrame()->begin());
+    writer.finish();
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
+
+bool DocumentExporter::writeOdt(const QTextDocument *document, QIODevice *device)
+{
+    if (device->isSequential()) {
+        qDebug() << "ODT export needs a seekable device";
+        return false;
+    }
+
+    // The mimetype entry has to come first, uncompressed
+    ZipWriter zip(device);
+    if (!zip.addEntry(QStringLiteral("mimetype"), ODT_MIME_TYPE.toLatin1())) {
+        return false;
+    }
+
+    QStringList imageNames;
+    if (!zip.beginEntry(QStringLiteral("content.xml"))) {
+        return false;
+    }
+    {
+        ZipEntryDevice entry(&zip);
+        QXmlStreamWriter xml(&entry);
+        xml.writeStartDocument();
+        xml.writeStartElement("office:document-content");
+        writeNamespaces(xml);
+
+        OdtWriter writer(document, xml);
+        xml.writeStartElement("office:automatic-styles");
+        writer.writeAutomaticStyles();
+        xml.writeEndElement();
+
+        xml.writeStartElement("office:body");
+        xml.writeStartElement("office:text");
+        writer.writeFrame(document->rootFrame()->begin());
+        writer.closeLists();
+        xml.writeEndDocument();
+        if (xml.hasError()) {
+            return false;
+        }
+        imageNames = writer.imageNames();
+    }
+    if (!zip.endEntry() || !zip.addEntry(QStringLiteral("styles.xml"), stylesXml(document))) {
+        return false;
+    }
+
+    for (int i = 0; i < imageNames.size(); ++i) {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        imageResource(document, imageNames.at(i)).save(&buffer, "PNG");
+        if (!zip.addEntry(QStringLiteral("Pictures/image%1.png").arg(i), png)) {
+            return false;
+        }
+    }
+
+    return zip.addEntry(QStringLiteral("META-INF/manifest.xml"), manifestXml(imageNames.size()))
+        && zip.finish();
+}
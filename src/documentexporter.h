@@ -0,0 +1,36 @@
+#ifndef DOCUMENTEXPORTER_H
+#define DOCUMENTEXPORTER_H
+
+#include <QString>
+
+class QTextDocument;
+class QIODevice;
+
+// Writes documents as Markdown or OpenDocument Text. Unlike toMarkdown()
+// and QTextDocumentWriter, which build the whole output in memory first,
+// the exporters walk the frame, block and fragment iterators and stream
+// each piece to the device as it is produced, so memory use does not grow
+// with the document.
+//
+// ODT files are written as an uncompressed zip. Entry sizes and checksums
+// are patched into the local headers after each entry is streamed, which
+// needs a seekable device; embedded images are stored after content.xml.
+class DocumentExporter
+{
+public:
+    enum Format {
+        Markdown,
+        Odt
+    };
+
+    // False when the file name has no extension handled here
+    static bool formatForFile(const QString &fileName, Format *format);
+    static QString fileFilter(Format format);
+
+    static bool exportToFile(const QTextDocument *document, const QString &fileName, Format format,
+                             QString *errorString = nullptr);
+    static bool writeMarkdown(const QTextDocument *document, QIODevice *device);
+    static bool writeOdt(const QTextDocument *document, QIODevice *device);
+};
+
+#endif // DOCUMENTEXPORTER_H
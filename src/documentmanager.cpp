@@ -1,4 +1,9 @@
 #include "documentmanager.h"
+#include "textimport.h"
+#include "htmlimport.h"
+#include "htmlwriter.h"
+#include "tracer.h"
+#include "taskexecutor.h"
 
 #include <QTextDocument>
 #include <QFile>
@@ -10,11 +15,41 @@
 #include <QApplication>
 #include <QDebug>
 #include <QStringConverter>
+#include <QSaveFile>
+#include <QElapsedTimer>
+#include <QtEndian>
+
+namespace {
+// Leading bytes of a compressed recovery snapshot; older files are plain UTF-8
+const QByteArray SNAPSHOT_MAGIC("CPWZ");
+
+// Encoded size without encoding a second copy of the snapshot
+qint64 utf8Length(QStringView text)
+{
+    qint64 bytes = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const char16_t c = text.at(i).unicode();
+        if (c < 0x80) {
+            bytes += 1;
+        } else if (c < 0x800) {
+            bytes += 2;
+        } else if (QChar::isHighSurrogate(c) && i + 1 < text.size() && text.at(i + 1).isLowSurrogate()) {
+            bytes += 4;
+            ++i;
+        } else {
+            bytes += 3;
+        }
+    }
+    return bytes;
+}
+}
 
 DocumentManager::DocumentManager(QObject *parent)
     : QObject(parent)
     , m_autoSaveTimer(new QTimer(this))
     , m_document(nullptr)
+    , m_lastRawBytes(0)
+    , m_lastGuiMsecs(0)
 {
     connect(m_autoSaveTimer, &QTimer::timeout, this, &DocumentManager::autoSave);
 }
@@ -22,6 +57,8 @@ DocumentManager::DocumentManager(QObject *parent)
 DocumentManager::~DocumentManager()
 {
     stopAutoSave();
+    m_recoveryTask.waitForFinished();
+    m_historyTask.waitForFinished();
 }
 
 void DocumentManager::setProperty(const QString &key, const QVariant &value)
@@ -66,6 +103,13 @@ void DocumentManager::startAutoSave(QTextDocument *document, const QString &file
     // Load properties if exists
     loadProperties(filePath);
     
+    // Keep the loaded history across saves of the same file
+    if (!m_versionHistory || m_historyFilePath != filePath) {
+        m_historyTask.waitForFinished();
+        m_versionHistory.reset(new VersionHistory(historyDirectory(filePath)));
+        m_historyFilePath = filePath;
+    }
+    
     // Start auto-save timer
     m_autoSaveTimer->start(AUTO_SAVE_INTERVAL);
 }
@@ -84,26 +128,26 @@ bool DocumentManager::hasRecoveryFile(const QString &filePath) const
 
 bool DocumentManager::recoverDocument(QTextDocument *document, const QString &filePath)
 {
+    TRACE_SCOPE("DocumentManager::recoverDocument");
+    
     if (!document || !hasRecoveryFile(filePath)) {
         return false;
     }
     
-    QFile file(recoveryFilePath(filePath));
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+    // Make sure a snapshot still being written is complete
+    m_recoveryTask.waitForFinished();
+    
+    QString content;
+    if (!readSnapshot(recoveryFilePath(filePath), &content)) {
         return false;
     }
     
-    QTextStream in(&file);
-    in.setEncoding(QStringConverter::Utf8);
-    
     if (filePath.endsWith(".txt", Qt::CaseInsensitive)) {
-        document->setPlainText(in.readAll());
+        document->setPlainText(content);
     } else {
-        document->setHtml(in.readAll());
+        HtmlImport::importInto(document, content);
     }
     
-    file.close();
-    
     // Also load document properties
     loadProperties(filePath);
     
@@ -112,6 +156,8 @@ bool DocumentManager::recoverDocument(QTextDocument *document, const QString &fi
 
 void DocumentManager::clearRecoveryFile(const QString &filePath)
 {
+    // A pending write would otherwise bring the file back
+    m_recoveryTask.waitForFinished();
     QFile::remove(recoveryFilePath(filePath));
 }
 
@@ -140,34 +186,46 @@ QStringList DocumentManager::pendingRecoveryFiles() const
 
 void DocumentManager::autoSave()
 {
+    TRACE_SCOPE("DocumentManager::autoSave");
+    
     try {
         if (!m_document || m_currentFilePath.isEmpty()) {
             return;
         }
         
-        QFile file(recoveryFilePath(m_currentFilePath));
-        QDir dir = QFileInfo(file).dir();
-        
-        if (!dir.exists()) {
-            dir.mkpath(".");
+        // Skip this tick if the previous snapshot is still being written
+        if (m_recoveryTask.isRunning()) {
+            return;
         }
         
-        if (file.open(QFile::WriteOnly | QFile::Text)) {
-            QTextStream out(&file);
-            out.setEncoding(QStringConverter::Utf8);
-            
-            if (m_currentFilePath.endsWith(".txt", Qt::CaseInsensitive)) {
-                // Create a copy of text to avoid concurrent access issues
-                QString text = m_document->toPlainText();
-                out << text;
-            } else {
-                // Create a copy of HTML to avoid concurrent access issues
-                QString html = m_document->toHtml();
-                out << html;
-            }
-            
-            file.close();
+        QElapsedTimer timer;
+        timer.start();
+        
+        // Create a copy of the content to avoid concurrent access issues
+        const QString content = serializeDocument();
+        const QString path = recoveryFilePath(m_currentFilePath);
+        
+        // Compression and disk I/O happen on a worker thread
+        m_recoveryTask = TaskExecutor::instance()->run(TaskExecutor::Background, this,
+            [path, content](const TaskExecutor::CancellationToken &) {
+                return writeCompressedSnapshot(path, content);
+            },
+            [this](qint64 written) {
+                if (written >= 0) {
+                    TRACE_COUNTER("recovery snapshot bytes", written);
+                    emit autoSaved(m_lastRawBytes, written, m_lastGuiMsecs);
+                }
+            });
+        
+        // Unchanged content is not recorded again; a version still being
+        // written makes this tick skip one
+        if (m_versionHistory && !m_historyTask.isRunning()) {
+            addVersion(content, tr("Autosave"));
         }
+        
+        m_lastRawBytes = utf8Length(content);
+        m_lastGuiMsecs = timer.elapsed();
+        TRACE_COUNTER("autosave GUI ms", m_lastGuiMsecs);
     } catch (const std::exception& e) {
         qDebug() << "Exception in DocumentManager::autoSave:" << e.what();
     } catch (...) {
@@ -175,6 +233,150 @@ void DocumentManager::autoSave()
     }
 }
 
+bool DocumentManager::snapshotVersion(const QString &label)
+{
+    if (!m_document || !m_versionHistory) {
+        return false;
+    }
+    
+    // Labelled versions are never skipped
+    m_historyTask.waitForFinished();
+    addVersion(serializeDocument(), label);
+    return true;
+}
+
+void DocumentManager::addVersion(const QString &content, const QString &label)
+{
+    VersionHistory *history = m_versionHistory.get();
+    m_historyTask = TaskExecutor::instance()->run(TaskExecutor::Background, this,
+        [history, content, label](const TaskExecutor::CancellationToken &) {
+            TRACE_SCOPE("DocumentManager::addVersion");
+            return history->addVersion(content, label);
+        },
+        [](bool) {});
+}
+
+QList<VersionHistory::Version> DocumentManager::versions() const
+{
+    if (!m_versionHistory) {
+        return QList<VersionHistory::Version>();
+    }
+    m_historyTask.waitForFinished();
+    return m_versionHistory->versions();
+}
+
+QString DocumentManager::versionContent(int number) const
+{
+    if (!m_versionHistory) {
+        return QString();
+    }
+    m_historyTask.waitForFinished();
+    return m_versionHistory->content(number);
+}
+
+qint64 DocumentManager::versionStorageBytes() const
+{
+    if (!m_versionHistory) {
+        return 0;
+    }
+    m_historyTask.waitForFinished();
+    return m_versionHistory->storedBytes();
+}
+
+qint64 DocumentManager::writeCompressedSnapshot(const QString &path, const QString &content)
+{
+    TRACE_SCOPE("DocumentManager::writeCompressedSnapshot");
+    
+    QDir dir = QFileInfo(path).dir();
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+    
+    // QSaveFile keeps the previous snapshot intact until the new one is complete
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return -1;
+    }
+    
+    file.write(SNAPSHOT_MAGIC);
+    
+    QStringEncoder encoder(QStringConverter::Utf8);
+    int position = 0;
+    while (position < content.size()) {
+        int length = qMin(int(SNAPSHOT_FRAME_SIZE), int(content.size()) - position);
+        if (position + length < content.size() && content.at(position + length - 1).isHighSurrogate()) {
+            ++length;
+        }
+        
+        const QByteArray frame = qCompress(encoder.encode(QStringView(content).mid(position, length)),
+                                           SNAPSHOT_COMPRESSION_LEVEL);
+        QByteArray header(4, Qt::Uninitialized);
+        qToBigEndian<quint32>(quint32(frame.size()), header.data());
+        file.write(header);
+        file.write(frame);
+        
+        position += length;
+    }
+    
+    if (!file.commit()) {
+        return -1;
+    }
+    return QFileInfo(path).size();
+}
+
+bool DocumentManager::readSnapshot(const QString &path, QString *content)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    
+    content->clear();
+    QStringDecoder decoder(QStringConverter::Utf8);
+    
+    if (file.peek(SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC) {
+        // Snapshot written by an older version
+        return TextImport::decode(file.readAll(), content);
+    }
+    
+    // Decompress one frame at a time
+    file.read(SNAPSHOT_MAGIC.size());
+    while (!file.atEnd()) {
+        const QByteArray header = file.read(4);
+        if (header.size() != 4) {
+            return false;
+        }
+        
+        const quint32 size = qFromBigEndian<quint32>(header.constData());
+        const QByteArray frame = qUncompress(file.read(size));
+        if (frame.isEmpty()) {
+            return false;
+        }
+        content->append(decoder.decode(frame));
+    }
+    
+    return !decoder.hasError();
+}
+
+QString DocumentManager::serializeDocument() const
+{
+    if (m_currentFilePath.endsWith(".txt", Qt::CaseInsensitive)) {
+        return m_document->toPlainText();
+    }
+    return HtmlWriter::toHtml(m_document);
+}
+
+QString DocumentManager::historyDirectory(const QString &originalPath) const
+{
+    // Same naming scheme as the recovery files
+    QString safeName = originalPath;
+    safeName.replace("/", "_");
+    safeName.replace("\\", "_");
+    safeName.replace(":", "_");
+    
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/history/" + safeName;
+}
+
 QString DocumentManager::recoveryFilePath(const QString &originalPath) const
 {
     QDir recoveryDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/recovery");
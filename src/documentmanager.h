@@ -7,6 +7,10 @@
 #include <QMap>
 #include <QString>
 #include <QVariant>
+#include <memory>
+
+#include "versionhistory.h"
+#include "taskexecutor.h"
 
 class QTextDocument;
 
@@ -32,12 +36,32 @@ public:
     void clearRecoveryFile(const QString &filePath);
     QStringList pendingRecoveryFiles() const;
 
+    // Version history; versions are hashed, diffed and written on the task
+    // executor, and the queries below wait for a pending one
+    bool snapshotVersion(const QString &label);
+    QList<VersionHistory::Version> versions() const;
+    QString versionContent(int number) const;
+    qint64 versionStorageBytes() const;
+
+signals:
+    // Emitted when a recovery snapshot is on disk; guiMsecs is the time the
+    // autosave tick spent on the GUI thread
+    void autoSaved(qint64 rawBytes, qint64 writtenBytes, qint64 guiMsecs);
+
 private slots:
     void autoSave();
 
 private:
     QString recoveryFilePath(const QString &originalPath) const;
     QString propertiesFilePath(const QString &originalPath) const;
+    QString historyDirectory(const QString &originalPath) const;
+    QString serializeDocument() const;
+    void addVersion(const QString &content, const QString &label);
+
+    // Recovery snapshots are written as a sequence of independently
+    // qCompress'ed frames so neither side holds a second full copy
+    static qint64 writeCompressedSnapshot(const QString &path, const QString &content);
+    static bool readSnapshot(const QString &path, QString *content);
     bool saveProperties(const QString &filePath);
     bool loadProperties(const QString &filePath);
 
@@ -45,7 +69,15 @@ private:
     QTimer *m_autoSaveTimer;
     QTextDocument *m_document;
     QString m_currentFilePath;
+    QString m_historyFilePath;
+    std::unique_ptr<VersionHistory> m_versionHistory;
+    TaskExecutor::Task m_recoveryTask;
+    mutable TaskExecutor::Task m_historyTask;
+    qint64 m_lastRawBytes;
+    qint64 m_lastGuiMsecs;
     static const int AUTO_SAVE_INTERVAL = 30000; // 30 seconds
+    static const int SNAPSHOT_FRAME_SIZE = 256 * 1024; // characters per compressed frame
+    static const int SNAPSHOT_COMPRESSION_LEVEL = 1; // markup compresses well even at the fastest level
 };
 
 #endif // DOCUMENTMANAGER_H 
\ No newline at end of file
@@ -0,0 +1,449 @@
+#include "filemonitor.h"
+#include "textimport.h"
+#include "htmlimport.h"
+
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QScrollBar>
+#include <QDataStream>
+#include <QDebug>
+#include <algorithm>
+
+FileMonitor::FileMonitor(QTextEdit *editor, QObject *parent)
+    : QObject(parent)
+    , m_editor(editor)
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_debounceTimer(new QTimer(this))
+    , m_format(Qt::PlainText)
+    , m_lastSize(-1)
+    , m_revision(0)
+    , m_changePending(false)
+    , m_force(false)
+{
+    m_debounceTimer->setSingleShot(true);
+    m_debounceTimer->setInterval(DEBOUNCE_INTERVAL);
+
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &FileMonitor::onFileChanged);
+    connect(m_debounceTimer, &QTimer::timeout, this, &FileMonitor::check);
+}
+
+FileMonitor::~FileMonitor()
+{
+    m_diffTask.cancel();
+    m_diffTask.waitForFinished();
+}
+
+void FileMonitor::watch(const QString &filePath, Qt::TextFormat format)
+{
+    if (!m_filePath.isEmpty() && m_filePath != filePath) {
+        unwatch();
+    }
+
+    m_filePath = filePath;
+    m_format = format;
+    m_changePending = false;
+    m_force = false;
+
+    if (!m_watcher->files().contains(filePath)) {
+        m_watcher->addPath(filePath);
+    }
+
+    // What is on disk now is what the document shows
+    updateStamp();
+}
+
+void FileMonitor::unwatch()
+{
+    if (!m_filePath.isEmpty()) {
+        m_watcher->removePath(m_filePath);
+    }
+    m_filePath.clear();
+    m_debounceTimer->stop();
+    m_diffTask.cancel();
+    m_changePending = false;
+    m_force = false;
+}
+
+QString FileMonitor::filePath() const
+{
+    return m_filePath;
+}
+
+void FileMonitor::reload()
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+    m_force = true;
+    check();
+}
+
+void FileMonitor::onFileChanged(const QString &path)
+{
+    if (path != m_filePath) {
+        return;
+    }
+    m_debounceTimer->start();
+}
+
+void FileMonitor::check()
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+
+    QFileInfo info(m_filePath);
+    if (!info.exists()) {
+        emit fileRemoved(m_filePath);
+        return;
+    }
+
+    // Editors that save by renaming a new file over the old one make the
+    // watcher drop the path
+    if (!m_watcher->files().contains(m_filePath)) {
+        m_watcher->addPath(m_filePath);
+    }
+
+    // Our own saves and plain touches change nothing
+    if (!m_force && info.lastModified() == m_lastModified && info.size() == m_lastSize) {
+        return;
+    }
+
+    if (m_diffTask.isRunning()) {
+        m_changePending = true;
+        return;
+    }
+
+    if (!m_force && m_editor->document()->isModified()) {
+        updateStamp();
+        emit externallyModified(m_filePath);
+        return;
+    }
+
+    startDiff();
+}
+
+void FileMonitor::startDiff()
+{
+    QTextDocument *document = m_editor->document();
+
+    QVector<size_t> oldKeys;
+    oldKeys.reserve(document->blockCount());
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        oldKeys.append(blockKey(block, m_format != Qt::PlainText));
+    }
+
+    m_revision = document->revision();
+    updateStamp();
+
+    const QString filePath = m_filePath;
+    const Qt::TextFormat format = m_format;
+    m_diffTask = TaskExecutor::instance()->run(TaskExecutor::Interactive, this,
+        [filePath, format, oldKeys](const TaskExecutor::CancellationToken &) {
+            return computeDiff(filePath, format, oldKeys);
+        },
+        [this](const DiffResult &result) {
+            onDiffReady(result);
+        });
+}
+
+void FileMonitor::onDiffReady(const DiffResult &result)
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+
+    // The user typed while the diff was computed; start over
+    if (m_editor->document()->revision() != m_revision) {
+        m_lastSize = -1;
+        m_debounceTimer->start();
+        return;
+    }
+
+    if (!result.ok) {
+        qDebug() << "FileMonitor: could not read" << m_filePath;
+        return;
+    }
+
+    m_force = false;
+    applyHunks(result.hunks);
+
+    if (m_changePending) {
+        m_changePending = false;
+        m_debounceTimer->start();
+    }
+}
+
+void FileMonitor::applyHunks(const QList<Hunk> &hunks)
+{
+    QTextDocument *document = m_editor->document();
+    QScrollBar *scrollBar = m_editor->verticalScrollBar();
+    const bool followTail = scrollBar->value() == scrollBar->maximum();
+
+    int changedBlocks = 0;
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+
+    // Back to front, so block numbers of earlier hunks stay valid
+    for (int i = hunks.size() - 1; i >= 0; --i) {
+        const Hunk &hunk = hunks.at(i);
+        changedBlocks += hunk.oldCount > 0 ? hunk.oldCount : 1;
+
+        if (hunk.oldCount > 0) {
+            const QTextBlock first = document->findBlockByNumber(hunk.oldStart);
+            const QTextBlock last = document->findBlockByNumber(hunk.oldStart + hunk.oldCount - 1);
+            int start = first.position();
+            int end = last.position() + last.length() - 1;
+
+            // Blocks removed outright take one separator with them
+            if (hunk.newCount == 0) {
+                if (last.next().isValid()) {
+                    end = last.next().position();
+                } else if (first.previous().isValid()) {
+                    start = first.position() - 1;
+                }
+            }
+
+            cursor.setPosition(start);
+            cursor.setPosition(end, QTextCursor::KeepAnchor);
+        } else if (hunk.oldStart < document->blockCount()) {
+            cursor.setPosition(document->findBlockByNumber(hunk.oldStart).position());
+        } else {
+            cursor.movePosition(QTextCursor::End);
+        }
+
+        if (!hunk.fragment.isEmpty()) {
+            cursor.insertFragment(hunk.fragment);
+        } else if (!hunk.text.isEmpty()) {
+            cursor.insertText(hunk.text);
+        } else {
+            cursor.removeSelectedText();
+        }
+    }
+
+    cursor.endEditBlock();
+
+    // The document matches the file again
+    document->setModified(false);
+
+    if (followTail) {
+        scrollBar->setValue(scrollBar->maximum());
+    }
+
+    emit reloaded(changedBlocks);
+}
+
+void FileMonitor::updateStamp()
+{
+    QFileInfo info(m_filePath);
+    m_lastModified = info.lastModified();
+    m_lastSize = info.exists() ? info.size() : -1;
+}
+
+size_t FileMonitor::blockKey(const QTextBlock &block, bool richText)
+{
+    const size_t textHash = qHash(block.text());
+    if (!richText) {
+        return textHash;
+    }
+
+    // Same text with different formatting is a different block
+    QByteArray formats;
+    QDataStream out(&formats, QIODevice::WriteOnly);
+    out << block.blockFormat();
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        out << qint32(fragment.length()) << fragment.charFormat();
+    }
+    return qHash(formats, textHash);
+}
+
+FileMonitor::DiffResult FileMonitor::computeDiff(const QString &filePath, Qt::TextFormat format,
+                                                 const QVector<size_t> &oldKeys)
+{
+    DiffResult result;
+    const bool richText = format != Qt::PlainText;
+
+    QString content;
+    if (!TextImport::readFile(filePath, &content)) {
+        return result;
+    }
+
+    QVector<size_t> newKeys;
+    QStringList lines;
+    QTextDocument document;
+
+    if (richText) {
+        // Parsed the way the editor loaded it, so blocks compare as rendered
+        document.setUndoRedoEnabled(false);
+        if (format == Qt::MarkdownText) {
+            document.setMarkdown(content);
+        } else {
+            HtmlImport::importInto(&document, content);
+        }
+        newKeys.reserve(document.blockCount());
+        for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+            newKeys.append(blockKey(block, true));
+        }
+    } else {
+        lines = content.split(QLatin1Char('\n'));
+        newKeys.reserve(lines.size());
+        for (const QString &line : lines) {
+            newKeys.append(qHash(line));
+        }
+    }
+    content.clear();
+
+    const int oldCount = oldKeys.size();
+    int oldIndex = 0;
+    int newIndex = 0;
+
+    // Everything between two matched blocks becomes one hunk
+    auto addHunk = [&](int oldEnd, int newEnd) {
+        if (oldIndex == oldEnd && newIndex == newEnd) {
+            return;
+        }
+
+        Hunk hunk;
+        hunk.oldStart = oldIndex;
+        hunk.oldCount = oldEnd - oldIndex;
+        hunk.newCount = newEnd - newIndex;
+
+        if (hunk.newCount > 0) {
+            const bool insertion = hunk.oldCount == 0;
+            const bool atEnd = oldIndex == oldCount;
+
+            // Pure insertions carry the separator that joins them to their
+            // neighbour; an insertion at the end always follows a matched block
+            if (richText) {
+                const QTextBlock first = document.findBlockByNumber(newIndex);
+                const QTextBlock last = document.findBlockByNumber(newEnd - 1);
+                int start = first.position();
+                int end = last.position() + last.length() - 1;
+                if (insertion && !atEnd) {
+                    end = last.next().position();
+                } else if (insertion) {
+                    start = first.position() - 1;
+                }
+
+                QTextCursor cursor(&document);
+                cursor.setPosition(start);
+                cursor.setPosition(end, QTextCursor::KeepAnchor);
+                hunk.fragment = cursor.selection();
+            } else {
+                hunk.text = lines.mid(newIndex, hunk.newCount).join(QLatin1Char('\n'));
+                if (insertion) {
+                    hunk.text = atEnd ? QLatin1Char('\n') + hunk.text : hunk.text + QLatin1Char('\n');
+                }
+            }
+        }
+
+        result.hunks.append(hunk);
+    };
+
+    const QList<QPair<int, int>> matches = matchLines(oldKeys, newKeys);
+    for (const QPair<int, int> &match : matches) {
+        addHunk(match.first, match.second);
+        oldIndex = match.first + 1;
+        newIndex = match.second + 1;
+    }
+    addHunk(oldCount, newKeys.size());
+
+    result.ok = true;
+    return result;
+}
+
+QList<QPair<int, int>> FileMonitor::matchLines(const QVector<size_t> &oldKeys, const QVector<size_t> &newKeys)
+{
+    QList<QPair<int, int>> matches;
+    const int oldCount = oldKeys.size();
+    const int newCount = newKeys.size();
+
+    // Common prefix and suffix first; appending to a log ends here
+    int prefix = 0;
+    while (prefix < oldCount && prefix < newCount && oldKeys.at(prefix) == newKeys.at(prefix)) {
+        matches.append(qMakePair(prefix, prefix));
+        ++prefix;
+    }
+
+    int suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix
+           && oldKeys.at(oldCount - 1 - suffix) == newKeys.at(newCount - 1 - suffix)) {
+        ++suffix;
+    }
+
+    // Myers' O(ND) diff over what is left in between
+    const int n = oldCount - prefix - suffix;
+    const int m = newCount - prefix - suffix;
+    if (n > 0 && m > 0) {
+        const int maxDistance = qMin(n + m, int(MAX_EDIT_DISTANCE));
+        const int offset = maxDistance + 1;
+        QVector<int> v(2 * offset + 1, 0);
+        QVector<QVector<int>> trace;
+        int distance = -1;
+
+        for (int d = 0; d <= maxDistance && distance < 0; ++d) {
+            trace.append(v);
+            for (int k = -d; k <= d; k += 2) {
+                int x;
+                if (k == -d || (k != d && v.at(offset + k - 1) < v.at(offset + k + 1))) {
+                    x = v.at(offset + k + 1);
+                } else {
+                    x = v.at(offset + k - 1) + 1;
+                }
+                int y = x - k;
+                while (x < n && y < m && oldKeys.at(prefix + x) == newKeys.at(prefix + y)) {
+                    ++x;
+                    ++y;
+                }
+                v[offset + k] = x;
+                if (x >= n && y >= m) {
+                    distance = d;
+                    break;
+                }
+            }
+        }
+
+        // Past the distance limit nothing in the middle is matched and it is
+        // replaced as a whole
+        if (distance >= 0) {
+            QList<QPair<int, int>> middle;
+            int x = n;
+            int y = m;
+            for (int d = distance; d > 0; --d) {
+                const QVector<int> &previous = trace.at(d);
+                const int k = x - y;
+                const int previousK = (k == -d || (k != d && previous.at(offset + k - 1) < previous.at(offset + k + 1)))
+                                      ? k + 1 : k - 1;
+                const int previousX = previous.at(offset + previousK);
+                const int previousY = previousX - previousK;
+                while (x > previousX && y > previousY) {
+                    --x;
+                    --y;
+                    middle.append(qMakePair(prefix + x, prefix + y));
+                }
+                x = previousX;
+                y = previousY;
+            }
+            while (x > 0 && y > 0) {
+                --x;
+                --y;
+                middle.append(qMakePair(prefix + x, prefix + y));
+            }
+
+            std::reverse(middle.begin(), middle.end());
+            matches.append(middle);
+        }
+    }
+
+    for (int i = suffix; i > 0; --i) {
+        matches.append(qMakePair(oldCount - i, newCount - i));
+    }
+
+    return matches;
+}
@@ -0,0 +1,91 @@
+#ifndef FILEMONITOR_H
+#define FILEMONITOR_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QTextDocumentFragment>
+#include <QTimer>
+#include <QVector>
+
+#include "taskexecutor.h"
+
+class QTextEdit;
+class QTextBlock;
+class QFileSystemWatcher;
+
+// Notices when the open file is rewritten by another program and brings
+// the editor up to date without reopening it. The new file is read, parsed
+// and diffed against hashes of the current blocks on a worker thread; the
+// GUI thread then applies only the changed runs of blocks in one edit
+// block, so undo history, cursor and scroll position survive and a growing
+// log only gets its new tail appended. HTML and Markdown files are diffed
+// by their rendered blocks, in the same format the editor loaded them.
+class FileMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileMonitor(QTextEdit *editor, QObject *parent = nullptr);
+    ~FileMonitor();
+
+    // format is Qt::PlainText, Qt::RichText or Qt::MarkdownText
+    void watch(const QString &filePath, Qt::TextFormat format);
+    void unwatch();
+    QString filePath() const;
+
+public slots:
+    // Applies the file on disk even if the document has unsaved changes
+    void reload();
+
+signals:
+    // The file changed while the document had unsaved changes; nothing was applied
+    void externallyModified(const QString &filePath);
+    void fileRemoved(const QString &filePath);
+    void reloaded(int changedBlocks);
+
+private slots:
+    void onFileChanged(const QString &path);
+    void check();
+
+private:
+    struct Hunk {
+        int oldStart;
+        int oldCount;
+        int newCount;
+        QString text;                   // plain text documents
+        QTextDocumentFragment fragment; // rich text documents
+    };
+
+    struct DiffResult {
+        bool ok = false;
+        QList<Hunk> hunks;
+    };
+
+    void startDiff();
+    void onDiffReady(const DiffResult &result);
+    void applyHunks(const QList<Hunk> &hunks);
+    void updateStamp();
+
+    static size_t blockKey(const QTextBlock &block, bool richText);
+    static DiffResult computeDiff(const QString &filePath, Qt::TextFormat format, const QVector<size_t> &oldKeys);
+    static QList<QPair<int, int>> matchLines(const QVector<size_t> &oldKeys, const QVector<size_t> &newKeys);
+
+    QTextEdit *m_editor;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_debounceTimer;
+    TaskExecutor::Task m_diffTask;
+    QString m_filePath;
+    Qt::TextFormat m_format;
+    QDateTime m_lastModified;
+    qint64 m_lastSize;
+    int m_revision;       // document revision the running diff was based on
+    bool m_changePending; // another change arrived while diffing
+    bool m_force;
+
+    static const int DEBOUNCE_INTERVAL = 100; // ms, lets writers finish
+    static const int MAX_EDIT_DISTANCE = 1000; // beyond this the changed range is replaced whole
+};
+
+#endif // FILEMONITOR_H
@@ -0,0 +1,228 @@
+#include "formatcompactor.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextDocumentFragment>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextFragment>
+#include <QTextFrame>
+#include <QElapsedTimer>
+#include <QFont>
+#include <QPen>
+#include <QHash>
+#include <QUrl>
+#include <memory>
+
+namespace {
+
+// Rough per-entry costs of QTextFormatCollection: the shared private, the
+// hash slot and one property map node per property
+const int FORMAT_OVERHEAD = 96;
+const int PROPERTY_OVERHEAD = 48;
+
+bool isTransparent(const QBrush &brush)
+{
+    return brush.style() == Qt::NoBrush || (brush.style() == Qt::SolidPattern && brush.color().alpha() == 0);
+}
+
+// True when the property holds the value the document would use anyway
+bool isRedundant(const QTextCharFormat &format, int property, const QVariant &value, const QFont &defaultFont)
+{
+    switch (property) {
+    case QTextFormat::FontFamilies: {
+        const QStringList families = defaultFont.families().isEmpty()
+            ? QStringList() << defaultFont.family() : defaultFont.families();
+        return value.toStringList() == families;
+    }
+    case QTextFormat::FontPointSize:
+        return qFuzzyCompare(value.toReal(), defaultFont.pointSizeF());
+    case QTextFormat::FontWeight:
+        return value.toInt() == int(defaultFont.weight());
+    case QTextFormat::FontItalic:
+        return value.toBool() == defaultFont.italic();
+    case QTextFormat::FontUnderline:
+        return value.toBool() == defaultFont.underline();
+    case QTextFormat::TextUnderlineStyle:
+        return value.toInt() == QTextCharFormat::NoUnderline && !defaultFont.underline();
+    case QTextFormat::FontOverline:
+        return value.toBool() == defaultFont.overline();
+    case QTextFormat::FontStrikeOut:
+        return value.toBool() == defaultFont.strikeOut();
+    case QTextFormat::FontCapitalization:
+        return value.toInt() == QFont::MixedCase;
+    case QTextFormat::FontLetterSpacingType:
+        return value.toInt() == QFont::PercentageSpacing;
+    case QTextFormat::FontLetterSpacing:
+        return format.intProperty(QTextFormat::FontLetterSpacingType) == QFont::PercentageSpacing
+            && qFuzzyCompare(value.toReal(), 100.0);
+    case QTextFormat::FontWordSpacing:
+        return qFuzzyIsNull(value.toReal());
+    case QTextFormat::FontStretch:
+        return value.toInt() == 0 || value.toInt() == QFont::Unstretched;
+    case QTextFormat::FontKerning:
+        return value.toBool();
+    case QTextFormat::FontFixedPitch:
+        return !value.toBool();
+    case QTextFormat::FontStyleHint:
+        return value.toInt() == QFont::AnyStyle;
+    case QTextFormat::TextVerticalAlignment:
+        return value.toInt() == QTextCharFormat::AlignNormal;
+    case QTextFormat::BackgroundBrush:
+        return isTransparent(qvariant_cast<QBrush>(value));
+    case QTextFormat::TextOutline:
+        return qvariant_cast<QPen>(value).style() == Qt::NoPen;
+    case QTextFormat::IsAnchor:
+        return !value.toBool();
+    case QTextFormat::AnchorHref:
+    case QTextFormat::TextToolTip:
+        return value.toString().isEmpty();
+    case QTextFormat::AnchorName:
+        return value.toStringList().isEmpty();
+    default:
+        return false;
+    }
+}
+
+int countCharFormats(const QList<QTextFormat> &formats)
+{
+    int count = 0;
+    for (const QTextFormat &format : formats) {
+        if (format.isCharFormat()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Rewrites every fragment and block character format of a document that
+// has no layout, as one edit
+void normalizeDocument(QTextDocument *document)
+{
+    const QFont defaultFont = document->defaultFont();
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        const QTextCharFormat blockCharFormat = FormatCompactor::normalized(block.charFormat(), defaultFont);
+        if (!(blockCharFormat == block.charFormat())) {
+            cursor.setPosition(block.position());
+            cursor.setBlockCharFormat(blockCharFormat);
+        }
+
+        // Collected first: changing a format may merge fragments under the iterator
+        QList<QPair<int, int>> ranges;
+        QList<QTextCharFormat> formats;
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (!fragment.isValid()) {
+                continue;
+            }
+            const QTextCharFormat normal = FormatCompactor::normalized(fragment.charFormat(), defaultFont);
+            if (!(normal == fragment.charFormat())) {
+                ranges.append(qMakePair(fragment.position(), fragment.length()));
+                formats.append(normal);
+            }
+        }
+        for (int i = 0; i < ranges.size(); ++i) {
+            cursor.setPosition(ranges.at(i).first);
+            cursor.setPosition(ranges.at(i).first + ranges.at(i).second, QTextCursor::KeepAnchor);
+            cursor.setCharFormat(formats.at(i));
+        }
+    }
+
+    cursor.endEditBlock();
+}
+
+}
+
+FormatCompactor::Stats FormatCompactor::compact(QTextDocument *document)
+{
+    TRACE_SCOPE("FormatCompactor::compact");
+    QElapsedTimer timer;
+    timer.start();
+
+    Stats stats;
+    const QList<QTextFormat> before = document->allFormats();
+    stats.formatsBefore = countCharFormats(before);
+    stats.bytesBefore = estimateMemory(before);
+
+    // Normalize a copy, which has no layout to keep up to date
+    std::unique_ptr<QTextDocument> scratch(document->clone());
+    scratch->setUndoRedoEnabled(false);
+    normalizeDocument(scratch.get());
+    const QTextDocumentFragment normalized(scratch.get());
+    scratch.reset();
+
+    // Images kept as document resources do not survive clear()
+    QHash<QString, QVariant> images;
+    for (const QTextFormat &format : before) {
+        if (format.isImageFormat()) {
+            const QString name = format.toImageFormat().name();
+            const QVariant image = document->resource(QTextDocument::ImageResource, QUrl(name));
+            if (image.isValid()) {
+                images.insert(name, image);
+            }
+        }
+    }
+
+    // Nor do the page margins and other root frame properties
+    const QTextFrameFormat rootFrameFormat = document->rootFrame()->frameFormat();
+    const bool modified = document->isModified();
+    const bool undoRedo = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+    document->clear();
+    document->rootFrame()->setFrameFormat(rootFrameFormat);
+    for (auto it = images.constBegin(); it != images.constEnd(); ++it) {
+        document->addResource(QTextDocument::ImageResource, QUrl(it.key()), it.value());
+    }
+    QTextCursor cursor(document);
+    cursor.insertFragment(normalized);
+    document->setUndoRedoEnabled(undoRedo);
+    document->setModified(modified);
+
+    const QList<QTextFormat> after = document->allFormats();
+    stats.formatsAfter = countCharFormats(after);
+    stats.bytesAfter = estimateMemory(after);
+    stats.msecs = timer.elapsed();
+
+    TRACE_COUNTER("formats", stats.formatsAfter);
+    return stats;
+}
+
+bool FormatCompactor::isWorthCompacting(const QTextDocument *document)
+{
+    return countCharFormats(document->allFormats()) > COMPACT_HINT_THRESHOLD;
+}
+
+QTextCharFormat FormatCompactor::normalized(const QTextCharFormat &format, const QFont &defaultFont)
+{
+    QTextCharFormat result = format;
+    const QMap<int, QVariant> properties = format.properties();
+    for (auto it = properties.constBegin(); it != properties.constEnd(); ++it) {
+        if (isRedundant(format, it.key(), it.value(), defaultFont)) {
+            result.clearProperty(it.key());
+        }
+    }
+    return result;
+}
+
+qint64 FormatCompactor::estimateMemory(const QList<QTextFormat> &formats)
+{
+    qint64 bytes = 0;
+    for (const QTextFormat &format : formats) {
+        bytes += FORMAT_OVERHEAD;
+        const QMap<int, QVariant> properties = format.properties();
+        for (auto it = properties.constBegin(); it != properties.constEnd(); ++it) {
+            bytes += PROPERTY_OVERHEAD;
+            if (it.value().typeId() == QMetaType::QString) {
+                bytes += it.value().toString().size() * sizeof(QChar);
+            } else if (it.value().typeId() == QMetaType::QStringList) {
+                for (const QString &string : it.value().toStringList()) {
+                    bytes += string.size() * sizeof(QChar) + sizeof(QString);
+                }
+            }
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,40 @@
+#ifndef FORMATCOMPACTOR_H
+#define FORMATCOMPACTOR_H
+
+#include <QList>
+#include <QTextCharFormat>
+
+class QTextDocument;
+class QFont;
+
+// Shrinks a document's format table. HTML import leaves many character
+// formats that differ only in properties set to their default value (normal
+// weight, no underline, the document's own font size...). Those properties
+// are dropped, so equivalent formats become identical and share one entry.
+//
+// QTextDocument never removes formats from its table, so the document is
+// rebuilt from a normalized copy; only formats still in use are carried
+// over. The rebuild relayouts the whole document and clears the undo
+// history, so it only runs when the user asks for it.
+class FormatCompactor
+{
+public:
+    struct Stats {
+        int formatsBefore = 0; // character formats only
+        int formatsAfter = 0;
+        qint64 bytesBefore = 0; // estimated
+        qint64 bytesAfter = 0;
+        qint64 msecs = 0;
+    };
+
+    static Stats compact(QTextDocument *document);
+    // Enough character formats that compacting is worth suggesting
+    static bool isWorthCompacting(const QTextDocument *document);
+
+    static QTextCharFormat normalized(const QTextCharFormat &format, const QFont &defaultFont);
+    static qint64 estimateMemory(const QList<QTextFormat> &formats);
+
+    static const int COMPACT_HINT_THRESHOLD = 512; // character formats
+};
+
+#endif // FORMATCOMPACTOR_H
@@ -0,0 +1,678 @@
+#include "htmlimport.h"
+#include "progressiveloader.h"
+#include "stylemanager.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextEdit>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QSet>
+#include <QVarLengthArray>
+
+namespace {
+
+// Dropped together with everything inside them
+bool isDroppedWithContent(const QString &name)
+{
+    static const QSet<QString> names = {
+        "script", "noscript", "iframe", "object", "applet", "svg", "math",
+        "canvas", "template", "audio", "video", "select", "textarea"
+    };
+    return names.contains(name);
+}
+
+// Dropped, but their content is kept
+bool isDroppedTag(const QString &name)
+{
+    static const QSet<QString> names = {
+        "meta", "link", "base", "embed", "source", "track", "param", "input",
+        "button", "form", "label", "option", "wbr", "o:p", "xml"
+    };
+    return names.contains(name);
+}
+
+bool isSupportedAttribute(const QString &name)
+{
+    static const QSet<QString> names = {
+        "href", "name", "id", "class", "style", "src", "alt", "title", "width",
+        "height", "align", "valign", "bgcolor", "color", "face", "size", "colspan",
+        "rowspan", "cellpadding", "cellspacing", "border", "type", "start", "value", "dir"
+    };
+    return names.contains(name);
+}
+
+// CSS properties Qt's rich text engine honours, including everything
+// QTextHtmlExporter writes, so documents saved by Qt come back unchanged
+bool isSupportedProperty(const QString &name)
+{
+    static const QSet<QString> names = {
+        "color", "background", "background-color", "background-image", "font", "font-family",
+        "font-size", "font-style", "font-weight", "font-variant", "font-kerning", "text-decoration",
+        "text-align", "text-indent", "text-transform", "vertical-align", "white-space", "direction",
+        "margin", "margin-top", "margin-bottom", "margin-left", "margin-right",
+        "padding", "padding-top", "padding-bottom", "padding-left", "padding-right",
+        "border", "border-width", "border-style", "border-color", "border-collapse",
+        "border-top", "border-top-width", "border-top-style", "border-top-color",
+        "border-bottom", "border-bottom-width", "border-bottom-style", "border-bottom-color",
+        "border-left", "border-left-width", "border-left-style", "border-left-color",
+        "border-right", "border-right-width", "border-right-style", "border-right-color",
+        "width", "height", "line-height", "letter-spacing", "word-spacing", "float",
+        "list-style", "list-style-type", "page-break-before", "page-break-after",
+        "-qt-block-indent", "-qt-paragraph-type", "-qt-list-indent", "-qt-user-state",
+        "-qt-line-height-type", "-qt-list-number-prefix", "-qt-list-number-suffix",
+        "-qt-table-type", "-qt-fg-texture-cachekey", "-qt-stroke-color", "-qt-stroke-width",
+        "-qt-stroke-dasharray", "-qt-stroke-dashoffset", "-qt-stroke-joinstyle",
+        "-qt-stroke-linecap", "-qt-stroke-miterlimit",
+        "-cppword-paragraph-style", "-cppword-character-style"
+    };
+    return names.contains(name);
+}
+
+// Index of the '>' closing the tag that starts at lt, skipping quoted values
+qsizetype tagEnd(QStringView html, qsizetype lt)
+{
+    QChar quote;
+    for (qsizetype i = lt + 1; i < html.size(); ++i) {
+        const QChar c = html.at(i);
+        if (!quote.isNull()) {
+            if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == QLatin1Char('"') || c == QLatin1Char('\'')) {
+            quote = c;
+        } else if (c == QLatin1Char('>')) {
+            return i;
+        }
+    }
+    return html.size() - 1;
+}
+
+// Position after the end tag of an element whose content starts at from
+qsizetype skipElement(QStringView html, qsizetype from, const QString &name)
+{
+    const qsizetype end = html.indexOf(QString(QLatin1String("</") + name), from, Qt::CaseInsensitive);
+    if (end < 0) {
+        return html.size();
+    }
+    return tagEnd(html, end) + 1;
+}
+
+bool isNameChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char(':') || c == QLatin1Char('-') || c == QLatin1Char('_');
+}
+
+// Starts each style reference in a title: 'P' or 'C' and the style's name
+const QChar REFERENCE_MARK(0xE000);
+
+// Elements HtmlWriter writes paragraphs as
+bool isParagraph(const QString &name)
+{
+    static const QSet<QString> names = {
+        "p", "li", "pre", "h1", "h2", "h3", "h4", "h5", "h6"
+    };
+    return names.contains(name);
+}
+
+bool isHexDigit(QChar c)
+{
+    return (c >= QLatin1Char('0') && c <= QLatin1Char('9')) || (c >= QLatin1Char('a') && c <= QLatin1Char('f'))
+        || (c >= QLatin1Char('A') && c <= QLatin1Char('F'));
+}
+
+// A CSS string or identifier with its quotes and escapes removed
+QString cssString(QStringView value)
+{
+    value = value.trimmed();
+    QChar quote;
+    if (!value.isEmpty() && (value.front() == QLatin1Char('"') || value.front() == QLatin1Char('\''))) {
+        quote = value.front();
+        value = value.mid(1);
+    }
+
+    QString out;
+    for (qsizetype i = 0; i < value.size(); ++i) {
+        const QChar c = value.at(i);
+        if (c == quote) {
+            break;
+        }
+        if (c != QLatin1Char('\\') || i + 1 == value.size()) {
+            out.append(c);
+            continue;
+        }
+        // Up to six hex digits and an optional space, or the next character
+        qsizetype end = i + 1;
+        while (end < value.size() && end - i <= 6 && isHexDigit(value.at(end))) {
+            ++end;
+        }
+        if (end == i + 1) {
+            out.append(value.at(++i));
+            continue;
+        }
+        const char32_t code = value.mid(i + 1, end - i - 1).toUInt(nullptr, 16);
+        out.append(QString::fromUcs4(&code, 1));
+        if (end < value.size() && value.at(end) == QLatin1Char(' ')) {
+            ++end;
+        }
+        i = end - 1;
+    }
+    return out;
+}
+
+// The style references among CSS declarations, as title markers
+QString referenceMarkers(QStringView declarations)
+{
+    QString markers;
+    if (!declarations.contains(QLatin1String("-cppword-"), Qt::CaseInsensitive)) {
+        return markers;
+    }
+    for (QStringView declaration : declarations.split(QLatin1Char(';'))) {
+        const qsizetype colon = declaration.indexOf(QLatin1Char(':'));
+        if (colon <= 0) {
+            continue;
+        }
+        const QStringView property = declaration.left(colon).trimmed();
+        QChar kind;
+        if (property.compare(QLatin1String("-cppword-paragraph-style"), Qt::CaseInsensitive) == 0) {
+            kind = QLatin1Char('P');
+        } else if (property.compare(QLatin1String("-cppword-character-style"), Qt::CaseInsensitive) == 0) {
+            kind = QLatin1Char('C');
+        } else {
+            continue;
+        }
+        const QString name = cssString(declaration.mid(colon + 1));
+        if (!name.isEmpty()) {
+            markers += REFERENCE_MARK;
+            markers += kind;
+            markers += name;
+        }
+    }
+    return markers;
+}
+
+// Adds the markers of a style sheet's class rules, by class name
+void collectStyleReferences(QStringView css, QHash<QString, QString> *references)
+{
+    if (!css.contains(QLatin1String("-cppword-"), Qt::CaseInsensitive)) {
+        return;
+    }
+    qsizetype pos = 0;
+    while (pos < css.size()) {
+        const qsizetype open = css.indexOf(QLatin1Char('{'), pos);
+        if (open < 0) {
+            break;
+        }
+        const qsizetype close = css.indexOf(QLatin1Char('}'), open);
+        const qsizetype bodyEnd = close < 0 ? css.size() : close;
+        const QString markers = referenceMarkers(css.mid(open + 1, bodyEnd - open - 1));
+        if (!markers.isEmpty()) {
+            for (QStringView selector : css.mid(pos, open - pos).split(QLatin1Char(','))) {
+                selector = selector.trimmed();
+                if (selector.startsWith(QLatin1Char('.'))) {
+                    (*references)[selector.mid(1).toString()] += markers;
+                }
+            }
+        }
+        pos = bodyEnd + 1;
+    }
+}
+
+// Moves the references in a title into format properties; the paragraph
+// style goes to paragraphStyle
+bool takeReferences(QTextCharFormat *format, QString *paragraphStyle)
+{
+    const QString title = format->toolTip();
+    if (!title.startsWith(REFERENCE_MARK)) {
+        return false;
+    }
+    for (QStringView marker : QStringView(title).split(REFERENCE_MARK, Qt::SkipEmptyParts)) {
+        if (marker.startsWith(QLatin1Char('P'))) {
+            *paragraphStyle = marker.mid(1).toString();
+        } else if (marker.startsWith(QLatin1Char('C'))) {
+            format->setProperty(StyleManager::CHARACTER_STYLE_PROPERTY, marker.mid(1).toString());
+        }
+    }
+    format->clearProperty(QTextFormat::TextToolTip);
+    return true;
+}
+
+}
+
+QString HtmlImport::sanitize(QStringView html)
+{
+    QHash<QString, QString> references;
+    return sanitize(html, &references);
+}
+
+QString HtmlImport::sanitize(QStringView html, QHash<QString, QString> *references)
+{
+    QString out;
+    out.reserve(html.size());
+
+    // One entry per open span: true when its tags were dropped
+    QVarLengthArray<bool, 32> spans;
+    // Markers of the open paragraph, which its spans repeat as their titles
+    // replace the paragraph's
+    QString paragraphMarkers;
+
+    const qsizetype size = html.size();
+    qsizetype pos = 0;
+    while (pos < size) {
+        const qsizetype lt = html.indexOf(QLatin1Char('<'), pos);
+        if (lt < 0) {
+            out.append(html.mid(pos));
+            break;
+        }
+        out.append(html.mid(pos, lt - pos));
+
+        if (html.mid(lt, 4) == QLatin1String("<!--")) {
+            const qsizetype end = html.indexOf(QLatin1String("-->"), lt + 4);
+            pos = end < 0 ? size : end + 3;
+            continue;
+        }
+
+        // Doctype, CDATA and processing instructions
+        if (lt + 1 < size && (html.at(lt + 1) == QLatin1Char('!') || html.at(lt + 1) == QLatin1Char('?'))) {
+            pos = tagEnd(html, lt) + 1;
+            continue;
+        }
+
+        const bool closing = lt + 1 < size && html.at(lt + 1) == QLatin1Char('/');
+        const qsizetype nameStart = lt + (closing ? 2 : 1);
+        qsizetype nameEnd = nameStart;
+        while (nameEnd < size && isNameChar(html.at(nameEnd))) {
+            ++nameEnd;
+        }
+        if (nameEnd == nameStart) {
+            // A lone '<' in text
+            out.append(QLatin1String("&lt;"));
+            pos = lt + 1;
+            continue;
+        }
+
+        const qsizetype gt = tagEnd(html, lt);
+        const QString name = html.mid(nameStart, nameEnd - nameStart).toString().toLower();
+        pos = gt + 1;
+
+        if (isDroppedWithContent(name)) {
+            if (!closing) {
+                pos = skipElement(html, pos, name);
+            }
+            continue;
+        }
+        if (isDroppedTag(name)) {
+            // Qt's marker for its own rich text, which changes how the
+            // parser treats whitespace
+            if (name == QLatin1String("meta") && !closing
+                && html.mid(nameEnd, gt - nameEnd).contains(QLatin1String("qrichtext"), Qt::CaseInsensitive)) {
+                out.append(QLatin1String("<meta name=\"qrichtext\" content=\"1\" />"));
+            }
+            continue;
+        }
+
+        if (name == QLatin1String("style")) {
+            if (!closing) {
+                const qsizetype end = html.indexOf(QLatin1String("</style"), pos, Qt::CaseInsensitive);
+                const qsizetype contentEnd = end < 0 ? size : end;
+                const QString css = sanitizeStyleSheet(html.mid(pos, contentEnd - pos));
+                collectStyleReferences(css, references);
+                out.append(QLatin1String("<style>"));
+                out.append(css);
+                out.append(QLatin1String("</style>"));
+                pos = end < 0 ? size : tagEnd(html, end) + 1;
+            }
+            continue;
+        }
+
+        if (closing) {
+            if (isParagraph(name)) {
+                paragraphMarkers.clear();
+            }
+            if (name == QLatin1String("span")) {
+                const bool dropped = !spans.isEmpty() && spans.last();
+                if (!spans.isEmpty()) {
+                    spans.removeLast();
+                }
+                if (dropped) {
+                    continue;
+                }
+            }
+            out.append(QLatin1String("</"));
+            out.append(name);
+            out.append(QLatin1Char('>'));
+            continue;
+        }
+
+        qsizetype attributesEnd = gt;
+        const bool selfClosing = gt > nameEnd && html.at(gt - 1) == QLatin1Char('/');
+        if (selfClosing) {
+            --attributesEnd;
+        }
+        QString markers;
+        const QString attributes = sanitizeAttributes(html.mid(nameEnd, attributesEnd - nameEnd), *references,
+                                                      &markers);
+        if (isParagraph(name)) {
+            paragraphMarkers = markers;
+        } else if (name == QLatin1String("span") && !markers.isEmpty()) {
+            markers.prepend(paragraphMarkers);
+        } else {
+            markers.clear();
+        }
+
+        // Spans that no longer carry formatting only cost the parser time
+        if (name == QLatin1String("span") && !selfClosing) {
+            const bool dropped = attributes.isEmpty() && markers.isEmpty();
+            spans.append(dropped);
+            if (dropped) {
+                continue;
+            }
+        }
+
+        out.append(QLatin1Char('<'));
+        out.append(name);
+        out.append(attributes);
+        if (!markers.isEmpty()) {
+            markers.replace(QLatin1Char('&'), QLatin1String("&amp;"));
+            markers.replace(QLatin1Char('<'), QLatin1String("&lt;"));
+            markers.replace(QLatin1Char('"'), QLatin1String("&quot;"));
+            out.append(QLatin1String(" title=\""));
+            out.append(markers);
+            out.append(QLatin1Char('"'));
+        }
+        out.append(selfClosing ? QLatin1String(" />") : QLatin1String(">"));
+    }
+
+    return out;
+}
+
+QString HtmlImport::sanitizeStyleSheet(QStringView css)
+{
+    QString out;
+    out.reserve(css.size());
+
+    qsizetype pos = 0;
+    while (pos < css.size()) {
+        const QChar c = css.at(pos);
+
+        if (c == QLatin1Char('/') && pos + 1 < css.size() && css.at(pos + 1) == QLatin1Char('*')) {
+            const qsizetype end = css.indexOf(QLatin1String("*/"), pos + 2);
+            pos = end < 0 ? css.size() : end + 2;
+            continue;
+        }
+
+        // At-rules (@media, @font-face, @import...) are not supported
+        if (c == QLatin1Char('@')) {
+            qsizetype i = pos;
+            while (i < css.size() && css.at(i) != QLatin1Char('{') && css.at(i) != QLatin1Char(';')) {
+                ++i;
+            }
+            if (i < css.size() && css.at(i) == QLatin1Char('{')) {
+                int depth = 0;
+                for (; i < css.size(); ++i) {
+                    if (css.at(i) == QLatin1Char('{')) {
+                        ++depth;
+                    } else if (css.at(i) == QLatin1Char('}') && --depth == 0) {
+                        break;
+                    }
+                }
+            }
+            pos = i + 1;
+            continue;
+        }
+
+        out.append(c);
+        ++pos;
+    }
+
+    return out;
+}
+
+QString HtmlImport::sanitizeAttributes(QStringView attributes, const QHash<QString, QString> &references,
+                                       QString *markers)
+{
+    QString out;
+    // Written last, unless a style reference takes its place
+    QString title;
+    const qsizetype size = attributes.size();
+    qsizetype pos = 0;
+
+    while (pos < size) {
+        while (pos < size && (attributes.at(pos).isSpace() || attributes.at(pos) == QLatin1Char('/'))) {
+            ++pos;
+        }
+        const qsizetype nameStart = pos;
+        while (pos < size && !attributes.at(pos).isSpace() && attributes.at(pos) != QLatin1Char('=')) {
+            ++pos;
+        }
+        if (pos == nameStart) {
+            break;
+        }
+        const QString name = attributes.mid(nameStart, pos - nameStart).toString().toLower();
+
+        while (pos < size && attributes.at(pos).isSpace()) {
+            ++pos;
+        }
+        QStringView value;
+        bool hasValue = false;
+        if (pos < size && attributes.at(pos) == QLatin1Char('=')) {
+            hasValue = true;
+            ++pos;
+            while (pos < size && attributes.at(pos).isSpace()) {
+                ++pos;
+            }
+            if (pos < size && (attributes.at(pos) == QLatin1Char('"') || attributes.at(pos) == QLatin1Char('\''))) {
+                const QChar quote = attributes.at(pos);
+                const qsizetype end = attributes.indexOf(quote, pos + 1);
+                const qsizetype valueEnd = end < 0 ? size : end;
+                value = attributes.mid(pos + 1, valueEnd - pos - 1);
+                pos = valueEnd + 1;
+            } else {
+                const qsizetype valueStart = pos;
+                while (pos < size && !attributes.at(pos).isSpace()) {
+                    ++pos;
+                }
+                value = attributes.mid(valueStart, pos - valueStart);
+            }
+        }
+
+        if (!isSupportedAttribute(name)) {
+            continue;
+        }
+
+        QString cleanValue = value.toString();
+        if (name == QLatin1String("style")) {
+            cleanValue = sanitizeStyle(value);
+            if (cleanValue.isEmpty()) {
+                continue;
+            }
+            *markers += referenceMarkers(cleanValue);
+        } else if (name == QLatin1String("class") && !references.isEmpty()) {
+            for (QStringView className : value.split(QLatin1Char(' '), Qt::SkipEmptyParts)) {
+                *markers += references.value(className.toString());
+            }
+        } else if ((name == QLatin1String("href") || name == QLatin1String("src"))
+                   && value.trimmed().startsWith(QLatin1String("javascript:"), Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        QString &target = name == QLatin1String("title") ? title : out;
+        target.append(QLatin1Char(' '));
+        target.append(name);
+        if (hasValue) {
+            cleanValue.replace(QLatin1Char('"'), QLatin1String("&quot;"));
+            target.append(QLatin1String("=\""));
+            target.append(cleanValue);
+            target.append(QLatin1Char('"'));
+        }
+    }
+
+    if (markers->isEmpty()) {
+        out.append(title);
+    }
+    return out;
+}
+
+QString HtmlImport::sanitizeStyle(QStringView style)
+{
+    QString out;
+    for (QStringView declaration : style.split(QLatin1Char(';'))) {
+        const qsizetype colon = declaration.indexOf(QLatin1Char(':'));
+        if (colon <= 0) {
+            continue;
+        }
+        const QString property = declaration.left(colon).trimmed().toString().toLower();
+        const QStringView value = declaration.mid(colon + 1).trimmed();
+        if (value.isEmpty() || !isSupportedProperty(property)
+            || value.contains(QLatin1String("expression("), Qt::CaseInsensitive)
+            || value.contains(QLatin1String("javascript:"), Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        if (!out.isEmpty()) {
+            out.append(QLatin1String("; "));
+        }
+        out.append(property);
+        out.append(QLatin1String(": "));
+        out.append(value);
+    }
+    return out;
+}
+
+QList<QFuture<QTextDocumentFragment>> HtmlImport::parseChunks(const QStringList &chunks, const QString &styleSheets,
+                                                              const TaskExecutor::CancellationToken &token)
+{
+    // The chunks need the style references of the head's class rules
+    QHash<QString, QString> references;
+    sanitize(styleSheets, &references);
+
+    QList<QFuture<QTextDocumentFragment>> fragments;
+    fragments.reserve(chunks.size());
+    for (const QString &chunk : chunks) {
+        fragments.append(TaskExecutor::instance()->submit(TaskExecutor::Interactive, token,
+            [styleSheets, references, chunk](const TaskExecutor::CancellationToken &) {
+                TRACE_SCOPE("HtmlImport::parseChunk");
+                QHash<QString, QString> chunkReferences = references;
+                return QTextDocumentFragment::fromHtml(styleSheets + sanitize(chunk, &chunkReferences));
+            }));
+    }
+    return fragments;
+}
+
+QList<QTextDocumentFragment> HtmlImport::parseFragments(const QString &html, QString *head)
+{
+    TRACE_SCOPE("HtmlImport::parseFragments");
+
+    QString rawHead;
+    const QStringList chunks = ProgressiveLoader::splitHtml(html, CHUNK_SIZE, &rawHead);
+    const QString cleanHead = sanitize(rawHead);
+    if (head) {
+        *head = cleanHead;
+    }
+
+    // Waiting from a worker runs chunks not started yet on that worker
+    QList<QTextDocumentFragment> fragments;
+    fragments.reserve(chunks.size());
+    for (const QFuture<QTextDocumentFragment> &fragment :
+         parseChunks(chunks, ProgressiveLoader::extractStyleSheets(cleanHead))) {
+        fragments.append(fragment.result());
+    }
+    return fragments;
+}
+
+void HtmlImport::importInto(QTextDocument *document, const QString &html)
+{
+    TRACE_SCOPE("HtmlImport::importInto");
+
+    QString head;
+    const QList<QTextDocumentFragment> fragments = parseFragments(html, &head);
+
+    const bool undoRedo = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+
+    // The head carries the document's own settings, such as its default style sheet
+    document->setHtml(head);
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (int i = 0; i < fragments.size(); ++i) {
+        if (i > 0) {
+            cursor.insertBlock(QTextBlockFormat(), QTextCharFormat());
+        }
+        cursor.insertFragment(fragments.at(i));
+    }
+    resolveStyleReferences(document);
+    cursor.endEditBlock();
+
+    document->setUndoRedoEnabled(undoRedo);
+}
+
+void HtmlImport::setHtml(QTextEdit *editor, const QString &html)
+{
+    QTextDocument *document = editor->document();
+    editor->setHtml(html);
+
+    const bool undoRedo = document->isUndoRedoEnabled();
+    const bool modified = document->isModified();
+    document->setUndoRedoEnabled(false);
+    resolveStyleReferences(document);
+    document->setUndoRedoEnabled(undoRedo);
+    document->setModified(modified);
+}
+
+void HtmlImport::resolveStyleReferences(QTextDocument *document, int from, int to)
+{
+    TRACE_SCOPE("HtmlImport::resolveStyleReferences");
+    if (to < 0) {
+        to = document->characterCount() - 1;
+    }
+
+    // Collected first: changing formats while walking splits fragments
+    struct Resolved {
+        int position;
+        int length;                 // 0 for a paragraph's own formats
+        QTextCharFormat charFormat;
+        bool hasCharFormat;
+        QString paragraphStyle;
+    };
+    QList<Resolved> resolved;
+    for (QTextBlock block = document->findBlock(from); block.isValid() && block.position() <= to;
+         block = block.next()) {
+        QString paragraphStyle;
+        QTextCharFormat blockCharFormat = block.charFormat();
+        const bool blockMarked = takeReferences(&blockCharFormat, &paragraphStyle);
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            QTextCharFormat format = fragment.charFormat();
+            if (fragment.isValid() && takeReferences(&format, &paragraphStyle)) {
+                resolved.append({fragment.position(), fragment.length(), format, true, QString()});
+            }
+        }
+        if (blockMarked || !paragraphStyle.isEmpty()) {
+            resolved.append({block.position(), 0, blockCharFormat, blockMarked, paragraphStyle});
+        }
+    }
+    if (resolved.isEmpty()) {
+        return;
+    }
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (const Resolved &reference : std::as_const(resolved)) {
+        cursor.setPosition(reference.position);
+        if (reference.length > 0) {
+            cursor.setPosition(reference.position + reference.length, QTextCursor::KeepAnchor);
+            cursor.setCharFormat(reference.charFormat);
+            continue;
+        }
+        if (reference.hasCharFormat) {
+            cursor.setBlockCharFormat(reference.charFormat);
+        }
+        if (!reference.paragraphStyle.isEmpty()) {
+            QTextBlockFormat format = cursor.blockFormat();
+            format.setProperty(StyleManager::PARAGRAPH_STYLE_PROPERTY, reference.paragraphStyle);
+            cursor.setBlockFormat(format);
+        }
+    }
+    cursor.endEditBlock();
+}
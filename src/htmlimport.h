@@ -0,0 +1,62 @@
+#ifndef HTMLIMPORT_H
+#define HTMLIMPORT_H
+
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTextDocumentFragment>
+
+#include "taskexecutor.h"
+
+class QTextDocument;
+class QTextEdit;
+
+// HTML import shared by opening, recovery and paste. Markup is cleaned up in
+// one streaming pass: scripts, embedded objects, comments and elements Qt
+// cannot show are dropped, attributes are reduced to the ones rich text
+// understands, inline CSS keeps only supported properties, and spans left
+// without attributes are unwrapped. Large documents are split at top-level
+// block boundaries and the chunks are cleaned and parsed in parallel as
+// TaskExecutor tasks; the resulting fragments are spliced in order.
+//
+// Qt's parser drops CSS it does not know, so the named style references
+// HtmlWriter keeps in class rules are carried through it as the title of
+// the paragraph or span using the class. resolveStyleReferences() turns
+// them back into StyleManager's format properties once the text is in a
+// document; every path that inserts sanitized markup calls it.
+class HtmlImport
+{
+public:
+    static QString sanitize(QStringView html);
+    static QString sanitizeStyleSheet(QStringView css);
+
+    // Cleans and parses body chunks in parallel, one task per chunk in chunk
+    // order; cancelling token skips the chunks not started yet
+    static QList<QFuture<QTextDocumentFragment>> parseChunks(
+        const QStringList &chunks, const QString &styleSheets,
+        const TaskExecutor::CancellationToken &token = TaskExecutor::CancellationToken());
+    // Blocking variant for a whole document; the cleaned head is returned
+    // through head when given
+    static QList<QTextDocumentFragment> parseFragments(const QString &html, QString *head = nullptr);
+    // Replaces the contents of a document, like QTextDocument::setHtml
+    static void importInto(QTextDocument *document, const QString &html);
+    // QTextEdit::setHtml for sanitized markup; resolving the references is
+    // part of loading, so it is neither an undo step nor a modification
+    static void setHtml(QTextEdit *editor, const QString &html);
+    // Resolves the style references sanitize() left in [from, to], -1 for
+    // the end of the document, as one edit block
+    static void resolveStyleReferences(QTextDocument *document, int from = 0, int to = -1);
+
+    static const int CHUNK_SIZE = 64 * 1024;
+
+private:
+    // Style references are looked up in and added to references, by class
+    static QString sanitize(QStringView html, QHash<QString, QString> *references);
+    static QString sanitizeAttributes(QStringView attributes, const QHash<QString, QString> &references,
+                                      QString *markers);
+    static QString sanitizeStyle(QStringView style);
+};
+
+#endif // HTMLIMPORT_H
@@ -0,0 +1,685 @@
+#include "htmlwriter.h"
+#include "stylemanager.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextFrame>
+#include <QTextTable>
+#include <QTextBlock>
+#include <QTextList>
+#include <QTextFragment>
+#include <QTextStream>
+#include <QSaveFile>
+#include <QCoreApplication>
+
+namespace {
+
+QString escaped(QStringView text)
+{
+    QString result;
+    result.reserve(text.size() + text.size() / 8);
+    for (const QChar c : text) {
+        switch (c.unicode()) {
+        case '<':
+            result += QLatin1String("&lt;");
+            break;
+        case '>':
+            result += QLatin1String("&gt;");
+            break;
+        case '&':
+            result += QLatin1String("&amp;");
+            break;
+        case '"':
+            result += QLatin1String("&quot;");
+            break;
+        case QChar::LineSeparator:
+            result += QLatin1String("<br />");
+            break;
+        default:
+            result += c;
+            break;
+        }
+    }
+    return result;
+}
+
+QString fontFamilies(const QStringList &families)
+{
+    QStringList quoted;
+    for (const QString &family : families) {
+        quoted << QLatin1Char('\'') + family + QLatin1Char('\'');
+    }
+    return quoted.join(QLatin1Char(','));
+}
+
+// A named style reference as a declaration of its own, which other readers
+// ignore. Characters that could end the value, the rule or the style
+// element early are written as CSS escapes.
+QString styleReference(const char *property, const QString &name)
+{
+    QString value;
+    for (const QChar c : name) {
+        if (c == QLatin1Char('"') || c == QLatin1Char('\\') || c == QLatin1Char(';') || c == QLatin1Char('<')
+            || c == QLatin1Char('>') || c == QLatin1Char('{') || c == QLatin1Char('}') || c.unicode() < 0x20) {
+            value += QStringLiteral("\\%1 ").arg(c.unicode(), 0, 16);
+        } else {
+            value += c;
+        }
+    }
+    return QStringLiteral("%1:\"%2\"; ").arg(QLatin1String(property), value);
+}
+
+QString charCss(const QTextCharFormat &format)
+{
+    QString css;
+    if (format.hasProperty(StyleManager::CHARACTER_STYLE_PROPERTY)) {
+        css += styleReference("-cppword-character-style",
+                              format.stringProperty(StyleManager::CHARACTER_STYLE_PROPERTY));
+    }
+    const QStringList families = format.property(QTextFormat::FontFamilies).toStringList();
+    if (!families.isEmpty()) {
+        css += QStringLiteral("font-family:%1; ").arg(fontFamilies(families));
+    }
+    if (format.hasProperty(QTextFormat::FontPointSize)) {
+        css += QStringLiteral("font-size:%1pt; ").arg(format.fontPointSize());
+    } else if (format.hasProperty(QTextFormat::FontPixelSize)) {
+        css += QStringLiteral("font-size:%1px; ").arg(format.intProperty(QTextFormat::FontPixelSize));
+    }
+    if (format.hasProperty(QTextFormat::FontWeight)) {
+        css += QStringLiteral("font-weight:%1; ").arg(format.fontWeight());
+    }
+    if (format.hasProperty(QTextFormat::FontItalic)) {
+        css += format.fontItalic() ? QStringLiteral("font-style:italic; ") : QStringLiteral("font-style:normal; ");
+    }
+    if (format.hasProperty(QTextFormat::FontUnderline) || format.hasProperty(QTextFormat::TextUnderlineStyle)
+        || format.hasProperty(QTextFormat::FontOverline) || format.hasProperty(QTextFormat::FontStrikeOut)) {
+        QStringList decorations;
+        if (format.fontUnderline()) {
+            decorations << QStringLiteral("underline");
+        }
+        if (format.fontOverline()) {
+            decorations << QStringLiteral("overline");
+        }
+        if (format.fontStrikeOut()) {
+            decorations << QStringLiteral("line-through");
+        }
+        css += QStringLiteral("text-decoration:%1; ")
+            .arg(decorations.isEmpty() ? QStringLiteral("none") : decorations.join(QLatin1Char(' ')));
+    }
+    if (format.hasProperty(QTextFormat::ForegroundBrush) && format.foreground().style() != Qt::NoBrush) {
+        css += QStringLiteral("color:%1; ").arg(format.foreground().color().name());
+    }
+    if (format.hasProperty(QTextFormat::BackgroundBrush) && format.background().style() != Qt::NoBrush) {
+        css += QStringLiteral("background-color:%1; ").arg(format.background().color().name());
+    }
+    switch (format.verticalAlignment()) {
+    case QTextCharFormat::AlignSuperScript:
+        css += QStringLiteral("vertical-align:super; ");
+        break;
+    case QTextCharFormat::AlignSubScript:
+        css += QStringLiteral("vertical-align:sub; ");
+        break;
+    case QTextCharFormat::AlignMiddle:
+        css += QStringLiteral("vertical-align:middle; ");
+        break;
+    case QTextCharFormat::AlignTop:
+        css += QStringLiteral("vertical-align:top; ");
+        break;
+    case QTextCharFormat::AlignBottom:
+        css += QStringLiteral("vertical-align:bottom; ");
+        break;
+    default:
+        break;
+    }
+    switch (format.fontCapitalization()) {
+    case QFont::SmallCaps:
+        css += QStringLiteral("font-variant:small-caps; ");
+        break;
+    case QFont::AllUppercase:
+        css += QStringLiteral("text-transform:uppercase; ");
+        break;
+    case QFont::AllLowercase:
+        css += QStringLiteral("text-transform:lowercase; ");
+        break;
+    case QFont::Capitalize:
+        css += QStringLiteral("text-transform:capitalize; ");
+        break;
+    default:
+        break;
+    }
+    if (format.hasProperty(QTextFormat::FontLetterSpacing)
+        && format.fontLetterSpacingType() == QFont::AbsoluteSpacing) {
+        css += QStringLiteral("letter-spacing:%1px; ").arg(format.fontLetterSpacing());
+    }
+    if (format.hasProperty(QTextFormat::FontWordSpacing)) {
+        css += QStringLiteral("word-spacing:%1px; ").arg(format.fontWordSpacing());
+    }
+    return css;
+}
+
+// Margins are always written: <p> and the headings have default margins
+// that would otherwise come back on import
+QString blockCss(const QTextBlockFormat &format)
+{
+    QString css = QStringLiteral("margin-top:%1px; margin-bottom:%2px; margin-left:%3px; margin-right:%4px; "
+                                 "-qt-block-indent:%5; text-indent:%6px; ")
+        .arg(format.topMargin())
+        .arg(format.bottomMargin())
+        .arg(format.leftMargin())
+        .arg(format.rightMargin())
+        .arg(format.indent())
+        .arg(format.textIndent());
+
+    if (format.hasProperty(StyleManager::PARAGRAPH_STYLE_PROPERTY)) {
+        css += styleReference("-cppword-paragraph-style",
+                              format.stringProperty(StyleManager::PARAGRAPH_STYLE_PROPERTY));
+    }
+    if (format.hasProperty(QTextFormat::BlockAlignment)) {
+        const Qt::Alignment alignment = format.alignment() & Qt::AlignHorizontal_Mask;
+        if (alignment & Qt::AlignRight) {
+            css += QStringLiteral("text-align:right; ");
+        } else if (alignment & Qt::AlignHCenter) {
+            css += QStringLiteral("text-align:center; ");
+        } else if (alignment & Qt::AlignJustify) {
+            css += QStringLiteral("text-align:justify; ");
+        } else {
+            css += QStringLiteral("text-align:left; ");
+        }
+    }
+    if (format.lineHeightType() == QTextBlockFormat::ProportionalHeight) {
+        css += QStringLiteral("line-height:%1%; ").arg(format.lineHeight());
+    }
+    if (format.hasProperty(QTextFormat::BackgroundBrush) && format.background().style() != Qt::NoBrush) {
+        css += QStringLiteral("background-color:%1; ").arg(format.background().color().name());
+    }
+    if (format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysBefore) {
+        css += QStringLiteral("page-break-before:always; ");
+    }
+    if (format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysAfter) {
+        css += QStringLiteral("page-break-after:always; ");
+    }
+    return css;
+}
+
+bool isOrdered(const QTextListFormat &format)
+{
+    return format.style() != QTextListFormat::ListDisc && format.style() != QTextListFormat::ListCircle
+        && format.style() != QTextListFormat::ListSquare;
+}
+
+QString listCss(const QTextListFormat &format)
+{
+    QString type;
+    switch (format.style()) {
+    case QTextListFormat::ListCircle:
+        type = QStringLiteral("circle");
+        break;
+    case QTextListFormat::ListSquare:
+        type = QStringLiteral("square");
+        break;
+    case QTextListFormat::ListDecimal:
+        type = QStringLiteral("decimal");
+        break;
+    case QTextListFormat::ListLowerAlpha:
+        type = QStringLiteral("lower-alpha");
+        break;
+    case QTextListFormat::ListUpperAlpha:
+        type = QStringLiteral("upper-alpha");
+        break;
+    case QTextListFormat::ListLowerRoman:
+        type = QStringLiteral("lower-roman");
+        break;
+    case QTextListFormat::ListUpperRoman:
+        type = QStringLiteral("upper-roman");
+        break;
+    default:
+        type = QStringLiteral("disc");
+        break;
+    }
+    return QStringLiteral("list-style-type:%1; margin-top:0px; margin-bottom:0px; margin-left:0px; "
+                          "margin-right:0px; -qt-list-indent:%2; ")
+        .arg(type)
+        .arg(qMax(1, format.indent()));
+}
+
+QString lengthValue(const QTextLength &length)
+{
+    if (length.type() == QTextLength::PercentageLength) {
+        return QString::number(length.rawValue()) + QLatin1Char('%');
+    }
+    return QString::number(length.rawValue());
+}
+
+QString borderStyleName(QTextFrameFormat::BorderStyle style)
+{
+    switch (style) {
+    case QTextFrameFormat::BorderStyle_None:
+        return QStringLiteral("none");
+    case QTextFrameFormat::BorderStyle_Dotted:
+        return QStringLiteral("dotted");
+    case QTextFrameFormat::BorderStyle_Dashed:
+        return QStringLiteral("dashed");
+    case QTextFrameFormat::BorderStyle_Double:
+        return QStringLiteral("double");
+    case QTextFrameFormat::BorderStyle_Groove:
+        return QStringLiteral("groove");
+    case QTextFrameFormat::BorderStyle_Ridge:
+        return QStringLiteral("ridge");
+    case QTextFrameFormat::BorderStyle_Inset:
+        return QStringLiteral("inset");
+    case QTextFrameFormat::BorderStyle_Outset:
+        return QStringLiteral("outset");
+    default:
+        return QStringLiteral("solid");
+    }
+}
+
+// Border and margins of a table or frame, as QTextHtmlExporter writes them
+QString frameCss(const QTextFrameFormat &format)
+{
+    QString css;
+    if (format.hasProperty(QTextFormat::FrameTopMargin) || format.hasProperty(QTextFormat::FrameMargin)) {
+        css += QStringLiteral("margin-top:%1px; margin-bottom:%2px; margin-left:%3px; margin-right:%4px; ")
+            .arg(format.topMargin())
+            .arg(format.bottomMargin())
+            .arg(format.leftMargin())
+            .arg(format.rightMargin());
+    }
+    if (format.hasProperty(QTextFormat::FrameBorderStyle)) {
+        css += QStringLiteral("border-style:%1; ").arg(borderStyleName(format.borderStyle()));
+    }
+    if (format.hasProperty(QTextFormat::FrameBorderBrush) && format.borderBrush().style() != Qt::NoBrush) {
+        css += QStringLiteral("border-color:%1; ").arg(format.borderBrush().color().name());
+    }
+    return css;
+}
+
+class HtmlSerializer
+{
+public:
+    HtmlSerializer(const QTextDocument *document, QTextStream &out)
+        : m_document(document)
+        , m_out(out)
+    {
+    }
+
+    void write();
+
+private:
+    void collectUsedFormats();
+    void writeStyleSheet();
+    void writeFrame(QTextFrame::iterator it);
+    void writeBlock(const QTextBlock &block);
+    void writeTable(const QTextTable *table);
+    void writeChildFrame(const QTextFrame *frame);
+    void writeFragment(const QTextFragment &fragment);
+    void openList(const QTextList *list);
+    void closeLists(int depth = 0);
+
+    const QTextDocument *m_document;
+    QTextStream &m_out;
+    QList<bool> m_used;     // by format index
+    QList<bool> m_hasClass; // by format index
+    QList<const QTextList *> m_lists; // open lists, innermost last
+};
+
+void HtmlSerializer::write()
+{
+    m_out << "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+          << "<html><head><meta name=\"qrichtext\" content=\"1\" /><meta charset=\"utf-8\" />";
+    const QString title = m_document->metaInformation(QTextDocument::DocumentTitle);
+    if (!title.isEmpty()) {
+        m_out << "<title>" << escaped(title) << "</title>";
+    }
+    m_out << "<style type=\"text/css\">\n"
+          << "p, li, pre, h1, h2, h3, h4, h5, h6 { white-space: pre-wrap; }\n"
+          << "hr { height: 1px; border-width: 0; }\n";
+    writeStyleSheet();
+    m_out << "</style></head>";
+
+    const QFont font = m_document->defaultFont();
+    m_out << "<body style=\"font-family:" << escaped(fontFamilies(font.families().isEmpty()
+                                                                   ? QStringList() << font.family()
+                                                                   : font.families()));
+    if (font.pointSizeF() > 0) {
+        m_out << "; font-size:" << font.pointSizeF() << "pt";
+    } else {
+        m_out << "; font-size:" << font.pixelSize() << "px";
+    }
+    m_out << "; font-weight:" << int(font.weight()) << "; font-style:" << (font.italic() ? "italic" : "normal")
+          << ";\">\n";
+
+    writeFrame(m_document->rootFrame()->begin());
+    closeLists();
+    m_out << "</body></html>\n";
+}
+
+// The format table keeps formats nothing refers to any more; only the ones
+// in use get a class
+void HtmlSerializer::collectUsedFormats()
+{
+    m_used.fill(false, m_document->allFormats().size());
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next()) {
+        m_used[block.blockFormatIndex()] = true;
+        if (block.length() <= 1) {
+            m_used[block.charFormatIndex()] = true;
+        }
+        if (const QTextList *list = block.textList()) {
+            m_used[list->formatIndex()] = true;
+        }
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            if (it.fragment().isValid()) {
+                m_used[it.fragment().charFormatIndex()] = true;
+            }
+        }
+    }
+}
+
+void HtmlSerializer::writeStyleSheet()
+{
+    collectUsedFormats();
+    const QList<QTextFormat> formats = m_document->allFormats();
+    m_hasClass.fill(false, formats.size());
+    for (int i = 0; i < formats.size(); ++i) {
+        if (!m_used.value(i)) {
+            continue;
+        }
+        const QTextFormat &format = formats.at(i);
+        QString css;
+        QChar prefix;
+        if (format.isBlockFormat()) {
+            css = blockCss(format.toBlockFormat());
+            prefix = QLatin1Char('p');
+        } else if (format.isListFormat()) {
+            css = listCss(format.toListFormat());
+            prefix = QLatin1Char('l');
+        } else if (format.isCharFormat() && !format.isImageFormat()) {
+            css = charCss(format.toCharFormat());
+            prefix = QLatin1Char('c');
+        }
+        if (!css.isEmpty()) {
+            css.chop(1);
+            m_out << '.' << prefix << i << " { " << css << " }\n";
+            m_hasClass[i] = true;
+        }
+    }
+}
+
+void HtmlSerializer::writeFrame(QTextFrame::iterator it)
+{
+    for (; !it.atEnd(); ++it) {
+        if (QTextFrame *frame = it.currentFrame()) {
+            closeLists();
+            if (QTextTable *table = qobject_cast<QTextTable *>(frame)) {
+                writeTable(table);
+            } else {
+                writeChildFrame(frame);
+            }
+        } else if (it.currentBlock().isValid()) {
+            writeBlock(it.currentBlock());
+        }
+    }
+}
+
+void HtmlSerializer::closeLists(int depth)
+{
+    while (m_lists.size() > depth) {
+        m_out << (isOrdered(m_lists.takeLast()->format()) ? "</ol>\n" : "</ul>\n");
+    }
+}
+
+// Deeper indented lists nest inside the ones around them; returning to a
+// list that is still open closes the lists nested in it
+void HtmlSerializer::openList(const QTextList *list)
+{
+    if (!list) {
+        closeLists();
+        return;
+    }
+    const int open = m_lists.indexOf(list);
+    if (open >= 0) {
+        closeLists(open + 1);
+        return;
+    }
+    const int indent = list->format().indent();
+    while (!m_lists.isEmpty() && m_lists.last()->format().indent() >= indent) {
+        closeLists(m_lists.size() - 1);
+    }
+
+    const int index = list->formatIndex();
+    m_out << (isOrdered(list->format()) ? "<ol" : "<ul");
+    if (m_hasClass.value(index)) {
+        m_out << " class=\"l" << index << '"';
+    }
+    m_out << ">\n";
+    m_lists.append(list);
+}
+
+void HtmlSerializer::writeBlock(const QTextBlock &block)
+{
+    const QTextBlockFormat format = block.blockFormat();
+    const QTextList *list = block.textList();
+    openList(list);
+
+    if (!list && format.hasProperty(QTextFormat::BlockTrailingHorizontalRulerWidth)) {
+        m_out << "<hr />\n";
+        return;
+    }
+
+    QString tag;
+    if (list) {
+        tag = QStringLiteral("li");
+    } else if (format.headingLevel() > 0) {
+        tag = QStringLiteral("h%1").arg(qMin(6, format.headingLevel()));
+    } else if (format.nonBreakableLines()) {
+        tag = QStringLiteral("pre");
+    } else {
+        tag = QStringLiteral("p");
+    }
+
+    m_out << '<' << tag;
+    const bool empty = block.length() <= 1;
+    QStringList classes;
+    if (m_hasClass.value(block.blockFormatIndex())) {
+        classes << QStringLiteral("p%1").arg(block.blockFormatIndex());
+    }
+    // An empty paragraph has no fragment, so its own character format
+    // carries the font text typed into it gets
+    if (empty && m_hasClass.value(block.charFormatIndex())) {
+        classes << QStringLiteral("c%1").arg(block.charFormatIndex());
+    }
+    if (!classes.isEmpty()) {
+        m_out << " class=\"" << classes.join(QLatin1Char(' ')) << '"';
+    }
+    if (empty) {
+        // Keeps the paragraph without adding a line break on import
+        m_out << " style=\"-qt-paragraph-type:empty;\"><br />";
+    } else {
+        m_out << '>';
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            if (it.fragment().isValid()) {
+                writeFragment(it.fragment());
+            }
+        }
+    }
+    m_out << "</" << tag << ">\n";
+}
+
+void HtmlSerializer::writeTable(const QTextTable *table)
+{
+    const QTextTableFormat format = table->format();
+    m_out << "<table border=\"" << format.border() << "\" cellspacing=\"" << format.cellSpacing()
+          << "\" cellpadding=\"" << format.cellPadding() << '"';
+    const QTextLength width = format.width();
+    if (width.type() != QTextLength::VariableLength) {
+        m_out << " width=\"" << lengthValue(width) << '"';
+    }
+    const Qt::Alignment alignment = format.alignment() & Qt::AlignHorizontal_Mask;
+    if (alignment & Qt::AlignRight) {
+        m_out << " align=\"right\"";
+    } else if (alignment & Qt::AlignHCenter) {
+        m_out << " align=\"center\"";
+    }
+    if (format.background().style() != Qt::NoBrush) {
+        m_out << " bgcolor=\"" << format.background().color().name() << '"';
+    }
+    QString css = frameCss(format);
+    if (format.borderCollapse()) {
+        css += QStringLiteral("border-collapse:collapse; ");
+    }
+    if (!css.isEmpty()) {
+        css.chop(1);
+        m_out << " style=\"" << css << '"';
+    }
+    m_out << ">\n";
+
+    const QList<QTextLength> columnWidths = format.columnWidthConstraints();
+    const int headerRows = qMin(format.headerRowCount(), table->rows());
+    for (int row = 0; row < table->rows(); ++row) {
+        if (row == 0 && headerRows > 0) {
+            m_out << "<thead>\n";
+        }
+        m_out << "<tr>\n";
+        for (int column = 0; column < table->columns(); ++column) {
+            const QTextTableCell cell = table->cellAt(row, column);
+            if (cell.row() != row || cell.column() != column) {
+                continue;
+            }
+            m_out << "<td";
+            if (cell.rowSpan() > 1) {
+                m_out << " rowspan=\"" << cell.rowSpan() << '"';
+            }
+            if (cell.columnSpan() > 1) {
+                m_out << " colspan=\"" << cell.columnSpan() << '"';
+            } else if (column < columnWidths.size()
+                       && columnWidths.at(column).type() != QTextLength::VariableLength) {
+                m_out << " width=\"" << lengthValue(columnWidths.at(column)) << '"';
+            }
+            const QTextCharFormat cellFormat = cell.format();
+            if (cellFormat.background().style() != Qt::NoBrush) {
+                m_out << " bgcolor=\"" << cellFormat.background().color().name() << '"';
+            }
+            m_out << ">\n";
+            writeFrame(cell.begin());
+            closeLists();
+            m_out << "</td>\n";
+        }
+        m_out << "</tr>\n";
+        if (row + 1 == headerRows) {
+            m_out << "</thead>\n";
+        }
+    }
+    m_out << "</table>\n";
+}
+
+// Qt's importer turns a one-cell table of type frame back into a QTextFrame
+void HtmlSerializer::writeChildFrame(const QTextFrame *frame)
+{
+    const QTextFrameFormat format = frame->frameFormat();
+    m_out << "<table border=\"" << format.border() << "\" cellpadding=\"" << format.padding() << '"';
+    const QTextLength width = format.width();
+    if (width.type() != QTextLength::VariableLength) {
+        m_out << " width=\"" << lengthValue(width) << '"';
+    }
+    if (format.background().style() != Qt::NoBrush) {
+        m_out << " bgcolor=\"" << format.background().color().name() << '"';
+    }
+    QString css = QStringLiteral("-qt-table-type: frame; ") + frameCss(format);
+    if (format.height().type() != QTextLength::VariableLength) {
+        css += QStringLiteral("height:%1px; ").arg(format.height().rawValue());
+    }
+    css.chop(1);
+    m_out << " style=\"" << css << "\">\n<tr>\n<td style=\"border: none;\">\n";
+    writeFrame(frame->begin());
+    closeLists();
+    m_out << "</td>\n</tr>\n</table>\n";
+}
+
+void HtmlSerializer::writeFragment(const QTextFragment &fragment)
+{
+    const QTextCharFormat format = fragment.charFormat();
+    if (format.isImageFormat()) {
+        const QTextImageFormat image = format.toImageFormat();
+        for (int i = 0; i < fragment.length(); ++i) {
+            m_out << "<img src=\"" << escaped(image.name()) << '"';
+            if (image.hasProperty(QTextFormat::ImageWidth)) {
+                m_out << " width=\"" << image.width() << '"';
+            }
+            if (image.hasProperty(QTextFormat::ImageHeight)) {
+                m_out << " height=\"" << image.height() << '"';
+            }
+            m_out << " />";
+        }
+        return;
+    }
+
+    const QStringList anchorNames = format.anchorNames();
+    for (const QString &name : anchorNames) {
+        m_out << "<a name=\"" << escaped(name) << "\"></a>";
+    }
+    const bool link = format.isAnchor() && !format.anchorHref().isEmpty();
+    if (link) {
+        m_out << "<a href=\"" << escaped(format.anchorHref()) << "\">";
+    }
+
+    const int index = fragment.charFormatIndex();
+    const bool span = m_hasClass.value(index);
+    if (span) {
+        m_out << "<span class=\"c" << index << "\">";
+    }
+    m_out << escaped(fragment.text());
+    if (span) {
+        m_out << "</span>";
+    }
+    if (link) {
+        m_out << "</a>";
+    }
+}
+
+}
+
+bool HtmlWriter::write(const QTextDocument *document, QIODevice *device)
+{
+    TRACE_SCOPE("HtmlWriter::write");
+    QTextStream out(device);
+    out.setEncoding(QStringConverter::Utf8);
+    HtmlSerializer(document, out).write();
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
+
+bool HtmlWriter::writeToFile(const QTextDocument *document, const QString &fileName, QString *errorString)
+{
+    // QSaveFile keeps the previous file intact until the new one is complete
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+    if (!write(document, &file)) {
+        file.cancelWriting();
+        if (errorString) {
+            *errorString = QCoreApplication::translate("HtmlWriter", "The document could not be written");
+        }
+        return false;
+    }
+    if (!file.commit()) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+QString HtmlWriter::toHtml(const QTextDocument *document)
+{
+    TRACE_SCOPE("HtmlWriter::toHtml");
+    QString html;
+    QTextStream out(&html);
+    HtmlSerializer(document, out).write();
+    out.flush();
+    return html;
+}
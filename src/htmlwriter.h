@@ -0,0 +1,32 @@
+#ifndef HTMLWRITER_H
+#define HTMLWRITER_H
+
+#include <QString>
+
+class QTextDocument;
+class QIODevice;
+
+// Serializes documents as HTML one block at a time, replacing toHtml() and
+// QTextDocumentWriter for save and autosave. Character, paragraph and list
+// formats in use become CSS classes named after their index in the
+// document's format table, so a span carries class="c12" instead of
+// repeating its inline style; a named style a format refers to is kept in
+// its class as a -cppword-paragraph-style or -cppword-character-style
+// declaration, which HtmlImport resolves again. Tables, frames and nested
+// lists are written in the forms QTextDocument::setHtml() reads back.
+// Output goes through a buffered stream, so saving to a file never holds
+// the whole markup in memory.
+//
+// Every block ends with a newline: version history deltas and the chunked
+// HTML loader both rely on blocks being on lines of their own.
+class HtmlWriter
+{
+public:
+    static bool write(const QTextDocument *document, QIODevice *device);
+    static bool writeToFile(const QTextDocument *document, const QString &fileName,
+                            QString *errorString = nullptr);
+    // Same markup as a string, for recovery snapshots and version history
+    static QString toHtml(const QTextDocument *document);
+};
+
+#endif // HTMLWRITER_H
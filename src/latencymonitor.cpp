@@ -0,0 +1,139 @@
+#include "latencymonitor.h"
+#include "tracer.h"
+
+#include <QJsonArray>
+#include <cmath>
+
+LatencyMonitor::LatencyMonitor(QObject *parent)
+    : QObject(parent)
+    , m_inputStart(0)
+    , m_pendingInput(-1)
+    , m_buckets(MAX_LATENCY_MS * BUCKETS_PER_MS + 1, 0)
+    , m_samples(0)
+    , m_maximum(0)
+    , m_last(0)
+{
+    m_clock.start();
+}
+
+void LatencyMonitor::inputStarted()
+{
+    m_inputStart = m_clock.nsecsElapsed();
+}
+
+void LatencyMonitor::inputHandled(bool visibleChange)
+{
+    // Keys that arrive before the next paint are shown by that same paint;
+    // the oldest one is the latency the user sees
+    if (visibleChange && m_pendingInput < 0) {
+        m_pendingInput = m_inputStart;
+    }
+}
+
+void LatencyMonitor::framePainted(int characters, int blocks)
+{
+    if (m_pendingInput < 0) {
+        return;
+    }
+
+    const qreal latency = (m_clock.nsecsElapsed() - m_pendingInput) / 1e6;
+    m_pendingInput = -1;
+
+    const int bucket = qMin(int(latency * BUCKETS_PER_MS), int(m_buckets.size()) - 1);
+    ++m_buckets[bucket];
+    ++m_samples;
+    m_maximum = qMax(m_maximum, latency);
+    m_last = latency;
+
+    if (latency > SLOW_FRAME_MS) {
+        if (m_slowFrames.size() >= MAX_SLOW_FRAMES) {
+            m_slowFrames.removeFirst();
+        }
+        m_slowFrames.append(SlowFrame{QDateTime::currentDateTime(), latency, characters, blocks});
+    }
+
+    TRACE_COUNTER("keystroke latency (us)", latency * 1000);
+    emit sampleAdded(latency);
+}
+
+int LatencyMonitor::sampleCount() const
+{
+    return m_samples;
+}
+
+qreal LatencyMonitor::percentile(qreal fraction) const
+{
+    if (m_samples == 0) {
+        return 0;
+    }
+
+    // Upper edge of the bucket holding the requested rank
+    const qint64 rank = qMax<qint64>(1, qint64(std::ceil(fraction * m_samples)));
+    qint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        seen += m_buckets.at(i);
+        if (seen >= rank) {
+            return i == m_buckets.size() - 1 ? m_maximum : qreal(i + 1) / BUCKETS_PER_MS;
+        }
+    }
+    return m_maximum;
+}
+
+qreal LatencyMonitor::maximum() const
+{
+    return m_maximum;
+}
+
+qreal LatencyMonitor::lastLatency() const
+{
+    return m_last;
+}
+
+QList<LatencyMonitor::SlowFrame> LatencyMonitor::slowFrames() const
+{
+    return m_slowFrames;
+}
+
+QJsonObject LatencyMonitor::toJson() const
+{
+    QJsonObject summary;
+    summary["samples"] = m_samples;
+    summary["p50Ms"] = percentile(0.50);
+    summary["p95Ms"] = percentile(0.95);
+    summary["p99Ms"] = percentile(0.99);
+    summary["maxMs"] = m_maximum;
+
+    // Only buckets that saw samples, keyed by their lower edge
+    QJsonArray histogram;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        if (m_buckets.at(i) > 0) {
+            histogram.append(QJsonObject{{"fromMs", qreal(i) / BUCKETS_PER_MS},
+                                         {"count", m_buckets.at(i)}});
+        }
+    }
+
+    QJsonArray slow;
+    for (const SlowFrame &frame : m_slowFrames) {
+        slow.append(QJsonObject{{"timestamp", frame.timestamp.toString(Qt::ISODateWithMs)},
+                                {"latencyMs", frame.latencyMs},
+                                {"characters", frame.characters},
+                                {"paragraphs", frame.blocks}});
+    }
+
+    QJsonObject root;
+    root["summary"] = summary;
+    root["bucketWidthMs"] = 1.0 / BUCKETS_PER_MS;
+    root["histogram"] = histogram;
+    root["slowFrames"] = slow;
+    return root;
+}
+
+void LatencyMonitor::reset()
+{
+    m_pendingInput = -1;
+    m_buckets.fill(0);
+    m_samples = 0;
+    m_maximum = 0;
+    m_last = 0;
+    m_slowFrames.clear();
+}
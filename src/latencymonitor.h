@@ -0,0 +1,69 @@
+#ifndef LATENCYMONITOR_H
+#define LATENCYMONITOR_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QList>
+#include <QVector>
+
+// Measures how long a keystroke takes to show up on screen. The editor
+// marks each key press that changes something and every finished paint;
+// the first paint after a key press closes its sample. Samples go into a
+// histogram with 0.5 ms buckets up to MAX_LATENCY_MS, and samples over
+// SLOW_FRAME_MS are kept with the document size at the time.
+//
+// The clock starts when the editor receives the event and stops when its
+// paint event returns, so time spent in the OS input queue and in the
+// compositor is not included.
+class LatencyMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct SlowFrame {
+        QDateTime timestamp;
+        qreal latencyMs;
+        int characters;
+        int blocks;
+    };
+
+    explicit LatencyMonitor(QObject *parent = nullptr);
+
+    // Bracket the handling of one key press; keys with no visible effect
+    // are not measured, as the next paint might only be a cursor blink
+    void inputStarted();
+    void inputHandled(bool visibleChange);
+    void framePainted(int characters, int blocks);
+
+    int sampleCount() const;
+    qreal percentile(qreal fraction) const; // milliseconds
+    qreal maximum() const;
+    qreal lastLatency() const;
+    QList<SlowFrame> slowFrames() const;
+
+    QJsonObject toJson() const;
+    void reset();
+
+    static const int SLOW_FRAME_MS = 33;   // two frames at 60 Hz
+    static const int MAX_LATENCY_MS = 1000;
+
+signals:
+    void sampleAdded(qreal latencyMs);
+
+private:
+    QElapsedTimer m_clock;
+    qint64 m_inputStart;
+    qint64 m_pendingInput; // ns, -1 when no key press is waiting for a paint
+    QVector<int> m_buckets; // last bucket counts everything above MAX_LATENCY_MS
+    int m_samples;
+    qreal m_maximum;
+    qreal m_last;
+    QList<SlowFrame> m_slowFrames;
+
+    static const int BUCKETS_PER_MS = 2;
+    static const int MAX_SLOW_FRAMES = 200;
+};
+
+#endif // LATENCYMONITOR_H
@@ -0,0 +1,445 @@
+#include "macrorecorder.h"
+#include "texteditor.h"
+
+#include <QAction>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+#include <QKeyEvent>
+#include <QMimeData>
+#include <QTextCursor>
+#include <QDebug>
+#include <algorithm>
+
+MacroRecorder::MacroRecorder(TextEditor *editor, QObject *parent)
+    : QObject(parent)
+    , m_editor(editor)
+    , m_recording(false)
+    , m_lastStepTime(0)
+    , m_keyStep(-1)
+    , m_playing(false)
+    , m_pacing(FullSpeed)
+    , m_nextStep(0)
+    , m_stepPending(false)
+    , m_playTimer(new QTimer(this))
+{
+    m_playTimer->setSingleShot(true);
+    connect(m_playTimer, &QTimer::timeout, this, &MacroRecorder::playNext);
+}
+
+void MacroRecorder::registerAction(const QString &id, QAction *action)
+{
+    m_actions.insert(id, action);
+    connect(action, &QAction::triggered, this, [this, id](bool checked) {
+        Step step;
+        step.type = Step::Action;
+        step.text = id;
+        step.flag = checked;
+        record(step);
+    });
+}
+
+void MacroRecorder::startRecording()
+{
+    if (m_recording || m_playing) {
+        return;
+    }
+
+    m_steps.clear();
+    m_recording = true;
+    m_recordClock.start();
+    m_lastStepTime = 0;
+    m_keyStep = -1;
+    emit recordingChanged(true);
+}
+
+void MacroRecorder::stopRecording()
+{
+    if (!m_recording) {
+        return;
+    }
+
+    m_recording = false;
+    m_keyStep = -1;
+    emit recordingChanged(false);
+}
+
+bool MacroRecorder::isRecording() const
+{
+    return m_recording;
+}
+
+void MacroRecorder::play(Pacing pacing)
+{
+    if (m_playing || m_recording || m_steps.isEmpty()) {
+        return;
+    }
+
+    m_playing = true;
+    m_pacing = pacing;
+    m_nextStep = 0;
+    m_stepPending = false;
+    m_timings.clear();
+    m_runClock.start();
+    m_playTimer->start(0);
+}
+
+void MacroRecorder::stopPlayback()
+{
+    if (!m_playing) {
+        return;
+    }
+
+    m_playTimer->stop();
+    m_nextStep = m_steps.size();
+    m_stepPending = false;
+    playNext();
+}
+
+bool MacroRecorder::isPlaying() const
+{
+    return m_playing;
+}
+
+int MacroRecorder::stepCount() const
+{
+    return m_steps.size();
+}
+
+bool MacroRecorder::save(const QString &filePath) const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    out << MAGIC << VERSION << quint32(m_steps.size());
+    for (const Step &step : m_steps) {
+        out << quint8(step.type) << step.delay;
+        switch (step.type) {
+        case Step::Key:
+            out << qint32(step.key) << qint32(step.modifiers) << step.text;
+            break;
+        case Step::Paste:
+        case Step::Action:
+            out << step.text << step.flag;
+            break;
+        case Step::Format:
+            out << step.format;
+            break;
+        case Step::Alignment:
+            out << qint32(step.position);
+            break;
+        case Step::Cursor:
+            out << qint32(step.position) << qint32(step.anchor);
+            break;
+        }
+    }
+
+    QFile file(filePath);
+    if (!file.open(QFile::WriteOnly)) {
+        qDebug() << "MacroRecorder: could not write" << filePath << file.errorString();
+        return false;
+    }
+    file.write(qCompress(data));
+    file.close();
+    return true;
+}
+
+bool MacroRecorder::load(const QString &filePath)
+{
+    if (m_recording || m_playing) {
+        return false;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = qUncompress(file.readAll());
+    file.close();
+
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic;
+    quint16 version;
+    quint32 count;
+    in >> magic >> version >> count;
+    if (in.status() != QDataStream::Ok || magic != MAGIC || version > VERSION) {
+        qDebug() << "MacroRecorder: not a macro file" << filePath;
+        return false;
+    }
+
+    QList<Step> steps;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Step step;
+        quint8 type;
+        in >> type >> step.delay;
+        step.type = Step::Type(type);
+
+        qint32 first = 0;
+        qint32 second = 0;
+        QTextFormat format;
+        switch (step.type) {
+        case Step::Key:
+            in >> first >> second >> step.text;
+            step.key = first;
+            step.modifiers = second;
+            break;
+        case Step::Paste:
+        case Step::Action:
+            in >> step.text >> step.flag;
+            break;
+        case Step::Format:
+            in >> format;
+            step.format = format.toCharFormat();
+            break;
+        case Step::Alignment:
+            in >> first;
+            step.position = first;
+            break;
+        case Step::Cursor:
+            in >> first >> second;
+            step.position = first;
+            step.anchor = second;
+            break;
+        default:
+            return false;
+        }
+        steps.append(step);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    m_steps = steps;
+    return true;
+}
+
+void MacroRecorder::keyStarted(const QKeyEvent *event)
+{
+    // Modifiers on their own change nothing
+    switch (event->key()) {
+    case Qt::Key_Shift:
+    case Qt::Key_Control:
+    case Qt::Key_Alt:
+    case Qt::Key_Meta:
+    case Qt::Key_AltGr:
+        return;
+    default:
+        break;
+    }
+
+    Step step;
+    step.type = Step::Key;
+    step.key = event->key();
+    step.modifiers = int(event->modifiers());
+    step.text = event->text();
+    record(step);
+
+    if (m_recording && !m_playing) {
+        m_keyStep = m_steps.size() - 1;
+    }
+}
+
+void MacroRecorder::keyFinished()
+{
+    m_keyStep = -1;
+}
+
+void MacroRecorder::pasted(const QMimeData *source, bool richText)
+{
+    if (!m_recording || m_playing || !source) {
+        return;
+    }
+
+    Step step;
+    step.type = Step::Paste;
+    step.flag = richText && source->hasHtml();
+    step.text = step.flag ? source->html() : source->text();
+
+    // A paste shortcut is replaced by what it pasted, so replay does not
+    // depend on the clipboard
+    if (m_keyStep >= 0 && m_keyStep == m_steps.size() - 1) {
+        step.delay = m_steps.at(m_keyStep).delay;
+        m_steps[m_keyStep] = step;
+        m_keyStep = -1;
+        return;
+    }
+
+    record(step);
+}
+
+void MacroRecorder::formatMerged(const QTextCharFormat &format)
+{
+    Step step;
+    step.type = Step::Format;
+    step.format = format;
+    record(step);
+}
+
+void MacroRecorder::alignmentSet(Qt::Alignment alignment)
+{
+    Step step;
+    step.type = Step::Alignment;
+    step.position = int(alignment);
+    record(step);
+}
+
+void MacroRecorder::cursorPlaced(int position, int anchor)
+{
+    Step step;
+    step.type = Step::Cursor;
+    step.position = position;
+    step.anchor = anchor;
+    record(step);
+}
+
+QString MacroRecorder::typeName(Step::Type type)
+{
+    switch (type) {
+    case Step::Key:
+        return tr("Keys");
+    case Step::Paste:
+        return tr("Pastes");
+    case Step::Format:
+        return tr("Formats");
+    case Step::Alignment:
+        return tr("Alignments");
+    case Step::Cursor:
+        return tr("Cursor moves");
+    case Step::Action:
+        return tr("Actions");
+    }
+    return QString();
+}
+
+void MacroRecorder::record(Step step)
+{
+    if (!m_recording || m_playing) {
+        return;
+    }
+
+    const qint64 now = m_recordClock.elapsed();
+    step.delay = quint32(now - m_lastStepTime);
+    m_lastStepTime = now;
+    m_steps.append(step);
+}
+
+void MacroRecorder::playNext()
+{
+    if (!m_playing) {
+        return;
+    }
+
+    // The previous step started a paste or load that is still running
+    if (m_stepPending) {
+        if (m_editor->isPasting() || m_editor->isLoading()) {
+            m_playTimer->start(BUSY_POLL_INTERVAL);
+            return;
+        }
+        finishStep();
+        return;
+    }
+
+    if (m_nextStep >= m_steps.size()) {
+        m_playing = false;
+
+        QStringList lines;
+        lines << tr("%n step(s) in %1 ms", "", m_steps.size()).arg(m_runClock.elapsed());
+        for (auto it = m_timings.constBegin(); it != m_timings.constEnd(); ++it) {
+            QList<qreal> timings = it.value();
+            std::sort(timings.begin(), timings.end());
+            qreal total = 0;
+            for (qreal timing : timings) {
+                total += timing;
+            }
+            const qreal p95 = timings.at(qMin(int(timings.size() * 0.95), int(timings.size()) - 1));
+            lines << tr("%1: %2, mean %3 ms, p95 %4 ms, max %5 ms")
+                     .arg(typeName(Step::Type(it.key())))
+                     .arg(timings.size())
+                     .arg(total / timings.size(), 0, 'f', 2)
+                     .arg(p95, 0, 'f', 2)
+                     .arg(timings.last(), 0, 'f', 2);
+        }
+        emit playbackFinished(lines.join(QLatin1Char('\n')));
+        return;
+    }
+
+    m_stepClock.start();
+    execute(m_steps.at(m_nextStep));
+    m_stepPending = true;
+
+    if (m_editor->isPasting() || m_editor->isLoading()) {
+        m_playTimer->start(BUSY_POLL_INTERVAL);
+        return;
+    }
+    finishStep();
+}
+
+void MacroRecorder::finishStep()
+{
+    const qreal msecs = m_stepClock.nsecsElapsed() / 1e6;
+    const Step &step = m_steps.at(m_nextStep);
+    m_timings[step.type].append(msecs);
+    emit stepPlayed(m_nextStep, m_steps.size(), typeName(step.type), msecs);
+
+    m_stepPending = false;
+    ++m_nextStep;
+
+    // Real-time pacing waits out the recorded pause, minus the time the
+    // step itself took
+    int wait = 0;
+    if (m_pacing == RealTime && m_nextStep < m_steps.size()) {
+        wait = qMax(0, int(m_steps.at(m_nextStep).delay) - int(msecs));
+    }
+    m_playTimer->start(wait);
+}
+
+void MacroRecorder::execute(const Step &step)
+{
+    switch (step.type) {
+    case Step::Key: {
+        QKeyEvent press(QEvent::KeyPress, step.key, Qt::KeyboardModifiers(step.modifiers), step.text);
+        QCoreApplication::sendEvent(m_editor, &press);
+        QKeyEvent release(QEvent::KeyRelease, step.key, Qt::KeyboardModifiers(step.modifiers), step.text);
+        QCoreApplication::sendEvent(m_editor, &release);
+        break;
+    }
+    case Step::Paste: {
+        QMimeData data;
+        if (step.flag) {
+            data.setHtml(step.text);
+        } else {
+            data.setText(step.text);
+        }
+        m_editor->insertMimeData(&data);
+        break;
+    }
+    case Step::Format:
+        m_editor->mergeFormatOnWordOrSelection(step.format);
+        break;
+    case Step::Alignment:
+        m_editor->setAlignment(Qt::Alignment(step.position));
+        break;
+    case Step::Cursor: {
+        QTextCursor cursor(m_editor->document());
+        const int last = m_editor->document()->characterCount() - 1;
+        cursor.setPosition(qBound(0, step.anchor, last));
+        cursor.setPosition(qBound(0, step.position, last), QTextCursor::KeepAnchor);
+        m_editor->setTextCursor(cursor);
+        break;
+    }
+    case Step::Action:
+        if (QAction *action = m_actions.value(step.text)) {
+            // trigger() toggles checkable actions, so start from the opposite state
+            if (action->isCheckable()) {
+                action->setChecked(!step.flag);
+            }
+            action->trigger();
+        }
+        break;
+    }
+}
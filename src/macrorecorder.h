@@ -0,0 +1,120 @@
+#ifndef MACRORECORDER_H
+#define MACRORECORDER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTextCharFormat>
+#include <QTimer>
+
+class TextEditor;
+class QAction;
+class QKeyEvent;
+class QMimeData;
+
+// Records what the user does in the editor and plays it back. Steps come
+// from hooks in TextEditor (keys, pastes with their content, character
+// formats, alignment, cursor placement by mouse) and from QActions that
+// were registered by id. Pasted content and formats are stored by value,
+// so a replay does not depend on the clipboard or on dialogs.
+//
+// Playback runs from the event loop, either as fast as possible or with
+// the recorded pauses, and reports how long each step took. A step is
+// complete once the editor has finished any asynchronous paste it started.
+class MacroRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Pacing {
+        FullSpeed,
+        RealTime
+    };
+
+    struct Step {
+        enum Type : quint8 {
+            Key,
+            Paste,
+            Format,
+            Alignment,
+            Cursor,
+            Action
+        };
+
+        Type type = Key;
+        quint32 delay = 0;        // ms since the previous step
+        int key = 0;              // Key
+        int modifiers = 0;        // Key
+        QString text;             // Key text, Paste content, Action id
+        bool flag = false;        // Paste: text is HTML; Action: checked
+        QTextCharFormat format;   // Format
+        int position = 0;         // Alignment, Cursor
+        int anchor = 0;           // Cursor
+    };
+
+    explicit MacroRecorder(TextEditor *editor, QObject *parent = nullptr);
+
+    void registerAction(const QString &id, QAction *action);
+
+    void startRecording();
+    void stopRecording();
+    bool isRecording() const;
+
+    void play(Pacing pacing);
+    void stopPlayback();
+    bool isPlaying() const;
+
+    int stepCount() const;
+    bool save(const QString &filePath) const;
+    bool load(const QString &filePath);
+
+    // Hooks called by TextEditor
+    void keyStarted(const QKeyEvent *event);
+    void keyFinished();
+    void pasted(const QMimeData *source, bool richText);
+    void formatMerged(const QTextCharFormat &format);
+    void alignmentSet(Qt::Alignment alignment);
+    void cursorPlaced(int position, int anchor);
+
+    static QString typeName(Step::Type type);
+
+signals:
+    void recordingChanged(bool recording);
+    void stepPlayed(int index, int count, const QString &type, qreal msecs);
+    // Summary of the run, one line per step type
+    void playbackFinished(const QString &report);
+
+private slots:
+    void playNext();
+
+private:
+    void record(Step step);
+    void execute(const Step &step);
+    void finishStep();
+
+    TextEditor *m_editor;
+    QHash<QString, QAction *> m_actions;
+    QList<Step> m_steps;
+
+    bool m_recording;
+    QElapsedTimer m_recordClock;
+    qint64 m_lastStepTime;
+    int m_keyStep; // step of the key being handled, -1 outside a key press
+
+    bool m_playing;
+    Pacing m_pacing;
+    int m_nextStep;
+    bool m_stepPending;
+    QTimer *m_playTimer;
+    QElapsedTimer m_stepClock;
+    QElapsedTimer m_runClock;
+    QHash<int, QList<qreal>> m_timings; // per step type
+
+    static const quint32 MAGIC = 0x4350574d; // "CPWM"
+    static const quint16 VERSION = 1;
+    static const int BUSY_POLL_INTERVAL = 10; // ms between checks for a finished paste
+};
+
+#endif // MACRORECORDER_H
@@ -1,12 +1,171 @@
 #include <QApplication>
 #include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QTextDocument>
+#include <QTextDocumentWriter>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include "mainwindow.h"
+#include "tracer.h"
+#include "textimport.h"
+#include "htmlimport.h"
+#include "documentexporter.h"
+#include "htmlwriter.h"
+#include "singleinstance.h"
+
+namespace {
+
+// Converts a document without opening a window; the output format follows
+// the file extension
+int convertDocument(const QString &input, const QString &output)
+{
+    QTextStream err(stderr);
+    QElapsedTimer timer;
+    timer.start();
+    
+    QString content;
+    QString errorString;
+    if (!TextImport::readFile(input, &content, nullptr, &errorString)) {
+        err << "Could not open " << input << ": " << errorString << Qt::endl;
+        return 1;
+    }
+    
+    QTextDocument document;
+    document.setUndoRedoEnabled(false);
+    if (input.endsWith(".html", Qt::CaseInsensitive) || input.endsWith(".htm", Qt::CaseInsensitive)
+        || input.endsWith(".rtf", Qt::CaseInsensitive)) {
+        HtmlImport::importInto(&document, content);
+    } else if (input.endsWith(".md", Qt::CaseInsensitive) || input.endsWith(".markdown", Qt::CaseInsensitive)) {
+        document.setMarkdown(content);
+    } else {
+        document.setPlainText(content);
+    }
+    content.clear();
+    
+    DocumentExporter::Format format;
+    bool success = false;
+    if (DocumentExporter::formatForFile(output, &format)) {
+        success = DocumentExporter::exportToFile(&document, output, format, &errorString);
+    } else if (output.endsWith(".html", Qt::CaseInsensitive) || output.endsWith(".htm", Qt::CaseInsensitive)) {
+        success = HtmlWriter::writeToFile(&document, output, &errorString);
+    } else {
+        QTextDocumentWriter writer(output);
+        writer.setFormat("plaintext");
+        success = writer.write(&document);
+        errorString = writer.device() ? writer.device()->errorString() : QString();
+    }
+    
+    if (!success) {
+        err << "Could not write " << output << ": " << errorString << Qt::endl;
+        return 1;
+    }
+    err << "Converted " << input << " to " << output << " in " << timer.elapsed() << " ms" << Qt::endl;
+    return 0;
+}
+
+// Opened and extra windows are deleted when closed; the first window lives
+// on main()'s stack
+MainWindow *newWindow()
+{
+    MainWindow *window = new MainWindow;
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    if (QWidget *active = QApplication::activeWindow()) {
+        window->move(active->pos() + QPoint(30, 30));
+    }
+    return window;
+}
+
+void showWindow(MainWindow *window)
+{
+    window->show();
+    window->raise();
+    window->activateWindow();
+}
+
+// Brings up each document in the window that already has it open, in a
+// blank window, or else in a new one. No documents asks for a window.
+void openDocuments(const QStringList &files)
+{
+    QList<MainWindow *> windows;
+    for (QWidget *widget : QApplication::topLevelWidgets()) {
+        if (MainWindow *window = qobject_cast<MainWindow *>(widget)) {
+            windows.append(window);
+        }
+    }
+    auto findWindow = [&windows](const QString &fileName) -> MainWindow * {
+        for (MainWindow *window : windows) {
+            if (fileName.isEmpty() ? window->isBlank() : window->currentFile() == fileName) {
+                return window;
+            }
+        }
+        return nullptr;
+    };
+    
+    if (files.isEmpty()) {
+        MainWindow *window = findWindow(QString());
+        showWindow(window ? window : newWindow());
+        return;
+    }
+    
+    for (const QString &fileName : files) {
+        if (MainWindow *window = findWindow(fileName)) {
+            showWindow(window);
+            continue;
+        }
+        MainWindow *window = findWindow(QString());
+        const bool created = !window;
+        if (created) {
+            window = newWindow();
+            windows.append(window);
+        }
+        showWindow(window);
+        if (!window->openFile(fileName) && created) {
+            window->close();
+            windows.removeOne(window);
+        }
+    }
+}
+
+}
 
 int main(int argc, char *argv[])
 {
     // Must be called before QApplication
     QApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::PassThrough);
     
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption convertOption("convert", "Convert <file> to <output> without opening a window.", "output");
+    parser.addOption(convertOption);
+    parser.addPositionalArgument("files", "Documents to open, or the document to convert.", "[files...]");
+    
+    // Parsed once before any application exists: conversions need no
+    // display, and options are for this process only. Errors and --help
+    // are reported when the options are processed below.
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i) {
+        arguments.append(QString::fromLocal8Bit(argv[i]));
+    }
+    const bool parsed = parser.parse(arguments);
+    if (parsed && parser.isSet(convertOption) && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    const bool handOff = parsed && parser.optionNames().isEmpty();
+    
+    // A running instance opens the documents far sooner than a cold start;
+    // a core application is enough to talk to it
+    if (handOff) {
+        QCoreApplication probe(argc, argv);
+        QStringList files;
+        for (const QString &argument : parser.positionalArguments()) {
+            files.append(QFileInfo(argument).absoluteFilePath());
+        }
+        if (SingleInstance::sendToPrimary(files)) {
+            return 0;
+        }
+    }
+    
     // Remove deprecated high DPI scaling attributes
     // In Qt 6.10.0, these are always enabled by default
     
@@ -14,6 +173,22 @@ int main(int argc, char *argv[])
     app.setApplicationName("CPP Word");
     app.setOrganizationName("CPP Word");
     
+    // CPPWORD_TRACE records hot-path spans and writes them out on exit
+    Tracer::initializeFromEnvironment();
+    
+    parser.process(app);
+    
+    if (parser.isSet(convertOption)) {
+        if (parser.positionalArguments().size() != 1) {
+            parser.showHelp(1);
+        }
+        const int status = convertDocument(parser.positionalArguments().first(), parser.value(convertOption));
+        if (Tracer::isEnabled()) {
+            Tracer::writeChromeTrace(Tracer::outputPath());
+        }
+        return status;
+    }
+    
     // Set application-wide stylesheet to improve spacing
     app.setStyleSheet(
         "QToolBar { spacing: 8px; padding: 4px; }"
@@ -24,10 +199,33 @@ int main(int argc, char *argv[])
         "QMenu::item { padding: 4px 20px 4px 20px; }"
     );
     
+    // Later launches hand their documents to this process
+    SingleInstance instance;
+    instance.listen();
+    
+    QStringList files;
+    for (const QString &argument : parser.positionalArguments()) {
+        files.append(QFileInfo(argument).absoluteFilePath());
+    }
+    
     MainWindow mainWindow;
     mainWindow.setWindowTitle("CPP Word");
     mainWindow.resize(1024, 768);
+    mainWindow.checkForRecoveryFiles();
+    if (files.isEmpty()) {
+        mainWindow.restoreSession();
+    }
     mainWindow.show();
+    if (!files.isEmpty()) {
+        openDocuments(files);
+    }
+    QObject::connect(&instance, &SingleInstance::filesReceived, &mainWindow, &openDocuments);
+    
+    int result = app.exec();
+    
+    if (Tracer::isEnabled()) {
+        Tracer::writeChromeTrace(Tracer::outputPath());
+    }
     
-    return app.exec();
+    return result;
 } 
\ No newline at end of file
@@ -2,6 +2,26 @@
 #include "texteditor.h"
 #include "formatbar.h"
 #include "documentmanager.h"
+#include "outlinepanel.h"
+#include "sharedsession.h"
+#include "textimport.h"
+#include "filemonitor.h"
+#include "tracer.h"
+#include "latencymonitor.h"
+#include "sessionstate.h"
+#include "macrorecorder.h"
+#include "tableimport.h"
+#include "stylemanager.h"
+#include "formatcompactor.h"
+#include "documentexporter.h"
+#include "htmlwriter.h"
+#include "paginator.h"
+#include "recentfiles.h"
+#include "taskexecutor.h"
+#include "documentcompare.h"
+#include "compareview.h"
+#include "wordcounter.h"
+#include "htmlimport.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
@@ -11,10 +31,11 @@
 #include <QColorDialog>
 #include <QTextDocument>
 #include <QTextCursor>
+#include <QTextBlock>
+#include <QTextDocumentFragment>
 #include <QCloseEvent>
 #include <QDebug>
 #include <QLabel>
-#include <QRegularExpression>
 #include <QFileInfo>
 #include <QInputDialog>
 #include <QDialog>
@@ -35,16 +56,39 @@
 #include <QStringConverter>
 #include <QToolBar>
 #include <QTextEdit>
+#include <QListWidget>
+#include <QTextBrowser>
+#include <QDialogButtonBox>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QScrollBar>
+#include <QTimer>
+#include <QSpinBox>
+#include <QFormLayout>
+#include <QTextTable>
+#include <QFontDialog>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_textEditor(new TextEditor(this))
     , m_formatBar(new FormatBar(this))
     , m_documentManager(new DocumentManager(this))
+    , m_outlinePanel(nullptr)
+    , m_outlineDock(nullptr)
+    , m_sharedSession(new SharedSession(this))
+    , m_fileMonitor(new FileMonitor(m_textEditor, this))
+    , m_macroRecorder(new MacroRecorder(m_textEditor, this))
+    , m_tableImport(new TableImport(m_textEditor))
+    , m_styleManager(new StyleManager(m_textEditor->document(), this))
+    , m_paginator(new Paginator(m_textEditor->document(), this))
+    , m_recentFiles(new RecentFiles(this))
+    , m_styleComboBox(nullptr)
+    , m_sessionState(SessionState::shared())
     , m_currentFile("")
 {
     setupUI();
     createActions();
+    createDockWindows();
     createMenus();
     createToolbars();
     setupConnections();
@@ -55,8 +99,10 @@ MainWindow::MainWindow(QWidget *parent)
     setCentralWidget(m_textEditor);
     setWindowIcon(QIcon(":/icons/word.png"));
     
-    // Check for recovery files on startup
-    checkForRecoveryFiles();
+    // Read the likely next documents ahead once startup has settled
+    QTimer::singleShot(RecentFiles::STARTUP_DELAY, this, [this]() {
+        m_recentFiles->prefetch(m_currentFile);
+    });
 }
 
 MainWindow::~MainWindow()
@@ -109,6 +155,16 @@ void MainWindow::createActions()
     m_documentPropertiesAction = new QAction(QIcon::fromTheme("document-properties"), tr("Document Proper&ties..."), this);
     m_documentPropertiesAction->setStatusTip(tr("View and edit document properties"));
     
+    m_versionHistoryAction = new QAction(QIcon::fromTheme("document-revert"), tr("&Version History..."), this);
+    m_versionHistoryAction->setStatusTip(tr("Browse and restore earlier versions of the document"));
+    
+    m_compareAction = new QAction(tr("Co&mpare Documents..."), this);
+    m_compareAction->setStatusTip(tr("Show the differences between two revisions of a document"));
+    
+    m_shareSessionAction = new QAction(QIcon::fromTheme("network-workgroup"), tr("S&hare Editing Session"), this);
+    m_shareSessionAction->setStatusTip(tr("Edit this document together with other CPP Word windows on this machine"));
+    m_shareSessionAction->setCheckable(true);
+    
     m_exitAction = new QAction(QIcon::fromTheme("application-exit"), tr("E&xit"), this);
     m_exitAction->setShortcut(QKeySequence::Quit);
     m_exitAction->setStatusTip(tr("Exit the application"));
@@ -134,6 +190,27 @@ void MainWindow::createActions()
     m_pasteAction->setShortcut(QKeySequence::Paste);
     m_pasteAction->setStatusTip(tr("Paste the clipboard's contents"));
     
+    m_recordMacroAction = new QAction(QIcon::fromTheme("media-record"), tr("&Record Macro"), this);
+    m_recordMacroAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_R));
+    m_recordMacroAction->setStatusTip(tr("Record keystrokes, pastes and formatting as a macro"));
+    m_recordMacroAction->setCheckable(true);
+    
+    m_playMacroAction = new QAction(QIcon::fromTheme("media-playback-start"), tr("&Play Macro"), this);
+    m_playMacroAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_P));
+    m_playMacroAction->setStatusTip(tr("Replay the recorded macro as fast as possible"));
+    m_playMacroAction->setEnabled(false);
+    
+    m_playMacroRealTimeAction = new QAction(tr("Play Macro in Real &Time"), this);
+    m_playMacroRealTimeAction->setStatusTip(tr("Replay the recorded macro with its original pauses"));
+    m_playMacroRealTimeAction->setEnabled(false);
+    
+    m_saveMacroAction = new QAction(tr("&Save Macro..."), this);
+    m_saveMacroAction->setStatusTip(tr("Save the recorded macro to a file"));
+    m_saveMacroAction->setEnabled(false);
+    
+    m_loadMacroAction = new QAction(tr("&Load Macro..."), this);
+    m_loadMacroAction->setStatusTip(tr("Load a macro from a file"));
+    
     // Format actions
     m_boldAction = new QAction(QIcon::fromTheme("format-text-bold"), tr("&Bold"), this);
     m_boldAction->setShortcut(QKeySequence::Bold);
@@ -169,6 +246,19 @@ void MainWindow::createActions()
     m_alignJustifyAction->setStatusTip(tr("Justify text"));
     m_alignJustifyAction->setCheckable(true);
     
+    m_modifyStyleAction = new QAction(tr("&Modify Style..."), this);
+    m_modifyStyleAction->setStatusTip(tr("Change a named style everywhere it is used"));
+    
+    m_compactFormatsAction = new QAction(tr("Compact &Formats"), this);
+    m_compactFormatsAction->setStatusTip(tr("Merge redundant character formats to save memory (clears undo history)"));
+    
+    // Table actions
+    m_insertTableAction = new QAction(QIcon::fromTheme("insert-table"), tr("&Insert Table..."), this);
+    m_insertTableAction->setStatusTip(tr("Insert an empty table at the cursor"));
+    
+    m_importCsvAction = new QAction(QIcon::fromTheme("text-csv"), tr("Import &CSV..."), this);
+    m_importCsvAction->setStatusTip(tr("Insert the contents of a CSV file as a table"));
+    
     // View actions
     m_zoomInAction = new QAction(QIcon::fromTheme("zoom-in"), tr("Zoom &In"), this);
     m_zoomInAction->setShortcut(QKeySequence::ZoomIn);
@@ -179,7 +269,25 @@ void MainWindow::createActions()
     m_zoomOutAction->setStatusTip(tr("Zoom out"));
     
     m_resetZoomAction = new QAction(QIcon::fromTheme("zoom-original"), tr("&Reset Zoom"), this);
+    m_resetZoomAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_0));
     m_resetZoomAction->setStatusTip(tr("Reset zoom to original size"));
+    
+    m_fitToWidthAction = new QAction(QIcon::fromTheme("zoom-fit-best"), tr("&Fit to Width"), this);
+    m_fitToWidthAction->setStatusTip(tr("Zoom so the page width fills the window"));
+    
+    m_latencyOverlayAction = new QAction(tr("Show Typing &Latency"), this);
+    m_latencyOverlayAction->setStatusTip(tr("Show keystroke-to-screen latency in the corner of the editor"));
+    m_latencyOverlayAction->setCheckable(true);
+    
+    m_typingLatencyAction = new QAction(tr("&Typing Latency..."), this);
+    m_typingLatencyAction->setStatusTip(tr("Show keystroke latency statistics and slow frames"));
+    
+    // Hidden diagnostics toggle, not shown in any menu
+    m_traceAction = new QAction(tr("Record Trace"), this);
+    m_traceAction->setShortcut(QKeySequence(Qt::CTRL | Qt::ALT | Qt::SHIFT | Qt::Key_T));
+    m_traceAction->setCheckable(true);
+    m_traceAction->setChecked(Tracer::isEnabled());
+    addAction(m_traceAction);
 }
 
 void MainWindow::createMenus()
@@ -192,6 +300,8 @@ void MainWindow::createMenus()
     m_fileMenu = menuBar()->addMenu(tr("&File"));
     m_fileMenu->addAction(m_newAction);
     m_fileMenu->addAction(m_openAction);
+    m_recentFilesMenu = m_fileMenu->addMenu(tr("Open &Recent"));
+    connect(m_recentFilesMenu, &QMenu::aboutToShow, this, &MainWindow::updateRecentFilesMenu);
     m_fileMenu->addSeparator();
     m_fileMenu->addAction(m_saveAction);
     m_fileMenu->addAction(m_saveAsAction);
@@ -200,6 +310,9 @@ void MainWindow::createMenus()
     m_fileMenu->addAction(m_printPreviewAction);
     m_fileMenu->addSeparator();
     m_fileMenu->addAction(m_documentPropertiesAction);
+    m_fileMenu->addAction(m_versionHistoryAction);
+    m_fileMenu->addAction(m_compareAction);
+    m_fileMenu->addAction(m_shareSessionAction);
     m_fileMenu->addSeparator();
     m_fileMenu->addAction(m_exitAction);
     
@@ -216,6 +329,15 @@ void MainWindow::createMenus()
     m_editMenu->addAction(m_cutAction);
     m_editMenu->addAction(m_copyAction);
     m_editMenu->addAction(m_pasteAction);
+    m_editMenu->addSeparator();
+    
+    QMenu *macroMenu = m_editMenu->addMenu(tr("&Macros"));
+    macroMenu->addAction(m_recordMacroAction);
+    macroMenu->addAction(m_playMacroAction);
+    macroMenu->addAction(m_playMacroRealTimeAction);
+    macroMenu->addSeparator();
+    macroMenu->addAction(m_saveMacroAction);
+    macroMenu->addAction(m_loadMacroAction);
     
     // Format Menu
     m_formatMenu = menuBar()->addMenu(tr("F&ormat"));
@@ -231,14 +353,29 @@ void MainWindow::createMenus()
     alignMenu->addAction(m_alignRightAction);
     alignMenu->addAction(m_alignJustifyAction);
     
+    m_formatMenu->addSeparator();
+    m_formatMenu->addAction(m_modifyStyleAction);
+    m_formatMenu->addAction(m_compactFormatsAction);
+    
+    // Table Menu
+    m_tableMenu = menuBar()->addMenu(tr("T&able"));
+    m_tableMenu->addAction(m_insertTableAction);
+    m_tableMenu->addAction(m_importCsvAction);
+    
     // View Menu
     m_viewMenu = menuBar()->addMenu(tr("&View"));
     m_viewMenu->addAction(m_zoomInAction);
     m_viewMenu->addAction(m_zoomOutAction);
     m_viewMenu->addAction(m_resetZoomAction);
+    m_viewMenu->addAction(m_fitToWidthAction);
+    m_viewMenu->addSeparator();
+    m_viewMenu->addAction(m_outlineDock->toggleViewAction());
+    m_viewMenu->addAction(m_latencyOverlayAction);
     
     // Help Menu
     m_helpMenu = menuBar()->addMenu(tr("&Help"));
+    m_helpMenu->addAction(m_typingLatencyAction);
+    m_helpMenu->addSeparator();
     m_helpMenu->addAction(tr("&About"), this, [this]() {
         QMessageBox::about(this, tr("About CPP Word"),
                            tr("A simple Word clone created with Qt and C++."));
@@ -298,6 +435,13 @@ void MainWindow::createToolbars()
     m_formatToolBar->addAction(m_alignRightAction);
     m_formatToolBar->addAction(m_alignJustifyAction);
     
+    // Named styles, paragraph styles first
+    m_styleComboBox = new QComboBox(m_formatToolBar);
+    m_styleComboBox->setMinimumWidth(110);
+    m_styleComboBox->setToolTip(tr("Paragraph and character styles"));
+    m_formatToolBar->addSeparator();
+    m_formatToolBar->addWidget(m_styleComboBox);
+    
     // Font combo box with reduced width for a compact UI
     QFontComboBox *fontComboBox = new QFontComboBox(m_formatToolBar);
     fontComboBox->setMinimumWidth(140); // Reduce width
@@ -334,6 +478,31 @@ void MainWindow::createToolbars()
     });
 }
 
+void MainWindow::createDockWindows()
+{
+    // Navigation pane with the heading outline of the current document
+    m_outlineDock = new QDockWidget(tr("Navigation"), this);
+    m_outlineDock->setObjectName("NavigationDock");
+    m_outlineDock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+    
+    m_outlinePanel = new OutlinePanel(m_outlineDock);
+    m_outlinePanel->setDocument(m_textEditor->document());
+    m_outlineDock->setWidget(m_outlinePanel);
+    addDockWidget(Qt::LeftDockWidgetArea, m_outlineDock);
+    
+    connect(m_outlinePanel, &OutlinePanel::headingActivated, this, [this](int blockNumber) {
+        QTextBlock block = m_textEditor->document()->findBlockByNumber(blockNumber);
+        if (!block.isValid()) {
+            return;
+        }
+        
+        QTextCursor cursor(block);
+        m_textEditor->setTextCursor(cursor);
+        m_textEditor->ensureCursorVisible();
+        m_textEditor->setFocus();
+    });
+}
+
 void MainWindow::setupConnections()
 {
     // File actions
@@ -344,7 +513,21 @@ void MainWindow::setupConnections()
     connect(m_printAction, &QAction::triggered, this, &MainWindow::printDocument);
     connect(m_printPreviewAction, &QAction::triggered, this, &MainWindow::printPreviewDialog);
     connect(m_documentPropertiesAction, &QAction::triggered, this, &MainWindow::documentProperties);
+    connect(m_versionHistoryAction, &QAction::triggered, this, &MainWindow::versionHistory);
+    connect(m_compareAction, &QAction::triggered, this, &MainWindow::compareDocuments);
+    connect(m_shareSessionAction, &QAction::toggled, this, &MainWindow::toggleSharedSession);
+    connect(m_traceAction, &QAction::triggered, this, &MainWindow::toggleTracing);
     connect(m_exitAction, &QAction::triggered, this, &QWidget::close);
+    
+    connect(m_sharedSession, &SharedSession::peersChanged, this, [this](int count) {
+        statusBar()->showMessage(tr("Shared session: %n other window(s) connected", "", count), 3000);
+    });
+    connect(m_sharedSession, &SharedSession::sessionEnded, this, [this]() {
+        m_shareSessionAction->setChecked(false);
+        m_undoAction->setEnabled(true);
+        m_redoAction->setEnabled(true);
+        statusBar()->showMessage(tr("Shared session ended"), 3000);
+    });
 
     // Edit actions
     connect(m_undoAction, &QAction::triggered, this, &MainWindow::undoAction);
@@ -352,12 +535,50 @@ void MainWindow::setupConnections()
     connect(m_cutAction, &QAction::triggered, this, &MainWindow::cutText);
     connect(m_copyAction, &QAction::triggered, this, &MainWindow::copyText);
     connect(m_pasteAction, &QAction::triggered, this, &MainWindow::pasteText);
+    
+    // Macros: the editor reports keys, pastes and formats; these actions are
+    // recorded by id. Paste and the format actions are left out because the
+    // editor already records what they did.
+    m_textEditor->setMacroRecorder(m_macroRecorder);
+    m_macroRecorder->registerAction("undo", m_undoAction);
+    m_macroRecorder->registerAction("redo", m_redoAction);
+    m_macroRecorder->registerAction("cut", m_cutAction);
+    m_macroRecorder->registerAction("copy", m_copyAction);
+    m_macroRecorder->registerAction("zoomIn", m_zoomInAction);
+    m_macroRecorder->registerAction("zoomOut", m_zoomOutAction);
+    m_macroRecorder->registerAction("resetZoom", m_resetZoomAction);
+    m_macroRecorder->registerAction("fitToWidth", m_fitToWidthAction);
+    
+    connect(m_recordMacroAction, &QAction::triggered, this, &MainWindow::toggleMacroRecording);
+    connect(m_playMacroAction, &QAction::triggered, this, &MainWindow::playMacro);
+    connect(m_playMacroRealTimeAction, &QAction::triggered, this, &MainWindow::playMacro);
+    connect(m_saveMacroAction, &QAction::triggered, this, &MainWindow::saveMacro);
+    connect(m_loadMacroAction, &QAction::triggered, this, &MainWindow::loadMacro);
+    connect(m_macroRecorder, &MacroRecorder::stepPlayed, this,
+            [this](int index, int count, const QString &type, qreal msecs) {
+        statusBar()->showMessage(tr("Macro step %1 of %2 (%3): %4 ms")
+                                 .arg(index + 1).arg(count).arg(type).arg(msecs, 0, 'f', 2));
+    });
+    connect(m_macroRecorder, &MacroRecorder::playbackFinished, this, [this](const QString &report) {
+        m_recordMacroAction->setEnabled(true);
+        m_loadMacroAction->setEnabled(true);
+        statusBar()->showMessage(tr("Macro finished"), 2000);
+        QMessageBox::information(this, tr("Macro Timings"), report);
+    });
 
     // Format actions
     connect(m_boldAction, &QAction::triggered, this, &MainWindow::textBold);
     connect(m_italicAction, &QAction::triggered, this, &MainWindow::textItalic);
     connect(m_underlineAction, &QAction::triggered, this, &MainWindow::textUnderline);
     connect(m_colorAction, &QAction::triggered, this, &MainWindow::textColor);
+    connect(m_modifyStyleAction, &QAction::triggered, this, &MainWindow::modifyStyle);
+    connect(m_compactFormatsAction, &QAction::triggered, this, &MainWindow::compactFormats);
+    connect(m_styleComboBox, QOverload<int>::of(&QComboBox::activated), this, &MainWindow::applyStyle);
+    connect(m_styleManager, &StyleManager::stylesChanged, this, &MainWindow::updateStyleComboBox);
+    connect(m_styleManager, &StyleManager::restyled, this, [this](int blocks, qint64 msecs) {
+        statusBar()->showMessage(tr("Restyled %n paragraph(s) in %1 ms", "", blocks).arg(msecs), 3000);
+    });
+    updateStyleComboBox();
     
     connect(m_alignLeftAction, &QAction::triggered, [this]() {
         m_textEditor->setAlignment(Qt::AlignLeft);
@@ -391,10 +612,34 @@ void MainWindow::setupConnections()
         m_alignJustifyAction->setChecked(true);
     });
 
+    // Table actions
+    connect(m_insertTableAction, &QAction::triggered, this, &MainWindow::insertTable);
+    connect(m_importCsvAction, &QAction::triggered, this, &MainWindow::importCsv);
+    connect(m_tableImport, &TableImport::progress, this, [this](int percent) {
+        if (percent < 100) {
+            statusBar()->showMessage(tr("Importing table... %1%").arg(percent));
+        }
+    });
+    connect(m_tableImport, &TableImport::finished, this, [this](int rows, int columns) {
+        m_importCsvAction->setEnabled(true);
+        statusBar()->showMessage(tr("Imported a table with %1 rows and %2 columns").arg(rows).arg(columns), 3000);
+    });
+    connect(m_tableImport, &TableImport::failed, this, [this](const QString &error) {
+        m_importCsvAction->setEnabled(true);
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, tr("Import Error"), tr("Could not import the table: %1").arg(error));
+    });
+
     // View actions
     connect(m_zoomInAction, &QAction::triggered, this, &MainWindow::zoomIn);
     connect(m_zoomOutAction, &QAction::triggered, this, &MainWindow::zoomOut);
     connect(m_resetZoomAction, &QAction::triggered, this, &MainWindow::resetZoom);
+    connect(m_fitToWidthAction, &QAction::triggered, this, &MainWindow::fitToWidth);
+    connect(m_latencyOverlayAction, &QAction::toggled, m_textEditor, &TextEditor::setLatencyOverlayVisible);
+    connect(m_typingLatencyAction, &QAction::triggered, this, &MainWindow::typingLatency);
+    connect(m_textEditor, &TextEditor::zoomChanged, this, [this](qreal factor) {
+        statusBar()->showMessage(tr("Zoom: %1%").arg(qRound(factor * 100)), 2000);
+    });
     
     // Text editor connections for updating UI
     connect(m_textEditor, &QTextEdit::cursorPositionChanged, [this]() {
@@ -410,29 +655,85 @@ void MainWindow::setupConnections()
         m_alignCenterAction->setChecked(alignment == Qt::AlignCenter);
         m_alignRightAction->setChecked(alignment == Qt::AlignRight);
         m_alignJustifyAction->setChecked(alignment == Qt::AlignJustify);
+        
+        // Show the paragraph style of the block, without applying it
+        const int styleIndex = m_styleComboBox->findData(StyleManager::paragraphStyle(cursor.block()));
+        m_styleComboBox->setCurrentIndex(qMax(0, styleIndex));
     });
     
     connect(m_textEditor->document(), &QTextDocument::modificationChanged, [this](bool changed) {
         setWindowModified(changed);
         updateWindowTitle();
     });
+    
+    // Files rewritten by other programs
+    connect(m_fileMonitor, &FileMonitor::externallyModified, this, [this](const QString &filePath) {
+        QMessageBox::StandardButton answer = QMessageBox::question(this, tr("File Changed"),
+            tr("%1 has been changed by another program.\n"
+               "Do you want to reload it and discard your changes?").arg(QFileInfo(filePath).fileName()),
+            QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+        if (answer == QMessageBox::Yes) {
+            m_fileMonitor->reload();
+        }
+    });
+    connect(m_fileMonitor, &FileMonitor::reloaded, this, [this](int changedBlocks) {
+        statusBar()->showMessage(tr("Reloaded from disk (%n paragraph(s) changed)", "", changedBlocks), 2000);
+    });
+    connect(m_fileMonitor, &FileMonitor::fileRemoved, this, [this](const QString &filePath) {
+        statusBar()->showMessage(tr("%1 was removed from disk").arg(QFileInfo(filePath).fileName()));
+    });
 }
 
 void MainWindow::setupStatusBar()
 {
     statusBar()->showMessage(tr("Ready"));
     
-    // Word count label
+    // Page label, fed by the background paginator
+    m_paginator->setPageLayout(QPrinter(QPrinter::HighResolution).pageLayout());
+    QLabel *pageLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(pageLabel);
+    
+    auto updatePageLabel = [=]() {
+        const int pageCount = m_paginator->pageCount();
+        if (pageCount < 0) {
+            return;
+        }
+        const int page = m_paginator->pageForPosition(m_textEditor->textCursor().position());
+        pageLabel->setText(tr("Page %1 of %2").arg(qBound(1, page, pageCount)).arg(pageCount));
+    };
+    connect(m_paginator, &Paginator::paginated, this, updatePageLabel);
+    connect(m_textEditor, &QTextEdit::cursorPositionChanged, this, updatePageLabel);
+    
+    // Word count label; paragraphs are counted as they change, so a
+    // keystroke recounts one paragraph rather than the whole document
+    WordCounter *wordCounter = new WordCounter(m_textEditor->document(), this);
     QLabel *wordCountLabel = new QLabel(this);
-    wordCountLabel->setText(tr("Words: 0"));
     statusBar()->addPermanentWidget(wordCountLabel);
-    
-    // Update word count when document changes
-    connect(m_textEditor->document(), &QTextDocument::contentsChanged, [=]() {
-        QString text = m_textEditor->toPlainText();
-        int wordCount = text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts).count();
+    wordCountLabel->setText(tr("Words: %1").arg(wordCounter->count()));
+    connect(wordCounter, &WordCounter::countChanged, wordCountLabel, [this, wordCountLabel](int wordCount) {
         wordCountLabel->setText(tr("Words: %1").arg(wordCount));
     });
+    
+    connect(m_textEditor, &TextEditor::pasteProgress, this, [this](int percent) {
+        if (percent < 100) {
+            statusBar()->showMessage(tr("Pasting... %1%").arg(percent));
+        } else {
+            statusBar()->showMessage(tr("Paste complete"), 2000);
+        }
+    });
+    
+    // Show progress while a large document finishes loading
+    connect(m_textEditor, &TextEditor::loadProgress, this, [this](int percent) {
+        if (percent < 100) {
+            statusBar()->showMessage(tr("Loading... %1%").arg(percent));
+        }
+    });
+    
+    connect(m_documentManager, &DocumentManager::autoSaved, this,
+            [this](qint64 rawBytes, qint64 writtenBytes, qint64 guiMsecs) {
+        statusBar()->showMessage(tr("Autosaved (%1 KB, %2 KB on disk, %3 ms on the GUI thread)")
+                                 .arg(rawBytes / 1024).arg(writtenBytes / 1024).arg(guiMsecs), 2000);
+    });
 }
 
 void MainWindow::updateWindowTitle()
@@ -452,6 +753,9 @@ void MainWindow::saveSettings()
     settings.setValue("geometry", saveGeometry());
     settings.setValue("state", saveState());
     settings.endGroup();
+    
+    m_sessionState->save();
+    m_styleManager->save();
 }
 
 void MainWindow::loadSettings()
@@ -461,12 +765,20 @@ void MainWindow::loadSettings()
     restoreGeometry(settings.value("geometry").toByteArray());
     restoreState(settings.value("state").toByteArray());
     settings.endGroup();
+    
+    m_styleManager->load();
+    m_recentFiles->load();
 }
 
 // File operations
 void MainWindow::newDocument()
 {
     if (maybeSave()) {
+        rememberDocumentState();
+        m_shareSessionAction->setChecked(false);
+        m_textEditor->cancelLoading();
+        m_tableImport->cancel();
+        m_importCsvAction->setEnabled(true);
         m_textEditor->clear();
         m_currentFile.clear();
         updateWindowTitle();
@@ -474,6 +786,7 @@ void MainWindow::newDocument()
         
         // Stop auto-save
         m_documentManager->stopAutoSave();
+        m_fileMonitor->unwatch();
     }
 }
 
@@ -484,35 +797,170 @@ void MainWindow::openDocument()
                            tr("All Supported Files (*.txt *.html *.htm *.rtf);;Text Documents (*.txt);;HTML Documents (*.html *.htm);;Rich Text Documents (*.rtf);;All Files (*)"));
         
         if (!fileName.isEmpty()) {
-            QFile file(fileName);
-            if (file.open(QFile::ReadOnly | QFile::Text)) {
-                QTextStream in(&file);
-                in.setEncoding(QStringConverter::Utf8);
-                
-                if (fileName.endsWith(".html", Qt::CaseInsensitive) || fileName.endsWith(".htm", Qt::CaseInsensitive)) {
-                    m_textEditor->setHtml(in.readAll());
-                } else if (fileName.endsWith(".rtf", Qt::CaseInsensitive)) {
-                    m_textEditor->setHtml(in.readAll());
-                } else {
-                    m_textEditor->setPlainText(in.readAll());
+            rememberDocumentState();
+            loadFile(fileName);
+        }
+    }
+}
+
+void MainWindow::openRecentFile(const QString &fileName)
+{
+    if (!maybeSave()) {
+        return;
+    }
+    if (!QFile::exists(fileName)) {
+        QMessageBox::warning(this, tr("Open Error"),
+                           tr("File %1 no longer exists.").arg(fileName));
+        m_recentFiles->remove(fileName);
+        return;
+    }
+    
+    rememberDocumentState();
+    loadFile(fileName);
+}
+
+void MainWindow::updateRecentFilesMenu()
+{
+    m_recentFilesMenu->clear();
+    
+    // Another window may have opened files since
+    m_recentFiles->load();
+    const QStringList files = m_recentFiles->files();
+    for (int i = 0; i < files.size(); ++i) {
+        const QString fileName = files.at(i);
+        QAction *action = m_recentFilesMenu->addAction(tr("&%1 %2").arg(i + 1).arg(QFileInfo(fileName).fileName()));
+        action->setStatusTip(fileName);
+        connect(action, &QAction::triggered, this, [this, fileName]() { openRecentFile(fileName); });
+    }
+    if (files.isEmpty()) {
+        m_recentFilesMenu->addAction(tr("No Recent Files"))->setEnabled(false);
+        return;
+    }
+    
+    m_recentFilesMenu->addSeparator();
+    connect(m_recentFilesMenu->addAction(tr("&Clear Recent Files")), &QAction::triggered,
+            m_recentFiles, &RecentFiles::clear);
+    
+    // The user is likely about to pick one; have it decoded by then
+    m_recentFiles->prefetch(m_currentFile, TaskExecutor::Background);
+}
+
+bool MainWindow::loadFile(const QString &fileName)
+{
+    TRACE_SCOPE("MainWindow::loadFile");
+    m_shareSessionAction->setChecked(false);
+    m_tableImport->cancel();
+    m_importCsvAction->setEnabled(true);
+    
+    QString content;
+    QString errorString;
+    TextImport::Encoding encoding;
+    
+    // A recent file read ahead in the background skips the disk
+    if (!m_recentFiles->takePrefetched(fileName, &content, &encoding)
+        && !TextImport::readFile(fileName, &content, &encoding, &errorString)) {
+        QMessageBox::warning(this, tr("Open Error"),
+                           tr("Could not open file %1: %2")
+                           .arg(fileName, errorString));
+        return false;
+    }
+    
+    TRACE_COUNTER("document characters", content.size());
+    
+    // Documents opened before come back where the user left them; the part
+    // that was on screen is loaded first
+    SessionState::Document state;
+    const bool known = m_sessionState->find(fileName, &state);
+    if (known) {
+        m_textEditor->setZoomFactor(state.zoomFactor);
+    }
+    const qreal startFraction = known ? state.visibleFraction : 0;
+    
+    // Large documents are laid out viewport-first and finish loading in the background
+    if (fileName.endsWith(".html", Qt::CaseInsensitive) || fileName.endsWith(".htm", Qt::CaseInsensitive)) {
+        m_textEditor->loadContent(content, Qt::RichText, startFraction);
+    } else if (fileName.endsWith(".rtf", Qt::CaseInsensitive)) {
+        m_textEditor->loadContent(content, Qt::RichText, startFraction);
+    } else if (fileName.endsWith(".md", Qt::CaseInsensitive) || fileName.endsWith(".markdown", Qt::CaseInsensitive)) {
+        m_textEditor->loadContent(content, Qt::MarkdownText, startFraction);
+    } else {
+        m_textEditor->loadContent(content, Qt::PlainText, startFraction);
+    }
+    content.clear();
+    
+    m_currentFile = fileName;
+    updateWindowTitle();
+    m_textEditor->document()->setModified(false);
+    m_recentFiles->add(fileName);
+    
+    if (encoding == TextImport::Utf8WithReplacements) {
+        QMessageBox::warning(this, tr("Invalid Characters"),
+                             tr("%1 is not entirely valid UTF-8. The invalid bytes were replaced with "
+                                "the Unicode replacement character and will be saved that way.")
+                             .arg(QFileInfo(fileName).fileName()));
+    } else if (encoding == TextImport::Utf16LittleEndianWithReplacements
+               || encoding == TextImport::Utf16BigEndianWithReplacements) {
+        QMessageBox::warning(this, tr("Invalid Characters"),
+                             tr("%1 is not entirely valid %2: it has an odd number of bytes or unpaired "
+                                "surrogates. The invalid parts were replaced with the Unicode replacement "
+                                "character and will be saved that way.")
+                             .arg(QFileInfo(fileName).fileName(), TextImport::encodingName(encoding)));
+    }
+    
+    // Cursor and scroll offsets need the whole document; a scroll made
+    // while the rest was loading wins over the saved offset
+    auto restoreState = [this, state](bool userScrolled) {
+        QTextDocument *document = m_textEditor->document();
+        const int last = document->characterCount() - 1;
+        QTextCursor cursor(document);
+        cursor.setPosition(qBound(0, state.anchorPosition, last));
+        cursor.setPosition(qBound(0, state.cursorPosition, last), QTextCursor::KeepAnchor);
+        
+        QScrollBar *vertical = m_textEditor->verticalScrollBar();
+        QScrollBar *horizontal = m_textEditor->horizontalScrollBar();
+        const int verticalValue = userScrolled ? vertical->value() : state.verticalScroll;
+        const int horizontalValue = userScrolled ? horizontal->value() : state.horizontalScroll;
+        m_textEditor->setTextCursor(cursor);
+        
+        // After the scroll ranges have caught up with the layout
+        QTimer::singleShot(0, this, [this, verticalValue, horizontalValue]() {
+            m_textEditor->verticalScrollBar()->setValue(verticalValue);
+            m_textEditor->horizontalScrollBar()->setValue(horizontalValue);
+        });
+    };
+    
+    // Start auto-save for crash recovery once the whole document is in
+    if (m_textEditor->isLoading()) {
+        auto userScrolled = std::make_shared<bool>(false);
+        QMetaObject::Connection scrollConnection = connect(m_textEditor->verticalScrollBar(), &QScrollBar::actionTriggered,
+                                                           this, [userScrolled]() { *userScrolled = true; });
+        connect(m_textEditor, &TextEditor::loadFinished, this, [this, fileName, known, restoreState, userScrolled, scrollConnection]() {
+            disconnect(scrollConnection);
+            if (m_currentFile == fileName) {
+                const bool hinted = suggestFormatCompaction();
+                if (known) {
+                    restoreState(*userScrolled);
                 }
-                
-                file.close();
-                m_currentFile = fileName;
-                updateWindowTitle();
-                m_textEditor->document()->setModified(false);
-                
-                // Start auto-save for crash recovery
                 m_documentManager->startAutoSave(m_textEditor->document(), m_currentFile);
-                
-                statusBar()->showMessage(tr("File loaded"), 2000);
-            } else {
-                QMessageBox::warning(this, tr("Open Error"),
-                                   tr("Could not open file %1: %2")
-                                   .arg(fileName, file.errorString()));
+                watchCurrentFile();
+                if (!hinted) {
+                    statusBar()->showMessage(tr("File loaded"), 2000);
+                }
             }
+        }, Qt::SingleShotConnection);
+    } else {
+        const bool hinted = suggestFormatCompaction();
+        if (known) {
+            restoreState(false);
+        }
+        m_documentManager->startAutoSave(m_textEditor->document(), m_currentFile);
+        watchCurrentFile();
+        if (!hinted) {
+            statusBar()->showMessage(tr("File loaded"), 2000);
         }
     }
+    
+    return true;
 }
 
 bool MainWindow::saveDocument()
@@ -521,6 +969,11 @@ bool MainWindow::saveDocument()
         return saveAsDocument();
     }
     
+    TRACE_SCOPE("MainWindow::saveDocument");
+    
+    // Never write out a partially loaded document
+    m_textEditor->finishLoading();
+    
     // Determine the file format
     QString format;
     if (m_currentFile.endsWith(".html", Qt::CaseInsensitive) || m_currentFile.endsWith(".htm", Qt::CaseInsensitive)) {
@@ -531,9 +984,15 @@ bool MainWindow::saveDocument()
         format = "txt";
     }
     
+    DocumentExporter::Format exportFormat;
     bool success = false;
     
-    if (format == "html" || format == "rtf") {
+    if (DocumentExporter::formatForFile(m_currentFile, &exportFormat)) {
+        // Streamed block by block, without building the output in memory
+        success = DocumentExporter::exportToFile(m_textEditor->document(), m_currentFile, exportFormat);
+    } else if (format == "html") {
+        success = HtmlWriter::writeToFile(m_textEditor->document(), m_currentFile);
+    } else if (format == "rtf") {
         QTextDocumentWriter writer(m_currentFile);
         writer.setFormat(format.toUtf8());
         success = writer.write(m_textEditor->document());
@@ -552,8 +1011,12 @@ bool MainWindow::saveDocument()
         m_textEditor->document()->setModified(false);
         statusBar()->showMessage(tr("File saved"), 2000);
         
-        // Update auto-save
+        // Update auto-save and record the saved state in the version history
         m_documentManager->startAutoSave(m_textEditor->document(), m_currentFile);
+        m_documentManager->snapshotVersion(tr("Saved"));
+        
+        // Our own write is not an external change
+        watchCurrentFile();
     } else {
         QMessageBox::warning(this, tr("Save Error"),
                            tr("Could not save file %1")
@@ -566,7 +1029,9 @@ bool MainWindow::saveDocument()
 bool MainWindow::saveAsDocument()
 {
     QString fileName = QFileDialog::getSaveFileName(this, tr("Save As"), "",
-                        tr("Text Documents (*.txt);;HTML Documents (*.html *.htm);;Rich Text Documents (*.rtf);;All Files (*)"));
+                        tr("Text Documents (*.txt);;HTML Documents (*.html *.htm);;Rich Text Documents (*.rtf);;%1;;%2;;All Files (*)")
+                        .arg(DocumentExporter::fileFilter(DocumentExporter::Markdown),
+                             DocumentExporter::fileFilter(DocumentExporter::Odt)));
     
     if (fileName.isEmpty()) {
         return false;
@@ -580,7 +1045,11 @@ bool MainWindow::saveAsDocument()
     
     m_currentFile = fileName;
     updateWindowTitle();
-    return saveDocument();
+    if (!saveDocument()) {
+        return false;
+    }
+    m_recentFiles->add(fileName);
+    return true;
 }
 
 bool MainWindow::maybeSave()
@@ -605,9 +1074,13 @@ bool MainWindow::maybeSave()
 void MainWindow::printDocument()
 {
     QPrinter printer(QPrinter::HighResolution);
+    printer.setPageLayout(m_paginator->pageLayout());
     QPrintDialog dialog(&printer, this);
     
     if (dialog.exec() == QDialog::Accepted) {
+        TRACE_SCOPE("MainWindow::printDocument");
+        m_textEditor->finishLoading();
+        m_paginator->setPageLayout(printer.pageLayout());
         m_textEditor->print(&printer);
     }
 }
@@ -615,15 +1088,24 @@ void MainWindow::printDocument()
 void MainWindow::printPreviewDialog()
 {
     QPrinter printer(QPrinter::HighResolution);
+    printer.setPageLayout(m_paginator->pageLayout());
     QPrintPreviewDialog preview(&printer, this);
     
-    connect(&preview, &QPrintPreviewDialog::paintRequested, m_textEditor, &TextEditor::print);
+    // The preview is painted by a real print pass; the paginator only takes
+    // over the layout, so its page count agrees with what is shown
+    connect(&preview, &QPrintPreviewDialog::paintRequested, this, [this](QPrinter *printer) {
+        TRACE_SCOPE("MainWindow::printPreview");
+        m_textEditor->finishLoading();
+        m_paginator->setPageLayout(printer->pageLayout());
+        m_textEditor->print(printer);
+    });
     preview.exec();
 }
 
 // Edit operations
 void MainWindow::cutText()
 {
+    // Clipboard formats are produced lazily by TextEditor::createMimeDataFromSelection
     m_textEditor->cut();
 }
 
@@ -647,6 +1129,73 @@ void MainWindow::redoAction()
     m_textEditor->redo();
 }
 
+void MainWindow::toggleMacroRecording(bool enabled)
+{
+    if (enabled) {
+        m_macroRecorder->startRecording();
+        m_playMacroAction->setEnabled(false);
+        m_playMacroRealTimeAction->setEnabled(false);
+        m_saveMacroAction->setEnabled(false);
+        m_loadMacroAction->setEnabled(false);
+        statusBar()->showMessage(tr("Recording macro"));
+        return;
+    }
+    
+    m_macroRecorder->stopRecording();
+    const bool hasSteps = m_macroRecorder->stepCount() > 0;
+    m_playMacroAction->setEnabled(hasSteps);
+    m_playMacroRealTimeAction->setEnabled(hasSteps);
+    m_saveMacroAction->setEnabled(hasSteps);
+    m_loadMacroAction->setEnabled(true);
+    statusBar()->showMessage(tr("Macro recorded (%n step(s))", "", m_macroRecorder->stepCount()), 3000);
+}
+
+void MainWindow::playMacro()
+{
+    if (m_macroRecorder->isPlaying()) {
+        return;
+    }
+    
+    m_recordMacroAction->setEnabled(false);
+    m_loadMacroAction->setEnabled(false);
+    m_textEditor->setFocus();
+    m_macroRecorder->play(sender() == m_playMacroRealTimeAction ? MacroRecorder::RealTime
+                                                                : MacroRecorder::FullSpeed);
+}
+
+void MainWindow::saveMacro()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Macro"), "",
+                                                    tr("CPP Word Macros (*.cpwmacro);;All Files (*)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    if (!m_macroRecorder->save(fileName)) {
+        QMessageBox::warning(this, tr("Save Error"), tr("Could not write macro to %1").arg(fileName));
+    }
+}
+
+void MainWindow::loadMacro()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Load Macro"), "",
+                                                    tr("CPP Word Macros (*.cpwmacro);;All Files (*)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    if (!m_macroRecorder->load(fileName)) {
+        QMessageBox::warning(this, tr("Load Error"), tr("%1 is not a macro file").arg(fileName));
+        return;
+    }
+    
+    const bool hasSteps = m_macroRecorder->stepCount() > 0;
+    m_playMacroAction->setEnabled(hasSteps);
+    m_playMacroRealTimeAction->setEnabled(hasSteps);
+    m_saveMacroAction->setEnabled(hasSteps);
+    statusBar()->showMessage(tr("Macro loaded (%n step(s))", "", m_macroRecorder->stepCount()), 3000);
+}
+
 // Format operations
 void MainWindow::textBold()
 {
@@ -695,15 +1244,254 @@ void MainWindow::paragraphAlign()
     }
 }
 
+void MainWindow::applyStyle(int index)
+{
+    const QString name = m_styleComboBox->itemData(index).toString();
+    if (name.isEmpty()) {
+        return;
+    }
+    
+    m_styleManager->applyStyle(m_textEditor->textCursor(), name);
+    m_textEditor->setFocus();
+}
+
+void MainWindow::modifyStyle()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Modify Style"));
+    
+    QFormLayout *layout = new QFormLayout(&dialog);
+    
+    QComboBox *nameComboBox = new QComboBox(&dialog);
+    nameComboBox->addItems(m_styleManager->styleNames(StyleManager::ParagraphStyle));
+    nameComboBox->addItems(m_styleManager->styleNames(StyleManager::CharacterStyle));
+    const QString current = StyleManager::paragraphStyle(m_textEditor->textCursor().block());
+    if (!current.isEmpty()) {
+        nameComboBox->setCurrentText(current);
+    }
+    layout->addRow(tr("Style:"), nameComboBox);
+    
+    // The edited definition; rebuilt whenever another style is picked
+    StyleManager::Style style;
+    
+    QPushButton *fontButton = new QPushButton(&dialog);
+    QPushButton *colorButton = new QPushButton(tr("Color..."), &dialog);
+    QComboBox *alignmentComboBox = new QComboBox(&dialog);
+    alignmentComboBox->addItem(tr("Unchanged"), 0);
+    alignmentComboBox->addItem(tr("Left"), int(Qt::AlignLeft));
+    alignmentComboBox->addItem(tr("Center"), int(Qt::AlignCenter));
+    alignmentComboBox->addItem(tr("Right"), int(Qt::AlignRight));
+    alignmentComboBox->addItem(tr("Justify"), int(Qt::AlignJustify));
+    QSpinBox *spacingSpinBox = new QSpinBox(&dialog);
+    spacingSpinBox->setRange(0, 72);
+    spacingSpinBox->setSuffix(tr(" pt"));
+    
+    layout->addRow(tr("Font:"), fontButton);
+    layout->addRow(tr("Text color:"), colorButton);
+    layout->addRow(tr("Alignment:"), alignmentComboBox);
+    layout->addRow(tr("Space after:"), spacingSpinBox);
+    
+    auto styleFont = [this, &style]() {
+        QTextCharFormat format;
+        format.setFont(m_textEditor->document()->defaultFont());
+        format.merge(style.charFormat);
+        return format.font();
+    };
+    auto showStyle = [&]() {
+        style = m_styleManager->style(nameComboBox->currentText());
+        const QFont font = styleFont();
+        fontButton->setText(QString("%1, %2 pt").arg(font.family()).arg(font.pointSizeF()));
+        
+        const bool paragraph = style.type == StyleManager::ParagraphStyle;
+        alignmentComboBox->setEnabled(paragraph);
+        spacingSpinBox->setEnabled(paragraph);
+        const int alignmentIndex = alignmentComboBox->findData(int(style.blockFormat.alignment()));
+        alignmentComboBox->setCurrentIndex(style.blockFormat.hasProperty(QTextFormat::BlockAlignment)
+                                           ? qMax(0, alignmentIndex) : 0);
+        spacingSpinBox->setValue(qRound(style.blockFormat.bottomMargin()));
+    };
+    showStyle();
+    connect(nameComboBox, &QComboBox::currentTextChanged, &dialog, showStyle);
+    
+    connect(fontButton, &QPushButton::clicked, &dialog, [&]() {
+        bool ok = false;
+        const QFont font = QFontDialog::getFont(&ok, styleFont(), &dialog);
+        if (ok) {
+            style.charFormat.setFontFamilies(QStringList() << font.family());
+            style.charFormat.setFontPointSize(font.pointSizeF());
+            style.charFormat.setFontWeight(font.weight());
+            style.charFormat.setFontItalic(font.italic());
+            fontButton->setText(QString("%1, %2 pt").arg(font.family()).arg(font.pointSizeF()));
+        }
+    });
+    connect(colorButton, &QPushButton::clicked, &dialog, [&]() {
+        const QColor color = QColorDialog::getColor(style.charFormat.foreground().color(), &dialog);
+        if (color.isValid()) {
+            style.charFormat.setForeground(color);
+        }
+    });
+    
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    layout->addRow(buttonBox);
+    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    if (style.type == StyleManager::ParagraphStyle) {
+        const int alignment = alignmentComboBox->currentData().toInt();
+        if (alignment != 0) {
+            style.blockFormat.setAlignment(Qt::Alignment(alignment));
+        } else {
+            style.blockFormat.clearProperty(QTextFormat::BlockAlignment);
+        }
+        style.blockFormat.setBottomMargin(spacingSpinBox->value());
+    }
+    m_styleManager->redefineStyle(style);
+}
+
+void MainWindow::compactFormats()
+{
+    if (m_textEditor->isLoading() || m_textEditor->isPasting()) {
+        statusBar()->showMessage(tr("Formats can be compacted once loading has finished"), 3000);
+        return;
+    }
+    
+    // Compacting rebuilds the document, which empties the undo stack
+    if (m_textEditor->document()->isUndoAvailable()) {
+        const QMessageBox::StandardButton answer = QMessageBox::question(this, tr("Compact Formats"),
+            tr("Compacting formats rebuilds the document and clears its undo history. "
+               "Edits made so far can no longer be undone.\n\nCompact formats anyway?"),
+            QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+        if (answer != QMessageBox::Yes) {
+            return;
+        }
+    }
+    
+    const QPoint scroll(m_textEditor->horizontalScrollBar()->value(), m_textEditor->verticalScrollBar()->value());
+    const QTextCursor previous = m_textEditor->textCursor();
+    const int position = previous.position();
+    const int anchor = previous.anchor();
+    
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const FormatCompactor::Stats stats = FormatCompactor::compact(m_textEditor->document());
+    QApplication::restoreOverrideCursor();
+    
+    QTextCursor cursor(m_textEditor->document());
+    cursor.setPosition(anchor);
+    cursor.setPosition(position, QTextCursor::KeepAnchor);
+    m_textEditor->setTextCursor(cursor);
+    QTimer::singleShot(0, this, [this, scroll]() {
+        m_textEditor->horizontalScrollBar()->setValue(scroll.x());
+        m_textEditor->verticalScrollBar()->setValue(scroll.y());
+    });
+    
+    QMessageBox::information(this, tr("Compact Formats"),
+                             tr("Character formats: %1 before, %2 after.\n"
+                                "Estimated format memory: %3 KB before, %4 KB after.\n"
+                                "Took %5 ms.")
+                             .arg(stats.formatsBefore).arg(stats.formatsAfter)
+                             .arg(stats.bytesBefore / 1024).arg(stats.bytesAfter / 1024)
+                             .arg(stats.msecs));
+}
+
+// Imported HTML often carries thousands of formats that only differ in
+// redundant properties. Compacting rebuilds the whole document, which would
+// undo the progressive load, so it is only suggested here.
+bool MainWindow::suggestFormatCompaction()
+{
+    if (!FormatCompactor::isWorthCompacting(m_textEditor->document())) {
+        return false;
+    }
+    
+    statusBar()->showMessage(tr("File loaded; it has many redundant formats, use Format > Compact Formats to merge them"), 5000);
+    return true;
+}
+
+void MainWindow::updateStyleComboBox()
+{
+    const QString current = m_styleComboBox->currentData().toString();
+    
+    m_styleComboBox->clear();
+    m_styleComboBox->addItem(tr("(No style)"), QString());
+    for (const QString &name : m_styleManager->styleNames(StyleManager::ParagraphStyle)) {
+        m_styleComboBox->addItem(name, name);
+    }
+    m_styleComboBox->insertSeparator(m_styleComboBox->count());
+    for (const QString &name : m_styleManager->styleNames(StyleManager::CharacterStyle)) {
+        m_styleComboBox->addItem(name, name);
+    }
+    
+    m_styleComboBox->setCurrentIndex(qMax(0, m_styleComboBox->findData(current)));
+}
+
+// Table operations
+void MainWindow::insertTable()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Insert Table"));
+    
+    QFormLayout *layout = new QFormLayout(&dialog);
+    
+    QSpinBox *rowsSpinBox = new QSpinBox(&dialog);
+    rowsSpinBox->setRange(1, 100000);
+    rowsSpinBox->setValue(3);
+    layout->addRow(tr("Rows:"), rowsSpinBox);
+    
+    QSpinBox *columnsSpinBox = new QSpinBox(&dialog);
+    columnsSpinBox->setRange(1, 64);
+    columnsSpinBox->setValue(3);
+    layout->addRow(tr("Columns:"), columnsSpinBox);
+    
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    layout->addRow(buttonBox);
+    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    TRACE_SCOPE("MainWindow::insertTable");
+    const int columns = columnsSpinBox->value();
+    QTextCursor cursor = m_textEditor->textCursor();
+    cursor.beginEditBlock();
+    cursor.removeSelectedText();
+    QTextTable *table = cursor.insertTable(rowsSpinBox->value(), columns, TableImport::tableFormat(columns));
+    cursor.endEditBlock();
+    
+    m_textEditor->setTextCursor(table->cellAt(0, 0).firstCursorPosition());
+    m_textEditor->setFocus();
+}
+
+void MainWindow::importCsv()
+{
+    if (m_tableImport->isRunning()) {
+        return;
+    }
+    
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import CSV"), "",
+                                                    tr("CSV Files (*.csv *.tsv *.txt);;All Files (*)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    if (m_tableImport->start(fileName)) {
+        m_importCsvAction->setEnabled(false);
+    }
+}
+
 // View operations
 void MainWindow::zoomIn()
 {
-    m_textEditor->zoomIn();
+    m_textEditor->zoomBy(1);
 }
 
 void MainWindow::zoomOut()
 {
-    m_textEditor->zoomOut();
+    m_textEditor->zoomBy(-1);
 }
 
 void MainWindow::resetZoom()
@@ -711,11 +1499,198 @@ void MainWindow::resetZoom()
     m_textEditor->resetZoom();
 }
 
+void MainWindow::typingLatency()
+{
+    LatencyMonitor *monitor = m_textEditor->latencyMonitor();
+    
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Typing Latency"));
+    dialog.resize(560, 420);
+    
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    
+    QLabel *summaryLabel = new QLabel(&dialog);
+    layout->addWidget(summaryLabel);
+    
+    QTableWidget *slowTable = new QTableWidget(&dialog);
+    slowTable->setColumnCount(4);
+    slowTable->setHorizontalHeaderLabels({tr("Time"), tr("Latency (ms)"), tr("Characters"), tr("Paragraphs")});
+    slowTable->horizontalHeader()->setStretchLastSection(true);
+    slowTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    layout->addWidget(slowTable);
+    
+    QLabel *tasksLabel = new QLabel(&dialog);
+    layout->addWidget(tasksLabel);
+    
+    auto refresh = [=]() {
+        summaryLabel->setText(tr("%n keystroke(s) measured. p50 %1 ms, p95 %2 ms, p99 %3 ms, max %4 ms.\n"
+                                 "Frames slower than %5 ms:", "", monitor->sampleCount())
+                              .arg(monitor->percentile(0.50), 0, 'f', 1)
+                              .arg(monitor->percentile(0.95), 0, 'f', 1)
+                              .arg(monitor->percentile(0.99), 0, 'f', 1)
+                              .arg(monitor->maximum(), 0, 'f', 1)
+                              .arg(LatencyMonitor::SLOW_FRAME_MS));
+        
+        // Newest first
+        const QList<LatencyMonitor::SlowFrame> frames = monitor->slowFrames();
+        slowTable->setRowCount(frames.size());
+        for (int i = 0; i < frames.size(); ++i) {
+            const LatencyMonitor::SlowFrame &frame = frames.at(frames.size() - 1 - i);
+            slowTable->setItem(i, 0, new QTableWidgetItem(frame.timestamp.toString("hh:mm:ss.zzz")));
+            slowTable->setItem(i, 1, new QTableWidgetItem(QString::number(frame.latencyMs, 'f', 1)));
+            slowTable->setItem(i, 2, new QTableWidgetItem(QString::number(frame.characters)));
+            slowTable->setItem(i, 3, new QTableWidgetItem(QString::number(frame.blocks)));
+        }
+        
+        // Work moved off the GUI thread still delays results if it queues up
+        const TaskExecutor::Stats tasks = TaskExecutor::instance()->stats();
+        tasksLabel->setText(tr("Background tasks: %1 running, %2/%3/%4 queued (interactive/background/idle), "
+                               "%5 done, %6 cancelled.\nWait %7 ms mean, %8 ms max; run %9 ms mean.")
+                            .arg(tasks.running)
+                            .arg(tasks.queued[TaskExecutor::Interactive])
+                            .arg(tasks.queued[TaskExecutor::Background])
+                            .arg(tasks.queued[TaskExecutor::Idle])
+                            .arg(tasks.completed)
+                            .arg(tasks.cancelled)
+                            .arg(tasks.meanWaitUsecs / 1000.0, 0, 'f', 1)
+                            .arg(tasks.maxWaitUsecs / 1000.0, 0, 'f', 1)
+                            .arg(tasks.meanRunUsecs / 1000.0, 0, 'f', 1));
+    };
+    refresh();
+    
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    QPushButton *exportButton = buttonBox->addButton(tr("Export..."), QDialogButtonBox::ActionRole);
+    QPushButton *resetButton = buttonBox->addButton(tr("Reset"), QDialogButtonBox::ResetRole);
+    layout->addWidget(buttonBox);
+    
+    connect(exportButton, &QPushButton::clicked, &dialog, [&]() {
+        QString fileName = QFileDialog::getSaveFileName(&dialog, tr("Export Typing Latency"), "typing-latency.json",
+                                                        tr("JSON Files (*.json);;All Files (*)"));
+        if (fileName.isEmpty()) {
+            return;
+        }
+        
+        QFile file(fileName);
+        if (!file.open(QFile::WriteOnly)) {
+            QMessageBox::warning(&dialog, tr("Export Error"),
+                                 tr("Could not write file %1: %2").arg(fileName, file.errorString()));
+            return;
+        }
+        file.write(QJsonDocument(monitor->toJson()).toJson());
+        file.close();
+    });
+    connect(resetButton, &QPushButton::clicked, &dialog, [=]() {
+        monitor->reset();
+        refresh();
+    });
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    
+    dialog.exec();
+}
+
+void MainWindow::toggleTracing(bool enabled)
+{
+    if (enabled) {
+        Tracer::setEnabled(true);
+        statusBar()->showMessage(tr("Recording trace"), 2000);
+        return;
+    }
+    
+    Tracer::setEnabled(false);
+    const QString path = Tracer::outputPath();
+    if (Tracer::writeChromeTrace(path)) {
+        statusBar()->showMessage(tr("Trace written to %1").arg(QDir::toNativeSeparators(path)), 5000);
+    } else {
+        statusBar()->showMessage(tr("Could not write trace to %1").arg(QDir::toNativeSeparators(path)), 5000);
+    }
+}
+
+bool MainWindow::openFile(const QString &fileName)
+{
+    if (!maybeSave()) {
+        return false;
+    }
+    rememberDocumentState();
+    return loadFile(fileName);
+}
+
+QString MainWindow::currentFile() const
+{
+    return m_currentFile;
+}
+
+bool MainWindow::isBlank() const
+{
+    return m_currentFile.isEmpty() && !m_textEditor->isLoading()
+        && !m_textEditor->document()->isModified() && m_textEditor->document()->isEmpty();
+}
+
+// Reopens the last document unless one was recovered or opened already
+void MainWindow::restoreSession()
+{
+    const QString activeFile = m_sessionState->activeFile();
+    if (!m_currentFile.isEmpty() || activeFile.isEmpty() || !QFile::exists(activeFile)) {
+        return;
+    }
+    
+    loadFile(activeFile);
+}
+
+void MainWindow::rememberDocumentState()
+{
+    // Positions in a partially loaded document are not meaningful yet
+    if (m_currentFile.isEmpty() || m_textEditor->isLoading()) {
+        return;
+    }
+    
+    SessionState::Document state;
+    state.filePath = m_currentFile;
+    
+    const QTextCursor cursor = m_textEditor->textCursor();
+    state.cursorPosition = cursor.position();
+    state.anchorPosition = cursor.anchor();
+    
+    QScrollBar *vertical = m_textEditor->verticalScrollBar();
+    state.verticalScroll = vertical->value();
+    state.horizontalScroll = m_textEditor->horizontalScrollBar()->value();
+    state.zoomFactor = m_textEditor->zoomFactor();
+    
+    const int range = vertical->maximum() + vertical->pageStep();
+    state.visibleFraction = range > 0 ? qreal(vertical->value()) / range : 0;
+    
+    m_sessionState->remember(state);
+}
+
+void MainWindow::watchCurrentFile()
+{
+    // Same rule as openDocument for how the file is loaded
+    Qt::TextFormat format = Qt::PlainText;
+    if (m_currentFile.endsWith(".html", Qt::CaseInsensitive) || m_currentFile.endsWith(".htm", Qt::CaseInsensitive)
+        || m_currentFile.endsWith(".rtf", Qt::CaseInsensitive)) {
+        format = Qt::RichText;
+    } else if (m_currentFile.endsWith(".md", Qt::CaseInsensitive)
+               || m_currentFile.endsWith(".markdown", Qt::CaseInsensitive)) {
+        format = Qt::MarkdownText;
+    }
+    m_fileMonitor->watch(m_currentFile, format);
+}
+
+void MainWindow::fitToWidth()
+{
+    m_textEditor->fitToWidth(m_paginator->textWidth());
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     if (maybeSave()) {
+        // Remember where the user was for the next start
+        rememberDocumentState();
+        m_sessionState->setActiveFile(m_currentFile);
+        
         // Stop auto-save and clean up
         m_documentManager->stopAutoSave();
+        m_sharedSession->stop();
+        m_fileMonitor->unwatch();
         
         // Save current settings
         saveSettings();
@@ -726,6 +1701,212 @@ void MainWindow::closeEvent(QCloseEvent *event)
     }
 }
 
+void MainWindow::toggleSharedSession(bool enabled)
+{
+    if (!enabled) {
+        if (m_sharedSession->isActive()) {
+            m_sharedSession->stop();
+            m_undoAction->setEnabled(true);
+            m_redoAction->setEnabled(true);
+            statusBar()->showMessage(tr("Left shared session"), 2000);
+        }
+        return;
+    }
+    
+    if (m_currentFile.isEmpty()) {
+        QMessageBox::information(this, tr("Share Editing Session"),
+                                 tr("Please save the document first."));
+        m_shareSessionAction->setChecked(false);
+        return;
+    }
+    
+    // Make sure the whole document is in before it is shared
+    m_textEditor->finishLoading();
+    
+    if (!m_sharedSession->start(m_textEditor->document(), m_currentFile)) {
+        QMessageBox::warning(this, tr("Share Editing Session"),
+                             tr("Could not start a shared session for %1").arg(m_currentFile));
+        m_shareSessionAction->setChecked(false);
+        return;
+    }
+    
+    // Undo would take back other people's edits too, so the session turns
+    // it off until the document is no longer shared
+    m_undoAction->setEnabled(false);
+    m_redoAction->setEnabled(false);
+    statusBar()->showMessage(m_sharedSession->isHost()
+                             ? tr("Hosting shared session; undo is off while the document is shared")
+                             : tr("Joined shared session; undo is off while the document is shared"), 5000);
+}
+
+void MainWindow::versionHistory()
+{
+    if (m_currentFile.isEmpty()) {
+        QMessageBox::information(this, tr("Version History"),
+                                 tr("Please save the document first."));
+        return;
+    }
+    
+    QList<VersionHistory::Version> versions = m_documentManager->versions();
+    if (versions.isEmpty()) {
+        QMessageBox::information(this, tr("Version History"),
+                                 tr("No earlier versions have been recorded for this document yet."));
+        return;
+    }
+    
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Version History"));
+    dialog.resize(800, 500);
+    
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    QHBoxLayout *contentLayout = new QHBoxLayout();
+    
+    // Newest first
+    QListWidget *listWidget = new QListWidget(&dialog);
+    listWidget->setMinimumWidth(260);
+    for (int i = versions.size() - 1; i >= 0; --i) {
+        const VersionHistory::Version &version = versions.at(i);
+        QListWidgetItem *item = new QListWidgetItem(
+            tr("%1  %2 (%3 KB stored)").arg(version.timestamp.toString("yyyy-MM-dd hh:mm:ss"),
+                                            version.label,
+                                            QString::number(version.stored / 1024.0, 'f', 1)),
+            listWidget);
+        item->setData(Qt::UserRole, version.number);
+    }
+    
+    QTextBrowser *preview = new QTextBrowser(&dialog);
+    contentLayout->addWidget(listWidget);
+    contentLayout->addWidget(preview, 1);
+    layout->addLayout(contentLayout);
+    
+    QLabel *storageLabel = new QLabel(tr("%n version(s), %1 KB on disk", "", versions.size())
+                                      .arg(m_documentManager->versionStorageBytes() / 1024), &dialog);
+    layout->addWidget(storageLabel);
+    
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    QPushButton *restoreButton = buttonBox->addButton(tr("Restore"), QDialogButtonBox::AcceptRole);
+    restoreButton->setEnabled(false);
+    layout->addWidget(buttonBox);
+    
+    const bool plainText = m_currentFile.endsWith(".txt", Qt::CaseInsensitive);
+    
+    connect(listWidget, &QListWidget::currentItemChanged, [&](QListWidgetItem *item) {
+        restoreButton->setEnabled(item != nullptr);
+        if (!item) {
+            return;
+        }
+        
+        // Only the start of large versions is previewed
+        QString content = m_documentManager->versionContent(item->data(Qt::UserRole).toInt());
+        content.truncate(200000);
+        if (plainText) {
+            preview->setPlainText(content);
+        } else {
+            preview->setHtml(content);
+        }
+    });
+    
+    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    
+    if (dialog.exec() == QDialog::Accepted && listWidget->currentItem()) {
+        const int number = listWidget->currentItem()->data(Qt::UserRole).toInt();
+        const QString content = m_documentManager->versionContent(number);
+        
+        QTextDocument restored;
+        if (plainText) {
+            restored.setPlainText(content);
+        } else {
+            HtmlImport::importInto(&restored, content);
+        }
+        
+        // Replaced as one edit, so restoring can be undone; loading would
+        // clear the undo history
+        m_textEditor->finishLoading();
+        QTextCursor cursor(m_textEditor->document());
+        cursor.beginEditBlock();
+        cursor.select(QTextCursor::Document);
+        cursor.insertFragment(QTextDocumentFragment(&restored));
+        cursor.endEditBlock();
+        statusBar()->showMessage(tr("Version restored"), 2000);
+    }
+}
+
+void MainWindow::compareDocuments()
+{
+    const QString filter = tr("All Supported Files (*.txt *.html *.htm *.rtf *.md *.markdown);;All Files (*)");
+    const QString oldFile = QFileDialog::getOpenFileName(this, tr("Compare: Original Document"), m_currentFile, filter);
+    if (oldFile.isEmpty()) {
+        return;
+    }
+    const QString newFile = QFileDialog::getOpenFileName(this, tr("Compare: Revised Document"),
+                                                         QFileInfo(oldFile).absolutePath(), filter);
+    if (newFile.isEmpty()) {
+        return;
+    }
+    
+    // Not modal, so the document stays editable next to the comparison
+    QDialog *dialog = new QDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->setWindowTitle(tr("Compare %1 and %2").arg(QFileInfo(oldFile).fileName(), QFileInfo(newFile).fileName()));
+    dialog->resize(1000, 700);
+    
+    QVBoxLayout *layout = new QVBoxLayout(dialog);
+    
+    QHBoxLayout *toolLayout = new QHBoxLayout();
+    QComboBox *modeComboBox = new QComboBox(dialog);
+    modeComboBox->addItem(tr("Inline"), CompareView::Inline);
+    modeComboBox->addItem(tr("Side by Side"), CompareView::SideBySide);
+    QPushButton *previousButton = new QPushButton(tr("&Previous Change"), dialog);
+    QPushButton *nextButton = new QPushButton(tr("&Next Change"), dialog);
+    QLabel *summaryLabel = new QLabel(tr("Comparing..."), dialog);
+    previousButton->setEnabled(false);
+    nextButton->setEnabled(false);
+    toolLayout->addWidget(modeComboBox);
+    toolLayout->addWidget(previousButton);
+    toolLayout->addWidget(nextButton);
+    toolLayout->addWidget(summaryLabel, 1);
+    layout->addLayout(toolLayout);
+    
+    CompareView *view = new CompareView(dialog);
+    layout->addWidget(view);
+    
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, dialog);
+    layout->addWidget(buttonBox);
+    
+    connect(buttonBox, &QDialogButtonBox::rejected, dialog, &QDialog::close);
+    connect(modeComboBox, &QComboBox::currentIndexChanged, view, [view, modeComboBox]() {
+        view->setMode(CompareView::Mode(modeComboBox->currentData().toInt()));
+    });
+    connect(previousButton, &QPushButton::clicked, view, &CompareView::previousChange);
+    connect(nextButton, &QPushButton::clicked, view, &CompareView::nextChange);
+    
+    // Reading, parsing and diffing run on workers; closing the dialog
+    // cancels the comparison
+    const TaskExecutor::Task task = TaskExecutor::instance()->run(TaskExecutor::Interactive, view,
+        [oldFile, newFile](const TaskExecutor::CancellationToken &token) {
+            return DocumentCompare::compareFiles(oldFile, newFile, token);
+        },
+        [view, summaryLabel, previousButton, nextButton](const DocumentCompare::Result &result) {
+            if (!result.ok) {
+                summaryLabel->setText(result.errorString);
+                return;
+            }
+            QElapsedTimer timer;
+            timer.start();
+            view->setResult(result);
+            summaryLabel->setText(tr("%n change(s); compared in %1 ms, shown in %2 ms.", "", result.changes)
+                                  .arg(result.msecs)
+                                  .arg(timer.elapsed()));
+            previousButton->setEnabled(result.changes > 0);
+            nextButton->setEnabled(result.changes > 0);
+        });
+    const TaskExecutor::CancellationToken token = task.token();
+    connect(dialog, &QObject::destroyed, [token]() { token.cancel(); });
+    
+    dialog->show();
+}
+
 void MainWindow::checkForRecoveryFiles()
 {
     QStringList recoveryFiles = m_documentManager->pendingRecoveryFiles();
@@ -786,6 +1967,7 @@ bool MainWindow::recoverDocument(const QString &filePath)
                 
                 // Start auto-save for this document
                 m_documentManager->startAutoSave(m_textEditor->document(), m_currentFile);
+                watchCurrentFile();
                 
                 // Clear the recovery file
                 m_documentManager->clearRecoveryFile(filePath);
@@ -830,6 +2012,11 @@ void MainWindow::documentProperties()
     properties["Size"] = QString::number(fileInfo.size()) + " bytes";
     properties["Created"] = fileInfo.birthTime().toString();
     properties["Modified"] = fileInfo.lastModified().toString();
+    const int pageCount = m_paginator->pageCount();
+    if (pageCount >= 0) {
+        properties["Pages"] = m_paginator->isUpToDate() ? QString::number(pageCount)
+                                                        : tr("%1 (updating)").arg(pageCount);
+    }
     
     // Populate the table
     tableWidget->setRowCount(properties.size());
@@ -870,7 +2057,7 @@ void MainWindow::documentProperties()
         
         if (!name.isEmpty()) {
             // Skip system properties
-            QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified"};
+            QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified", "Pages"};
             if (systemProps.contains(name)) {
                 QMessageBox::warning(&dialog, tr("Invalid Property"), 
                                     tr("Cannot add or modify system properties."));
@@ -905,7 +2092,7 @@ void MainWindow::documentProperties()
             QString propName = tableWidget->item(currentRow, 0)->text();
             
             // Skip system properties
-            QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified"};
+            QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified", "Pages"};
             if (systemProps.contains(propName)) {
                 QMessageBox::warning(&dialog, tr("Invalid Operation"), 
                                     tr("Cannot remove system properties."));
@@ -925,7 +2112,7 @@ void MainWindow::documentProperties()
         m_documentManager->clearProperties();
         
         // Skip system properties when saving
-        QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified"};
+        QStringList systemProps = {"File Name", "File Path", "Size", "Created", "Modified", "Pages"};
         
         for (int i = 0; i < tableWidget->rowCount(); ++i) {
             QString name = tableWidget->item(i, 0)->text();
@@ -12,11 +12,21 @@
 #include <QDockWidget>
 #include <QPrinter>
 #include <QSettings>
+#include <memory>
 
 class TextEditor;
 class FormatBar;
 class QCloseEvent;
 class DocumentManager;
+class OutlinePanel;
+class SharedSession;
+class FileMonitor;
+class SessionState;
+class MacroRecorder;
+class TableImport;
+class StyleManager;
+class Paginator;
+class RecentFiles;
 
 class MainWindow : public QMainWindow
 {
@@ -25,16 +35,31 @@ class MainWindow : public QMainWindow
 public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
+    
+    // Recovery and session restore belong to the first window of a process
+    void checkForRecoveryFiles();
+    void restoreSession();
+    
+    bool openFile(const QString &fileName);
+    QString currentFile() const;
+    // No file and nothing typed; a document handed over can replace it
+    bool isBlank() const;
 
 private slots:
     // File operations
     void newDocument();
     void openDocument();
+    void openRecentFile(const QString &fileName);
+    void updateRecentFilesMenu();
     bool saveDocument();
     bool saveAsDocument();
     void printDocument();
     void printPreviewDialog();
     void documentProperties();
+    void toggleSharedSession(bool enabled);
+    void versionHistory();
+    void compareDocuments();
+    void toggleTracing(bool enabled);
     
     // Edit operations
     void cutText();
@@ -42,6 +67,10 @@ private slots:
     void pasteText();
     void undoAction();
     void redoAction();
+    void toggleMacroRecording(bool enabled);
+    void playMacro();
+    void saveMacro();
+    void loadMacro();
     
     // Format operations
     void textBold();
@@ -49,14 +78,22 @@ private slots:
     void textUnderline();
     void textColor();
     void paragraphAlign();
+    void applyStyle(int index);
+    void modifyStyle();
+    void compactFormats();
+    
+    // Table operations
+    void insertTable();
+    void importCsv();
     
     // View operations
     void zoomIn();
     void zoomOut();
     void resetZoom();
+    void fitToWidth();
+    void typingLatency();
 
     // Recovery
-    void checkForRecoveryFiles();
     bool recoverDocument(const QString &filePath);
 
 private:
@@ -64,6 +101,7 @@ private:
     void createActions();
     void createMenus();
     void createToolbars();
+    void createDockWindows();
     void setupConnections();
     void setupStatusBar();
     
@@ -71,6 +109,13 @@ private:
     void loadSettings();
     void updateWindowTitle();
     bool maybeSave();
+    void watchCurrentFile();
+    void updateStyleComboBox();
+    bool suggestFormatCompaction();
+    bool loadFile(const QString &fileName);
+    
+    // Session restore
+    void rememberDocumentState();
     
     // Override
     void closeEvent(QCloseEvent *event) override;
@@ -78,11 +123,24 @@ private:
     TextEditor *m_textEditor;
     FormatBar *m_formatBar;
     DocumentManager *m_documentManager;
+    OutlinePanel *m_outlinePanel;
+    QDockWidget *m_outlineDock;
+    SharedSession *m_sharedSession;
+    FileMonitor *m_fileMonitor;
+    MacroRecorder *m_macroRecorder;
+    TableImport *m_tableImport;
+    StyleManager *m_styleManager;
+    Paginator *m_paginator;
+    RecentFiles *m_recentFiles;
+    QComboBox *m_styleComboBox;
+    std::shared_ptr<SessionState> m_sessionState;
     
     // Menus
     QMenu *m_fileMenu;
+    QMenu *m_recentFilesMenu;
     QMenu *m_editMenu;
     QMenu *m_formatMenu;
+    QMenu *m_tableMenu;
     QMenu *m_viewMenu;
     QMenu *m_helpMenu;
     
@@ -99,6 +157,10 @@ private:
     QAction *m_printAction;
     QAction *m_printPreviewAction;
     QAction *m_documentPropertiesAction;
+    QAction *m_shareSessionAction;
+    QAction *m_versionHistoryAction;
+    QAction *m_compareAction;
+    QAction *m_traceAction;
     QAction *m_exitAction;
     
     QAction *m_undoAction;
@@ -106,6 +168,11 @@ private:
     QAction *m_cutAction;
     QAction *m_copyAction;
     QAction *m_pasteAction;
+    QAction *m_recordMacroAction;
+    QAction *m_playMacroAction;
+    QAction *m_playMacroRealTimeAction;
+    QAction *m_saveMacroAction;
+    QAction *m_loadMacroAction;
     
     QAction *m_boldAction;
     QAction *m_italicAction;
@@ -115,10 +182,18 @@ private:
     QAction *m_alignCenterAction;
     QAction *m_alignRightAction;
     QAction *m_alignJustifyAction;
+    QAction *m_modifyStyleAction;
+    QAction *m_compactFormatsAction;
+    
+    QAction *m_insertTableAction;
+    QAction *m_importCsvAction;
     
     QAction *m_zoomInAction;
     QAction *m_zoomOutAction;
     QAction *m_resetZoomAction;
+    QAction *m_fitToWidthAction;
+    QAction *m_latencyOverlayAction;
+    QAction *m_typingLatencyAction;
     
     QString m_currentFile;
 };
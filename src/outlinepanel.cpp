@@ -0,0 +1,309 @@
+#include "outlinepanel.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextFragment>
+#include <QListView>
+#include <QVBoxLayout>
+#include <QFont>
+#include <algorithm>
+
+namespace {
+const int MAX_HEADING_LENGTH = 200; // longer paragraphs are never headings
+const int MAX_TITLE_LENGTH = 120;
+}
+
+OutlineModel::OutlineModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_document(nullptr)
+    , m_blockCount(0)
+    , m_dirtyFirst(-1)
+    , m_dirtyLast(-1)
+    , m_flushTimer(new QTimer(this))
+{
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FLUSH_DELAY);
+    connect(m_flushTimer, &QTimer::timeout, this, &OutlineModel::flushPending);
+}
+
+void OutlineModel::setDocument(QTextDocument *document)
+{
+    if (m_document) {
+        disconnect(m_document, nullptr, this, nullptr);
+    }
+
+    m_document = document;
+
+    if (m_document) {
+        connect(m_document, &QTextDocument::contentsChange, this, &OutlineModel::onContentsChange);
+        connect(m_document, &QObject::destroyed, this, [this]() {
+            m_document = nullptr;
+            rebuild();
+        });
+    }
+
+    rebuild();
+}
+
+int OutlineModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_headings.size();
+}
+
+QVariant OutlineModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_headings.size()) {
+        return QVariant();
+    }
+
+    const Heading &heading = m_headings.at(index.row());
+
+    switch (role) {
+    case Qt::DisplayRole:
+        // Indent by level; the view uses uniform item sizes so this stays cheap
+        return QString((heading.level - 1) * 4, QLatin1Char(' ')) + heading.title;
+    case Qt::ToolTipRole:
+        return heading.title;
+    case Qt::FontRole:
+        if (heading.level == 1) {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+        return QVariant();
+    case BlockNumberRole:
+        return heading.blockNumber;
+    case LevelRole:
+        return heading.level;
+    default:
+        return QVariant();
+    }
+}
+
+int OutlineModel::headingLevel(const QTextBlock &block)
+{
+    if (!block.isValid()) {
+        return 0;
+    }
+
+    // Explicit heading levels come from <h1>..<h6> in imported HTML
+    int level = block.blockFormat().headingLevel();
+    if (level > 0) {
+        return qMin(level, 6);
+    }
+
+    const int length = block.length() - 1;
+    if (length <= 0 || length > MAX_HEADING_LENGTH) {
+        return 0;
+    }
+
+    // Otherwise treat short paragraphs set entirely in large bold type as headings
+    qreal pointSize = 0;
+    bool hasText = false;
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        QTextFragment fragment = it.fragment();
+        if (!fragment.isValid() || fragment.text().trimmed().isEmpty()) {
+            continue;
+        }
+
+        QTextCharFormat format = fragment.charFormat();
+        if (format.fontWeight() < QFont::Bold) {
+            return 0;
+        }
+
+        qreal size = format.fontPointSize();
+        if (size <= 0) {
+            size = block.document()->defaultFont().pointSizeF();
+        }
+        pointSize = qMax(pointSize, size);
+        hasText = true;
+    }
+
+    if (!hasText) {
+        return 0;
+    }
+    if (pointSize >= 20) {
+        return 1;
+    }
+    if (pointSize >= 16) {
+        return 2;
+    }
+    if (pointSize >= 14) {
+        return 3;
+    }
+    return 0;
+}
+
+void OutlineModel::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    if (!m_document) {
+        return;
+    }
+
+    const int newCount = m_document->blockCount();
+    const int delta = newCount - m_blockCount;
+    m_blockCount = newCount;
+
+    const int first = m_document->findBlock(position).blockNumber();
+    int last = m_document->findBlock(position + charsAdded).blockNumber();
+    if (first < 0) {
+        return;
+    }
+    if (last < first) {
+        last = newCount - 1;
+    }
+    const int oldLast = last - delta;
+
+    // Renumber headings after the edited range; headings inside it are
+    // clamped into the dirty range and replaced on the next flush.
+    if (delta != 0) {
+        const int tail = lowerBound(oldLast + 1);
+        for (int i = lowerBound(first); i < tail; ++i) {
+            m_headings[i].blockNumber = qMin(m_headings[i].blockNumber, last);
+        }
+        for (int i = tail; i < m_headings.size(); ++i) {
+            m_headings[i].blockNumber += delta;
+        }
+    }
+
+    if (m_dirtyFirst < 0) {
+        m_dirtyFirst = first;
+        m_dirtyLast = last;
+    } else {
+        if (m_dirtyLast > oldLast) {
+            m_dirtyLast += delta;
+        }
+        m_dirtyFirst = qMin(m_dirtyFirst, first);
+        m_dirtyLast = qMax(m_dirtyLast, last);
+    }
+
+    m_flushTimer->start();
+}
+
+void OutlineModel::flushPending()
+{
+    if (!m_document || m_dirtyFirst < 0) {
+        return;
+    }
+
+    const int first = m_dirtyFirst;
+    const int last = qMin(m_dirtyLast, m_document->blockCount() - 1);
+    m_dirtyFirst = -1;
+    m_dirtyLast = -1;
+
+    const int begin = lowerBound(first);
+    const int end = lowerBound(last + 1);
+    QVector<Heading> fresh = scanBlocks(first, last);
+
+    if (fresh.size() == end - begin) {
+        // Same shape: update in place so the view keeps its selection
+        int changedFirst = -1;
+        int changedLast = -1;
+        for (int i = 0; i < fresh.size(); ++i) {
+            if (!(m_headings.at(begin + i) == fresh.at(i))) {
+                m_headings[begin + i] = fresh.at(i);
+                if (changedFirst < 0) {
+                    changedFirst = begin + i;
+                }
+                changedLast = begin + i;
+            }
+        }
+        if (changedFirst >= 0) {
+            emit dataChanged(index(changedFirst), index(changedLast));
+        }
+        return;
+    }
+
+    if (end > begin) {
+        beginRemoveRows(QModelIndex(), begin, end - 1);
+        m_headings.remove(begin, end - begin);
+        endRemoveRows();
+    }
+
+    if (!fresh.isEmpty()) {
+        beginInsertRows(QModelIndex(), begin, begin + fresh.size() - 1);
+        m_headings.insert(begin, fresh.size(), Heading());
+        std::copy(fresh.cbegin(), fresh.cend(), m_headings.begin() + begin);
+        endInsertRows();
+    }
+}
+
+void OutlineModel::rebuild()
+{
+    m_flushTimer->stop();
+    m_dirtyFirst = -1;
+    m_dirtyLast = -1;
+
+    beginResetModel();
+    if (m_document) {
+        m_blockCount = m_document->blockCount();
+        m_headings = scanBlocks(0, m_blockCount - 1);
+    } else {
+        m_blockCount = 0;
+        m_headings.clear();
+    }
+    endResetModel();
+}
+
+QVector<OutlineModel::Heading> OutlineModel::scanBlocks(int first, int last) const
+{
+    QVector<Heading> result;
+    if (!m_document || first > last) {
+        return result;
+    }
+
+    QTextBlock block = m_document->findBlockByNumber(first);
+    for (int number = first; block.isValid() && number <= last; block = block.next(), ++number) {
+        int level = headingLevel(block);
+        if (level > 0) {
+            QString title = block.text().simplified();
+            if (title.length() > MAX_TITLE_LENGTH) {
+                title = title.left(MAX_TITLE_LENGTH) + QStringLiteral("...");
+            }
+            result.append({number, level, title});
+        }
+    }
+
+    return result;
+}
+
+int OutlineModel::lowerBound(int blockNumber) const
+{
+    auto it = std::lower_bound(m_headings.cbegin(), m_headings.cend(), blockNumber,
+                               [](const Heading &heading, int number) {
+                                   return heading.blockNumber < number;
+                               });
+    return int(it - m_headings.cbegin());
+}
+
+OutlinePanel::OutlinePanel(QWidget *parent)
+    : QWidget(parent)
+    , m_model(new OutlineModel(this))
+    , m_view(new QListView(this))
+{
+    // Uniform item sizes let the view skip measuring rows it never shows
+    m_view->setModel(m_model);
+    m_view->setUniformItemSizes(true);
+    m_view->setLayoutMode(QListView::Batched);
+    m_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_view->setSelectionMode(QAbstractItemView::SingleSelection);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_view);
+    setLayout(layout);
+
+    connect(m_view, &QListView::clicked, this, [this](const QModelIndex &index) {
+        emit headingActivated(index.data(OutlineModel::BlockNumberRole).toInt());
+    });
+    connect(m_view, &QListView::activated, this, [this](const QModelIndex &index) {
+        emit headingActivated(index.data(OutlineModel::BlockNumberRole).toInt());
+    });
+}
+
+void OutlinePanel::setDocument(QTextDocument *document)
+{
+    m_model->setDocument(document);
+}
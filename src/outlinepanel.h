@@ -0,0 +1,86 @@
+#ifndef OUTLINEPANEL_H
+#define OUTLINEPANEL_H
+
+#include <QAbstractListModel>
+#include <QWidget>
+#include <QVector>
+#include <QString>
+#include <QTimer>
+
+class QTextDocument;
+class QTextBlock;
+class QListView;
+
+// Flat, ordered index of the headings in a document. Headings are keyed by
+// block number and kept up to date from QTextDocument::contentsChange, so
+// only the blocks touched by an edit are rescanned.
+class OutlineModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        BlockNumberRole = Qt::UserRole + 1,
+        LevelRole
+    };
+
+    explicit OutlineModel(QObject *parent = nullptr);
+
+    void setDocument(QTextDocument *document);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Returns the outline level (1-6) of a block, or 0 if it is not a heading
+    static int headingLevel(const QTextBlock &block);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void flushPending();
+
+private:
+    struct Heading {
+        int blockNumber;
+        int level;
+        QString title;
+
+        bool operator==(const Heading &other) const {
+            return blockNumber == other.blockNumber && level == other.level && title == other.title;
+        }
+    };
+
+    void rebuild();
+    QVector<Heading> scanBlocks(int first, int last) const;
+    int lowerBound(int blockNumber) const;
+
+    QTextDocument *m_document;
+    QVector<Heading> m_headings;
+    int m_blockCount;
+
+    // Pending dirty block range, in current block numbering
+    int m_dirtyFirst;
+    int m_dirtyLast;
+    QTimer *m_flushTimer;
+
+    static const int FLUSH_DELAY = 150; // ms, coalesces bursts of typing
+};
+
+// Dock contents: a virtualized list of headings with click-to-jump.
+class OutlinePanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit OutlinePanel(QWidget *parent = nullptr);
+
+    void setDocument(QTextDocument *document);
+
+signals:
+    void headingActivated(int blockNumber);
+
+private:
+    OutlineModel *m_model;
+    QListView *m_view;
+};
+
+#endif // OUTLINEPANEL_H
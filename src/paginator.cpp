@@ -0,0 +1,312 @@
+#include "paginator.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QTextList>
+#include <QTextTable>
+#include <QPageSize>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+// The resolution QTextDocument lays out at when it has no paint device
+qreal layoutDpi()
+{
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    return screen ? screen->logicalDotsPerInchY() : 96;
+}
+
+}
+
+Paginator::Paginator(QTextDocument *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+    , m_sliceTimer(new QTimer(this))
+    , m_pageLayout(QPageSize(QPageSize::A4), QPageLayout::Portrait, QMarginsF())
+    , m_firstDirty(0)
+    , m_textWidth(0)
+    , m_pageHeight(0)
+    , m_pageCount(-1)
+    , m_lastPage(1)
+    , m_passMsecs(0)
+    , m_upToDate(false)
+{
+    m_sliceTimer->setSingleShot(true);
+    connect(m_sliceTimer, &QTimer::timeout, this, &Paginator::paginateSlice);
+    connect(m_document, &QTextDocument::contentsChange, this, &Paginator::onContentsChange);
+    applyPageLayout();
+    invalidateAll();
+    m_sliceTimer->start(IDLE_DELAY);
+}
+
+Paginator::~Paginator()
+{
+}
+
+void Paginator::setPageLayout(const QPageLayout &layout)
+{
+    if (layout.isEquivalentTo(m_pageLayout)) {
+        return;
+    }
+    m_pageLayout = layout;
+    applyPageLayout();
+    invalidateAll();
+    m_upToDate = false;
+    m_sliceTimer->start(0);
+}
+
+QPageLayout Paginator::pageLayout() const
+{
+    return m_pageLayout;
+}
+
+qreal Paginator::textWidth() const
+{
+    return m_textWidth;
+}
+
+int Paginator::pageCount() const
+{
+    return m_pageCount;
+}
+
+int Paginator::pageForPosition(int position) const
+{
+    const QTextBlock block = m_document->findBlock(position);
+    const int number = block.blockNumber();
+    if (m_pageCount < 0 || number < 0 || number >= m_blocks.size() || !m_blocks.at(number).measured) {
+        return m_lastPage;
+    }
+
+    // Replay the paragraph's own page breaks up to the line holding position
+    const BlockMetrics &metrics = m_blocks.at(number);
+    const int offset = position - block.position();
+    const int line = int(std::upper_bound(metrics.lineStarts.begin(), metrics.lineStarts.end(), offset)
+                         - metrics.lineStarts.begin()) - 1;
+    int page = metrics.page;
+    qreal y = metrics.top + metrics.topMargin;
+    for (int i = 0; i < line; ++i) {
+        const qreal height = lineHeight(metrics, i);
+        if (y + height > m_pageHeight && y > 0) {
+            ++page;
+            y = 0;
+        }
+        y += height;
+    }
+    if (line >= 0 && y + lineHeight(metrics, line) > m_pageHeight && y > 0) {
+        ++page;
+    }
+    return page;
+}
+
+bool Paginator::isUpToDate() const
+{
+    return m_upToDate;
+}
+
+void Paginator::finish()
+{
+    if (m_upToDate) {
+        return;
+    }
+    TRACE_SCOPE("Paginator::finish");
+    QElapsedTimer timer;
+    timer.start();
+
+    m_sliceTimer->stop();
+    if (m_blocks.size() != m_document->blockCount()) {
+        invalidateAll();
+    }
+    for (QTextBlock block = m_document->findBlockByNumber(m_firstDirty); block.isValid(); block = block.next()) {
+        BlockMetrics &metrics = m_blocks[block.blockNumber()];
+        if (!metrics.measured) {
+            measure(block, &metrics);
+        }
+    }
+    m_passMsecs += timer.elapsed();
+    completed();
+}
+
+void Paginator::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    m_upToDate = false;
+    m_sliceTimer->start(IDLE_DELAY);
+
+    // Paragraphs after the change keep their measurements; the changed ones
+    // are replaced by unmeasured entries
+    const int last = m_document->characterCount() - 1;
+    const int first = m_document->findBlock(qMin(position, last)).blockNumber();
+    const int lastAdded = m_document->findBlock(qMin(position + charsAdded, last)).blockNumber();
+    const int added = lastAdded - first + 1;
+    const int removed = added - (m_document->blockCount() - m_blocks.size());
+    if (first < 0 || lastAdded < first || removed < 0 || first + removed > m_blocks.size()) {
+        invalidateAll();
+        return;
+    }
+    m_blocks.remove(first, removed);
+    m_blocks.insert(first, added, BlockMetrics());
+    m_firstDirty = qMin(m_firstDirty, first);
+}
+
+void Paginator::paginateSlice()
+{
+    TRACE_SCOPE("Paginator::paginateSlice");
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_blocks.size() != m_document->blockCount()) {
+        invalidateAll();
+    }
+
+    QTextBlock block = m_document->findBlockByNumber(m_firstDirty);
+    while (block.isValid()) {
+        BlockMetrics &metrics = m_blocks[block.blockNumber()];
+        if (!metrics.measured) {
+            measure(block, &metrics);
+        }
+        block = block.next();
+        if (timer.elapsed() >= SLICE_BUDGET) {
+            break;
+        }
+    }
+    m_passMsecs += timer.elapsed();
+
+    if (block.isValid()) {
+        m_firstDirty = block.blockNumber();
+        m_sliceTimer->start(0);
+        return;
+    }
+    completed();
+}
+
+void Paginator::measure(const QTextBlock &block, BlockMetrics *metrics) const
+{
+    const QTextBlockFormat format = block.blockFormat();
+    const qreal indentWidth = m_document->indentWidth();
+    qreal width = m_textWidth - format.leftMargin() - format.rightMargin() - format.indent() * indentWidth;
+    if (const QTextList *list = block.textList()) {
+        width -= list->format().indent() * indentWidth;
+    }
+    metrics->columns = 1;
+    if (const QTextTable *table = QTextCursor(block).currentTable()) {
+        metrics->columns = qMax(1, table->columns());
+        width /= metrics->columns;
+    }
+    width = qMax(width, qreal(1));
+
+    QTextLayout layout(block.text(), block.charFormat().font().resolve(m_document->defaultFont()));
+    QTextOption option = m_document->defaultTextOption();
+    option.setAlignment(format.alignment());
+    layout.setTextOption(option);
+    layout.setFormats(block.textFormats());
+
+    metrics->lineHeights.clear();
+    metrics->lineStarts.clear();
+    layout.beginLayout();
+    for (QTextLine line = layout.createLine(); line.isValid(); line = layout.createLine()) {
+        line.setLineWidth(metrics->lineStarts.isEmpty() ? width - format.textIndent() : width);
+        qreal height = line.height();
+        switch (format.lineHeightType()) {
+        case QTextBlockFormat::ProportionalHeight:
+            height *= format.lineHeight() / 100.0;
+            break;
+        case QTextBlockFormat::FixedHeight:
+            height = format.lineHeight();
+            break;
+        case QTextBlockFormat::MinimumHeight:
+            height = qMax(height, format.lineHeight());
+            break;
+        case QTextBlockFormat::LineDistanceHeight:
+            height += format.lineHeight();
+            break;
+        default:
+            break;
+        }
+        metrics->lineHeights.append(height);
+        metrics->lineStarts.append(line.textStart());
+    }
+    layout.endLayout();
+
+    metrics->topMargin = format.topMargin();
+    metrics->bottomMargin = format.bottomMargin();
+    metrics->breakBefore = format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysBefore;
+    metrics->breakAfter = format.pageBreakPolicy() & QTextFormat::PageBreak_AlwaysAfter;
+    metrics->measured = true;
+}
+
+qreal Paginator::lineHeight(const BlockMetrics &metrics, int line) const
+{
+    return metrics.lineHeights.at(line) / metrics.columns;
+}
+
+void Paginator::invalidateAll()
+{
+    m_blocks = QVector<BlockMetrics>(m_document->blockCount());
+    m_firstDirty = 0;
+}
+
+void Paginator::completed()
+{
+    TRACE_SCOPE("Paginator::completed");
+
+    // Lines that do not fit move to the next page, as QTextDocumentLayout does
+    int page = 1;
+    qreal y = 0;
+    for (int i = 0; i < m_blocks.size(); ++i) {
+        BlockMetrics &metrics = m_blocks[i];
+        if (metrics.breakBefore && y > 0) {
+            ++page;
+            y = 0;
+        }
+        metrics.page = page;
+        metrics.top = y;
+        y += metrics.topMargin;
+        for (int line = 0; line < metrics.lineHeights.size(); ++line) {
+            const qreal height = lineHeight(metrics, line);
+            if (y + height > m_pageHeight && y > 0) {
+                ++page;
+                y = 0;
+            }
+            y += height;
+        }
+        y += metrics.bottomMargin;
+        if (metrics.breakAfter && i + 1 < m_blocks.size()) {
+            ++page;
+            y = 0;
+        }
+    }
+
+    m_firstDirty = m_blocks.size();
+    m_pageCount = page;
+    m_lastPage = m_pageCount;
+    m_upToDate = true;
+
+    TRACE_COUNTER("pages", m_pageCount);
+    emit paginated(m_pageCount, m_passMsecs);
+    m_passMsecs = 0;
+}
+
+void Paginator::applyPageLayout()
+{
+    // Same geometry QTextDocument::print() uses: the printable area of the
+    // page, with a 2 cm margin inside it. Like print(), a layout without
+    // margins gets 2 mm ones first.
+    QPageLayout layout = m_pageLayout;
+    if (layout.margins(QPageLayout::Millimeter).isNull()) {
+        layout = QPageLayout(m_pageLayout.pageSize(), m_pageLayout.orientation(), QMarginsF(2, 2, 2, 2),
+                             QPageLayout::Millimeter);
+    }
+    const qreal dpi = layoutDpi();
+    const QRectF paintRect = layout.paintRectPoints();
+    const qreal margin = dpi * 2 / 2.54;
+    m_textWidth = qMax(qreal(1), paintRect.width() * dpi / 72.0 - 2 * margin);
+    m_pageHeight = qMax(qreal(1), paintRect.height() * dpi / 72.0 - 2 * margin);
+}
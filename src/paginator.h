@@ -0,0 +1,95 @@
+#ifndef PAGINATOR_H
+#define PAGINATOR_H
+
+#include <QObject>
+#include <QPageLayout>
+#include <QVector>
+
+class QTextDocument;
+class QTextBlock;
+class QTimer;
+
+// Keeps the page count of a document up to date for the current printer
+// page layout without a second copy of the document. Each paragraph is
+// broken into lines at the printed text width once, and only again after
+// it is edited; edits mark their paragraphs, and the measuring then runs in
+// idle time slices, so a keystroke never waits for the rest of the
+// document. Page breaks are then a quick pass over the cached line heights.
+//
+// Text paragraphs measure as QTextDocument::print() lays them out; table
+// cells and inline images are estimated, so the count is a close guide
+// rather than a promise for those.
+//
+// The status bar and the properties dialog read the cached breaks. Printing
+// and print preview still go through QTextEdit::print(), which lays the
+// document out again at printer resolution; QPrintPreviewDialog can only
+// show what a print() call paints. The page geometry here follows print()'s
+// margins and text width, so "Page X of Y" matches the preview.
+class Paginator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Paginator(QTextDocument *document, QObject *parent = nullptr);
+    ~Paginator();
+
+    void setPageLayout(const QPageLayout &layout);
+    QPageLayout pageLayout() const;
+    // Printed text width at screen resolution
+    qreal textWidth() const;
+
+    // The last complete count, or -1 before the first pass has finished
+    int pageCount() const;
+    // 1-based; positions in paragraphs not measured yet report the last
+    // page reached
+    int pageForPosition(int position) const;
+    bool isUpToDate() const;
+
+    // Completes any pending pagination right away
+    void finish();
+
+signals:
+    void paginated(int pageCount, qint64 msecs);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void paginateSlice();
+
+private:
+    struct BlockMetrics {
+        QVector<qreal> lineHeights;
+        QVector<int> lineStarts;
+        qreal topMargin = 0;
+        qreal bottomMargin = 0;
+        int columns = 1; // cells of a table row share their height
+        bool breakBefore = false;
+        bool breakAfter = false;
+        bool measured = false;
+        // Where the last pass put the paragraph
+        int page = 1;
+        qreal top = 0;
+    };
+
+    void measure(const QTextBlock &block, BlockMetrics *metrics) const;
+    qreal lineHeight(const BlockMetrics &metrics, int line) const;
+    void invalidateAll();
+    void applyPageLayout();
+    void completed();
+
+    QTextDocument *m_document;
+    QTimer *m_sliceTimer;
+    QPageLayout m_pageLayout;
+    QVector<BlockMetrics> m_blocks;
+    int m_firstDirty; // first paragraph that may need measuring
+    qreal m_textWidth;
+    qreal m_pageHeight;
+    int m_pageCount;
+    int m_lastPage;
+    qint64 m_passMsecs;
+    bool m_upToDate;
+
+    static const int SLICE_BUDGET = 8;        // ms of measuring per idle slice
+    static const int IDLE_DELAY = 300;        // ms without edits before repaginating
+};
+
+#endif // PAGINATOR_H
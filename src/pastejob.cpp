@@ -0,0 +1,173 @@
+#include "pastejob.h"
+#include "progressiveloader.h"
+#include "htmlimport.h"
+
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QMimeData>
+#include <QElapsedTimer>
+
+PasteJob::PasteJob(QTextEdit *editor)
+    : QObject(editor)
+    , m_editor(editor)
+    , m_sliceTimer(new QTimer(this))
+    , m_next(0)
+    , m_total(0)
+    , m_running(false)
+    , m_firstSlice(true)
+    , m_wasReadOnly(false)
+{
+    m_sliceTimer->setSingleShot(true);
+    m_sliceTimer->setInterval(0);
+    connect(m_sliceTimer, &QTimer::timeout, this, &PasteJob::insertSlice);
+}
+
+PasteJob::~PasteJob()
+{
+    m_sliceTimer->stop();
+    m_parseTask.cancel();
+    m_parseTask.waitForFinished();
+}
+
+bool PasteJob::start(const QMimeData *source)
+{
+    if (m_running || !source) {
+        return false;
+    }
+
+    if (source->hasHtml() && m_editor->acceptRichText()) {
+        const QString html = source->html();
+        if (html.size() < ASYNC_THRESHOLD) {
+            return false;
+        }
+
+        begin();
+
+        // Sanitize, split and parse off the GUI thread, chunks in parallel
+        m_parseTask = TaskExecutor::instance()->run(TaskExecutor::Interactive, this,
+            [html](const TaskExecutor::CancellationToken &) {
+                return HtmlImport::parseFragments(html);
+            },
+            [this](const QList<QTextDocumentFragment> &fragments) {
+                onParsed(fragments);
+            });
+        return true;
+    }
+
+    if (source->hasText()) {
+        // Fast path: plain text never goes near the HTML parser
+        const QString text = source->text();
+        if (text.size() < ASYNC_THRESHOLD) {
+            return false;
+        }
+
+        begin();
+        m_textChunks = ProgressiveLoader::splitPlainText(text, CHUNK_SIZE);
+        m_total = m_textChunks.size();
+        m_sliceTimer->start();
+        return true;
+    }
+
+    return false;
+}
+
+bool PasteJob::isRunning() const
+{
+    return m_running;
+}
+
+void PasteJob::cancel()
+{
+    if (!m_running) {
+        return;
+    }
+
+    // Whatever was inserted so far stays, as one undo step
+    m_sliceTimer->stop();
+    m_parseTask.cancel();
+    finish();
+}
+
+void PasteJob::begin()
+{
+    m_running = true;
+    m_firstSlice = true;
+    m_next = 0;
+    m_total = 0;
+    m_fragments.clear();
+    m_textChunks.clear();
+    m_cursor = m_editor->textCursor();
+
+    // Keep the user from editing between slices of the same edit block
+    m_wasReadOnly = m_editor->isReadOnly();
+    m_editor->setReadOnly(true);
+
+    emit progress(0);
+}
+
+void PasteJob::onParsed(const QList<QTextDocumentFragment> &fragments)
+{
+    if (!m_running) {
+        return;
+    }
+
+    m_fragments = fragments;
+    m_total = m_fragments.size();
+    m_sliceTimer->start();
+}
+
+void PasteJob::insertSlice()
+{
+    if (!m_running) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The first slice opens the undo step, later slices join it
+    if (m_firstSlice) {
+        m_cursor.beginEditBlock();
+        m_cursor.removeSelectedText();
+        m_firstSlice = false;
+    } else {
+        m_cursor.joinPreviousEditBlock();
+    }
+
+    while (m_next < m_total && timer.elapsed() < SLICE_BUDGET) {
+        if (!m_fragments.isEmpty()) {
+            const int start = m_cursor.position();
+            m_cursor.insertFragment(m_fragments.at(m_next));
+            HtmlImport::resolveStyleReferences(m_editor->document(), start, m_cursor.position());
+            m_fragments[m_next] = QTextDocumentFragment();
+        } else {
+            m_cursor.insertText(m_textChunks.at(m_next));
+            m_textChunks[m_next].clear();
+        }
+        ++m_next;
+    }
+
+    m_cursor.endEditBlock();
+
+    if (m_next >= m_total) {
+        finish();
+        return;
+    }
+
+    emit progress(m_next * 100 / m_total);
+    m_sliceTimer->start();
+}
+
+void PasteJob::finish()
+{
+    m_running = false;
+    m_fragments.clear();
+    m_textChunks.clear();
+    m_editor->setReadOnly(m_wasReadOnly);
+
+    m_editor->setTextCursor(m_cursor);
+    m_editor->ensureCursorVisible();
+
+    emit progress(100);
+    emit finished();
+}
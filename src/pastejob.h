@@ -0,0 +1,62 @@
+#ifndef PASTEJOB_H
+#define PASTEJOB_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTextCursor>
+#include <QTextDocumentFragment>
+#include <QTimer>
+
+#include "taskexecutor.h"
+
+class QTextEdit;
+class QMimeData;
+
+// Pastes large clipboard contents without blocking the UI. HTML is
+// sanitized and parsed into fragments by HtmlImport off the GUI thread; plain text skips
+// HTML parsing entirely. Either way the result is inserted in time-sliced
+// batches that all join a single undoable edit block.
+class PasteJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PasteJob(QTextEdit *editor);
+    ~PasteJob();
+
+    // Returns false if the data is small or has no text; the caller should
+    // then fall back to a regular synchronous paste.
+    bool start(const QMimeData *source);
+    bool isRunning() const;
+    void cancel();
+
+signals:
+    void progress(int percent);
+    void finished();
+
+private slots:
+    void insertSlice();
+
+private:
+    void begin();
+    void onParsed(const QList<QTextDocumentFragment> &fragments);
+    void finish();
+
+    QTextEdit *m_editor;
+    TaskExecutor::Task m_parseTask;
+    QTimer *m_sliceTimer;
+    QList<QTextDocumentFragment> m_fragments;
+    QStringList m_textChunks;
+    QTextCursor m_cursor;
+    int m_next;
+    int m_total;
+    bool m_running;
+    bool m_firstSlice;
+    bool m_wasReadOnly;
+
+    static const int ASYNC_THRESHOLD = 256 * 1024; // characters
+    static const int CHUNK_SIZE = 64 * 1024;
+    static const int SLICE_BUDGET = 8; // ms of insertion per event loop pass
+};
+
+#endif // PASTEJOB_H
@@ -0,0 +1,484 @@
+#include "progressiveloader.h"
+#include "htmlimport.h"
+
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QAbstractTextDocumentLayout>
+#include <QScrollBar>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QSet>
+
+namespace {
+
+// Elements that may nest other blocks; chunks are only cut outside of them
+bool isContainerTag(const QString &name)
+{
+    static const QSet<QString> tags = {
+        "table", "ul", "ol", "dl", "div", "blockquote", "pre",
+        "section", "article", "center", "form"
+    };
+    return tags.contains(name);
+}
+
+bool isBlockTag(const QString &name)
+{
+    static const QSet<QString> tags = {
+        "p", "h1", "h2", "h3", "h4", "h5", "h6"
+    };
+    return tags.contains(name) || isContainerTag(name);
+}
+
+// Returns the index of the '>' closing the tag that starts at lt, skipping
+// quoted attribute values.
+int tagEnd(const QString &html, int lt, int limit)
+{
+    QChar quote;
+    for (int i = lt + 1; i < limit; ++i) {
+        const QChar c = html.at(i);
+        if (!quote.isNull()) {
+            if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == QLatin1Char('"') || c == QLatin1Char('\'')) {
+            quote = c;
+        } else if (c == QLatin1Char('>')) {
+            return i;
+        }
+    }
+    return limit - 1;
+}
+
+}
+
+ProgressiveLoader::ProgressiveLoader(QTextEdit *editor)
+    : QObject(editor)
+    , m_editor(editor)
+    , m_sliceTimer(new QTimer(this))
+    , m_format(Qt::PlainText)
+    , m_nextChunk(0)
+    , m_previousChunk(-1)
+    , m_loadedChars(0)
+    , m_totalChars(0)
+    , m_loading(false)
+    , m_wasReadOnly(false)
+{
+    // A zero-interval timer fires once pending input and paint events are handled
+    m_sliceTimer->setSingleShot(true);
+    m_sliceTimer->setInterval(0);
+    connect(m_sliceTimer, &QTimer::timeout, this, &ProgressiveLoader::loadSlice);
+    connect(m_editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &ProgressiveLoader::onScrolled);
+}
+
+ProgressiveLoader::~ProgressiveLoader()
+{
+    m_sliceTimer->stop();
+    m_parseToken.cancel();
+}
+
+void ProgressiveLoader::start(const QString &content, Qt::TextFormat format, qreal startFraction)
+{
+    cancel();
+
+    QString head;
+    if (format == Qt::RichText) {
+        m_chunks = splitHtml(content, CHUNK_SIZE, &head);
+    } else {
+        m_chunks = splitPlainText(content, CHUNK_SIZE);
+    }
+
+    if (m_chunks.size() <= 1) {
+        // Nothing to gain from splitting
+        m_chunks.clear();
+        if (format == Qt::RichText) {
+            HtmlImport::setHtml(m_editor, HtmlImport::sanitize(content));
+        } else {
+            m_editor->setPlainText(content);
+        }
+        emit progress(100);
+        emit finished();
+        return;
+    }
+
+    m_format = format;
+    m_totalChars = 0;
+    for (const QString &chunk : std::as_const(m_chunks)) {
+        m_totalChars += chunk.size();
+    }
+    
+    // The chunk holding the start position is shown first
+    int firstChunk = 0;
+    qint64 chunkEnd = m_chunks.first().size();
+    while (firstChunk + 1 < m_chunks.size() && chunkEnd <= startFraction * m_totalChars) {
+        ++firstChunk;
+        chunkEnd += m_chunks.at(firstChunk).size();
+    }
+    m_nextChunk = firstChunk + 1;
+    m_previousChunk = firstChunk - 1;
+    m_loadedChars = m_chunks.at(firstChunk).size();
+
+    // Appended chunks are parsed as fragments, so they need the head's style
+    // sheets. The other chunks are parsed on the thread pool while the
+    // first one is laid out here.
+    if (format == Qt::RichText) {
+        head = HtmlImport::sanitize(head);
+        m_styleSheets = extractStyleSheets(head);
+        QStringList others = m_chunks;
+        others[firstChunk].clear();
+        m_parseToken = TaskExecutor::CancellationToken();
+        m_fragments = HtmlImport::parseChunks(others, m_styleSheets, m_parseToken);
+    }
+
+    m_wasReadOnly = m_editor->isReadOnly();
+    m_editor->setReadOnly(true);
+
+    QTextDocument *document = m_editor->document();
+    document->setUndoRedoEnabled(false);
+
+    if (format == Qt::RichText) {
+        // Sanitized together, so the chunk sees the head's style references
+        m_editor->setHtml(HtmlImport::sanitize(head + m_chunks.at(firstChunk)));
+        HtmlImport::resolveStyleReferences(document);
+    } else {
+        m_editor->setPlainText(m_chunks.at(firstChunk));
+    }
+    m_chunks[firstChunk].clear();
+
+    // Trailing spacer block that stands in for the height of the unloaded text
+    QTextCursor cursor(document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertBlock(QTextBlockFormat(), QTextCharFormat());
+    updateSpacer();
+    document->setModified(false);
+    m_loading = true;
+
+    emit progress(int(m_loadedChars * 100 / m_totalChars));
+    m_sliceTimer->start(0);
+}
+
+bool ProgressiveLoader::isLoading() const
+{
+    return m_loading;
+}
+
+void ProgressiveLoader::finish()
+{
+    if (!m_loading) {
+        return;
+    }
+
+    m_sliceTimer->stop();
+
+    QTextCursor cursor(m_editor->document());
+    cursor.beginEditBlock();
+    while (appendNextChunk() || prependPreviousChunk()) {
+    }
+    cursor.endEditBlock();
+
+    complete();
+}
+
+void ProgressiveLoader::cancel()
+{
+    if (!m_loading) {
+        return;
+    }
+
+    m_sliceTimer->stop();
+    m_parseToken.cancel();
+    m_chunks.clear();
+    complete();
+}
+
+void ProgressiveLoader::loadSlice()
+{
+    if (!m_loading) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Follows the top of the text that was already loaded
+    QTextCursor marker(m_editor->document());
+    const qreal topBefore = firstBlockTop();
+
+    // Text below the view first, then what comes before it
+    // Only chunks that are already parsed; the slice never waits for a worker
+    QTextCursor cursor(m_editor->document());
+    cursor.beginEditBlock();
+    const qint64 loadedBefore = m_loadedChars;
+    while (timer.elapsed() < SLICE_BUDGET && (appendNextChunk(false) || prependPreviousChunk(false))) {
+    }
+    cursor.endEditBlock();
+
+    const qreal inserted = m_editor->document()->documentLayout()->blockBoundingRect(marker.block()).top() - topBefore;
+    if (inserted > 0) {
+        emit prepended(inserted);
+    }
+
+    updateSpacer();
+    m_editor->document()->setModified(false);
+
+    if (m_nextChunk >= m_chunks.size() && m_previousChunk < 0) {
+        complete();
+        return;
+    }
+
+    emit progress(int(m_loadedChars * 100 / m_totalChars));
+    m_sliceTimer->start(m_loadedChars > loadedBefore ? 0 : PARSE_WAIT);
+}
+
+void ProgressiveLoader::onScrolled(int value)
+{
+    if (!m_loading) {
+        return;
+    }
+
+    // Scrolled into the estimated region: load up to the viewport right away
+    const qreal target = value + 2 * m_editor->viewport()->height();
+    if (loadedHeight() >= target) {
+        return;
+    }
+
+    // No edit block here: the loop needs the layout to follow each chunk
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < SCROLL_BUDGET && loadedHeight() < target && appendNextChunk()) {
+    }
+    updateSpacer();
+    m_editor->document()->setModified(false);
+}
+
+bool ProgressiveLoader::appendNextChunk(bool wait)
+{
+    if (m_nextChunk >= m_chunks.size() || (!wait && !isChunkReady(m_nextChunk))) {
+        return false;
+    }
+
+    QTextDocument *document = m_editor->document();
+    QTextBlock spacer = document->lastBlock();
+
+    // Insert at the end of the block before the spacer
+    QTextCursor cursor(document);
+    cursor.setPosition(spacer.position() - 1);
+
+    const int index = m_nextChunk++;
+    QString &chunk = m_chunks[index];
+    m_loadedChars += chunk.size();
+
+    if (m_format == Qt::RichText) {
+        cursor.insertBlock(QTextBlockFormat(), QTextCharFormat());
+        const int start = cursor.position();
+        cursor.insertFragment(m_fragments.at(index).result());
+        HtmlImport::resolveStyleReferences(document, start, cursor.position());
+    } else {
+        cursor.insertText(chunk);
+    }
+
+    // The text is in the document now, drop our copy
+    chunk.clear();
+    return true;
+}
+
+bool ProgressiveLoader::prependPreviousChunk(bool wait)
+{
+    if (m_previousChunk < 0 || (!wait && !isChunkReady(m_previousChunk))) {
+        return false;
+    }
+
+    QTextDocument *document = m_editor->document();
+    QTextCursor cursor(document);
+
+    const int index = m_previousChunk--;
+    QString &chunk = m_chunks[index];
+    m_loadedChars += chunk.size();
+
+    // Chunks end at a block boundary; rich text needs its own block so the
+    // chunk's last paragraph is not merged into the first loaded one
+    if (m_format == Qt::RichText) {
+        cursor.insertBlock();
+        cursor.setPosition(0);
+        cursor.insertFragment(m_fragments.at(index).result());
+        HtmlImport::resolveStyleReferences(document, 0, cursor.position());
+    } else {
+        cursor.insertText(chunk);
+    }
+
+    chunk.clear();
+    return true;
+}
+
+bool ProgressiveLoader::isChunkReady(int index) const
+{
+    return m_format != Qt::RichText || m_fragments.at(index).isFinished();
+}
+
+qreal ProgressiveLoader::firstBlockTop() const
+{
+    QTextDocument *document = m_editor->document();
+    return document->documentLayout()->blockBoundingRect(document->firstBlock()).top();
+}
+
+void ProgressiveLoader::updateSpacer()
+{
+    QTextDocument *document = m_editor->document();
+    QTextBlock spacer = document->lastBlock();
+
+    qreal estimate = 0;
+    if (m_loadedChars > 0) {
+        estimate = loadedHeight() * qreal(m_totalChars - m_loadedChars) / qreal(m_loadedChars);
+    }
+
+    QTextBlockFormat format;
+    format.setTopMargin(estimate);
+
+    QTextCursor cursor(spacer);
+    cursor.setBlockFormat(format);
+}
+
+qreal ProgressiveLoader::loadedHeight() const
+{
+    QTextDocument *document = m_editor->document();
+    return document->documentLayout()->blockBoundingRect(document->lastBlock()).top();
+}
+
+void ProgressiveLoader::complete()
+{
+    QTextDocument *document = m_editor->document();
+
+    // Drop the spacer together with the separator in front of it
+    QTextBlock spacer = document->lastBlock();
+    if (spacer.position() > 0) {
+        QTextCursor cursor(document);
+        cursor.setPosition(spacer.position() - 1);
+        cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+        cursor.removeSelectedText();
+    }
+
+    m_chunks.clear();
+    m_styleSheets.clear();
+    m_fragments.clear();
+    m_loading = false;
+
+    document->setUndoRedoEnabled(true);
+    document->setModified(false);
+    m_editor->setReadOnly(m_wasReadOnly);
+
+    emit progress(100);
+    emit finished();
+}
+
+QStringList ProgressiveLoader::splitHtml(const QString &html, int chunkSize, QString *head)
+{
+    QStringList chunks;
+
+    int bodyStart = 0;
+    const int bodyTag = html.indexOf(QLatin1String("<body"), 0, Qt::CaseInsensitive);
+    if (bodyTag >= 0) {
+        const int close = html.indexOf(QLatin1Char('>'), bodyTag);
+        bodyStart = close >= 0 ? close + 1 : html.size();
+    }
+
+    int bodyEnd = html.lastIndexOf(QLatin1String("</body"), -1, Qt::CaseInsensitive);
+    if (bodyEnd < bodyStart) {
+        bodyEnd = html.size();
+    }
+
+    if (head) {
+        *head = html.left(bodyStart);
+    }
+
+    int depth = 0;
+    int chunkStart = bodyStart;
+    int pos = bodyStart;
+
+    while (pos < bodyEnd) {
+        const int lt = html.indexOf(QLatin1Char('<'), pos);
+        if (lt < 0 || lt >= bodyEnd) {
+            break;
+        }
+
+        if (html.mid(lt, 4) == QLatin1String("<!--")) {
+            const int end = html.indexOf(QLatin1String("-->"), lt + 4);
+            pos = end < 0 ? bodyEnd : end + 3;
+            continue;
+        }
+
+        const int gt = tagEnd(html, lt, bodyEnd);
+        const bool closing = lt + 1 < bodyEnd && html.at(lt + 1) == QLatin1Char('/');
+        const int nameStart = lt + (closing ? 2 : 1);
+        int nameEnd = nameStart;
+        while (nameEnd < gt && html.at(nameEnd).isLetterOrNumber()) {
+            ++nameEnd;
+        }
+        const QString name = html.mid(nameStart, nameEnd - nameStart).toLower();
+        pos = gt + 1;
+
+        // Never cut inside scripts or inline style sheets
+        if (!closing && (name == QLatin1String("script") || name == QLatin1String("style"))) {
+            const int end = html.indexOf(QLatin1String("</") + name, pos, Qt::CaseInsensitive);
+            const int endGt = end < 0 ? -1 : html.indexOf(QLatin1Char('>'), end);
+            pos = endGt < 0 ? bodyEnd : endGt + 1;
+            continue;
+        }
+
+        if (isContainerTag(name)) {
+            if (closing) {
+                depth = qMax(0, depth - 1);
+            } else if (html.at(gt - 1) != QLatin1Char('/')) {
+                ++depth;
+            }
+        }
+
+        if (closing && depth == 0 && isBlockTag(name) && pos - chunkStart >= chunkSize) {
+            chunks.append(html.mid(chunkStart, pos - chunkStart));
+            chunkStart = pos;
+        }
+    }
+
+    if (chunkStart < bodyEnd) {
+        chunks.append(html.mid(chunkStart, bodyEnd - chunkStart));
+    }
+
+    return chunks;
+}
+
+QStringList ProgressiveLoader::splitPlainText(const QString &text, int chunkSize)
+{
+    QStringList chunks;
+
+    // Every chunk after the first starts with the line break in front of it,
+    // so appending a chunk at the end of the document starts a new block.
+    int chunkStart = 0;
+    while (chunkStart < text.size()) {
+        int cut = text.size();
+        if (text.size() - chunkStart > chunkSize) {
+            const int newline = text.indexOf(QLatin1Char('\n'), chunkStart + chunkSize);
+            if (newline > chunkStart) {
+                cut = newline;
+            }
+        }
+
+        chunks.append(text.mid(chunkStart, cut - chunkStart));
+        chunkStart = cut;
+    }
+
+    return chunks;
+}
+
+QString ProgressiveLoader::extractStyleSheets(const QString &head)
+{
+    static const QRegularExpression styleExpression(QStringLiteral("<style[^>]*>.*?</style>"),
+                                                    QRegularExpression::CaseInsensitiveOption
+                                                    | QRegularExpression::DotMatchesEverythingOption);
+
+    QString styleSheets;
+    QRegularExpressionMatchIterator it = styleExpression.globalMatch(head);
+    while (it.hasNext()) {
+        styleSheets += it.next().captured(0);
+    }
+    return styleSheets;
+}
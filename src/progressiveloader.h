@@ -0,0 +1,83 @@
+#ifndef PROGRESSIVELOADER_H
+#define PROGRESSIVELOADER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QFuture>
+#include <QTextDocumentFragment>
+
+#include "taskexecutor.h"
+
+class QTextEdit;
+
+// Loads large documents into a QTextEdit viewport-first: the first chunk is
+// shown immediately, a spacer block stands in for the estimated height of
+// the rest so the scrollbar is usable, and remaining chunks are appended in
+// idle time slices (or on demand when the user scrolls into the estimate).
+// Loading can start in the middle of the document, at a restored reading
+// position; the chunks before it are then prepended in the background.
+// HTML chunks are cleaned and parsed in parallel by HtmlImport while the
+// first chunk is shown; slices insert whichever fragments are ready.
+class ProgressiveLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProgressiveLoader(QTextEdit *editor);
+    ~ProgressiveLoader();
+
+    // startFraction is the share of the content before the chunk shown first
+    void start(const QString &content, Qt::TextFormat format, qreal startFraction = 0);
+    bool isLoading() const;
+    void finish();
+    void cancel();
+
+    // Splits an HTML document into body chunks at top-level block boundaries.
+    // Everything before the body content is returned through head.
+    static QStringList splitHtml(const QString &html, int chunkSize, QString *head);
+    static QStringList splitPlainText(const QString &text, int chunkSize);
+
+    // Concatenated <style> elements of an HTML head, for parsing body chunks
+    static QString extractStyleSheets(const QString &head);
+
+signals:
+    void progress(int percent);
+    void finished();
+    // Text was inserted above the view; height is in document coordinates
+    void prepended(qreal height);
+
+private slots:
+    void loadSlice();
+    void onScrolled(int value);
+
+private:
+    bool appendNextChunk(bool wait = true);
+    bool prependPreviousChunk(bool wait = true);
+    bool isChunkReady(int index) const;
+    qreal firstBlockTop() const;
+    void updateSpacer();
+    qreal loadedHeight() const;
+    void complete();
+
+    QTextEdit *m_editor;
+    QTimer *m_sliceTimer;
+    QStringList m_chunks;
+    QList<QFuture<QTextDocumentFragment>> m_fragments; // rich text only, one per chunk
+    TaskExecutor::CancellationToken m_parseToken;
+    QString m_styleSheets;
+    Qt::TextFormat m_format;
+    int m_nextChunk;
+    int m_previousChunk;
+    qint64 m_loadedChars;
+    qint64 m_totalChars;
+    bool m_loading;
+    bool m_wasReadOnly;
+
+    static const int CHUNK_SIZE = 64 * 1024;
+    static const int SLICE_BUDGET = 8;     // ms of work per idle slice
+    static const int SCROLL_BUDGET = 50;   // ms spent catching up with a scroll
+    static const int PARSE_WAIT = 5;       // ms before checking again for parsed chunks
+};
+
+#endif // PROGRESSIVELOADER_H
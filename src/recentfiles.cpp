@@ -0,0 +1,202 @@
+#include "recentfiles.h"
+#include "tracer.h"
+
+#include <QFileInfo>
+#include <QSettings>
+
+namespace {
+
+QStringList storedFiles()
+{
+    QSettings settings;
+    settings.beginGroup("RecentFiles");
+    const QStringList files = settings.value("files").toStringList().mid(0, RecentFiles::MAX_FILES);
+    settings.endGroup();
+    return files;
+}
+
+}
+
+RecentFiles::RecentFiles(QObject *parent)
+    : QObject(parent)
+    , m_cacheBytes(0)
+{
+}
+
+RecentFiles::~RecentFiles()
+{
+    for (const TaskExecutor::Task &task : std::as_const(m_pending)) {
+        task.cancel();
+    }
+}
+
+void RecentFiles::load()
+{
+    m_files = storedFiles();
+    emit changed();
+}
+
+void RecentFiles::save() const
+{
+    QSettings settings;
+    settings.beginGroup("RecentFiles");
+    settings.setValue("files", m_files);
+    settings.endGroup();
+}
+
+QStringList RecentFiles::files() const
+{
+    return m_files;
+}
+
+// Changes go straight to the settings, on top of what other windows stored
+void RecentFiles::add(const QString &filePath)
+{
+    m_files = storedFiles();
+    m_files.removeAll(filePath);
+    m_files.prepend(filePath);
+    while (m_files.size() > MAX_FILES) {
+        drop(m_files.takeLast());
+    }
+    save();
+    emit changed();
+}
+
+void RecentFiles::remove(const QString &filePath)
+{
+    m_files = storedFiles();
+    m_files.removeAll(filePath);
+    drop(filePath);
+    save();
+    emit changed();
+}
+
+void RecentFiles::clear()
+{
+    m_files.clear();
+    m_cache.clear();
+    m_cacheBytes = 0;
+    save();
+    emit changed();
+}
+
+void RecentFiles::prefetch(const QString &skipFile, TaskExecutor::Priority priority)
+{
+    // Cached entries are only checked, not read again, unless they changed
+    int requested = 0;
+    for (const QString &filePath : std::as_const(m_files)) {
+        if (requested == PREFETCH_COUNT) {
+            break;
+        }
+        if (filePath == skipFile) {
+            continue;
+        }
+        ++requested;
+        if (m_pending.contains(filePath)) {
+            continue;
+        }
+
+        Prefetch request;
+        request.filePath = filePath;
+        const auto cached = m_cache.constFind(filePath);
+        if (cached != m_cache.constEnd()) {
+            request.modified = cached->modified;
+            request.size = cached->size;
+        }
+        m_pending.insert(filePath, TaskExecutor::instance()->run(priority, this,
+            [request](const TaskExecutor::CancellationToken &token) {
+                return readAhead(request, token);
+            },
+            [this](const Prefetch &prefetch) {
+                m_pending.remove(prefetch.filePath);
+                store(prefetch);
+            }));
+    }
+}
+
+bool RecentFiles::takePrefetched(const QString &filePath, QString *content, TextImport::Encoding *encoding)
+{
+    const auto it = m_cache.find(filePath);
+    if (it == m_cache.end()) {
+        return false;
+    }
+    const Prefetch prefetch = it.value();
+    drop(filePath);
+
+    // The file may have been written since it was read ahead
+    const QFileInfo info(filePath);
+    if (info.size() != prefetch.size || info.lastModified() != prefetch.modified) {
+        return false;
+    }
+
+    *content = prefetch.content;
+    if (encoding) {
+        *encoding = prefetch.encoding;
+    }
+    return true;
+}
+
+qint64 RecentFiles::cachedBytes() const
+{
+    return m_cacheBytes;
+}
+
+RecentFiles::Prefetch RecentFiles::readAhead(const Prefetch &request, const TaskExecutor::CancellationToken &token)
+{
+    TRACE_SCOPE("RecentFiles::readAhead");
+
+    Prefetch result;
+    result.filePath = request.filePath;
+
+    const QFileInfo info(request.filePath);
+    if (!info.isFile()) {
+        return result;
+    }
+    result.modified = info.lastModified();
+    result.size = info.size();
+    if (result.size == request.size && result.modified == request.modified) {
+        result.unchanged = true;
+        return result;
+    }
+
+    // Decoded text takes up to two bytes per byte on disk
+    if (result.size * 2 > CACHE_LIMIT || token.isCancelled()) {
+        return result;
+    }
+    result.valid = TextImport::readFile(request.filePath, &result.content, &result.encoding);
+    return result;
+}
+
+void RecentFiles::store(const Prefetch &prefetch)
+{
+    if (prefetch.unchanged) {
+        return;
+    }
+    drop(prefetch.filePath);
+    if (!prefetch.valid || !m_files.contains(prefetch.filePath)) {
+        return;
+    }
+
+    m_cache.insert(prefetch.filePath, prefetch);
+    m_cacheBytes += prefetch.content.size() * qint64(sizeof(QChar));
+    evict();
+
+    TRACE_COUNTER("prefetch cache bytes", m_cacheBytes);
+}
+
+void RecentFiles::evict()
+{
+    // Lowest ranked first
+    for (int i = m_files.size() - 1; i >= 0 && m_cacheBytes > CACHE_LIMIT; --i) {
+        drop(m_files.at(i));
+    }
+}
+
+void RecentFiles::drop(const QString &filePath)
+{
+    const auto it = m_cache.find(filePath);
+    if (it != m_cache.end()) {
+        m_cacheBytes -= it->content.size() * qint64(sizeof(QChar));
+        m_cache.erase(it);
+    }
+}
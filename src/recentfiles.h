@@ -0,0 +1,69 @@
+#ifndef RECENTFILES_H
+#define RECENTFILES_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QStringList>
+
+#include "textimport.h"
+#include "taskexecutor.h"
+
+// Most recently used documents for File > Open Recent. The top entries are
+// read ahead on the task executor (memory-mapped and decoded by TextImport) so
+// that picking one skips the disk, which matters most on network shares.
+// Prefetched text is capped at CACHE_LIMIT bytes, lower-ranked entries are
+// evicted first, and an entry is only handed out while the file's size and
+// modification time still match the ones it was read with.
+class RecentFiles : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RecentFiles(QObject *parent = nullptr);
+    ~RecentFiles();
+
+    void load();
+    void save() const;
+
+    QStringList files() const;
+    void add(const QString &filePath);
+    void remove(const QString &filePath);
+    void clear();
+
+    // Reads the top entries ahead, except skipFile (usually the open document)
+    void prefetch(const QString &skipFile = QString(), TaskExecutor::Priority priority = TaskExecutor::Idle);
+    bool takePrefetched(const QString &filePath, QString *content, TextImport::Encoding *encoding = nullptr);
+    qint64 cachedBytes() const;
+
+    static const int MAX_FILES = 10;
+    static const int PREFETCH_COUNT = 3;
+    static const int STARTUP_DELAY = 2000; // ms of idle time before the first prefetch
+    static const qint64 CACHE_LIMIT = 64 * 1024 * 1024; // bytes of decoded text
+
+signals:
+    void changed();
+
+private:
+    struct Prefetch {
+        QString filePath;
+        QString content;
+        TextImport::Encoding encoding = TextImport::Utf8;
+        QDateTime modified;
+        qint64 size = -1;
+        bool unchanged = false; // the cached copy is still current
+        bool valid = false;
+    };
+
+    static Prefetch readAhead(const Prefetch &request, const TaskExecutor::CancellationToken &token);
+    void store(const Prefetch &prefetch);
+    void evict();
+    void drop(const QString &filePath);
+
+    QStringList m_files;
+    QHash<QString, Prefetch> m_cache;
+    qint64 m_cacheBytes;
+    QHash<QString, TaskExecutor::Task> m_pending;
+};
+
+#endif // RECENTFILES_H
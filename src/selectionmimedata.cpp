@@ -0,0 +1,80 @@
+#include "selectionmimedata.h"
+
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextDocumentWriter>
+#include <QBuffer>
+
+namespace {
+const QString PLAIN_TEXT = QStringLiteral("text/plain");
+const QString HTML = QStringLiteral("text/html");
+const QString ODF = QStringLiteral("application/vnd.oasis.opendocument.text");
+}
+
+SelectionMimeData::SelectionMimeData(const QTextDocumentFragment &fragment, bool richText)
+    : m_fragment(fragment)
+    , m_richText(richText)
+{
+}
+
+QStringList SelectionMimeData::formats() const
+{
+    if (!m_richText) {
+        return {PLAIN_TEXT};
+    }
+#if QT_CONFIG(textodfwriter)
+    return {HTML, PLAIN_TEXT, ODF};
+#else
+    return {HTML, PLAIN_TEXT};
+#endif
+}
+
+bool SelectionMimeData::hasFormat(const QString &mimeType) const
+{
+    // Answered from the format list alone, without serializing anything
+    return formats().contains(mimeType);
+}
+
+QVariant SelectionMimeData::retrieveData(const QString &mimeType, QMetaType type) const
+{
+    if (!hasFormat(mimeType)) {
+        return QMimeData::retrieveData(mimeType, type);
+    }
+
+    // Some platforms ask for the same format several times during one paste
+    auto it = m_cache.constFind(mimeType);
+    if (it != m_cache.constEnd()) {
+        return it.value();
+    }
+
+    QVariant data = serialize(mimeType);
+    m_cache.insert(mimeType, data);
+    return data;
+}
+
+QVariant SelectionMimeData::serialize(const QString &mimeType) const
+{
+    if (mimeType == PLAIN_TEXT) {
+        // Read straight from the fragment's text, no markup is generated
+        return m_fragment.toPlainText();
+    }
+
+    if (mimeType == HTML) {
+        return m_fragment.toHtml();
+    }
+
+#if QT_CONFIG(textodfwriter)
+    if (mimeType == ODF) {
+        QTextDocument document;
+        QTextCursor(&document).insertFragment(m_fragment);
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        QTextDocumentWriter writer(&buffer, "ODF");
+        writer.write(&document);
+        return buffer.data();
+    }
+#endif
+
+    return QVariant();
+}
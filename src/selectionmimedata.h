@@ -0,0 +1,32 @@
+#ifndef SELECTIONMIMEDATA_H
+#define SELECTIONMIMEDATA_H
+
+#include <QMimeData>
+#include <QTextDocumentFragment>
+#include <QHash>
+
+// Clipboard data for a text selection that serializes each format only when
+// a consumer asks for it. Pasting into a plain text editor never pays for
+// HTML or ODF generation, and nothing is serialized for formats nobody reads.
+class SelectionMimeData : public QMimeData
+{
+    Q_OBJECT
+
+public:
+    SelectionMimeData(const QTextDocumentFragment &fragment, bool richText);
+
+    QStringList formats() const override;
+    bool hasFormat(const QString &mimeType) const override;
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QMetaType type) const override;
+
+private:
+    QVariant serialize(const QString &mimeType) const;
+
+    QTextDocumentFragment m_fragment;
+    bool m_richText;
+    mutable QHash<QString, QVariant> m_cache;
+};
+
+#endif // SELECTIONMIMEDATA_H
@@ -0,0 +1,101 @@
+#include "sessionstate.h"
+
+#include <QSettings>
+
+std::shared_ptr<SessionState> SessionState::shared()
+{
+    static std::weak_ptr<SessionState> instance;
+    std::shared_ptr<SessionState> state = instance.lock();
+    if (!state) {
+        state = std::make_shared<SessionState>();
+        state->load();
+        instance = state;
+    }
+    return state;
+}
+
+void SessionState::load()
+{
+    m_documents.clear();
+
+    QSettings settings;
+    settings.beginGroup("Session");
+    m_activeFile = settings.value("activeFile").toString();
+
+    const int count = settings.beginReadArray("documents");
+    for (int i = 0; i < count && i < MAX_DOCUMENTS; ++i) {
+        settings.setArrayIndex(i);
+        Document document;
+        document.filePath = settings.value("filePath").toString();
+        document.cursorPosition = settings.value("cursorPosition").toInt();
+        document.anchorPosition = settings.value("anchorPosition").toInt();
+        document.verticalScroll = settings.value("verticalScroll").toInt();
+        document.horizontalScroll = settings.value("horizontalScroll").toInt();
+        document.zoomFactor = settings.value("zoomFactor", 1.0).toReal();
+        document.visibleFraction = settings.value("visibleFraction").toReal();
+        if (!document.filePath.isEmpty()) {
+            m_documents.append(document);
+        }
+    }
+    settings.endArray();
+    settings.endGroup();
+}
+
+void SessionState::save() const
+{
+    QSettings settings;
+    settings.beginGroup("Session");
+    settings.setValue("activeFile", m_activeFile);
+
+    settings.remove("documents");
+    settings.beginWriteArray("documents", m_documents.size());
+    for (int i = 0; i < m_documents.size(); ++i) {
+        const Document &document = m_documents.at(i);
+        settings.setArrayIndex(i);
+        settings.setValue("filePath", document.filePath);
+        settings.setValue("cursorPosition", document.cursorPosition);
+        settings.setValue("anchorPosition", document.anchorPosition);
+        settings.setValue("verticalScroll", document.verticalScroll);
+        settings.setValue("horizontalScroll", document.horizontalScroll);
+        settings.setValue("zoomFactor", document.zoomFactor);
+        settings.setValue("visibleFraction", document.visibleFraction);
+    }
+    settings.endArray();
+    settings.endGroup();
+}
+
+void SessionState::remember(const Document &document)
+{
+    for (int i = 0; i < m_documents.size(); ++i) {
+        if (m_documents.at(i).filePath == document.filePath) {
+            m_documents.removeAt(i);
+            break;
+        }
+    }
+
+    m_documents.prepend(document);
+    while (m_documents.size() > MAX_DOCUMENTS) {
+        m_documents.removeLast();
+    }
+}
+
+bool SessionState::find(const QString &filePath, Document *document) const
+{
+    for (const Document &candidate : m_documents) {
+        if (candidate.filePath == filePath) {
+            *document = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+QString SessionState::activeFile() const
+{
+    return m_activeFile;
+}
+
+void SessionState::setActiveFile(const QString &filePath)
+{
+    m_activeFile = filePath;
+}
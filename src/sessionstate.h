@@ -0,0 +1,46 @@
+#ifndef SESSIONSTATE_H
+#define SESSIONSTATE_H
+
+#include <QList>
+#include <QString>
+#include <memory>
+
+// Where the user was in recently used documents: cursor, selection, scroll
+// offsets and zoom, most recent first and capped at MAX_DOCUMENTS. The
+// active document is reopened on start; the others are restored when they
+// are opened again. Stored in QSettings next to the window state. All
+// windows of a process share one instance, so closing one window saves
+// what the others remembered instead of overwriting it.
+class SessionState
+{
+public:
+    // Loaded on first use, kept while any window holds it
+    static std::shared_ptr<SessionState> shared();
+
+    struct Document {
+        QString filePath;
+        int cursorPosition = 0;
+        int anchorPosition = 0;
+        int verticalScroll = 0;
+        int horizontalScroll = 0;
+        qreal zoomFactor = 1.0;
+        qreal visibleFraction = 0; // share of the document above the view
+    };
+
+    void load();
+    void save() const;
+
+    void remember(const Document &document);
+    bool find(const QString &filePath, Document *document) const;
+
+    QString activeFile() const;
+    void setActiveFile(const QString &filePath);
+
+    static const int MAX_DOCUMENTS = 20;
+
+private:
+    QList<Document> m_documents;
+    QString m_activeFile;
+};
+
+#endif // SESSIONSTATE_H
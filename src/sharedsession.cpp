@@ -0,0 +1,646 @@
+#include "sharedsession.h"
+
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextDocumentFragment>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
+#include <QDir>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+
+using Operations = QList<EditOperation>;
+
+EditOperation makeInsert(int position, const QString &text)
+{
+    return {EditOperation::Insert, position, 0, text};
+}
+
+EditOperation makeDelete(int position, int length)
+{
+    return {EditOperation::Delete, position, length, QString()};
+}
+
+// Position x after the range removed by d
+int mapThroughDelete(int x, const EditOperation &d)
+{
+    if (x <= d.position) {
+        return x;
+    }
+    if (x >= d.end()) {
+        return x - d.length;
+    }
+    return d.position;
+}
+
+Operations deleteAfterInsert(const EditOperation &d, const EditOperation &i)
+{
+    if (i.position >= d.end()) {
+        return {d};
+    }
+    if (i.position <= d.position) {
+        return {makeDelete(d.position + i.text.size(), d.length)};
+    }
+    // The insert landed inside the deleted range: keep it, delete around it
+    return {makeDelete(d.position, i.position - d.position),
+            makeDelete(d.position + i.text.size(), d.end() - i.position)};
+}
+
+Operations deleteAfterDelete(const EditOperation &a, const EditOperation &b)
+{
+    const int start = mapThroughDelete(a.position, b);
+    const int end = mapThroughDelete(a.end(), b);
+    if (end <= start) {
+        return {};
+    }
+    return {makeDelete(start, end - start)};
+}
+
+// Transforms two single operations made against the same state. aOut is a
+// rewritten to apply after b, bOut is b rewritten to apply after a.
+void transformPair(const EditOperation &a, const EditOperation &b, bool aWins,
+                   Operations &aOut, Operations &bOut)
+{
+    if (a.type == EditOperation::Insert && b.type == EditOperation::Insert) {
+        if (a.position < b.position || (a.position == b.position && aWins)) {
+            aOut = {a};
+            bOut = {makeInsert(b.position + a.text.size(), b.text)};
+        } else {
+            aOut = {makeInsert(a.position + b.text.size(), a.text)};
+            bOut = {b};
+        }
+    } else if (a.type == EditOperation::Insert) {
+        aOut = {makeInsert(mapThroughDelete(a.position, b), a.text)};
+        bOut = deleteAfterInsert(b, a);
+    } else if (b.type == EditOperation::Insert) {
+        aOut = deleteAfterInsert(a, b);
+        bOut = {makeInsert(mapThroughDelete(b.position, a), b.text)};
+    } else {
+        aOut = deleteAfterDelete(a, b);
+        bOut = deleteAfterDelete(b, a);
+    }
+}
+
+// Same as transformPair for sequences of operations
+void transform(const Operations &a, const Operations &b, bool aWins,
+               Operations &aOut, Operations &bOut)
+{
+    if (a.isEmpty() || b.isEmpty()) {
+        aOut = a;
+        bOut = b;
+        return;
+    }
+
+    if (a.size() == 1 && b.size() == 1) {
+        transformPair(a.first(), b.first(), aWins, aOut, bOut);
+        return;
+    }
+
+    if (a.size() > 1) {
+        Operations head, tail, b1, b2;
+        transform(a.mid(0, 1), b, aWins, head, b1);
+        transform(a.mid(1), b1, aWins, tail, b2);
+        aOut = head + tail;
+        bOut = b2;
+        return;
+    }
+
+    Operations head, tail, a1, a2;
+    transform(a, b.mid(0, 1), aWins, a1, head);
+    transform(a1, b.mid(1), aWins, a2, tail);
+    aOut = a2;
+    bOut = head + tail;
+}
+
+}
+
+SharedSession::SharedSession(QObject *parent)
+    : QObject(parent)
+    , m_document(nullptr)
+    , m_server(nullptr)
+    , m_socket(nullptr)
+    , m_flushTimer(new QTimer(this))
+    , m_site(0)
+    , m_nextSite(0)
+    , m_revision(-1)
+    , m_applyingRemote(false)
+    , m_undoRedoWasEnabled(false)
+{
+    m_flushTimer->setInterval(FLUSH_INTERVAL);
+    connect(m_flushTimer, &QTimer::timeout, this, &SharedSession::flush);
+}
+
+SharedSession::~SharedSession()
+{
+    stop();
+}
+
+QString SharedSession::serverName(const QString &filePath)
+{
+    QString path = QFileInfo(filePath).absoluteFilePath();
+#ifdef Q_OS_WIN
+    path = path.toLower();
+#endif
+    const QByteArray hash = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStringLiteral("CPPWord-share-") + QString::fromLatin1(hash.left(16));
+}
+
+bool SharedSession::start(QTextDocument *document, const QString &filePath)
+{
+    stop();
+
+    if (!document || filePath.isEmpty()) {
+        return false;
+    }
+
+    m_document = document;
+    // Undo would revert other people's edits and send the revert to every
+    // site, so a shared document keeps no undo history
+    m_undoRedoWasEnabled = m_document->isUndoRedoEnabled();
+    m_document->setUndoRedoEnabled(false);
+    resyncShadow();
+    connect(m_document, &QTextDocument::contentsChange, this, &SharedSession::onContentsChange);
+
+    const QString name = serverName(filePath);
+
+    // Join a session another instance is already hosting
+    if (joinHost(name)) {
+        return true;
+    }
+
+    // Otherwise host it. The host holds the lock for the whole session; a
+    // lock we cannot get belongs to a live host that has not started
+    // listening yet, so join that one instead.
+    m_hostLock.reset(new QLockFile(QDir::temp().filePath(name + QStringLiteral(".lock"))));
+    m_hostLock->setStaleLockTime(0); // only a dead owner makes it stale
+    if (!m_hostLock->tryLock(LOCK_TIMEOUT)) {
+        m_hostLock.reset();
+        if (joinHost(name)) {
+            return true;
+        }
+        stop();
+        return false;
+    }
+
+    // No live host, so a socket file left behind is from a crash
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        qDebug() << "SharedSession: could not listen on" << name << m_server->errorString();
+        stop();
+        return false;
+    }
+    connect(m_server, &QLocalServer::newConnection, this, &SharedSession::onNewConnection);
+
+    m_site = 0;
+    m_nextSite = 0;
+    m_revision = 0;
+    m_flushTimer->start();
+    return true;
+}
+
+void SharedSession::stop()
+{
+    m_flushTimer->stop();
+
+    if (m_document) {
+        disconnect(m_document, nullptr, this, nullptr);
+        m_document->setUndoRedoEnabled(m_undoRedoWasEnabled);
+        m_document = nullptr;
+    }
+
+    for (auto it = m_peers.constBegin(); it != m_peers.constEnd(); ++it) {
+        disconnect(it.key(), nullptr, this, nullptr);
+        it.key()->disconnectFromServer();
+        it.key()->deleteLater();
+    }
+    m_peers.clear();
+    m_readBuffers.clear();
+
+    if (m_server) {
+        m_server->close();
+        m_server->deleteLater();
+        m_server = nullptr;
+    }
+    m_hostLock.reset();
+
+    if (m_socket) {
+        disconnect(m_socket, nullptr, this, nullptr);
+        m_socket->disconnectFromServer();
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+
+    m_shadow.clear();
+    m_history.clear();
+    m_inflight.clear();
+    m_buffer.clear();
+    m_revision = -1;
+}
+
+bool SharedSession::joinHost(const QString &name)
+{
+    m_socket = new QLocalSocket(this);
+    m_socket->connectToServer(name);
+    if (!m_socket->waitForConnected(CONNECT_TIMEOUT)) {
+        delete m_socket;
+        m_socket = nullptr;
+        return false;
+    }
+
+    connect(m_socket, &QLocalSocket::readyRead, this, &SharedSession::onReadyRead);
+    connect(m_socket, &QLocalSocket::disconnected, this, &SharedSession::onHostDisconnected);
+    m_revision = -1; // until the host's welcome arrives
+    m_flushTimer->start();
+    return true;
+}
+
+bool SharedSession::isActive() const
+{
+    return m_server || m_socket;
+}
+
+bool SharedSession::isHost() const
+{
+    return m_server != nullptr;
+}
+
+int SharedSession::peerCount() const
+{
+    return m_peers.size();
+}
+
+void SharedSession::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (m_applyingRemote || !m_document) {
+        return;
+    }
+
+    // contentsChange may count the document's implicit final separator
+    const int length = m_document->characterCount() - 1;
+    if (position > m_shadow.size() || position > length) {
+        resendDocument(m_shadow.size());
+        return;
+    }
+    const int removed = qMin(charsRemoved, int(m_shadow.size()) - position);
+    const int added = qMin(charsAdded, length - position);
+
+    QTextCursor cursor(m_document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + added, QTextCursor::KeepAnchor);
+    const QString inserted = cursor.selectedText();
+    const QString previous = m_shadow.mid(position, removed);
+
+    if (inserted == previous) {
+        return; // formatting only
+    }
+
+    // Trim the common prefix and suffix so only the real change is sent
+    int prefix = 0;
+    while (prefix < removed && prefix < added && previous.at(prefix) == inserted.at(prefix)) {
+        ++prefix;
+    }
+    int suffix = 0;
+    while (suffix < removed - prefix && suffix < added - prefix
+           && previous.at(removed - 1 - suffix) == inserted.at(added - 1 - suffix)) {
+        ++suffix;
+    }
+
+    m_shadow.replace(position, removed, inserted);
+    if (m_shadow.size() != length) {
+        resendDocument(m_shadow.size() - inserted.size() + removed);
+        return;
+    }
+
+    const int deleted = removed - prefix - suffix;
+    if (deleted > 0) {
+        queueLocal(makeDelete(position + prefix, deleted));
+    }
+    if (added - prefix - suffix > 0) {
+        queueLocal(makeInsert(position + prefix, inserted.mid(prefix, added - prefix - suffix)));
+    }
+}
+
+void SharedSession::resendDocument(int sharedLength)
+{
+    // Lost track of the document; send it whole rather than diverge
+    resyncShadow();
+    if (sharedLength > 0) {
+        queueLocal(makeDelete(0, sharedLength));
+    }
+    if (!m_shadow.isEmpty()) {
+        queueLocal(makeInsert(0, m_shadow));
+    }
+}
+
+void SharedSession::queueLocal(const EditOperation &operation)
+{
+    // Merge with the previous edit while typing or deleting in one place
+    if (!m_buffer.isEmpty()) {
+        EditOperation &last = m_buffer.last();
+        if (last.type == EditOperation::Insert && operation.type == EditOperation::Insert
+            && operation.position == last.end()) {
+            last.text += operation.text;
+            return;
+        }
+        if (last.type == EditOperation::Delete && operation.type == EditOperation::Delete) {
+            if (operation.end() == last.position) {
+                // Backspace
+                last.position = operation.position;
+                last.length += operation.length;
+                return;
+            }
+            if (operation.position == last.position) {
+                // Forward delete
+                last.length += operation.length;
+                return;
+            }
+        }
+    }
+
+    m_buffer.append(operation);
+}
+
+void SharedSession::flush()
+{
+    if (m_buffer.isEmpty()) {
+        return;
+    }
+
+    if (m_server) {
+        hostSubmit(m_site, m_revision, m_buffer);
+        m_buffer.clear();
+        return;
+    }
+
+    // Clients keep at most one batch in flight; the rest waits for the ack
+    if (m_socket && m_revision >= 0 && m_inflight.isEmpty()) {
+        m_inflight = m_buffer;
+        m_buffer.clear();
+        send(m_socket, encode(Submit, m_site, m_revision, m_inflight));
+    }
+}
+
+void SharedSession::hostSubmit(quint32 site, int baseRevision, QList<EditOperation> operations)
+{
+    // Rebase onto everything sequenced since the submitter's revision
+    for (int revision = qMax(0, baseRevision); revision < m_history.size(); ++revision) {
+        Operations rebased, unused;
+        transform(operations, m_history.at(revision), false, rebased, unused);
+        operations = rebased;
+    }
+
+    if (site != m_site) {
+        applyRemote(operations);
+    }
+
+    m_history.append(operations);
+    m_revision = m_history.size();
+
+    const QByteArray message = encode(Broadcast, site, m_revision, operations);
+    for (auto it = m_peers.constBegin(); it != m_peers.constEnd(); ++it) {
+        send(it.key(), message);
+    }
+}
+
+void SharedSession::applyRemote(const QList<EditOperation> &operations)
+{
+    if (!m_document || operations.isEmpty()) {
+        return;
+    }
+
+    m_applyingRemote = true;
+
+    QTextCursor cursor(m_document);
+    cursor.beginEditBlock();
+    for (const EditOperation &operation : operations) {
+        const int length = m_document->characterCount() - 1;
+        const int position = qBound(0, operation.position, length);
+
+        cursor.setPosition(position);
+        if (operation.type == EditOperation::Insert) {
+            cursor.insertText(operation.text);
+            m_shadow.insert(position, operation.text);
+        } else {
+            const int end = qMin(position + operation.length, length);
+            cursor.setPosition(end, QTextCursor::KeepAnchor);
+            cursor.removeSelectedText();
+            m_shadow.remove(position, end - position);
+        }
+    }
+    cursor.endEditBlock();
+
+    m_applyingRemote = false;
+}
+
+void SharedSession::applySnapshot(const QString &snapshot)
+{
+    // The host's copy replaces ours in one edit; undo is off while the
+    // session runs, so it never reaches the history
+    QTextDocument incoming;
+    incoming.setHtml(snapshot);
+
+    m_applyingRemote = true;
+    if (incoming.toHtml() != m_document->toHtml()) {
+        QTextCursor cursor(m_document);
+        cursor.beginEditBlock();
+        cursor.select(QTextCursor::Document);
+        cursor.insertFragment(QTextDocumentFragment(&incoming));
+        cursor.endEditBlock();
+
+        // Every site must start from exactly the host's text
+        if (m_document->toPlainText() != incoming.toPlainText()) {
+            m_document->setHtml(snapshot);
+        }
+    }
+    m_applyingRemote = false;
+    resyncShadow();
+}
+
+void SharedSession::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        // The snapshot must match the head of the history
+        flush();
+
+        const quint32 site = ++m_nextSite;
+        m_peers.insert(socket, site);
+        connect(socket, &QLocalSocket::readyRead, this, &SharedSession::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &SharedSession::onPeerDisconnected);
+
+        send(socket, encode(Welcome, site, m_revision, {}, m_document->toHtml()));
+        emit peersChanged(m_peers.size());
+    }
+}
+
+void SharedSession::onReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    QByteArray &buffer = m_readBuffers[socket];
+    buffer.append(socket->readAll());
+
+    // Messages are framed with a 32-bit big-endian length
+    while (buffer.size() >= 4) {
+        const quint32 size = qFromBigEndian<quint32>(buffer.constData());
+        if (quint32(buffer.size()) < size + 4) {
+            break;
+        }
+        const QByteArray payload = buffer.mid(4, size);
+        buffer.remove(0, size + 4);
+        handleMessage(socket, payload);
+
+        // Handling may have ended the session
+        if (!isActive()) {
+            return;
+        }
+    }
+}
+
+void SharedSession::handleMessage(QLocalSocket *socket, const QByteArray &payload)
+{
+    if (payload.isEmpty()) {
+        return;
+    }
+
+    const QByteArray body = payload.at(0) ? qUncompress(payload.mid(1)) : payload.mid(1);
+    QDataStream in(body);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint8 type;
+    quint32 site;
+    qint32 revision;
+    qint32 count;
+    in >> type >> site >> revision >> count;
+
+    Operations operations;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        quint8 opType;
+        qint32 position;
+        in >> opType >> position;
+        if (opType == EditOperation::Insert) {
+            QString text;
+            in >> text;
+            operations.append(makeInsert(position, text));
+        } else {
+            qint32 length;
+            in >> length;
+            operations.append(makeDelete(position, length));
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "SharedSession: dropping malformed message";
+        return;
+    }
+
+    switch (type) {
+    case Welcome: {
+        QString snapshot;
+        in >> snapshot;
+        m_site = site;
+        m_revision = revision;
+        m_buffer.clear();
+        m_inflight.clear();
+        applySnapshot(snapshot);
+        break;
+    }
+    case Submit:
+        if (m_server && m_peers.contains(socket)) {
+            flush(); // sequence our own pending edits first
+            hostSubmit(m_peers.value(socket), revision, operations);
+        }
+        break;
+    case Broadcast:
+        if (site == m_site) {
+            // Acknowledgement of our batch
+            m_inflight.clear();
+        } else {
+            Operations remote, inflight, buffered;
+            transform(operations, m_inflight, true, remote, inflight);
+            transform(remote, m_buffer, true, operations, buffered);
+            applyRemote(operations);
+            m_inflight = inflight;
+            m_buffer = buffered;
+        }
+        m_revision = revision;
+        break;
+    default:
+        break;
+    }
+}
+
+void SharedSession::onPeerDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    m_peers.remove(socket);
+    m_readBuffers.remove(socket);
+    socket->deleteLater();
+    emit peersChanged(m_peers.size());
+}
+
+void SharedSession::onHostDisconnected()
+{
+    stop();
+    emit sessionEnded();
+}
+
+void SharedSession::send(QLocalSocket *socket, const QByteArray &payload)
+{
+    QByteArray header(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), header.data());
+    socket->write(header);
+    socket->write(payload);
+    socket->flush();
+}
+
+void SharedSession::resyncShadow()
+{
+    m_shadow.clear();
+    if (m_document) {
+        QTextCursor cursor(m_document);
+        cursor.select(QTextCursor::Document);
+        m_shadow = cursor.selectedText();
+    }
+}
+
+QByteArray SharedSession::encode(MessageType type, quint32 site, int revision,
+                                 const QList<EditOperation> &operations, const QString &snapshot)
+{
+    QByteArray body;
+    QDataStream out(&body, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    out << quint8(type) << site << qint32(revision) << qint32(operations.size());
+    for (const EditOperation &operation : operations) {
+        out << quint8(operation.type) << qint32(operation.position);
+        if (operation.type == EditOperation::Insert) {
+            out << operation.text;
+        } else {
+            out << qint32(operation.length);
+        }
+    }
+    if (type == Welcome) {
+        out << snapshot;
+    }
+
+    // One flag byte, then the body; only larger batches are worth compressing
+    if (body.size() > COMPRESS_THRESHOLD) {
+        return QByteArray(1, char(1)) + qCompress(body, 1);
+    }
+    return QByteArray(1, char(0)) + body;
+}
@@ -0,0 +1,118 @@
+#ifndef SHAREDSESSION_H
+#define SHAREDSESSION_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+class QTextDocument;
+class QLocalServer;
+class QLocalSocket;
+class QLockFile;
+
+// One character-level edit in a shared session
+struct EditOperation
+{
+    enum Type : quint8 {
+        Insert,
+        Delete
+    };
+
+    Type type;
+    int position;
+    int length;   // Delete only
+    QString text; // Insert only
+
+    int end() const { return position + (type == Insert ? text.size() : length); }
+};
+
+// Shares edits to one document between CPP Word processes on the same
+// machine. The first instance to open the session listens on a QLocalServer
+// and sequences all operations; others connect as clients. A lock file next
+// to the socket says who is hosting, so a crashed host's socket can be
+// cleaned up without taking the name from a live one. Concurrent edits
+// converge through operational transformation against the server's history,
+// with server-sequenced operations winning ties. Local edits are taken from
+// QTextDocument::contentsChange, merged while typing and flushed once per
+// frame. Only text is shared; formatting is synchronized when a client joins.
+// Undo is turned off for the document while it is shared, since undoing
+// would revert edits made at other sites.
+class SharedSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SharedSession(QObject *parent = nullptr);
+    ~SharedSession();
+
+    bool start(QTextDocument *document, const QString &filePath);
+    void stop();
+    bool isActive() const;
+    bool isHost() const;
+    int peerCount() const;
+
+    static QString serverName(const QString &filePath);
+
+signals:
+    void peersChanged(int count);
+    void sessionEnded();
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void flush();
+    void onNewConnection();
+    void onReadyRead();
+    void onPeerDisconnected();
+    void onHostDisconnected();
+
+private:
+    enum MessageType : quint8 {
+        Welcome,     // host -> client: site id, revision, HTML snapshot
+        Submit,      // client -> host: base revision, operations
+        Broadcast    // host -> clients: revision, origin site, operations
+    };
+
+    bool joinHost(const QString &name);
+    void applySnapshot(const QString &snapshot);
+    void queueLocal(const EditOperation &operation);
+    void resendDocument(int sharedLength);
+    void applyRemote(const QList<EditOperation> &operations);
+    void handleMessage(QLocalSocket *socket, const QByteArray &payload);
+    void hostSubmit(quint32 site, int baseRevision, QList<EditOperation> operations);
+    void send(QLocalSocket *socket, const QByteArray &payload);
+    void resyncShadow();
+
+    static QByteArray encode(MessageType type, quint32 site, int revision,
+                             const QList<EditOperation> &operations, const QString &snapshot = QString());
+
+    QTextDocument *m_document;
+    QLocalServer *m_server;
+    std::unique_ptr<QLockFile> m_hostLock;
+    QLocalSocket *m_socket;
+    QHash<QLocalSocket *, quint32> m_peers;
+    QHash<QLocalSocket *, QByteArray> m_readBuffers;
+    QTimer *m_flushTimer;
+
+    // Plain text mirror of the document, used to tell text edits from
+    // format-only changes and to trim edits down to what actually changed
+    QString m_shadow;
+
+    quint32 m_site;
+    quint32 m_nextSite;
+    int m_revision;
+    QList<QList<EditOperation>> m_history; // host only, one entry per revision
+    QList<EditOperation> m_inflight;       // client: sent, not yet acknowledged
+    QList<EditOperation> m_buffer;         // local edits not yet sent
+    bool m_applyingRemote;
+    bool m_undoRedoWasEnabled;
+
+    static const int FLUSH_INTERVAL = 16;       // ms, one frame
+    static const int CONNECT_TIMEOUT = 500;     // ms
+    static const int LOCK_TIMEOUT = 500;        // ms to wait for a host that is starting up
+    static const int COMPRESS_THRESHOLD = 512;  // bytes
+};
+
+#endif // SHAREDSESSION_H
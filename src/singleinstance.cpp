@@ -0,0 +1,115 @@
+#include "singleinstance.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QLockFile>
+#include <QDir>
+#include <QDebug>
+
+namespace {
+
+const char ACKNOWLEDGE = '1';
+
+}
+
+SingleInstance::SingleInstance(QObject *parent)
+    : QObject(parent)
+    , m_server(nullptr)
+{
+}
+
+SingleInstance::~SingleInstance()
+{
+}
+
+bool SingleInstance::listen()
+{
+    const QString name = serverName();
+
+    // Only one process at a time can hold the lock; one that cannot get it
+    // runs on its own and leaves the name to the live primary, even if that
+    // primary was too busy to answer
+    m_lock.reset(new QLockFile(QDir::temp().filePath(name + QStringLiteral(".lock"))));
+    m_lock->setStaleLockTime(0); // only a dead owner makes it stale
+    if (!m_lock->tryLock()) {
+        m_lock.reset();
+        return false;
+    }
+
+    // With the lock held, a socket left at the name is from a crash
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        qDebug() << "SingleInstance: could not listen on" << name << m_server->errorString();
+        delete m_server;
+        m_server = nullptr;
+        m_lock.reset();
+        return false;
+    }
+
+    connect(m_server, &QLocalServer::newConnection, this, &SingleInstance::onNewConnection);
+    return true;
+}
+
+bool SingleInstance::sendToPrimary(const QStringList &files)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(CONNECT_TIMEOUT)) {
+        return false;
+    }
+
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << files;
+    socket.write(message);
+    if (!socket.waitForBytesWritten(REPLY_TIMEOUT)) {
+        return false;
+    }
+
+    // Only an answer proves the primary is still processing events
+    while (socket.bytesAvailable() == 0) {
+        if (!socket.waitForReadyRead(REPLY_TIMEOUT)) {
+            return false;
+        }
+    }
+    char reply = 0;
+    return socket.getChar(&reply) && reply == ACKNOWLEDGE;
+}
+
+QString SingleInstance::serverName()
+{
+    // Local server names are machine-wide; keep one primary per user
+    QString home = QDir::homePath();
+#ifdef Q_OS_WIN
+    home = home.toLower();
+#endif
+    const QByteArray hash = QCryptographicHash::hash(home.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStringLiteral("CPPWord-instance-") + QString::fromLatin1(hash.left(16));
+}
+
+void SingleInstance::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            QDataStream in(socket);
+            in.setVersion(QDataStream::Qt_6_0);
+            in.startTransaction();
+            QStringList files;
+            in >> files;
+            if (!in.commitTransaction()) {
+                return;
+            }
+
+            socket->putChar(ACKNOWLEDGE);
+            socket->flush();
+            socket->disconnectFromServer();
+            emit filesReceived(files);
+        });
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QStringList>
+#include <memory>
+
+class QLocalServer;
+class QLockFile;
+
+// Lets a second launch hand its documents to the process that is already
+// running instead of paying for QApplication, style and font setup again.
+// The primary listens on a per-user QLocalServer. A new process calls
+// sendToPrimary() before creating its QApplication; the primary answers
+// once it has taken the list. If nobody is listening, or the primary does
+// not answer in time, the new process starts normally. The primary holds a
+// lock file for as long as it runs, so a new process only takes over the
+// server name once the previous primary has exited.
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+    ~SingleInstance();
+
+    bool listen();
+
+    // Safe to call before QApplication exists; file paths must be absolute
+    static bool sendToPrimary(const QStringList &files);
+    static QString serverName();
+
+    static const int CONNECT_TIMEOUT = 250; // ms
+    static const int REPLY_TIMEOUT = 2000;  // ms for the primary to take the files
+
+signals:
+    // An empty list asks for a new window
+    void filesReceived(const QStringList &files);
+
+private slots:
+    void onNewConnection();
+
+private:
+    QLocalServer *m_server;
+    std::unique_ptr<QLockFile> m_lock;
+};
+
+#endif // SINGLEINSTANCE_H
@@ -0,0 +1,374 @@
+#include "stylemanager.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextFragment>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QList>
+
+namespace {
+
+struct CharEdit {
+    int position;
+    int length;
+    QTextCharFormat format;
+};
+
+struct Edits {
+    QList<QPair<int, QTextBlockFormat>> blockFormats;
+    QList<QPair<int, QTextCharFormat>> blockCharFormats;
+    QList<CharEdit> charFormats;
+
+    bool isEmpty() const
+    {
+        return blockFormats.isEmpty() && blockCharFormats.isEmpty() && charFormats.isEmpty();
+    }
+};
+
+// Moves a format from one style definition to another. Properties that
+// still hold the old style's value are inherited and follow the new style;
+// other values are direct formatting and stay, unless force is set.
+bool restyle(QTextFormat *format, const QTextFormat &oldStyle, const QTextFormat &newStyle, bool force)
+{
+    const QTextFormat original = *format;
+
+    const QMap<int, QVariant> oldProperties = oldStyle.properties();
+    for (auto it = oldProperties.constBegin(); it != oldProperties.constEnd(); ++it) {
+        if (original.property(it.key()) == it.value()) {
+            format->clearProperty(it.key());
+        }
+    }
+
+    const QMap<int, QVariant> newProperties = newStyle.properties();
+    for (auto it = newProperties.constBegin(); it != newProperties.constEnd(); ++it) {
+        if (force || !original.hasProperty(it.key()) || original.property(it.key()) == oldStyle.property(it.key())) {
+            format->setProperty(it.key(), it.value());
+        }
+    }
+
+    return !(*format == original);
+}
+
+// Collects the changes that take a block, its block character format and
+// all of its fragments from one paragraph style to another
+bool collectBlock(const QTextBlock &block, const StyleManager::Style &oldStyle,
+                  const StyleManager::Style &newStyle, bool force, Edits *edits)
+{
+    bool changed = false;
+
+    QTextBlockFormat blockFormat = block.blockFormat();
+    bool blockChanged = restyle(&blockFormat, oldStyle.blockFormat, newStyle.blockFormat, force);
+    if (blockFormat.stringProperty(StyleManager::PARAGRAPH_STYLE_PROPERTY) != newStyle.name) {
+        blockFormat.setProperty(StyleManager::PARAGRAPH_STYLE_PROPERTY, newStyle.name);
+        blockChanged = true;
+    }
+    if (blockChanged) {
+        edits->blockFormats.append(qMakePair(block.position(), blockFormat));
+        changed = true;
+    }
+
+    QTextCharFormat blockCharFormat = block.charFormat();
+    if (restyle(&blockCharFormat, oldStyle.charFormat, newStyle.charFormat, force)) {
+        edits->blockCharFormats.append(qMakePair(block.position(), blockCharFormat));
+        changed = true;
+    }
+
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        if (!fragment.isValid()) {
+            continue;
+        }
+        QTextCharFormat format = fragment.charFormat();
+        if (restyle(&format, oldStyle.charFormat, newStyle.charFormat, force)) {
+            edits->charFormats.append({fragment.position(), fragment.length(), format});
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// Writes collected changes as one undo step. Format changes never move
+// text, so the recorded positions stay valid throughout.
+void applyEdits(QTextDocument *document, const Edits &edits)
+{
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (const auto &edit : edits.blockFormats) {
+        cursor.setPosition(edit.first);
+        cursor.setBlockFormat(edit.second);
+    }
+    for (const auto &edit : edits.blockCharFormats) {
+        cursor.setPosition(edit.first);
+        cursor.setBlockCharFormat(edit.second);
+    }
+    for (const CharEdit &edit : edits.charFormats) {
+        cursor.setPosition(edit.position);
+        cursor.setPosition(edit.position + edit.length, QTextCursor::KeepAnchor);
+        cursor.setCharFormat(edit.format);
+    }
+    cursor.endEditBlock();
+}
+
+}
+
+StyleManager::StyleManager(QTextDocument *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+{
+    addBuiltInStyles();
+}
+
+QStringList StyleManager::styleNames(StyleType type) const
+{
+    QStringList names;
+    for (const QString &name : m_order) {
+        if (m_styles.value(name).type == type) {
+            names.append(name);
+        }
+    }
+    return names;
+}
+
+bool StyleManager::hasStyle(const QString &name) const
+{
+    return m_styles.contains(name);
+}
+
+StyleManager::Style StyleManager::style(const QString &name) const
+{
+    return m_styles.value(name);
+}
+
+void StyleManager::applyStyle(const QTextCursor &cursor, const QString &name)
+{
+    auto found = m_styles.constFind(name);
+    if (found == m_styles.constEnd()) {
+        return;
+    }
+    const Style &target = *found;
+
+    TRACE_SCOPE("StyleManager::applyStyle");
+    Edits edits;
+
+    if (target.type == ParagraphStyle) {
+        const int end = cursor.selectionEnd();
+        for (QTextBlock block = m_document->findBlock(cursor.selectionStart());
+             block.isValid() && block.position() <= end; block = block.next()) {
+            collectBlock(block, style(paragraphStyle(block)), target, true, &edits);
+        }
+    } else {
+        QTextCursor range = cursor;
+        if (!range.hasSelection()) {
+            range.select(QTextCursor::WordUnderCursor);
+        }
+        const int start = range.selectionStart();
+        const int end = range.selectionEnd();
+        if (start == end) {
+            return;
+        }
+
+        // Fragments at the edges of the selection are only partly restyled
+        for (QTextBlock block = m_document->findBlock(start);
+             block.isValid() && block.position() < end; block = block.next()) {
+            for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+                const QTextFragment fragment = it.fragment();
+                const int from = qMax(start, fragment.position());
+                const int to = qMin(end, fragment.position() + fragment.length());
+                if (!fragment.isValid() || from >= to) {
+                    continue;
+                }
+
+                QTextCharFormat format = fragment.charFormat();
+                const Style previous = style(characterStyle(format));
+                restyle(&format, previous.charFormat, target.charFormat, true);
+                format.setProperty(CHARACTER_STYLE_PROPERTY, name);
+                edits.charFormats.append({from, to - from, format});
+            }
+        }
+    }
+
+    if (!edits.isEmpty()) {
+        applyEdits(m_document, edits);
+    }
+}
+
+int StyleManager::redefineStyle(const Style &style)
+{
+    auto found = m_styles.find(style.name);
+    if (found == m_styles.end() || found->type != style.type) {
+        return 0;
+    }
+
+    const Style previous = *found;
+    *found = style;
+    m_redefined.insert(style.name);
+
+    TRACE_SCOPE("StyleManager::redefineStyle");
+    QElapsedTimer timer;
+    timer.start();
+
+    // One pass over the document finds every block and fragment that
+    // refers to the style
+    Edits edits;
+    int blocks = 0;
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next()) {
+        if (style.type == ParagraphStyle) {
+            if (paragraphStyle(block) == style.name && collectBlock(block, previous, style, false, &edits)) {
+                ++blocks;
+            }
+            continue;
+        }
+
+        bool changed = false;
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (!fragment.isValid()) {
+                continue;
+            }
+            QTextCharFormat format = fragment.charFormat();
+            if (characterStyle(format) == style.name
+                && restyle(&format, previous.charFormat, style.charFormat, false)) {
+                edits.charFormats.append({fragment.position(), fragment.length(), format});
+                changed = true;
+            }
+        }
+        if (changed) {
+            ++blocks;
+        }
+    }
+
+    if (!edits.isEmpty()) {
+        applyEdits(m_document, edits);
+    }
+
+    TRACE_COUNTER("restyled blocks", blocks);
+    emit restyled(blocks, timer.elapsed());
+    emit stylesChanged();
+    return blocks;
+}
+
+QString StyleManager::paragraphStyle(const QTextBlock &block)
+{
+    return block.blockFormat().stringProperty(PARAGRAPH_STYLE_PROPERTY);
+}
+
+QString StyleManager::characterStyle(const QTextCharFormat &format)
+{
+    return format.stringProperty(CHARACTER_STYLE_PROPERTY);
+}
+
+void StyleManager::load()
+{
+    QSettings settings;
+    settings.beginGroup("Styles");
+    const QStringList names = settings.childKeys();
+    for (const QString &name : names) {
+        auto found = m_styles.find(name);
+        if (found == m_styles.end()) {
+            continue;
+        }
+
+        QDataStream in(settings.value(name).toByteArray());
+        QTextFormat blockFormat;
+        QTextFormat charFormat;
+        in >> blockFormat >> charFormat;
+        if (in.status() == QDataStream::Ok) {
+            found->blockFormat = blockFormat.toBlockFormat();
+            found->charFormat = charFormat.toCharFormat();
+        }
+    }
+    settings.endGroup();
+    emit stylesChanged();
+}
+
+void StyleManager::save() const
+{
+    QSettings settings;
+    settings.beginGroup("Styles");
+    for (const QString &name : m_order) {
+        if (!m_redefined.contains(name)) {
+            continue;
+        }
+        const Style style = m_styles.value(name);
+        QByteArray data;
+        QDataStream out(&data, QIODevice::WriteOnly);
+        out << QTextFormat(style.blockFormat) << QTextFormat(style.charFormat);
+        settings.setValue(name, data);
+    }
+    settings.endGroup();
+}
+
+void StyleManager::addStyle(const Style &style)
+{
+    if (!m_styles.contains(style.name)) {
+        m_order.append(style.name);
+    }
+    m_styles.insert(style.name, style);
+}
+
+// Style names end up in documents and settings, so they are not translated
+void StyleManager::addBuiltInStyles()
+{
+    Style normal;
+    normal.name = QStringLiteral("Normal");
+    normal.blockFormat.setHeadingLevel(0);
+    normal.blockFormat.setBottomMargin(6);
+    addStyle(normal);
+
+    Style title;
+    title.name = QStringLiteral("Title");
+    title.blockFormat.setAlignment(Qt::AlignCenter);
+    title.blockFormat.setBottomMargin(12);
+    title.charFormat.setFontPointSize(26);
+    title.charFormat.setFontWeight(QFont::Bold);
+    addStyle(title);
+
+    static const qreal headingSizes[] = {20, 16, 13};
+    for (int level = 1; level <= 3; ++level) {
+        Style heading;
+        heading.name = QStringLiteral("Heading %1").arg(level);
+        heading.blockFormat.setHeadingLevel(level);
+        heading.blockFormat.setTopMargin(12);
+        heading.blockFormat.setBottomMargin(6);
+        heading.charFormat.setFontPointSize(headingSizes[level - 1]);
+        heading.charFormat.setFontWeight(QFont::Bold);
+        addStyle(heading);
+    }
+
+    Style quote;
+    quote.name = QStringLiteral("Quote");
+    quote.blockFormat.setLeftMargin(24);
+    quote.blockFormat.setRightMargin(24);
+    quote.charFormat.setFontItalic(true);
+    quote.charFormat.setForeground(QColor(0x55, 0x55, 0x55));
+    addStyle(quote);
+
+    Style code;
+    code.name = QStringLiteral("Code");
+    code.blockFormat.setBackground(QColor(0xf4, 0xf4, 0xf4));
+    code.charFormat.setFontFamilies(QStringList() << "Courier New" << "monospace");
+    addStyle(code);
+
+    Style emphasis;
+    emphasis.name = QStringLiteral("Emphasis");
+    emphasis.type = CharacterStyle;
+    emphasis.charFormat.setFontItalic(true);
+    addStyle(emphasis);
+
+    Style strong;
+    strong.name = QStringLiteral("Strong");
+    strong.type = CharacterStyle;
+    strong.charFormat.setFontWeight(QFont::Bold);
+    addStyle(strong);
+
+    Style inlineCode;
+    inlineCode.name = QStringLiteral("Inline Code");
+    inlineCode.type = CharacterStyle;
+    inlineCode.charFormat.setFontFamilies(QStringList() << "Courier New" << "monospace");
+    addStyle(inlineCode);
+}
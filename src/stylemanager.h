@@ -0,0 +1,78 @@
+#ifndef STYLEMANAGER_H
+#define STYLEMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTextBlockFormat>
+#include <QTextCharFormat>
+
+class QTextDocument;
+class QTextCursor;
+class QTextBlock;
+
+// Named paragraph and character styles. A style is defined once here; blocks
+// and fragments refer to it by name through a user property on their format
+// and carry the style's properties as ordinary formatting.
+//
+// A property whose value still matches the style's definition counts as
+// inherited, anything else as direct formatting. Redefining a style walks the
+// document once, moves inherited properties to the new definition, leaves
+// direct formatting alone, and writes every change inside one edit block, so
+// the document is laid out once and the change is a single undo step.
+class StyleManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum StyleType {
+        ParagraphStyle,
+        CharacterStyle
+    };
+
+    struct Style {
+        QString name;
+        StyleType type = ParagraphStyle;
+        QTextBlockFormat blockFormat; // paragraph styles only
+        QTextCharFormat charFormat;
+    };
+
+    explicit StyleManager(QTextDocument *document, QObject *parent = nullptr);
+
+    QStringList styleNames(StyleType type) const;
+    bool hasStyle(const QString &name) const;
+    Style style(const QString &name) const;
+
+    // Paragraph styles apply to every block touched by the cursor, character
+    // styles to the selection or the word under the cursor
+    void applyStyle(const QTextCursor &cursor, const QString &name);
+    // Returns the number of blocks that changed
+    int redefineStyle(const Style &style);
+
+    static QString paragraphStyle(const QTextBlock &block);
+    static QString characterStyle(const QTextCharFormat &format);
+
+    // Definitions changed by the user are kept in QSettings; save() only
+    // writes the ones changed in this window, so other windows' changes stay
+    void load();
+    void save() const;
+
+    static const int PARAGRAPH_STYLE_PROPERTY = QTextFormat::UserProperty + 1;
+    static const int CHARACTER_STYLE_PROPERTY = QTextFormat::UserProperty + 2;
+
+signals:
+    void stylesChanged();
+    void restyled(int blocks, qint64 msecs);
+
+private:
+    void addStyle(const Style &style);
+    void addBuiltInStyles();
+
+    QTextDocument *m_document;
+    QHash<QString, Style> m_styles;
+    QStringList m_order;
+    QSet<QString> m_redefined;
+};
+
+#endif // STYLEMANAGER_H
@@ -0,0 +1,318 @@
+#include "tableimport.h"
+#include "textimport.h"
+#include "tracer.h"
+
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextTable>
+#include <QTextBlock>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+
+TableImport::TableImport(QTextEdit *editor)
+    : QObject(editor)
+    , m_editor(editor)
+    , m_sliceTimer(new QTimer(this))
+    , m_table(nullptr)
+    , m_columns(0)
+    , m_nextRow(0)
+    , m_running(false)
+    , m_wasReadOnly(false)
+{
+    m_sliceTimer->setSingleShot(true);
+    m_sliceTimer->setInterval(0);
+    connect(m_sliceTimer, &QTimer::timeout, this, &TableImport::insertSlice);
+}
+
+TableImport::~TableImport()
+{
+    m_sliceTimer->stop();
+    m_parseTask.cancel();
+    m_parseTask.waitForFinished();
+}
+
+bool TableImport::start(const QString &filePath)
+{
+    if (m_running) {
+        return false;
+    }
+
+    m_running = true;
+    emit progress(0);
+    m_parseTask = TaskExecutor::instance()->run(TaskExecutor::Interactive, this,
+        [filePath](const TaskExecutor::CancellationToken &) {
+            return parse(filePath);
+        },
+        [this](const Result &result) {
+            onParsed(result);
+        });
+    return true;
+}
+
+bool TableImport::isRunning() const
+{
+    return m_running;
+}
+
+void TableImport::cancel()
+{
+    if (!m_running) {
+        return;
+    }
+
+    // A parse still running finishes on its own and its result is dropped;
+    // rows already inserted stay, as one undo step
+    m_parseTask.cancel();
+    m_sliceTimer->stop();
+    // Rows are held from the parse result until the last slice
+    if (!m_rows.isEmpty()) {
+        m_editor->setReadOnly(m_wasReadOnly);
+    }
+    m_rows.clear();
+    m_table = nullptr;
+    m_running = false;
+}
+
+void TableImport::onParsed(const Result &result)
+{
+    if (!m_running) {
+        return;
+    }
+
+    if (!result.error.isEmpty()) {
+        m_running = false;
+        emit failed(result.error);
+        return;
+    }
+
+    m_rows = result.rows;
+    m_columns = result.columns;
+    m_nextRow = 0;
+    m_table = nullptr;
+    m_cursor = m_editor->textCursor();
+
+    // Keep the user from editing between slices of the same edit block
+    m_wasReadOnly = m_editor->isReadOnly();
+    m_editor->setReadOnly(true);
+    m_sliceTimer->start();
+}
+
+void TableImport::insertSlice()
+{
+    if (!m_running) {
+        return;
+    }
+    TRACE_SCOPE("TableImport::insertSlice");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The first slice opens the undo step, later slices join it
+    if (!m_table) {
+        m_cursor.beginEditBlock();
+        m_cursor.removeSelectedText();
+    } else {
+        m_cursor.joinPreviousEditBlock();
+    }
+
+    const int rowCount = m_rows.size();
+    while (m_nextRow < rowCount && timer.elapsed() < SLICE_BUDGET) {
+        const int batch = qMin(int(BATCH_ROWS), rowCount - m_nextRow);
+
+        // New rows go at the end of the table, so their cells are its last
+        // blocks
+        QTextBlock block;
+        if (!m_table) {
+            m_table = m_cursor.insertTable(batch, m_columns, tableFormat(m_columns));
+            block = m_cursor.block();
+        } else {
+            m_table->appendRows(batch);
+            block = m_table->lastCursorPosition().block();
+            for (int i = 1; i < batch * m_columns; ++i) {
+                block = block.previous();
+            }
+        }
+
+        for (int row = m_nextRow; row < m_nextRow + batch; ++row) {
+            QStringList &cells = m_rows[row];
+            for (int column = 0; column < m_columns; ++column) {
+                if (column < cells.size() && !cells.at(column).isEmpty()) {
+                    m_cursor.setPosition(block.position());
+                    m_cursor.insertText(cells.at(column));
+                }
+                block = block.next();
+            }
+            cells.clear();
+        }
+        m_nextRow += batch;
+    }
+
+    m_cursor.endEditBlock();
+
+    if (m_nextRow >= rowCount) {
+        finish();
+        return;
+    }
+
+    emit progress(m_nextRow * 100 / rowCount);
+    m_sliceTimer->start();
+}
+
+void TableImport::finish()
+{
+    const int rows = m_rows.size();
+    m_rows.clear();
+    m_running = false;
+    m_editor->setReadOnly(m_wasReadOnly);
+
+    // The cursor ends up after the table, as after a paste
+    m_cursor = m_table->lastCursorPosition();
+    m_cursor.movePosition(QTextCursor::NextBlock);
+    m_table = nullptr;
+    m_editor->setTextCursor(m_cursor);
+    m_editor->ensureCursorVisible();
+
+    emit progress(100);
+    emit finished(rows, m_columns);
+}
+
+TableImport::Result TableImport::parse(const QString &filePath)
+{
+    TRACE_SCOPE("TableImport::parse");
+    Result result;
+
+    QString text;
+    QString errorString;
+    if (!TextImport::readFile(filePath, &text, nullptr, &errorString)) {
+        result.error = errorString;
+        return result;
+    }
+
+    result.rows = parseCsv(text, detectDelimiter(text));
+    text.clear();
+    if (result.rows.isEmpty()) {
+        result.error = QCoreApplication::translate("TableImport", "The file contains no rows");
+        return result;
+    }
+
+    for (const QStringList &row : std::as_const(result.rows)) {
+        result.columns = qMax(result.columns, int(row.size()));
+    }
+    return result;
+}
+
+QChar TableImport::detectDelimiter(QStringView text)
+{
+    static const QChar candidates[] = {
+        QLatin1Char(','), QLatin1Char(';'), QLatin1Char('\t'), QLatin1Char('|')
+    };
+    int counts[4] = {0, 0, 0, 0};
+
+    bool quoted = false;
+    int lines = 0;
+    for (qsizetype i = 0; i < text.size() && lines < SNIFF_LINES; ++i) {
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char('"')) {
+            quoted = !quoted;
+        } else if (quoted) {
+            continue;
+        } else if (ch == QLatin1Char('\n')) {
+            ++lines;
+        } else {
+            for (int c = 0; c < 4; ++c) {
+                if (ch == candidates[c]) {
+                    ++counts[c];
+                }
+            }
+        }
+    }
+
+    int best = 0;
+    for (int c = 1; c < 4; ++c) {
+        if (counts[c] > counts[best]) {
+            best = c;
+        }
+    }
+    return candidates[best];
+}
+
+QList<QStringList> TableImport::parseCsv(QStringView text, QChar delimiter)
+{
+    QList<QStringList> rows;
+    QStringList row;
+    QString field;
+    bool quoted = false;
+    bool fieldStarted = false;
+
+    const qsizetype size = text.size();
+    qsizetype i = 0;
+    while (i < size) {
+        const QChar ch = text.at(i);
+
+        if (quoted) {
+            if (ch == QLatin1Char('"')) {
+                if (i + 1 < size && text.at(i + 1) == QLatin1Char('"')) {
+                    field.append(ch);
+                    i += 2;
+                    continue;
+                }
+                quoted = false;
+            } else if (ch == QLatin1Char('\n')) {
+                // A line break inside a cell must not split the cell's block
+                field.append(QChar::LineSeparator);
+            } else {
+                field.append(ch);
+            }
+            ++i;
+            continue;
+        }
+
+        if (ch == QLatin1Char('"') && !fieldStarted) {
+            quoted = true;
+            fieldStarted = true;
+        } else if (ch == delimiter) {
+            row.append(field);
+            field.clear();
+            fieldStarted = false;
+        } else if (ch == QLatin1Char('\n')) {
+            row.append(field);
+            field.clear();
+            fieldStarted = false;
+            rows.append(row);
+            row.clear();
+        } else {
+            field.append(ch);
+            fieldStarted = true;
+        }
+        ++i;
+    }
+
+    // Last line without a trailing newline
+    if (fieldStarted || !row.isEmpty()) {
+        row.append(field);
+        rows.append(row);
+    }
+    return rows;
+}
+
+QTextTableFormat TableImport::tableFormat(int columns)
+{
+    QTextTableFormat format;
+    format.setBorder(1);
+    format.setBorderCollapse(true);
+    format.setCellPadding(2);
+    format.setCellSpacing(0);
+    format.setHeaderRowCount(1);
+    format.setWidth(QTextLength(QTextLength::PercentageLength, 100));
+
+    // Fixed shares keep the columns from moving while cells are edited
+    QList<QTextLength> widths;
+    widths.reserve(columns);
+    for (int column = 0; column < columns; ++column) {
+        widths.append(QTextLength(QTextLength::PercentageLength, 100.0 / columns));
+    }
+    format.setColumnWidthConstraints(widths);
+    return format;
+}
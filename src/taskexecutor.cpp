@@ -0,0 +1,106 @@
+#include "taskexecutor.h"
+#include "tracer.h"
+
+#include <QElapsedTimer>
+
+namespace {
+
+qint64 clockUsecs()
+{
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+// Counter names must be string literals
+void recordQueueDepth(TaskExecutor::Priority priority, int depth)
+{
+    switch (priority) {
+    case TaskExecutor::Interactive:
+        TRACE_COUNTER("tasks queued (interactive)", depth);
+        break;
+    case TaskExecutor::Background:
+        TRACE_COUNTER("tasks queued (background)", depth);
+        break;
+    default:
+        TRACE_COUNTER("tasks queued (idle)", depth);
+        break;
+    }
+}
+
+}
+
+TaskExecutor::TaskExecutor()
+    : m_running(0)
+    , m_completed(0)
+    , m_cancelled(0)
+    , m_totalWaitUsecs(0)
+    , m_maxWaitUsecs(0)
+    , m_totalRunUsecs(0)
+    , m_started(0)
+{
+    for (std::atomic<int> &queued : m_queued) {
+        queued.store(0);
+    }
+}
+
+TaskExecutor *TaskExecutor::instance()
+{
+    static TaskExecutor executor;
+    return &executor;
+}
+
+TaskExecutor::Stats TaskExecutor::stats() const
+{
+    Stats stats;
+    for (int i = 0; i < PriorityCount; ++i) {
+        stats.queued[i] = m_queued[i].load(std::memory_order_relaxed);
+    }
+    stats.running = m_running.load(std::memory_order_relaxed);
+    stats.completed = m_completed.load(std::memory_order_relaxed);
+    stats.cancelled = m_cancelled.load(std::memory_order_relaxed);
+    const qint64 started = m_started.load(std::memory_order_relaxed);
+    const qint64 finished = stats.completed + stats.cancelled;
+    stats.meanWaitUsecs = started > 0 ? m_totalWaitUsecs.load(std::memory_order_relaxed) / started : 0;
+    stats.maxWaitUsecs = m_maxWaitUsecs.load(std::memory_order_relaxed);
+    stats.meanRunUsecs = finished > 0 ? m_totalRunUsecs.load(std::memory_order_relaxed) / finished : 0;
+    return stats;
+}
+
+qint64 TaskExecutor::queued(Priority priority)
+{
+    recordQueueDepth(priority, ++m_queued[priority]);
+    return clockUsecs();
+}
+
+qint64 TaskExecutor::started(Priority priority, qint64 queuedAt)
+{
+    recordQueueDepth(priority, --m_queued[priority]);
+    ++m_running;
+    ++m_started;
+
+    const qint64 now = clockUsecs();
+    const qint64 wait = now - queuedAt;
+    m_totalWaitUsecs += wait;
+    qint64 maxWait = m_maxWaitUsecs.load(std::memory_order_relaxed);
+    while (wait > maxWait && !m_maxWaitUsecs.compare_exchange_weak(maxWait, wait)) {
+    }
+    TRACE_COUNTER("task wait us", wait);
+    return now;
+}
+
+void TaskExecutor::finished(qint64 startedAt, bool cancelled)
+{
+    const qint64 run = clockUsecs() - startedAt;
+    m_totalRunUsecs += run;
+    --m_running;
+    if (cancelled) {
+        ++m_cancelled;
+    } else {
+        ++m_completed;
+    }
+    TRACE_COUNTER("task run us", run);
+}
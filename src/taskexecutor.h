@@ -0,0 +1,143 @@
+#ifndef TASKEXECUTOR_H
+#define TASKEXECUTOR_H
+
+#include <QObject>
+#include <QFuture>
+#include <QtConcurrent>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+// One place for background document work. Tasks run on the shared thread
+// pool in priority order: Interactive for results the user is waiting on,
+// Background for housekeeping such as autosave, Idle for speculative work
+// such as prefetching. The document is never touched off the GUI thread;
+// callers take a snapshot of what the task needs (plain text, serialized
+// markup) before submitting, and the result comes back on the thread of
+// a context object. Results are dropped if the task was cancelled or the
+// context was destroyed in the meantime.
+//
+// Queue depth and task latency are kept per priority and recorded as trace
+// counters.
+class TaskExecutor
+{
+public:
+    enum Priority {
+        Idle,
+        Background,
+        Interactive,
+        PriorityCount
+    };
+
+    // Shared between the submitter and the task; long-running work should
+    // poll isCancelled() and return early
+    class CancellationToken
+    {
+    public:
+        CancellationToken() : m_cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+        void cancel() const { m_cancelled->store(true, std::memory_order_relaxed); }
+        bool isCancelled() const { return m_cancelled->load(std::memory_order_relaxed); }
+
+    private:
+        std::shared_ptr<std::atomic<bool>> m_cancelled;
+    };
+
+    class Task
+    {
+    public:
+        void cancel() const { m_token.cancel(); }
+        bool isRunning() const { return m_future.isRunning(); }
+        // Waits for the work itself, not for the result delivery
+        void waitForFinished() { m_future.waitForFinished(); }
+        CancellationToken token() const { return m_token; }
+
+    private:
+        friend class TaskExecutor;
+        CancellationToken m_token;
+        QFuture<void> m_future;
+    };
+
+    struct Stats {
+        int queued[PriorityCount] = {};
+        int running = 0;
+        qint64 completed = 0;
+        qint64 cancelled = 0;
+        qint64 meanWaitUsecs = 0;
+        qint64 maxWaitUsecs = 0;
+        qint64 meanRunUsecs = 0;
+    };
+
+    static TaskExecutor *instance();
+
+    // work is called as work(token) on a worker thread; done(result) runs on
+    // context's thread
+    template <typename Work, typename Done>
+    Task run(Priority priority, QObject *context, Work work, Done done);
+
+    // For callers that wait on the result themselves, such as a task that
+    // fans out into several. Waiting on the future from a pool thread runs
+    // the work right there if it has not started yet, so nested waits cannot
+    // starve the pool. A cancelled task yields a default-constructed result.
+    template <typename Work>
+    QFuture<std::invoke_result_t<Work, const CancellationToken &>>
+    submit(Priority priority, const CancellationToken &token, Work work);
+
+    Stats stats() const;
+
+private:
+    TaskExecutor();
+
+    qint64 queued(Priority priority);
+    qint64 started(Priority priority, qint64 queuedAt);
+    void finished(qint64 startedAt, bool cancelled);
+
+    std::atomic<int> m_queued[PriorityCount];
+    std::atomic<int> m_running;
+    std::atomic<qint64> m_completed;
+    std::atomic<qint64> m_cancelled;
+    std::atomic<qint64> m_totalWaitUsecs;
+    std::atomic<qint64> m_maxWaitUsecs;
+    std::atomic<qint64> m_totalRunUsecs;
+    std::atomic<qint64> m_started;
+};
+
+template <typename Work>
+QFuture<std::invoke_result_t<Work, const TaskExecutor::CancellationToken &>>
+TaskExecutor::submit(Priority priority, const CancellationToken &token, Work work)
+{
+    using Result = std::invoke_result_t<Work, const CancellationToken &>;
+
+    const qint64 queuedAt = queued(priority);
+    return QtConcurrent::task([this, priority, queuedAt, token, work]() {
+        const qint64 startedAt = started(priority, queuedAt);
+        // Cancelled while still queued
+        if (token.isCancelled()) {
+            finished(startedAt, true);
+            return Result();
+        }
+        Result result = work(token);
+        finished(startedAt, token.isCancelled());
+        return result;
+    }).withPriority(int(priority)).spawn();
+}
+
+template <typename Work, typename Done>
+TaskExecutor::Task TaskExecutor::run(Priority priority, QObject *context, Work work, Done done)
+{
+    using Result = std::invoke_result_t<Work, const CancellationToken &>;
+
+    Task task;
+    const CancellationToken token = task.m_token;
+    QFuture<Result> future = submit(priority, token, work);
+
+    future.then(context, [token, done](Result result) {
+        if (!token.isCancelled()) {
+            done(std::move(result));
+        }
+    });
+
+    task.m_future = QFuture<void>(future);
+    return task;
+}
+
+#endif // TASKEXECUTOR_H
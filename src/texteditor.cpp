@@ -1,15 +1,37 @@
 #include "texteditor.h"
+#include "progressiveloader.h"
+#include "pastejob.h"
+#include "selectionmimedata.h"
+#include "tracer.h"
+#include "latencymonitor.h"
+#include "macrorecorder.h"
+#include "htmlimport.h"
 
 #include <QTextCursor>
 #include <QTextBlock>
+#include <QTextLayout>
 #include <QTextList>
 #include <QDebug>
 #include <QApplication>
 #include <QKeyEvent>
+#include <QPainter>
+#include <QtMath>
+#include <QScrollBar>
+#include <QAbstractTextDocumentLayout>
+#include <QLabel>
 
 TextEditor::TextEditor(QWidget *parent)
     : QTextEdit(parent)
     , m_zoomFactor(1.0)
+    , m_rewrapOnZoom(false)
+    , m_rewrapTimer(new QTimer(this))
+    , m_lazyLayout(true)
+    , m_loader(new ProgressiveLoader(this))
+    , m_pasteJob(new PasteJob(this))
+    , m_latencyMonitor(new LatencyMonitor(this))
+    , m_latencyOverlay(nullptr)
+    , m_overlayTimer(new QTimer(this))
+    , m_macroRecorder(nullptr)
 {
     // Set default settings
     setAcceptRichText(true);
@@ -20,6 +42,54 @@ TextEditor::TextEditor(QWidget *parent)
     document()->setDefaultFont(QFont("Arial", 12));
     document()->setDocumentMargin(10);
     
+    connect(m_loader, &ProgressiveLoader::progress, this, &TextEditor::loadProgress);
+    connect(m_loader, &ProgressiveLoader::finished, this, &TextEditor::loadFinished);
+    
+    // Keep the view on the same text when earlier chunks are loaded above it
+    connect(m_loader, &ProgressiveLoader::prepended, this, [this](qreal height) {
+        verticalScrollBar()->setValue(verticalScrollBar()->value() + qRound(height * m_zoomFactor));
+    });
+    connect(m_pasteJob, &PasteJob::progress, this, &TextEditor::pasteProgress);
+    
+    // The overlay is refreshed at most a few times a second so it does not
+    // add to the latency it reports
+    m_overlayTimer->setSingleShot(true);
+    m_overlayTimer->setInterval(OVERLAY_INTERVAL);
+    connect(m_overlayTimer, &QTimer::timeout, this, &TextEditor::updateLatencyOverlay);
+    connect(m_latencyMonitor, &LatencyMonitor::sampleAdded, this, [this]() {
+        if (m_latencyOverlay && m_latencyOverlay->isVisible() && !m_overlayTimer->isActive()) {
+            m_overlayTimer->start();
+        }
+    });
+    
+    // While zoomed, QTextEdit's own update rects and scroll ranges are in
+    // unscaled coordinates, so repaint whole and recompute the ranges
+    m_rewrapTimer->setSingleShot(true);
+    m_rewrapTimer->setInterval(REWRAP_DELAY);
+    connect(m_rewrapTimer, &QTimer::timeout, this, &TextEditor::rewrapForZoom);
+    
+    connect(document()->documentLayout(), &QAbstractTextDocumentLayout::update, this, [this]() {
+        if (isZoomed()) {
+            viewport()->update();
+        }
+    });
+    connect(document()->documentLayout(), &QAbstractTextDocumentLayout::documentSizeChanged, this, [this]() {
+        if (isZoomed()) {
+            adjustZoomScrollbars();
+        }
+    });
+    connect(this, &QTextEdit::cursorPositionChanged, this, [this]() {
+        if (isZoomed()) {
+            ensureZoomedCursorVisible();
+            viewport()->update();
+        }
+    });
+    connect(this, &QTextEdit::selectionChanged, this, [this]() {
+        if (isZoomed()) {
+            viewport()->update();
+        }
+    });
+    
     // Remove the problematic connection that causes infinite recursion
     // The TextEdit's cursorPositionChanged signal is being connected to itself
     // This was causing stack overflow
@@ -27,6 +97,8 @@ TextEditor::TextEditor(QWidget *parent)
 
 void TextEditor::mergeFormatOnWordOrSelection(const QTextCharFormat &format)
 {
+    TRACE_SCOPE("TextEditor::mergeFormatOnWordOrSelection");
+    
     // Add error checking to prevent crashes
     try {
         QTextCursor cursor = textCursor();
@@ -37,6 +109,9 @@ void TextEditor::mergeFormatOnWordOrSelection(const QTextCharFormat &format)
             cursor.mergeCharFormat(format);
             setTextCursor(cursor);
         }
+        if (m_macroRecorder) {
+            m_macroRecorder->formatMerged(format);
+        }
     } catch (const std::exception& e) {
         qDebug() << "Exception in mergeFormatOnWordOrSelection:" << e.what();
     }
@@ -44,6 +119,8 @@ void TextEditor::mergeFormatOnWordOrSelection(const QTextCharFormat &format)
 
 void TextEditor::setAlignment(Qt::Alignment alignment)
 {
+    TRACE_SCOPE("TextEditor::setAlignment");
+    
     try {
         QTextCursor cursor = textCursor();
         if (cursor.isNull()) {
@@ -56,6 +133,10 @@ void TextEditor::setAlignment(Qt::Alignment alignment)
         cursor.beginEditBlock();
         cursor.mergeBlockFormat(blockFormat);
         cursor.endEditBlock();
+        
+        if (m_macroRecorder) {
+            m_macroRecorder->alignmentSet(alignment);
+        }
     } catch (const std::exception& e) {
         qDebug() << "Exception in setAlignment:" << e.what();
     }
@@ -91,18 +172,410 @@ QColor TextEditor::textColor() const
     return QColor(Qt::black);
 }
 
+void TextEditor::setZoomFactor(qreal factor)
+{
+    factor = qBound(MIN_ZOOM, factor, MAX_ZOOM);
+    if (qFuzzyCompare(factor, m_zoomFactor)) {
+        return;
+    }
+    
+    // Keep the top of the viewport anchored while scaling
+    const qreal anchor = verticalScrollBar()->value() / m_zoomFactor;
+    
+    m_zoomFactor = factor;
+    adjustZoomScrollbars();
+    verticalScrollBar()->setValue(qRound(anchor * m_zoomFactor));
+    viewport()->update();
+    
+    if (m_rewrapOnZoom) {
+        m_rewrapTimer->start();
+    }
+    
+    emit zoomChanged(m_zoomFactor);
+}
+
+qreal TextEditor::zoomFactor() const
+{
+    return m_zoomFactor;
+}
+
+void TextEditor::zoomBy(int steps)
+{
+    setZoomFactor(m_zoomFactor + steps * ZOOM_STEP);
+}
+
+void TextEditor::fitToWidth(qreal pageWidth)
+{
+    // Text wrapped at the widget width always fills it, so the document
+    // width says nothing here; measure what is actually there
+    const qreal margin = document()->documentMargin();
+    qreal width = 0;
+    if (pageWidth > 0) {
+        width = pageWidth + 2 * margin;
+        if (lineWrapMode() != QTextEdit::FixedPixelWidth || lineWrapColumnOrWidth() != qRound(width)) {
+            setLineWrapColumnOrWidth(qRound(width));
+            setLineWrapMode(QTextEdit::FixedPixelWidth);
+        }
+    } else {
+        width = widestLineWidth() + margin;
+    }
+    if (width > 2 * margin) {
+        setZoomFactor(viewport()->width() / width);
+    }
+}
+
 void TextEditor::resetZoom()
 {
-    m_zoomFactor = 1.0;
-    zoomIn(0); // Reset zoom 
+    setZoomFactor(1.0);
+    if (lineWrapMode() != QTextEdit::WidgetWidth) {
+        setLineWrapMode(QTextEdit::WidgetWidth);
+    }
+}
+
+void TextEditor::setRewrapOnZoom(bool enabled)
+{
+    m_rewrapOnZoom = enabled;
+    if (!enabled) {
+        m_rewrapTimer->stop();
+    }
+}
+
+bool TextEditor::isZoomed() const
+{
+    return !qFuzzyCompare(m_zoomFactor, qreal(1.0));
+}
+
+QPointF TextEditor::unzoomedPosition(const QPointF &pos) const
+{
+    // QTextEdit adds the scroll offset to viewport positions; hand it a
+    // position that lands on the right document coordinate once it does
+    const QPointF offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    return (pos + offset) / m_zoomFactor - offset;
+}
+
+QMouseEvent TextEditor::unzoomedEvent(QMouseEvent *event) const
+{
+    return QMouseEvent(event->type(), unzoomedPosition(event->position()), event->globalPosition(),
+                       event->button(), event->buttons(), event->modifiers(), event->pointingDevice());
+}
+
+void TextEditor::adjustZoomScrollbars()
+{
+    const QSizeF size = document()->documentLayout()->documentSize() * m_zoomFactor;
+    const QSize viewportSize = viewport()->size();
+    
+    QScrollBar *vertical = verticalScrollBar();
+    vertical->setRange(0, qMax(0, qCeil(size.height()) - viewportSize.height()));
+    vertical->setPageStep(viewportSize.height());
+    
+    QScrollBar *horizontal = horizontalScrollBar();
+    horizontal->setRange(0, qMax(0, qCeil(size.width()) - viewportSize.width()));
+    horizontal->setPageStep(viewportSize.width());
+}
+
+void TextEditor::ensureZoomedCursorVisible()
+{
+    const QPoint offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    const QRectF documentRect = QRectF(cursorRect()).translated(offset);
+    const QRectF rect(documentRect.topLeft() * m_zoomFactor, documentRect.size() * m_zoomFactor);
+    
+    QScrollBar *vertical = verticalScrollBar();
+    if (rect.top() < vertical->value()) {
+        vertical->setValue(qFloor(rect.top()));
+    } else if (rect.bottom() > vertical->value() + viewport()->height()) {
+        vertical->setValue(qCeil(rect.bottom()) - viewport()->height());
+    }
+    
+    QScrollBar *horizontal = horizontalScrollBar();
+    if (rect.left() < horizontal->value()) {
+        horizontal->setValue(qFloor(rect.left()));
+    } else if (rect.right() > horizontal->value() + viewport()->width()) {
+        horizontal->setValue(qCeil(rect.right()) - viewport()->width());
+    }
+}
+
+qreal TextEditor::widestLineWidth() const
+{
+    // Right edge of the longest line among the paragraphs laid out so far
+    QAbstractTextDocumentLayout *layout = document()->documentLayout();
+    qreal widest = 0;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        const QTextLayout *blockLayout = block.layout();
+        if (!blockLayout || blockLayout->lineCount() == 0) {
+            continue;
+        }
+        const qreal left = layout->blockBoundingRect(block).left();
+        for (int i = 0; i < blockLayout->lineCount(); ++i) {
+            const QTextLine line = blockLayout->lineAt(i);
+            widest = qMax(widest, left + line.x() + line.naturalTextWidth());
+        }
+    }
+    return widest;
+}
+
+void TextEditor::rewrapForZoom()
+{
+    // Re-wrapping is a full relayout, so it only happens once zooming settles
+    if (!isZoomed()) {
+        if (lineWrapMode() != QTextEdit::WidgetWidth) {
+            setLineWrapMode(QTextEdit::WidgetWidth);
+        }
+    } else {
+        const int width = qRound(viewport()->width() / m_zoomFactor);
+        if (lineWrapColumnOrWidth() != width) {
+            setLineWrapColumnOrWidth(width);
+        }
+        if (lineWrapMode() != QTextEdit::FixedPixelWidth) {
+            setLineWrapMode(QTextEdit::FixedPixelWidth);
+        }
+        adjustZoomScrollbars();
+    }
+    viewport()->update();
+}
+
+void TextEditor::paintEvent(QPaintEvent *event)
+{
+    if (isZoomed()) {
+        paintZoomed(event);
+    } else {
+        QTextEdit::paintEvent(event);
+    }
+    
+    // The first paint after a key press ends its latency sample
+    m_latencyMonitor->framePainted(document()->characterCount(), document()->blockCount());
+}
+
+void TextEditor::paintZoomed(QPaintEvent *event)
+{
+    const QPoint offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    
+    QPainter painter(viewport());
+    painter.translate(-offset);
+    painter.scale(m_zoomFactor, m_zoomFactor);
+    
+    // Only the part of the document under the exposed rect is drawn
+    const QRectF exposed = QRectF(event->rect()).translated(offset);
+    
+    QAbstractTextDocumentLayout::PaintContext context;
+    context.clip = QRectF(exposed.topLeft() / m_zoomFactor, exposed.size() / m_zoomFactor);
+    context.palette = palette();
+    
+    const QTextCursor cursor = textCursor();
+    if (hasFocus() && !isReadOnly()) {
+        context.cursorPosition = cursor.position();
+    }
+    
+    const QList<ExtraSelection> extras = extraSelections();
+    for (const ExtraSelection &extra : extras) {
+        QAbstractTextDocumentLayout::Selection selection;
+        selection.cursor = extra.cursor;
+        selection.format = extra.format;
+        context.selections.append(selection);
+    }
+    
+    if (cursor.hasSelection()) {
+        QAbstractTextDocumentLayout::Selection selection;
+        selection.cursor = cursor;
+        selection.format.setBackground(palette().brush(QPalette::Highlight));
+        selection.format.setForeground(palette().brush(QPalette::HighlightedText));
+        context.selections.append(selection);
+    }
+    
+    document()->documentLayout()->draw(&painter, context);
+}
+
+void TextEditor::resizeEvent(QResizeEvent *event)
+{
+    QTextEdit::resizeEvent(event);
+    positionLatencyOverlay();
+    
+    if (isZoomed()) {
+        adjustZoomScrollbars();
+        if (m_rewrapOnZoom) {
+            m_rewrapTimer->start();
+        }
+    }
+}
+
+void TextEditor::wheelEvent(QWheelEvent *event)
+{
+    // Ctrl+wheel zooms the view instead of changing the font size
+    if (event->modifiers() & Qt::ControlModifier) {
+        const int steps = event->angleDelta().y() / 120;
+        if (steps != 0) {
+            zoomBy(steps);
+        }
+        event->accept();
+        return;
+    }
+    
+    QTextEdit::wheelEvent(event);
+}
+
+void TextEditor::mousePressEvent(QMouseEvent *event)
+{
+    if (!isZoomed()) {
+        QTextEdit::mousePressEvent(event);
+        return;
+    }
+    QMouseEvent mapped = unzoomedEvent(event);
+    QTextEdit::mousePressEvent(&mapped);
+    event->setAccepted(mapped.isAccepted());
+}
+
+void TextEditor::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!isZoomed()) {
+        QTextEdit::mouseMoveEvent(event);
+        return;
+    }
+    QMouseEvent mapped = unzoomedEvent(event);
+    QTextEdit::mouseMoveEvent(&mapped);
+    event->setAccepted(mapped.isAccepted());
+}
+
+void TextEditor::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!isZoomed()) {
+        QTextEdit::mouseReleaseEvent(event);
+    } else {
+        QMouseEvent mapped = unzoomedEvent(event);
+        QTextEdit::mouseReleaseEvent(&mapped);
+        event->setAccepted(mapped.isAccepted());
+    }
+    
+    // Clicks and drags are recorded by where they left the cursor
+    if (m_macroRecorder) {
+        const QTextCursor cursor = textCursor();
+        m_macroRecorder->cursorPlaced(cursor.position(), cursor.anchor());
+    }
+}
+
+void TextEditor::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (!isZoomed()) {
+        QTextEdit::mouseDoubleClickEvent(event);
+        return;
+    }
+    QMouseEvent mapped = unzoomedEvent(event);
+    QTextEdit::mouseDoubleClickEvent(&mapped);
+    event->setAccepted(mapped.isAccepted());
+}
+
+void TextEditor::setLazyLayoutEnabled(bool enabled)
+{
+    m_lazyLayout = enabled;
+}
+
+bool TextEditor::isLazyLayoutEnabled() const
+{
+    return m_lazyLayout;
+}
+
+void TextEditor::loadContent(const QString &content, Qt::TextFormat format, qreal startFraction)
+{
+    // Markdown is parsed in one go; there are no block boundaries to split at
+    if (format == Qt::MarkdownText) {
+        cancelLoading();
+        setMarkdown(content);
+        emit loadFinished();
+        return;
+    }
+    
+    if (m_lazyLayout && content.size() > LAZY_LAYOUT_THRESHOLD) {
+        m_loader->start(content, format, startFraction);
+        return;
+    }
+    
+    cancelLoading();
+    if (format == Qt::RichText) {
+        HtmlImport::setHtml(this, HtmlImport::sanitize(content));
+    } else {
+        setPlainText(content);
+    }
+    emit loadFinished();
+}
+
+bool TextEditor::isLoading() const
+{
+    return m_loader->isLoading();
+}
+
+void TextEditor::finishLoading()
+{
+    m_loader->finish();
+}
+
+void TextEditor::cancelLoading()
+{
+    m_loader->cancel();
+}
+
+bool TextEditor::isPasting() const
+{
+    return m_pasteJob->isRunning();
+}
+
+void TextEditor::insertFromMimeData(const QMimeData *source)
+{
+    if (m_macroRecorder) {
+        m_macroRecorder->pasted(source, acceptRichText());
+    }
+    
+    if (m_pasteJob->start(source)) {
+        return;
+    }
+    
+    // Small HTML pastes are cleaned up the same way as large ones
+    if (source && source->hasHtml() && acceptRichText()) {
+        QTextCursor cursor = textCursor();
+        cursor.beginEditBlock();
+        const int start = cursor.selectionStart();
+        cursor.insertFragment(QTextDocumentFragment::fromHtml(HtmlImport::sanitize(source->html()), document()));
+        HtmlImport::resolveStyleReferences(document(), start, cursor.position());
+        cursor.endEditBlock();
+        setTextCursor(cursor);
+        ensureCursorVisible();
+        return;
+    }
+    QTextEdit::insertFromMimeData(source);
+}
+
+QMimeData *TextEditor::createMimeDataFromSelection() const
+{
+    const QTextCursor cursor = textCursor();
+    if (!cursor.hasSelection()) {
+        return QTextEdit::createMimeDataFromSelection();
+    }
+    
+    return new SelectionMimeData(cursor.selection(), acceptRichText());
 }
 
 // Override keyPressEvent to catch and handle exceptions during typing
 void TextEditor::keyPressEvent(QKeyEvent *event)
 {
     try {
+        m_latencyMonitor->inputStarted();
+        const int revision = document()->revision();
+        const int position = textCursor().position();
+        if (m_macroRecorder) {
+            m_macroRecorder->keyStarted(event);
+        }
+        
         // Call the base class implementation
         QTextEdit::keyPressEvent(event);
+        
+        if (m_macroRecorder) {
+            m_macroRecorder->keyFinished();
+        }
+        
+        // The base class scrolls in unscaled coordinates
+        if (isZoomed()) {
+            ensureZoomedCursorVisible();
+        }
+        
+        m_latencyMonitor->inputHandled(document()->revision() != revision
+                                       || textCursor().position() != position);
     } catch (const std::exception& e) {
         qDebug() << "Exception in keyPressEvent:" << e.what();
         event->accept(); // Mark the event as handled
@@ -110,4 +583,75 @@ void TextEditor::keyPressEvent(QKeyEvent *event)
         qDebug() << "Unknown exception in keyPressEvent";
         event->accept(); // Mark the event as handled
     }
-} 
\ No newline at end of file
+} 
+
+void TextEditor::setMacroRecorder(MacroRecorder *recorder)
+{
+    m_macroRecorder = recorder;
+}
+
+void TextEditor::insertMimeData(const QMimeData *source)
+{
+    insertFromMimeData(source);
+}
+
+LatencyMonitor *TextEditor::latencyMonitor() const
+{
+    return m_latencyMonitor;
+}
+
+void TextEditor::setLatencyOverlayVisible(bool visible)
+{
+    if (visible && !m_latencyOverlay) {
+        // A child of the editor rather than the viewport, and opaque, so
+        // refreshing it does not repaint the document underneath
+        m_latencyOverlay = new QLabel(this);
+        m_latencyOverlay->setAutoFillBackground(true);
+        m_latencyOverlay->setContentsMargins(6, 3, 6, 3);
+        m_latencyOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+        QPalette overlayPalette = m_latencyOverlay->palette();
+        overlayPalette.setColor(QPalette::Window, QColor(40, 40, 40));
+        overlayPalette.setColor(QPalette::WindowText, Qt::white);
+        m_latencyOverlay->setPalette(overlayPalette);
+    }
+    
+    if (m_latencyOverlay) {
+        m_latencyOverlay->setVisible(visible);
+        if (visible) {
+            updateLatencyOverlay();
+        }
+    }
+}
+
+bool TextEditor::isLatencyOverlayVisible() const
+{
+    return m_latencyOverlay && m_latencyOverlay->isVisible();
+}
+
+void TextEditor::updateLatencyOverlay()
+{
+    if (!m_latencyOverlay) {
+        return;
+    }
+    
+    m_latencyOverlay->setText(tr("Key to paint: last %1 ms, p50 %2, p95 %3, p99 %4 (%5 keys)")
+                              .arg(m_latencyMonitor->lastLatency(), 0, 'f', 1)
+                              .arg(m_latencyMonitor->percentile(0.50), 0, 'f', 1)
+                              .arg(m_latencyMonitor->percentile(0.95), 0, 'f', 1)
+                              .arg(m_latencyMonitor->percentile(0.99), 0, 'f', 1)
+                              .arg(m_latencyMonitor->sampleCount()));
+    m_latencyOverlay->adjustSize();
+    positionLatencyOverlay();
+}
+
+void TextEditor::positionLatencyOverlay()
+{
+    if (!m_latencyOverlay) {
+        return;
+    }
+    
+    // Top right corner of the viewport
+    const QRect area = viewport()->geometry();
+    m_latencyOverlay->move(area.right() - m_latencyOverlay->width() - 8, area.top() + 8);
+    m_latencyOverlay->raise();
+}
\ No newline at end of file
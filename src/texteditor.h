@@ -3,6 +3,14 @@
 
 #include <QTextEdit>
 #include <QTextCharFormat>
+#include <QMouseEvent>
+#include <QTimer>
+
+class ProgressiveLoader;
+class PasteJob;
+class LatencyMonitor;
+class MacroRecorder;
+class QLabel;
 
 class TextEditor : public QTextEdit
 {
@@ -15,14 +23,94 @@ public:
     void setAlignment(Qt::Alignment alignment);
     Qt::Alignment alignment() const;
     QColor textColor() const;
+    
+    // Zoom is a view transform: painting and hit-testing are scaled, the
+    // document keeps its layout until an optional lazy re-wrap
+    void setZoomFactor(qreal factor);
+    qreal zoomFactor() const;
+    void zoomBy(int steps);
+    // Fits pageWidth (the printed text width, wrapping the text to it) to
+    // the viewport, or the widest laid out line when no page width is given
+    void fitToWidth(qreal pageWidth = 0);
     void resetZoom();
+    void setRewrapOnZoom(bool enabled);
+    
+    // Lazy layout: large documents are shown viewport-first and the rest
+    // is loaded in idle time slices. startFraction picks where in the
+    // content the first visible part comes from.
+    void setLazyLayoutEnabled(bool enabled);
+    bool isLazyLayoutEnabled() const;
+    void loadContent(const QString &content, Qt::TextFormat format, qreal startFraction = 0);
+    bool isLoading() const;
+    void finishLoading();
+    void cancelLoading();
+    
+    bool isPasting() const;
+    
+    // Keystroke-to-paint latency, optionally shown in a corner of the view
+    LatencyMonitor *latencyMonitor() const;
+    void setLatencyOverlayVisible(bool visible);
+    bool isLatencyOverlayVisible() const;
+    
+    // Edits are reported to the recorder while it is recording
+    void setMacroRecorder(MacroRecorder *recorder);
+    // Inserts as a paste would, for macro replay
+    void insertMimeData(const QMimeData *source);
+    
+signals:
+    void loadProgress(int percent);
+    void loadFinished();
+    void zoomChanged(qreal factor);
+    void pasteProgress(int percent);
     
 protected:
     // Override keyPressEvent to handle exceptions
     void keyPressEvent(QKeyEvent *event) override;
     
+    // Zoomed painting and hit-testing
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    
+    // Large pastes and drops go through the asynchronous paste pipeline
+    void insertFromMimeData(const QMimeData *source) override;
+    
+    // Copy and cut hand out clipboard data that is serialized on demand
+    QMimeData *createMimeDataFromSelection() const override;
+    
 private:
-    float m_zoomFactor;
+    bool isZoomed() const;
+    QPointF unzoomedPosition(const QPointF &pos) const;
+    QMouseEvent unzoomedEvent(QMouseEvent *event) const;
+    void adjustZoomScrollbars();
+    void ensureZoomedCursorVisible();
+    void rewrapForZoom();
+    qreal widestLineWidth() const;
+    void paintZoomed(QPaintEvent *event);
+    void updateLatencyOverlay();
+    void positionLatencyOverlay();
+    
+    qreal m_zoomFactor;
+    bool m_rewrapOnZoom;
+    QTimer *m_rewrapTimer;
+    bool m_lazyLayout;
+    ProgressiveLoader *m_loader;
+    PasteJob *m_pasteJob;
+    LatencyMonitor *m_latencyMonitor;
+    QLabel *m_latencyOverlay;
+    QTimer *m_overlayTimer;
+    MacroRecorder *m_macroRecorder;
+    
+    static const int LAZY_LAYOUT_THRESHOLD = 512 * 1024; // characters
+    static const int REWRAP_DELAY = 400; // ms after the last zoom change
+    static const int OVERLAY_INTERVAL = 250; // ms between overlay refreshes
+    static constexpr qreal MIN_ZOOM = 0.25;
+    static constexpr qreal MAX_ZOOM = 5.0;
+    static constexpr qreal ZOOM_STEP = 0.1;
 };
 
 #endif // TEXTEDITOR_H 
\ No newline at end of file
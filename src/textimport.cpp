@@ -0,0 +1,265 @@
+#include "textimport.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringConverter>
+#include <cstring>
+
+TextImport::Encoding TextImport::detectEncoding(QByteArrayView data, qsizetype *bomLength)
+{
+    const auto *bytes = reinterpret_cast<const uchar *>(data.data());
+    const qsizetype size = data.size();
+
+    if (bomLength) {
+        *bomLength = 0;
+    }
+
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        if (bomLength) {
+            *bomLength = 3;
+        }
+        return Utf8;
+    }
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        if (bomLength) {
+            *bomLength = 2;
+        }
+        return Utf16LittleEndian;
+    }
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        if (bomLength) {
+            *bomLength = 2;
+        }
+        return Utf16BigEndian;
+    }
+
+    const QByteArrayView sample = data.first(qMin(size, qsizetype(SNIFF_SIZE)));
+
+    // Text in UTF-16 without a BOM is mostly ASCII with a NUL high byte
+    qsizetype evenZeros = 0;
+    qsizetype oddZeros = 0;
+    for (qsizetype i = 0; i + 1 < sample.size(); i += 2) {
+        evenZeros += sample.at(i) == '\0';
+        oddZeros += sample.at(i + 1) == '\0';
+    }
+    const qsizetype pairs = sample.size() / 2;
+    if (pairs > 0) {
+        if (oddZeros * 10 > pairs * 4 && evenZeros * 10 < pairs) {
+            return Utf16LittleEndian;
+        }
+        if (evenZeros * 10 > pairs * 4 && oddZeros * 10 < pairs) {
+            return Utf16BigEndian;
+        }
+    }
+
+    return isValidUtf8(sample, sample.size() < size) ? Utf8 : Latin1;
+}
+
+bool TextImport::decode(QByteArrayView data, QString *text, Encoding *encoding)
+{
+    qsizetype bomLength = 0;
+    Encoding detected = detectEncoding(data, &bomLength);
+    const QByteArrayView body = data.sliced(bomLength);
+
+    // Guessing another encoding for the whole file because of a few bad
+    // bytes past the sniffed prefix would garble the rest of it
+    if (!decodeAs(body, detected, text)) {
+        switch (detected) {
+        case Utf8:
+            detected = Utf8WithReplacements;
+            break;
+        case Utf16LittleEndian:
+            detected = Utf16LittleEndianWithReplacements;
+            break;
+        case Utf16BigEndian:
+            detected = Utf16BigEndianWithReplacements;
+            break;
+        default:
+            break;
+        }
+    }
+
+    normalizeLineEndings(text);
+
+    if (encoding) {
+        *encoding = detected;
+    }
+    return true;
+}
+
+bool TextImport::readFile(const QString &path, QString *text, Encoding *encoding, QString *errorString)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (size == 0) {
+        text->clear();
+        if (encoding) {
+            *encoding = Utf8;
+        }
+        return true;
+    }
+
+    // Decode from the mapping directly; fall back to reading when the file
+    // cannot be mapped (pipes, some network file systems)
+    bool ok;
+    if (uchar *map = file.map(0, size)) {
+        ok = decode(QByteArrayView(map, size), text, encoding);
+        file.unmap(map);
+    } else {
+        ok = decode(file.readAll(), text, encoding);
+    }
+
+    if (!ok && errorString) {
+        *errorString = QCoreApplication::translate("TextImport", "The file is not valid text");
+    }
+    return ok;
+}
+
+QString TextImport::encodingName(Encoding encoding)
+{
+    switch (encoding) {
+    case Utf8:
+    case Utf8WithReplacements:
+        return QStringLiteral("UTF-8");
+    case Utf16LittleEndian:
+    case Utf16LittleEndianWithReplacements:
+        return QStringLiteral("UTF-16LE");
+    case Utf16BigEndian:
+    case Utf16BigEndianWithReplacements:
+        return QStringLiteral("UTF-16BE");
+    case Latin1:
+        return QStringLiteral("ISO-8859-1");
+    }
+    return QString();
+}
+
+bool TextImport::isValidUtf8(QByteArrayView data, bool truncated)
+{
+    const auto *bytes = reinterpret_cast<const uchar *>(data.data());
+    const qsizetype size = data.size();
+    qsizetype i = 0;
+
+    while (i < size) {
+        // Skip ASCII eight bytes at a time
+        while (i + 8 <= size) {
+            quint64 word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            if (word & Q_UINT64_C(0x8080808080808080)) {
+                break;
+            }
+            i += 8;
+        }
+        if (i >= size) {
+            break;
+        }
+
+        const uchar lead = bytes[i];
+        if (lead < 0x80) {
+            ++i;
+            continue;
+        }
+
+        int length;
+        uchar min = 0x80;
+        uchar max = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) {
+                min = 0xA0; // overlong
+            } else if (lead == 0xED) {
+                max = 0x9F; // surrogates
+            }
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) {
+                min = 0x90; // overlong
+            } else if (lead == 0xF4) {
+                max = 0x8F; // above U+10FFFF
+            }
+        } else {
+            return false;
+        }
+
+        // A sequence cut off by the end of the sample is not an error
+        if (i + length > size) {
+            return truncated;
+        }
+
+        if (bytes[i + 1] < min || bytes[i + 1] > max) {
+            return false;
+        }
+        for (int j = 2; j < length; ++j) {
+            if ((bytes[i + j] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+
+    return true;
+}
+
+bool TextImport::decodeAs(QByteArrayView data, Encoding encoding, QString *text)
+{
+    QStringConverter::Encoding converter = QStringConverter::Utf8;
+    switch (encoding) {
+    case Utf8:
+    case Utf8WithReplacements:
+        converter = QStringConverter::Utf8;
+        break;
+    case Utf16LittleEndian:
+    case Utf16LittleEndianWithReplacements:
+        converter = QStringConverter::Utf16LE;
+        break;
+    case Utf16BigEndian:
+    case Utf16BigEndianWithReplacements:
+        converter = QStringConverter::Utf16BE;
+        break;
+    case Latin1:
+        converter = QStringConverter::Latin1;
+        break;
+    }
+
+    // The BOM has already been stripped; keep a stray one as text
+    QStringDecoder decoder(converter, QStringConverter::Flag::Stateless | QStringConverter::Flag::ConvertInitialBom);
+
+    text->resize(decoder.requiredSpace(data.size()));
+    QChar *end = decoder.appendToBuffer(text->data(), data);
+    text->truncate(end - text->constData());
+
+    // Invalid input has been replaced with U+FFFD
+    return !decoder.hasError();
+}
+
+void TextImport::normalizeLineEndings(QString *text)
+{
+    qsizetype from = text->indexOf(QLatin1Char('\r'));
+    if (from < 0) {
+        return;
+    }
+
+    // Compact in place: CRLF becomes LF, a lone CR becomes LF
+    QChar *data = text->data();
+    const qsizetype size = text->size();
+    qsizetype out = from;
+    for (qsizetype in = from; in < size; ++in) {
+        if (data[in] == QLatin1Char('\r')) {
+            data[out++] = QLatin1Char('\n');
+            if (in + 1 < size && data[in + 1] == QLatin1Char('\n')) {
+                ++in;
+            }
+        } else {
+            data[out++] = data[in];
+        }
+    }
+    text->truncate(out);
+}
@@ -0,0 +1,45 @@
+#ifndef TEXTIMPORT_H
+#define TEXTIMPORT_H
+
+#include <QByteArrayView>
+#include <QString>
+
+// Reads text files in whatever encoding they were saved in. A byte order
+// mark decides the encoding when present; otherwise the first SNIFF_SIZE
+// bytes are checked for UTF-16 (NUL bytes in alternating positions) and for
+// valid UTF-8, falling back to Latin-1. Invalid bytes found later in a file
+// taken as UTF-8 (or one with a UTF-8 BOM) become U+FFFD and the encoding
+// is reported as Utf8WithReplacements, so the caller can warn the user
+// instead of silently changing the text. UTF-16 files with an odd byte
+// count or unpaired surrogates are reported the same way, as their own
+// UTF-16 ...WithReplacements value. Files are memory-mapped and decoded
+// with Qt's vectorized converters straight into the returned string's buffer,
+// so the only full-size copy is the one handed to the document.
+class TextImport
+{
+public:
+    enum Encoding {
+        Utf8,
+        Utf8WithReplacements,
+        Utf16LittleEndian,
+        Utf16LittleEndianWithReplacements,
+        Utf16BigEndian,
+        Utf16BigEndianWithReplacements,
+        Latin1
+    };
+
+    static Encoding detectEncoding(QByteArrayView data, qsizetype *bomLength = nullptr);
+    static bool decode(QByteArrayView data, QString *text, Encoding *encoding = nullptr);
+    static bool readFile(const QString &path, QString *text, Encoding *encoding = nullptr,
+                         QString *errorString = nullptr);
+    static QString encodingName(Encoding encoding);
+
+private:
+    static bool isValidUtf8(QByteArrayView data, bool truncated);
+    static bool decodeAs(QByteArrayView data, Encoding encoding, QString *text);
+    static void normalizeLineEndings(QString *text);
+
+    static const int SNIFF_SIZE = 4096;
+};
+
+#endif // TEXTIMPORT_H
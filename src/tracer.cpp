@@ -0,0 +1,200 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QStandardPaths>
+#include <QThread>
+#include <QVector>
+#include <QDebug>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const int BUFFER_SIZE = 64 * 1024; // events kept per thread
+
+struct TraceEvent {
+    const char *name;
+    qint64 start;
+    qint64 value; // end time for spans, value for counters
+    char phase;   // 'X' complete span, 'C' counter
+};
+
+// Only its own thread writes to a buffer; the mutex is there for the
+// occasional dump and is uncontended otherwise
+struct ThreadBuffer {
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    int next = 0;
+    int tid = 0;
+    QString threadName;
+};
+
+struct Registry {
+    QMutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    QElapsedTimer clock;
+    int nextTid = 1;
+
+    Registry() { clock.start(); }
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer *threadBuffer()
+{
+    // Buffers outlive their threads so a dump still sees pool threads' events
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        auto created = std::make_unique<ThreadBuffer>();
+        created->events.reserve(BUFFER_SIZE);
+
+        QThread *thread = QThread::currentThread();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            created->threadName = QStringLiteral("GUI");
+        } else if (!thread->objectName().isEmpty()) {
+            created->threadName = thread->objectName();
+        }
+
+        Registry &reg = registry();
+        QMutexLocker locker(&reg.mutex);
+        created->tid = reg.nextTid++;
+        if (created->threadName.isEmpty()) {
+            created->threadName = QStringLiteral("Worker %1").arg(created->tid);
+        }
+        buffer = created.get();
+        reg.buffers.push_back(std::move(created));
+    }
+    return buffer;
+}
+
+void append(const TraceEvent &event)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    if (buffer->events.size() < BUFFER_SIZE) {
+        buffer->events.append(event);
+    } else {
+        buffer->events[buffer->next] = event;
+    }
+    buffer->next = (buffer->next + 1) % BUFFER_SIZE;
+}
+
+}
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+void Tracer::setEnabled(bool enabled)
+{
+    // Start the clock before the first span can read it
+    Registry &reg = registry();
+    if (!enabled || s_enabled.load(std::memory_order_relaxed)) {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+        return;
+    }
+
+    // A new recording starts empty rather than after the previous one's events
+    QMutexLocker registryLocker(&reg.mutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : reg.buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        buffer->events.clear();
+        buffer->next = 0;
+    }
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::initializeFromEnvironment()
+{
+    const QString value = qEnvironmentVariable("CPPWORD_TRACE");
+    if (!value.isEmpty() && value != QLatin1String("0")) {
+        setEnabled(true);
+    }
+}
+
+QString Tracer::outputPath()
+{
+    const QString value = qEnvironmentVariable("CPPWORD_TRACE");
+    if (!value.isEmpty() && value != QLatin1String("0") && value != QLatin1String("1")) {
+        return value;
+    }
+
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/traces";
+    return dir + QStringLiteral("/trace-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+}
+
+bool Tracer::writeChromeTrace(const QString &filePath)
+{
+    QJsonArray events;
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    Registry &reg = registry();
+    QMutexLocker registryLocker(&reg.mutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : reg.buffers) {
+        QMutexLocker locker(&buffer->mutex);
+
+        QJsonObject metadata;
+        metadata["name"] = "thread_name";
+        metadata["ph"] = "M";
+        metadata["pid"] = pid;
+        metadata["tid"] = buffer->tid;
+        metadata["args"] = QJsonObject{{"name", buffer->threadName}};
+        events.append(metadata);
+
+        for (const TraceEvent &event : buffer->events) {
+            QJsonObject object;
+            object["name"] = QString::fromUtf8(event.name);
+            object["ph"] = QString(QLatin1Char(event.phase));
+            object["pid"] = pid;
+            object["tid"] = buffer->tid;
+            object["ts"] = event.start / 1000.0; // microseconds
+            if (event.phase == 'X') {
+                object["dur"] = (event.value - event.start) / 1000.0;
+            } else {
+                object["args"] = QJsonObject{{"value", event.value}};
+            }
+            events.append(object);
+        }
+    }
+    registryLocker.unlock();
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QFile file(filePath);
+    if (!file.open(QFile::WriteOnly)) {
+        qDebug() << "Tracer: could not write" << filePath << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    file.close();
+    return true;
+}
+
+qint64 Tracer::now()
+{
+    return registry().clock.nsecsElapsed();
+}
+
+void Tracer::recordSpan(const char *name, qint64 start, qint64 end)
+{
+    append(TraceEvent{name, start, end, 'X'});
+}
+
+void Tracer::recordCounter(const char *name, qint64 value)
+{
+    append(TraceEvent{name, now(), value, 'C'});
+}
@@ -0,0 +1,75 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Records timed spans and counters from hot paths into a ring buffer per
+// thread and writes them out as Chrome trace_event JSON, which
+// chrome://tracing and Perfetto open directly. Recording is off unless the
+// CPPWORD_TRACE environment variable is set or it is switched on at run
+// time; when off, a span costs one relaxed atomic load. Building with
+// CPPWORD_NO_TRACING defined removes the TRACE_* macros entirely.
+//
+// Span and counter names are stored as pointers, so they must be string
+// literals.
+class Tracer
+{
+public:
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    // CPPWORD_TRACE=1 enables tracing; any other value except 0 is also
+    // taken as the file to write the trace to
+    static void initializeFromEnvironment();
+    static QString outputPath();
+    static bool writeChromeTrace(const QString &filePath);
+
+    static qint64 now(); // nanoseconds since the tracer started
+    static void recordSpan(const char *name, qint64 start, qint64 end);
+    static void recordCounter(const char *name, qint64 value);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : m_name(name)
+        , m_start(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start >= 0) {
+            Tracer::recordSpan(m_name, m_start, Tracer::now());
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_name;
+    qint64 m_start;
+};
+
+#ifndef CPPWORD_NO_TRACING
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) \
+    do { \
+        if (Tracer::isEnabled()) { \
+            Tracer::recordCounter(name, qint64(value)); \
+        } \
+    } while (0)
+#else
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_COUNTER(name, value) do { } while (0)
+#endif
+
+#endif // TRACER_H
@@ -0,0 +1,365 @@
+#include "versionhistory.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+namespace {
+
+enum FileKind : quint8 {
+    Keyframe,
+    Delta
+};
+
+enum DeltaOp : quint8 {
+    Copy,      // run of blocks taken from the previous version
+    Literal    // new block
+};
+
+const char *const INDEX_FILE = "index.json";
+
+}
+
+VersionHistory::VersionHistory(const QString &directory)
+    : m_directory(directory)
+    , m_lastBlocksValid(false)
+{
+    loadIndex();
+}
+
+bool VersionHistory::addVersion(const QString &content, const QString &label)
+{
+    const QByteArray hash = QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Md5).toHex();
+    if (!m_versions.isEmpty() && m_versions.last().hash == hash) {
+        return false;
+    }
+
+    const QStringList current = content.split(QLatin1Char('\n'));
+    const int number = m_versions.isEmpty() ? 1 : m_versions.last().number + 1;
+
+    // Deltas need the previous version's blocks; fall back to a keyframe
+    // when there is no chain to extend, or replaying it would read more
+    // than the keyframe it starts from
+    int sinceKeyframe = 0;
+    qint64 chainBytes = 0;
+    qint64 keyframeBytes = 0;
+    for (int i = m_versions.size() - 1; i >= 0; --i) {
+        if (m_versions.at(i).keyframe) {
+            keyframeBytes = m_versions.at(i).stored;
+            break;
+        }
+        ++sinceKeyframe;
+        chainBytes += m_versions.at(i).stored;
+    }
+    bool keyframe = m_versions.isEmpty() || sinceKeyframe + 1 >= KEYFRAME_INTERVAL || chainBytes >= keyframeBytes;
+
+    if (!keyframe && !m_lastBlocksValid) {
+        m_lastBlocks = blocks(m_versions.last().number);
+        m_lastBlocksValid = !m_lastBlocks.isEmpty();
+        keyframe = !m_lastBlocksValid;
+    }
+
+    const QByteArray data = keyframe ? encodeKeyframe(current) : encodeDelta(m_lastBlocks, current);
+
+    QDir dir(m_directory);
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+
+    QFile file(versionFilePath(number));
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    file.write(data);
+    file.close();
+
+    Version version;
+    version.number = number;
+    version.timestamp = QDateTime::currentDateTime();
+    version.label = label;
+    version.size = content.size();
+    version.stored = data.size();
+    version.keyframe = keyframe;
+    version.hash = hash;
+    m_versions.append(version);
+
+    m_lastBlocks = current;
+    m_lastBlocksValid = true;
+
+    prune();
+    return saveIndex();
+}
+
+QList<VersionHistory::Version> VersionHistory::versions() const
+{
+    return m_versions;
+}
+
+QString VersionHistory::content(int number) const
+{
+    if (m_lastBlocksValid && !m_versions.isEmpty() && m_versions.last().number == number) {
+        return m_lastBlocks.join(QLatin1Char('\n'));
+    }
+    return blocks(number).join(QLatin1Char('\n'));
+}
+
+qint64 VersionHistory::storedBytes() const
+{
+    qint64 total = 0;
+    for (const Version &version : m_versions) {
+        total += version.stored;
+    }
+    return total;
+}
+
+QStringList VersionHistory::blocks(int number) const
+{
+    int index = -1;
+    for (int i = m_versions.size() - 1; i >= 0; --i) {
+        if (m_versions.at(i).number == number) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        return QStringList();
+    }
+
+    int keyframe = index;
+    while (keyframe > 0 && !m_versions.at(keyframe).keyframe) {
+        --keyframe;
+    }
+
+    // Replay from the nearest keyframe
+    QStringList result;
+    for (int i = keyframe; i <= index; ++i) {
+        QFile file(versionFilePath(m_versions.at(i).number));
+        if (!file.open(QFile::ReadOnly)) {
+            return QStringList();
+        }
+
+        QStringList next;
+        if (!decode(file.readAll(), result, &next)) {
+            qDebug() << "VersionHistory: corrupt version" << m_versions.at(i).number;
+            return QStringList();
+        }
+        result = next;
+    }
+
+    return result;
+}
+
+QString VersionHistory::versionFilePath(int number) const
+{
+    return QDir(m_directory).filePath(QString("v%1.ver").arg(number, 6, 10, QLatin1Char('0')));
+}
+
+bool VersionHistory::loadIndex()
+{
+    m_versions.clear();
+    m_lastBlocksValid = false;
+
+    QFile file(QDir(m_directory).filePath(INDEX_FILE));
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    file.close();
+    if (!doc.isObject()) {
+        return false;
+    }
+
+    const QJsonArray array = doc.object().value("versions").toArray();
+    for (const QJsonValue &value : array) {
+        const QJsonObject obj = value.toObject();
+        Version version;
+        version.number = obj.value("number").toInt();
+        version.timestamp = QDateTime::fromString(obj.value("timestamp").toString(), Qt::ISODate);
+        version.label = obj.value("label").toString();
+        version.size = obj.value("size").toInteger();
+        version.stored = obj.value("stored").toInteger();
+        version.keyframe = obj.value("keyframe").toBool();
+        version.hash = obj.value("hash").toString().toLatin1();
+        m_versions.append(version);
+    }
+
+    return true;
+}
+
+bool VersionHistory::saveIndex() const
+{
+    QJsonArray array;
+    for (const Version &version : m_versions) {
+        QJsonObject obj;
+        obj["number"] = version.number;
+        obj["timestamp"] = version.timestamp.toString(Qt::ISODate);
+        obj["label"] = version.label;
+        obj["size"] = version.size;
+        obj["stored"] = version.stored;
+        obj["keyframe"] = version.keyframe;
+        obj["hash"] = QString::fromLatin1(version.hash);
+        array.append(obj);
+    }
+
+    QJsonObject root;
+    root["versions"] = array;
+
+    QFile file(QDir(m_directory).filePath(INDEX_FILE));
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    file.close();
+
+    return true;
+}
+
+void VersionHistory::prune()
+{
+    // Drop whole keyframe groups from the front so every kept version can
+    // still be reconstructed
+    while (m_versions.size() > MAX_VERSIONS) {
+        int nextKeyframe = -1;
+        for (int i = 1; i < m_versions.size(); ++i) {
+            if (m_versions.at(i).keyframe) {
+                nextKeyframe = i;
+                break;
+            }
+        }
+        if (nextKeyframe < 0) {
+            break;
+        }
+
+        for (int i = 0; i < nextKeyframe; ++i) {
+            QFile::remove(versionFilePath(m_versions.at(i).number));
+        }
+        m_versions.erase(m_versions.begin(), m_versions.begin() + nextKeyframe);
+    }
+}
+
+QByteArray VersionHistory::encodeKeyframe(const QStringList &blocks)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    out << quint8(Keyframe) << quint32(blocks.size());
+    for (const QString &block : blocks) {
+        out << block;
+    }
+
+    return qCompress(data);
+}
+
+QByteArray VersionHistory::encodeDelta(const QStringList &previous, const QStringList &current)
+{
+    // First occurrence of each block in the previous version
+    QHash<QString, int> positions;
+    positions.reserve(previous.size());
+    for (int i = previous.size() - 1; i >= 0; --i) {
+        positions[previous.at(i)] = i;
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    QByteArray ops;
+    QDataStream opsOut(&ops, QIODevice::WriteOnly);
+    opsOut.setVersion(QDataStream::Qt_6_0);
+    quint32 opCount = 0;
+
+    int runStart = -1;
+    int runLength = 0;
+    auto flushRun = [&]() {
+        if (runLength > 0) {
+            opsOut << quint8(Copy) << quint32(runStart) << quint32(runLength);
+            ++opCount;
+        }
+        runStart = -1;
+        runLength = 0;
+    };
+
+    for (const QString &block : current) {
+        // Extend the current run while the versions line up
+        if (runLength > 0 && runStart + runLength < previous.size()
+            && previous.at(runStart + runLength) == block) {
+            ++runLength;
+            continue;
+        }
+
+        flushRun();
+
+        auto it = positions.constFind(block);
+        if (it != positions.constEnd()) {
+            runStart = it.value();
+            runLength = 1;
+        } else {
+            opsOut << quint8(Literal) << block;
+            ++opCount;
+        }
+    }
+    flushRun();
+
+    out << quint8(Delta) << opCount;
+    data.append(ops);
+
+    return qCompress(data);
+}
+
+bool VersionHistory::decode(const QByteArray &data, const QStringList &previous, QStringList *result)
+{
+    const QByteArray raw = qUncompress(data);
+    if (raw.isEmpty()) {
+        return false;
+    }
+
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint8 kind;
+    quint32 count;
+    in >> kind >> count;
+
+    result->clear();
+
+    if (kind == Keyframe) {
+        result->reserve(count);
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            QString block;
+            in >> block;
+            result->append(block);
+        }
+    } else if (kind == Delta) {
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            quint8 op;
+            in >> op;
+            if (op == Copy) {
+                quint32 start;
+                quint32 length;
+                in >> start >> length;
+                if (qint64(start) + length > previous.size()) {
+                    return false;
+                }
+                for (quint32 j = 0; j < length; ++j) {
+                    result->append(previous.at(start + j));
+                }
+            } else {
+                QString block;
+                in >> block;
+                result->append(block);
+            }
+        }
+    } else {
+        return false;
+    }
+
+    return in.status() == QDataStream::Ok;
+}
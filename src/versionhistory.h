@@ -0,0 +1,62 @@
+#ifndef VERSIONHISTORY_H
+#define VERSIONHISTORY_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// On-disk version history of one document. Each version is stored as a
+// block-level delta against the previous one (runs copied from it plus new
+// blocks). A full keyframe starts a new chain once the deltas since the last
+// one add up to the keyframe's own size, so rebuilding a version never reads
+// much more than two keyframes' worth, or after KEYFRAME_INTERVAL versions
+// at most. Every file is compressed with qCompress. Blocks are the lines of
+// the serialized document, which for HtmlWriter's output means one paragraph
+// per block.
+//
+// Not synchronized: DocumentManager runs addVersion() on the task executor
+// and waits for it before any other call.
+class VersionHistory
+{
+public:
+    struct Version {
+        int number;
+        QDateTime timestamp;
+        QString label;
+        qint64 size;      // characters in the reconstructed document
+        qint64 stored;    // bytes on disk
+        bool keyframe;
+        QByteArray hash;
+    };
+
+    explicit VersionHistory(const QString &directory);
+
+    // Returns false if nothing changed since the last version or on error
+    bool addVersion(const QString &content, const QString &label);
+
+    QList<Version> versions() const;
+    QString content(int number) const;
+    qint64 storedBytes() const;
+
+private:
+    QStringList blocks(int number) const;
+    QString versionFilePath(int number) const;
+    bool loadIndex();
+    bool saveIndex() const;
+    void prune();
+
+    static QByteArray encodeKeyframe(const QStringList &blocks);
+    static QByteArray encodeDelta(const QStringList &previous, const QStringList &current);
+    static bool decode(const QByteArray &data, const QStringList &previous, QStringList *result);
+
+    QString m_directory;
+    QList<Version> m_versions;
+    QStringList m_lastBlocks;   // blocks of the newest version, once known
+    bool m_lastBlocksValid;
+
+    static const int KEYFRAME_INTERVAL = 200; // longest delta chain
+    static const int MAX_VERSIONS = 1000;
+};
+
+#endif // VERSIONHISTORY_H
@@ -0,0 +1,80 @@
+#include "wordcounter.h"
+#include "tracer.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+
+WordCounter::WordCounter(QTextDocument *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+    , m_count(0)
+{
+    connect(m_document, &QTextDocument::contentsChange, this, &WordCounter::onContentsChange);
+    recountAll();
+}
+
+int WordCounter::count() const
+{
+    return m_count;
+}
+
+void WordCounter::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    TRACE_SCOPE("WordCounter::onContentsChange");
+    const int previous = m_count;
+
+    // Same splice as the paginator: paragraphs after the change keep their
+    // counts, the changed ones are counted again
+    const int last = m_document->characterCount() - 1;
+    const int first = m_document->findBlock(qMin(position, last)).blockNumber();
+    const int lastAdded = m_document->findBlock(qMin(position + charsAdded, last)).blockNumber();
+    const int added = lastAdded - first + 1;
+    const int removed = added - (m_document->blockCount() - m_blocks.size());
+    if (first < 0 || lastAdded < first || removed < 0 || first + removed > m_blocks.size()) {
+        recountAll();
+    } else {
+        for (int i = first; i < first + removed; ++i) {
+            m_count -= m_blocks.at(i);
+        }
+        m_blocks.remove(first, removed);
+        m_blocks.insert(first, added, 0);
+
+        QTextBlock block = m_document->findBlockByNumber(first);
+        for (int i = first; i <= lastAdded && block.isValid(); ++i, block = block.next()) {
+            m_blocks[i] = countWords(block);
+            m_count += m_blocks.at(i);
+        }
+    }
+
+    if (m_count != previous) {
+        TRACE_COUNTER("words", m_count);
+        emit countChanged(m_count);
+    }
+}
+
+int WordCounter::countWords(const QTextBlock &block)
+{
+    const QString text = block.text();
+    int words = 0;
+    bool inWord = false;
+    for (const QChar c : text) {
+        const bool space = c.isSpace();
+        if (!space && !inWord) {
+            ++words;
+        }
+        inWord = !space;
+    }
+    return words;
+}
+
+void WordCounter::recountAll()
+{
+    m_blocks.resize(m_document->blockCount());
+    m_count = 0;
+    int i = 0;
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next(), ++i) {
+        m_blocks[i] = countWords(block);
+        m_count += m_blocks.at(i);
+    }
+}
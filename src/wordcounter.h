@@ -0,0 +1,38 @@
+#ifndef WORDCOUNTER_H
+#define WORDCOUNTER_H
+
+#include <QObject>
+#include <QVector>
+
+class QTextDocument;
+class QTextBlock;
+
+// Keeps the word count of a document without rescanning it. Each paragraph
+// keeps its own count; an edit recounts only the paragraphs it touched, so
+// a keystroke costs one paragraph however long the document is. Words never
+// span paragraphs, which is also how a scan of toPlainText() counts them.
+class WordCounter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WordCounter(QTextDocument *document, QObject *parent = nullptr);
+
+    int count() const;
+
+signals:
+    void countChanged(int count);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    static int countWords(const QTextBlock &block);
+    void recountAll();
+
+    QTextDocument *m_document;
+    QVector<int> m_blocks; // words per paragraph
+    int m_count;
+};
+
+#endif // WORDCOUNTER_H
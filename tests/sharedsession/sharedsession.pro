@@ -0,0 +1,15 @@
+QT += core gui network testlib
+
+CONFIG += c++17 testcase
+
+TARGET = tst_sharedsession
+TEMPLATE = app
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+    tst_sharedsession.cpp \
+    ../../src/sharedsession.cpp
+
+HEADERS += \
+    ../../src/sharedsession.h
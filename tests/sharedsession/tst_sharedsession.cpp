@@ -0,0 +1,197 @@
+#include "sharedsession.h"
+
+#include <QtTest>
+#include <QGuiApplication>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <cstdio>
+
+// Several CPP Word processes editing one shared document at random must
+// all end up with the same text. The test process hosts the session and
+// edits too; the peers are copies of this executable started with --peer,
+// driven line by line over stdin and stdout.
+
+namespace {
+
+const int PEERS = 3;
+const int EDITS = 200;
+const int QUIET = 500;       // ms without changes before a site reports
+const int TIMEOUT = 30000;   // ms
+
+void randomEdit(QTextDocument *document, QRandomGenerator *random)
+{
+    static const QString alphabet = QStringLiteral("abcdefgh \n");
+
+    const int length = document->characterCount() - 1;
+    QTextCursor cursor(document);
+    cursor.setPosition(random->bounded(length + 1));
+    if (length > 0 && random->bounded(3) == 0) {
+        cursor.setPosition(qMin(length, cursor.position() + 1 + random->bounded(4)), QTextCursor::KeepAnchor);
+        cursor.removeSelectedText();
+    } else {
+        QString text;
+        for (int i = 1 + random->bounded(3); i > 0; --i) {
+            text += alphabet.at(random->bounded(int(alphabet.size())));
+        }
+        cursor.insertText(text);
+    }
+}
+
+void editRandomly(QTextDocument *document, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    for (int i = 0; i < EDITS; ++i) {
+        randomEdit(document, &random);
+        QTest::qWait(random.bounded(4));
+    }
+}
+
+// Returns once the document has not changed for QUIET ms
+void waitForQuiet(QTextDocument *document)
+{
+    QElapsedTimer quiet;
+    quiet.start();
+    const QMetaObject::Connection connection = QObject::connect(document, &QTextDocument::contentsChanged,
+                                                                [&quiet]() { quiet.restart(); });
+    while (quiet.elapsed() < QUIET) {
+        QTest::qWait(20);
+    }
+    QObject::disconnect(connection);
+}
+
+QByteArray digest(const QTextDocument &document)
+{
+    return QCryptographicHash::hash(document.toPlainText().toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+void say(const QByteArray &line)
+{
+    std::fputs(line.constData(), stdout);
+    std::fputc('\n', stdout);
+    std::fflush(stdout);
+}
+
+QByteArray readLineFrom(QProcess *peer)
+{
+    if (!QTest::qWaitFor([peer]() { return peer->canReadLine(); }, TIMEOUT)) {
+        return QByteArray();
+    }
+    return peer->readLine().trimmed();
+}
+
+// The peer side: join, wait for "go", edit, wait for "report", then print
+// the final text's digest. Blocking on stdin is fine; the host buffers.
+int runPeer(const QString &filePath, quint32 seed)
+{
+    QTextDocument document;
+    SharedSession session;
+    if (!session.start(&document, filePath) || session.isHost()) {
+        return 1;
+    }
+    // The host's welcome fills the empty document
+    if (!QTest::qWaitFor([&document]() { return !document.isEmpty(); }, TIMEOUT)) {
+        return 2;
+    }
+    say("joined");
+
+    QFile input;
+    input.open(stdin, QIODevice::ReadOnly);
+    input.readLine();
+    editRandomly(&document, seed);
+    say("edited");
+
+    input.readLine();
+    waitForQuiet(&document);
+    say(digest(document));
+    return 0;
+}
+
+}
+
+class TestSharedSession : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void concurrentEditsConverge();
+};
+
+void TestSharedSession::concurrentEditsConverge()
+{
+    const QString filePath = QDir::temp().filePath(
+        QStringLiteral("cppword-ot-%1.txt").arg(QCoreApplication::applicationPid()));
+
+    QTextDocument document;
+    document.setPlainText(QStringLiteral("The quick brown fox\njumps over the lazy dog\n"));
+    SharedSession host;
+    QVERIFY(host.start(&document, filePath));
+    QVERIFY(host.isHost());
+    // Undo would revert peers' edits, so it is off while shared
+    QVERIFY(!document.isUndoRedoEnabled());
+
+    QObject scope;
+    QList<QProcess *> peers;
+    for (int i = 0; i < PEERS; ++i) {
+        QProcess *peer = new QProcess(&scope);
+        peer->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        peer->start(QCoreApplication::applicationFilePath(),
+                    {QStringLiteral("--peer"), filePath, QString::number(i + 1)});
+        QVERIFY(peer->waitForStarted());
+        peers.append(peer);
+    }
+    for (QProcess *peer : std::as_const(peers)) {
+        QCOMPARE(readLineFrom(peer), QByteArray("joined"));
+    }
+    QCOMPARE(host.peerCount(), PEERS);
+
+    // Everyone edits at once
+    for (QProcess *peer : std::as_const(peers)) {
+        peer->write("go\n");
+    }
+    editRandomly(&document, 0);
+    for (QProcess *peer : std::as_const(peers)) {
+        QCOMPARE(readLineFrom(peer), QByteArray("edited"));
+    }
+
+    QList<QByteArray> digests;
+    for (QProcess *peer : std::as_const(peers)) {
+        peer->write("report\n");
+    }
+    for (QProcess *peer : std::as_const(peers)) {
+        digests.append(readLineFrom(peer));
+    }
+    waitForQuiet(&document);
+    for (const QByteArray &peerDigest : std::as_const(digests)) {
+        QCOMPARE(peerDigest, digest(document));
+    }
+
+    for (QProcess *peer : std::as_const(peers)) {
+        QVERIFY(peer->waitForFinished(TIMEOUT));
+        QCOMPARE(peer->exitCode(), 0);
+    }
+
+    host.stop();
+    QVERIFY(document.isUndoRedoEnabled());
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    if (argc == 4 && qstrcmp(argv[1], "--peer") == 0) {
+        return runPeer(QString::fromLocal8Bit(argv[2]), QByteArray(argv[3]).toUInt());
+    }
+
+    TestSharedSession test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_sharedsession.moc"
@@ -0,0 +1,17 @@
+QT += core concurrent testlib
+
+CONFIG += c++17 testcase
+
+TARGET = tst_taskexecutor
+TEMPLATE = app
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+    tst_taskexecutor.cpp \
+    ../../src/taskexecutor.cpp \
+    ../../src/tracer.cpp
+
+HEADERS += \
+    ../../src/taskexecutor.h \
+    ../../src/tracer.h
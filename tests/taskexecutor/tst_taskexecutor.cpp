@@ -0,0 +1,269 @@
+#include "taskexecutor.h"
+
+#include <QtTest>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QSet>
+#include <memory>
+
+// Floods the executor with tasks from every priority and checks that each
+// result arrives exactly once, on the context's thread, unless the task was
+// cancelled or its context destroyed; and that the counters add up once
+// everything has drained.
+
+namespace {
+
+const int TASKS = 2000;
+const int TIMEOUT = 30000; // ms
+
+TaskExecutor::Priority priorityOf(int i)
+{
+    return TaskExecutor::Priority(i % TaskExecutor::PriorityCount);
+}
+
+// A little busy work, so tasks overlap; returns i
+int spin(int i)
+{
+    volatile int value = i;
+    for (int j = 0; j < 1000; ++j) {
+        value = value * 31 + j;
+    }
+    return i;
+}
+
+// Occupies every pool thread until released
+class PoolBlocker
+{
+public:
+    PoolBlocker()
+        : m_threads(QThreadPool::globalInstance()->maxThreadCount())
+    {
+        for (int i = 0; i < m_threads; ++i) {
+            m_tasks.append(TaskExecutor::instance()->submit(TaskExecutor::Interactive, m_token,
+                [this](const TaskExecutor::CancellationToken &) {
+                    m_started.release();
+                    m_gate.acquire();
+                    return 0;
+                }));
+        }
+        m_started.acquire(m_threads);
+    }
+
+    ~PoolBlocker() { release(); }
+
+    void release()
+    {
+        m_gate.release(m_threads);
+        m_threads = 0;
+        for (QFuture<int> &task : m_tasks) {
+            task.waitForFinished();
+        }
+    }
+
+private:
+    int m_threads;
+    QSemaphore m_started;
+    QSemaphore m_gate;
+    TaskExecutor::CancellationToken m_token;
+    QList<QFuture<int>> m_tasks;
+};
+
+void waitForAll(QList<TaskExecutor::Task> *tasks)
+{
+    for (TaskExecutor::Task &task : *tasks) {
+        task.waitForFinished();
+    }
+}
+
+}
+
+class TestTaskExecutor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void everyResultArrivesOnce();
+    void cancelledTasksDropResults();
+    void destroyedContextDropsResults();
+    void higherPriorityRunsFirst();
+    void nestedWaitsDoNotStarve();
+};
+
+void TestTaskExecutor::everyResultArrivesOnce()
+{
+    const TaskExecutor::Stats before = TaskExecutor::instance()->stats();
+
+    QSet<int> delivered;
+    int duplicates = 0;
+    int wrongThread = 0;
+    int wrongResults = 0;
+    QList<TaskExecutor::Task> tasks;
+    for (int i = 0; i < TASKS; ++i) {
+        tasks.append(TaskExecutor::instance()->run(priorityOf(i), this,
+            [i](const TaskExecutor::CancellationToken &) {
+                return spin(i);
+            },
+            [&, i](int result) {
+                if (result != i) {
+                    ++wrongResults;
+                }
+                if (QThread::currentThread() != thread()) {
+                    ++wrongThread;
+                }
+                if (delivered.contains(result)) {
+                    ++duplicates;
+                }
+                delivered.insert(result);
+            }));
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(delivered.size(), TASKS, TIMEOUT);
+    waitForAll(&tasks);
+    QCOMPARE(duplicates, 0);
+    QCOMPARE(wrongThread, 0);
+    QCOMPARE(wrongResults, 0);
+
+    const TaskExecutor::Stats after = TaskExecutor::instance()->stats();
+    QCOMPARE(after.completed - before.completed, qint64(TASKS));
+    QCOMPARE(after.cancelled, before.cancelled);
+    QCOMPARE(after.running, 0);
+    for (int queued : after.queued) {
+        QCOMPARE(queued, 0);
+    }
+}
+
+void TestTaskExecutor::cancelledTasksDropResults()
+{
+    const TaskExecutor::Stats before = TaskExecutor::instance()->stats();
+
+    int delivered = 0;
+    int cancelledDelivered = 0;
+    QList<TaskExecutor::Task> tasks;
+    {
+        // Everything below is still queued when half of it is cancelled
+        PoolBlocker blocker;
+        for (int i = 0; i < TASKS; ++i) {
+            tasks.append(TaskExecutor::instance()->run(priorityOf(i), this,
+                [i](const TaskExecutor::CancellationToken &) {
+                    return spin(i);
+                },
+                [&](int result) {
+                    if (result % 2 == 0) {
+                        ++cancelledDelivered;
+                    }
+                    ++delivered;
+                }));
+        }
+        for (int i = 0; i < TASKS; i += 2) {
+            tasks[i].cancel();
+        }
+    }
+    waitForAll(&tasks);
+    QTRY_COMPARE_WITH_TIMEOUT(delivered, TASKS / 2, TIMEOUT);
+    // Late deliveries would show up now
+    QTest::qWait(50);
+    QCOMPARE(delivered, TASKS / 2);
+    QCOMPARE(cancelledDelivered, 0);
+
+    const TaskExecutor::Stats after = TaskExecutor::instance()->stats();
+    QCOMPARE(after.cancelled - before.cancelled, qint64(TASKS / 2));
+    QCOMPARE(after.running, 0);
+}
+
+void TestTaskExecutor::destroyedContextDropsResults()
+{
+    int delivered = 0;
+    QList<TaskExecutor::Task> tasks;
+    {
+        PoolBlocker blocker;
+        auto context = std::make_unique<QObject>();
+        for (int i = 0; i < TASKS; ++i) {
+            tasks.append(TaskExecutor::instance()->run(priorityOf(i), context.get(),
+                [i](const TaskExecutor::CancellationToken &) {
+                    return spin(i);
+                },
+                [&](int) {
+                    ++delivered;
+                }));
+        }
+        context.reset();
+    }
+    waitForAll(&tasks);
+    QTest::qWait(50);
+    QCOMPARE(delivered, 0);
+}
+
+void TestTaskExecutor::higherPriorityRunsFirst()
+{
+    // One thread makes the start order the queue order
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int maxThreads = pool->maxThreadCount();
+    pool->setMaxThreadCount(1);
+
+    QList<TaskExecutor::Priority> order;
+    QMutex mutex;
+    QList<TaskExecutor::Task> tasks;
+    {
+        PoolBlocker blocker;
+        for (int i = 0; i < 30; ++i) {
+            const TaskExecutor::Priority priority = priorityOf(i);
+            tasks.append(TaskExecutor::instance()->run(priority, this,
+                [&, priority](const TaskExecutor::CancellationToken &) {
+                    QMutexLocker locker(&mutex);
+                    order.append(priority);
+                    return 0;
+                },
+                [](int) {}));
+        }
+    }
+    // Waiting on a queued task would run it here, out of order, so the
+    // tasks are only waited for once they have all started
+    QTRY_COMPARE_WITH_TIMEOUT(order.size(), 30, TIMEOUT);
+    waitForAll(&tasks);
+    pool->setMaxThreadCount(maxThreads);
+
+    for (int i = 1; i < order.size(); ++i) {
+        QVERIFY(order.at(i - 1) >= order.at(i));
+    }
+}
+
+void TestTaskExecutor::nestedWaitsDoNotStarve()
+{
+    // More outer tasks than threads, each waiting on inner tasks queued
+    // behind the outer ones
+    const int outerTasks = QThreadPool::globalInstance()->maxThreadCount() * 4;
+    const int innerTasks = 16;
+
+    int delivered = 0;
+    int wrongSums = 0;
+    QList<TaskExecutor::Task> tasks;
+    for (int i = 0; i < outerTasks; ++i) {
+        tasks.append(TaskExecutor::instance()->run(TaskExecutor::Interactive, this,
+            [innerTasks](const TaskExecutor::CancellationToken &token) {
+                QList<QFuture<int>> inner;
+                for (int j = 0; j < innerTasks; ++j) {
+                    inner.append(TaskExecutor::instance()->submit(TaskExecutor::Idle, token,
+                        [j](const TaskExecutor::CancellationToken &) {
+                            return spin(j);
+                        }));
+                }
+                int sum = 0;
+                for (const QFuture<int> &future : std::as_const(inner)) {
+                    sum += future.result();
+                }
+                return sum;
+            },
+            [&](int sum) {
+                if (sum != innerTasks * (innerTasks - 1) / 2) {
+                    ++wrongSums;
+                }
+                ++delivered;
+            }));
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(delivered, outerTasks, TIMEOUT);
+    waitForAll(&tasks);
+    QCOMPARE(wrongSums, 0);
+}
+
+QTEST_GUILESS_MAIN(TestTaskExecutor)
+
+#include "tst_taskexecutor.moc"
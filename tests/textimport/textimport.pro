@@ -0,0 +1,15 @@
+QT += core testlib
+
+CONFIG += c++17 benchmark
+
+TARGET = tst_textimport
+TEMPLATE = app
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+    tst_textimport.cpp \
+    ../../src/textimport.cpp
+
+HEADERS += \
+    ../../src/textimport.h
@@ -0,0 +1,139 @@
+#include "textimport.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QStringEncoder>
+
+// Throughput of TextImport on multi-hundred-MB files in each encoding it
+// detects: readFile() from a memory-mapped file, and decode() from bytes
+// already in memory. The inputs are written once to a temporary directory;
+// CPPWORD_BENCH_MB overrides their size.
+
+namespace {
+
+const int DEFAULT_SIZE_MB = 256;
+
+// Mostly ASCII prose with letters outside ASCII, all of them in Latin-1,
+// and mixed line endings so the line ending pass has work too
+const char16_t SAMPLE[] = u"Ein Blick über den Fluß: café, naïve, résumé - 12345.\r\n"
+                          u"The quick brown fox jumps over the lazy dog; déjà vu.\n";
+
+qsizetype inputSize()
+{
+    const int megabytes = qEnvironmentVariableIntValue("CPPWORD_BENCH_MB");
+    return qsizetype(megabytes > 0 ? megabytes : DEFAULT_SIZE_MB) * 1024 * 1024;
+}
+
+// Repeats unit after prefix until the file holds at least size bytes; only
+// whole units are written, so the text never ends in a cut-off character
+bool writeInput(const QString &path, const QByteArray &prefix, const QByteArray &unit, qsizetype size)
+{
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    QByteArray block;
+    block.reserve(1024 * 1024 + unit.size());
+    while (block.size() < 1024 * 1024) {
+        block += unit;
+    }
+
+    qsizetype written = file.write(prefix);
+    while (written >= 0 && written < size) {
+        const qint64 count = file.write(block);
+        written = count < 0 ? -1 : written + count;
+    }
+    return written >= 0;
+}
+
+}
+
+class TestTextImport : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void readFile_data();
+    void readFile();
+    void decode_data();
+    void decode();
+
+private:
+    void addInputs();
+
+    QTemporaryDir m_dir;
+};
+
+void TestTextImport::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    const QString sample = QString::fromUtf16(SAMPLE);
+    const qsizetype size = inputSize();
+    QStringEncoder utf16(QStringConverter::Utf16LE);
+    QVERIFY(writeInput(m_dir.filePath(QStringLiteral("utf8.txt")), QByteArray(), sample.toUtf8(), size));
+    QVERIFY(writeInput(m_dir.filePath(QStringLiteral("utf16le.txt")), QByteArray("\xFF\xFE", 2),
+                       utf16.encode(sample), size));
+    QVERIFY(writeInput(m_dir.filePath(QStringLiteral("latin1.txt")), QByteArray(), sample.toLatin1(), size));
+}
+
+void TestTextImport::addInputs()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<int>("encoding");
+
+    QTest::newRow("UTF-8") << QStringLiteral("utf8.txt") << int(TextImport::Utf8);
+    QTest::newRow("UTF-16LE") << QStringLiteral("utf16le.txt") << int(TextImport::Utf16LittleEndian);
+    QTest::newRow("Latin-1") << QStringLiteral("latin1.txt") << int(TextImport::Latin1);
+}
+
+void TestTextImport::readFile_data()
+{
+    addInputs();
+}
+
+void TestTextImport::readFile()
+{
+    QFETCH(QString, fileName);
+    QFETCH(int, encoding);
+
+    const QString path = m_dir.filePath(fileName);
+    QString text;
+    TextImport::Encoding detected = TextImport::Utf8;
+    QBENCHMARK {
+        QVERIFY(TextImport::readFile(path, &text, &detected));
+    }
+    QCOMPARE(int(detected), encoding);
+    QVERIFY(text.startsWith(QLatin1String("Ein Blick")));
+}
+
+void TestTextImport::decode_data()
+{
+    addInputs();
+}
+
+void TestTextImport::decode()
+{
+    QFETCH(QString, fileName);
+    QFETCH(int, encoding);
+
+    QFile file(m_dir.filePath(fileName));
+    QVERIFY(file.open(QFile::ReadOnly));
+    const QByteArray data = file.readAll();
+    file.close();
+
+    QString text;
+    TextImport::Encoding detected = TextImport::Utf8;
+    QBENCHMARK {
+        QVERIFY(TextImport::decode(data, &text, &detected));
+    }
+    QCOMPARE(int(detected), encoding);
+    QVERIFY(text.startsWith(QLatin1String("Ein Blick")));
+}
+
+QTEST_GUILESS_MAIN(TestTextImport)
+
+#include "tst_textimport.moc"